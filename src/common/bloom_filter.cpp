@@ -0,0 +1,78 @@
+#include "common/bloom_filter.h"
+
+namespace twinshim {
+
+namespace {
+
+// 10 bits per item and 7 probes give about a 1% false positive rate at capacity.
+constexpr size_t kBitsPerItem = 10;
+constexpr int kProbes = 7;
+constexpr size_t kMinBits = 1024;
+
+// splitmix64 finalizer: derives the second, independent probe stride.
+uint64_t Mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ull;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBull;
+  x ^= x >> 31;
+  return x;
+}
+
+} // namespace
+
+void BloomFilter::Reset(size_t capacity) {
+  size_t bits = kMinBits;
+  while (bits < capacity * kBitsPerItem) {
+    bits <<= 1;
+  }
+  bits_.assign(bits / 64, 0);
+  mask_ = bits - 1;
+  count_ = 0;
+  capacity_ = bits / kBitsPerItem;
+}
+
+void BloomFilter::Clear() {
+  bits_.clear();
+  mask_ = 0;
+  count_ = 0;
+  capacity_ = 0;
+}
+
+bool BloomFilter::Add(uint64_t hash) {
+  if (bits_.empty()) {
+    return false;
+  }
+  // Double hashing (Kirsch-Mitzenmacher); an odd stride visits distinct bits.
+  const uint64_t stride = Mix(hash) | 1;
+  bool added = false;
+  for (int i = 0; i < kProbes; i++) {
+    const uint64_t bit = (hash + (uint64_t)i * stride) & mask_;
+    uint64_t& word = bits_[bit >> 6];
+    const uint64_t m = 1ull << (bit & 63);
+    if (!(word & m)) {
+      word |= m;
+      added = true;
+    }
+  }
+  if (added) {
+    count_++;
+  }
+  return added;
+}
+
+bool BloomFilter::MayContain(uint64_t hash) const {
+  if (bits_.empty()) {
+    return true;
+  }
+  const uint64_t stride = Mix(hash) | 1;
+  for (int i = 0; i < kProbes; i++) {
+    const uint64_t bit = (hash + (uint64_t)i * stride) & mask_;
+    if (!(bits_[bit >> 6] & (1ull << (bit & 63)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
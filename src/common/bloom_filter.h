@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace twinshim {
+
+// Bloom filter over caller-supplied 64-bit hashes: MayContain never returns
+// false for a hash that was added, and returns true for one that wasn't with
+// roughly 1% probability while the filter holds no more than its capacity.
+// Items can't be removed; owners rebuild once Saturated() says the false
+// positive rate has drifted past that.
+class BloomFilter {
+public:
+  // Clears the filter and sizes it for `capacity` items (~10 bits each).
+  void Reset(size_t capacity);
+  void Clear();
+
+  // Adds the hash; returns false when it (or a colliding one) was already present.
+  bool Add(uint64_t hash);
+  bool MayContain(uint64_t hash) const;
+
+  bool Empty() const { return bits_.empty(); }
+  size_t Count() const { return count_; }
+  size_t Capacity() const { return capacity_; }
+  bool Saturated() const { return count_ > capacity_; }
+
+private:
+  std::vector<uint64_t> bits_;
+  uint64_t mask_ = 0; // bit count - 1 (a power of two)
+  size_t count_ = 0;
+  size_t capacity_ = 0;
+};
+
+}
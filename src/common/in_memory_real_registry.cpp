@@ -0,0 +1,141 @@
+#include "common/in_memory_real_registry.h"
+
+#include "common/registry_path.h"
+
+namespace twinshim {
+
+InMemoryRealRegistry::Key& InMemoryRealRegistry::EnsureKeyLocked(const std::wstring& keyPath) {
+  // Materialize every ancestor so enumeration sees intermediate keys.
+  size_t pos = 0;
+  while (true) {
+    pos = keyPath.find(L'\\', pos);
+    const std::wstring prefix = (pos == std::wstring::npos) ? keyPath : keyPath.substr(0, pos);
+    auto& key = keys_[FoldCase(prefix)];
+    if (key.path.empty()) {
+      key.path = prefix;
+    }
+    if (pos == std::wstring::npos) {
+      return key;
+    }
+    pos++;
+  }
+}
+
+void InMemoryRealRegistry::PutKey(const std::wstring& keyPath) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  EnsureKeyLocked(keyPath);
+}
+
+void InMemoryRealRegistry::PutValue(const std::wstring& keyPath,
+                                    const std::wstring& valueName,
+                                    uint32_t type,
+                                    std::vector<uint8_t> data) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& key = EnsureKeyLocked(keyPath);
+  auto& v = key.values[FoldCase(valueName)];
+  if (v.name.empty()) {
+    v.name = valueName;
+  }
+  v.type = type;
+  v.data = std::move(data);
+}
+
+InMemoryRealRegistry::Key* InMemoryRealRegistry::FindKeyLocked(RealKeyHandle key) {
+  auto h = handles_.find(reinterpret_cast<uintptr_t>(key));
+  if (h == handles_.end()) {
+    return nullptr;
+  }
+  auto it = keys_.find(h->second);
+  return it == keys_.end() ? nullptr : &it->second;
+}
+
+RealKeyHandle InMemoryRealRegistry::OpenKey(const std::wstring& keyPath, uint32_t viewFlags) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  counters_.lastViewFlags = viewFlags;
+  const std::wstring folded = FoldCase(keyPath);
+  if (keys_.find(folded) == keys_.end()) {
+    counters_.failedOpens++;
+    return nullptr;
+  }
+  counters_.opens++;
+  const uintptr_t h = nextHandle_;
+  nextHandle_ += 4;
+  handles_.emplace(h, folded);
+  return reinterpret_cast<RealKeyHandle>(h);
+}
+
+void InMemoryRealRegistry::CloseKey(RealKeyHandle key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (handles_.erase(reinterpret_cast<uintptr_t>(key)) != 0) {
+    counters_.closes++;
+  }
+}
+
+std::vector<std::wstring> InMemoryRealRegistry::EnumValueNames(RealKeyHandle key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  counters_.enumValues++;
+  std::vector<std::wstring> out;
+  if (Key* k = FindKeyLocked(key)) {
+    out.reserve(k->values.size());
+    for (const auto& kv : k->values) {
+      out.push_back(kv.second.name);
+    }
+  }
+  return out;
+}
+
+std::vector<std::wstring> InMemoryRealRegistry::EnumSubKeyNames(RealKeyHandle key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  counters_.enumSubKeys++;
+  std::vector<std::wstring> out;
+  Key* k = FindKeyLocked(key);
+  if (!k) {
+    return out;
+  }
+  const std::wstring prefix = FoldCase(k->path) + L"\\";
+  for (auto it = keys_.lower_bound(prefix); it != keys_.end(); ++it) {
+    if (it->first.compare(0, prefix.size(), prefix) != 0) {
+      break;
+    }
+    if (it->first.find(L'\\', prefix.size()) != std::wstring::npos) {
+      continue;
+    }
+    out.push_back(it->second.path.substr(prefix.size()));
+  }
+  return out;
+}
+
+long InMemoryRealRegistry::QueryValue(RealKeyHandle key,
+                                      const std::wstring& valueName,
+                                      uint32_t* type,
+                                      std::vector<uint8_t>* data) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  counters_.queries++;
+  Key* k = FindKeyLocked(key);
+  if (!k) {
+    return regstatus::kFileNotFound;
+  }
+  auto it = k->values.find(FoldCase(valueName));
+  if (it == k->values.end()) {
+    return regstatus::kFileNotFound;
+  }
+  if (type) {
+    *type = it->second.type;
+  }
+  if (data) {
+    *data = it->second.data;
+  }
+  return regstatus::kSuccess;
+}
+
+InMemoryRealRegistry::Counters InMemoryRealRegistry::GetCounters() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return counters_;
+}
+
+size_t InMemoryRealRegistry::OpenHandleCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return handles_.size();
+}
+
+}
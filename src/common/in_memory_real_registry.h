@@ -0,0 +1,62 @@
+#pragma once
+
+#include "common/real_registry_backend.h"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace twinshim {
+
+// In-memory RealRegistryBackend used to exercise overlay semantics natively
+// (unit tests, replay benchmarks). Paths and names are case-insensitive and
+// keep the first spelling they were created with, like the real registry.
+class InMemoryRealRegistry : public RealRegistryBackend {
+public:
+  void PutKey(const std::wstring& keyPath);
+  void PutValue(const std::wstring& keyPath, const std::wstring& valueName, uint32_t type, std::vector<uint8_t> data);
+
+  RealKeyHandle OpenKey(const std::wstring& keyPath, uint32_t viewFlags) override;
+  void CloseKey(RealKeyHandle key) override;
+  std::vector<std::wstring> EnumValueNames(RealKeyHandle key) override;
+  std::vector<std::wstring> EnumSubKeyNames(RealKeyHandle key) override;
+  long QueryValue(RealKeyHandle key, const std::wstring& valueName, uint32_t* type, std::vector<uint8_t>* data) override;
+
+  // Call counters, so tests and benchmarks can assert how much real-registry
+  // traffic an overlay path generates.
+  struct Counters {
+    uint64_t opens = 0;
+    uint64_t failedOpens = 0;
+    uint64_t closes = 0;
+    uint64_t enumValues = 0;
+    uint64_t enumSubKeys = 0;
+    uint64_t queries = 0;
+    uint32_t lastViewFlags = 0; // viewFlags of the most recent OpenKey
+  };
+  Counters GetCounters() const;
+  size_t OpenHandleCount() const;
+
+private:
+  struct Value {
+    std::wstring name;
+    uint32_t type = 0;
+    std::vector<uint8_t> data;
+  };
+  struct Key {
+    std::wstring path;
+    std::map<std::wstring, Value> values; // folded name -> value
+  };
+
+  Key* FindKeyLocked(RealKeyHandle key);
+  Key& EnsureKeyLocked(const std::wstring& keyPath);
+
+  mutable std::mutex mutex_;
+  std::map<std::wstring, Key> keys_; // folded path -> key
+  std::map<uintptr_t, std::wstring> handles_; // handle -> folded path
+  uintptr_t nextHandle_ = 0x1000;
+  Counters counters_;
+};
+
+}
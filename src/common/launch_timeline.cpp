@@ -0,0 +1,330 @@
+#include "common/launch_timeline.h"
+
+#include "common/trace_record.h"
+#include "common/utf8.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <new>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace twinshim {
+namespace {
+
+constexpr uint32_t kSlotOpen = 1;
+constexpr uint32_t kSlotClosed = 2;
+
+uint32_t CurrentProcessId() {
+#if defined(_WIN32)
+  return (uint32_t)GetCurrentProcessId();
+#else
+  return (uint32_t)getpid();
+#endif
+}
+
+double TicksToMs(uint64_t ticks, uint64_t ticksPerSecond) {
+  return ticksPerSecond ? (double)ticks * 1000.0 / (double)ticksPerSecond : 0.0;
+}
+
+std::wstring FormatMs(double ms) {
+  wchar_t buf[32]{};
+  std::swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"%10.2f", ms);
+  return buf;
+}
+
+void AppendJsonString(std::string& out, const std::string& s) {
+  out += '"';
+  for (unsigned char ch : s) {
+    if (ch == '"' || ch == '\\') {
+      out += '\\';
+      out += (char)ch;
+    } else if (ch < 0x20) {
+      char esc[8];
+      std::snprintf(esc, sizeof(esc), "\\u%04x", ch);
+      out += esc;
+    } else {
+      out += (char)ch;
+    }
+  }
+  out += '"';
+}
+
+} // namespace
+
+void InitializeLaunchTimelineBlock(LaunchTimelineBlock* block, uint32_t creatorPid, uint64_t ticksPerSecond) {
+  if (!block) {
+    return;
+  }
+  new (block) LaunchTimelineBlock();
+  block->version = kLaunchTimelineVersion;
+  block->capacity = (uint32_t)kLaunchTimelineCapacity;
+  block->creatorPid = creatorPid;
+  block->ticksPerSecond = ticksPerSecond;
+  block->magic.store(kLaunchTimelineMagic, std::memory_order_release);
+}
+
+bool IsLaunchTimelineBlockValid(const LaunchTimelineBlock* block) {
+  return block && block->magic.load(std::memory_order_acquire) == kLaunchTimelineMagic &&
+         block->version == kLaunchTimelineVersion && block->capacity == kLaunchTimelineCapacity &&
+         block->ticksPerSecond != 0;
+}
+
+uint32_t LaunchTimeline::Claim(const char* name, uint64_t start) {
+  if (!block_) {
+    return kNoSpan;
+  }
+  const uint32_t index = block_->next.fetch_add(1, std::memory_order_relaxed);
+  if (index >= kLaunchTimelineCapacity) {
+    return kNoSpan;
+  }
+  LaunchTimelineSlot& slot = block_->slots[index];
+  slot.pid = CurrentProcessId();
+  slot.tid = TraceThreadId();
+  slot.start = start;
+  slot.end = 0;
+  std::strncpy(slot.name, name ? name : "", kLaunchTimelineNameBytes - 1);
+  slot.name[kLaunchTimelineNameBytes - 1] = '\0';
+  slot.state.store(kSlotOpen, std::memory_order_release);
+  return index;
+}
+
+uint32_t LaunchTimeline::Begin(const char* name) {
+  return block_ ? Claim(name, TraceTicks()) : kNoSpan;
+}
+
+void LaunchTimeline::End(uint32_t span) {
+  if (!block_ || span >= kLaunchTimelineCapacity) {
+    return;
+  }
+  LaunchTimelineSlot& slot = block_->slots[span];
+  slot.end = TraceTicks();
+  slot.state.store(kSlotClosed, std::memory_order_release);
+}
+
+void LaunchTimeline::Record(const char* name, uint64_t start, uint64_t end) {
+  const uint32_t span = Claim(name, start);
+  if (span == kNoSpan) {
+    return;
+  }
+  LaunchTimelineSlot& slot = block_->slots[span];
+  slot.end = std::max(start, end);
+  slot.state.store(kSlotClosed, std::memory_order_release);
+}
+
+std::vector<LaunchSpan> LaunchTimeline::Spans() const {
+  std::vector<LaunchSpan> spans;
+  if (!block_) {
+    return spans;
+  }
+  const uint32_t claimed = std::min<uint32_t>(block_->next.load(std::memory_order_acquire), kLaunchTimelineCapacity);
+  for (uint32_t i = 0; i < claimed; i++) {
+    const LaunchTimelineSlot& slot = block_->slots[i];
+    if (slot.state.load(std::memory_order_acquire) != kSlotClosed) {
+      continue;
+    }
+    LaunchSpan span;
+    span.name.assign(slot.name, strnlen(slot.name, kLaunchTimelineNameBytes));
+    span.pid = slot.pid;
+    span.tid = slot.tid;
+    span.start = slot.start;
+    span.end = slot.end;
+    spans.push_back(std::move(span));
+  }
+  // Longer spans first on ties so a phase precedes the steps inside it.
+  std::stable_sort(spans.begin(), spans.end(), [](const LaunchSpan& a, const LaunchSpan& b) {
+    return a.start != b.start ? a.start < b.start : a.end > b.end;
+  });
+  return spans;
+}
+
+uint32_t LaunchTimeline::Dropped() const {
+  if (!block_) {
+    return 0;
+  }
+  const uint32_t claimed = block_->next.load(std::memory_order_relaxed);
+  return claimed > kLaunchTimelineCapacity ? claimed - (uint32_t)kLaunchTimelineCapacity : 0;
+}
+
+uint64_t LaunchTimeline::TicksPerSecond() const {
+  return block_ ? block_->ticksPerSecond : 0;
+}
+
+std::wstring FormatLaunchTimeline(const std::vector<LaunchSpan>& spans,
+                                  uint64_t ticksPerSecond,
+                                  const std::vector<std::pair<uint32_t, std::wstring>>& processNames) {
+  if (spans.empty()) {
+    return L"No launch timeline spans were recorded.\n";
+  }
+  uint64_t base = spans.front().start;
+  for (const auto& span : spans) {
+    base = std::min(base, span.start);
+  }
+
+  std::wstring out = L"     start   duration  process   phase (ms)\n";
+  // Per process, the ends of the spans enclosing the current one.
+  std::map<uint32_t, std::vector<uint64_t>> open;
+  for (const auto& span : spans) {
+    std::vector<uint64_t>& stack = open[span.pid];
+    while (!stack.empty() && stack.back() < span.end) {
+      stack.pop_back();
+    }
+
+    std::wstring process = std::to_wstring(span.pid);
+    for (const auto& named : processNames) {
+      if (named.first == span.pid) {
+        process = named.second;
+        break;
+      }
+    }
+    if (process.size() < 8) {
+      process.resize(8, L' ');
+    }
+
+    out += FormatMs(TicksToMs(span.start - base, ticksPerSecond));
+    out += FormatMs(TicksToMs(span.end - span.start, ticksPerSecond));
+    out += L"  " + process + L"  " + std::wstring(stack.size() * 2, L' ') + Utf8ToWide(span.name) + L"\n";
+    stack.push_back(span.end);
+  }
+  return out;
+}
+
+std::string FormatLaunchTimelineChromeTrace(const std::vector<LaunchSpan>& spans, uint64_t ticksPerSecond) {
+  uint64_t base = spans.empty() ? 0 : spans.front().start;
+  for (const auto& span : spans) {
+    base = std::min(base, span.start);
+  }
+  std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  for (const auto& span : spans) {
+    char numbers[160];
+    std::snprintf(numbers,
+                  sizeof(numbers),
+                  ",\"cat\":\"launch\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u}",
+                  TicksToMs(span.start - base, ticksPerSecond) * 1000.0,
+                  TicksToMs(span.end - span.start, ticksPerSecond) * 1000.0,
+                  span.pid,
+                  span.tid);
+    out += first ? "\n{\"name\":" : ",\n{\"name\":";
+    AppendJsonString(out, span.name);
+    out += numbers;
+    first = false;
+  }
+  out += "\n]}\n";
+  return out;
+}
+
+LaunchTimelineMapping::~LaunchTimelineMapping() {
+  Close();
+}
+
+std::wstring LaunchTimelineMapping::NameForProcess(uint32_t pid) {
+#if defined(_WIN32)
+  return L"Local\\TwinShimTimeline." + std::to_wstring(pid);
+#else
+  return L"/twinshim-timeline." + std::to_wstring(pid);
+#endif
+}
+
+bool LaunchTimelineMapping::Create(uint32_t pid) {
+  Close();
+  const std::wstring name = NameForProcess(pid);
+#if defined(_WIN32)
+  HANDLE mapping = CreateFileMappingW(
+      INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)sizeof(LaunchTimelineBlock), name.c_str());
+  if (!mapping) {
+    return false;
+  }
+  void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(LaunchTimelineBlock));
+  if (!view) {
+    CloseHandle(mapping);
+    return false;
+  }
+  handle_ = mapping;
+#else
+  const std::string nameUtf8 = WideToUtf8(name);
+  int fd = shm_open(nameUtf8.c_str(), O_CREAT | O_RDWR, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  if (ftruncate(fd, (off_t)sizeof(LaunchTimelineBlock)) != 0) {
+    close(fd);
+    shm_unlink(nameUtf8.c_str());
+    return false;
+  }
+  void* view = mmap(nullptr, sizeof(LaunchTimelineBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED) {
+    shm_unlink(nameUtf8.c_str());
+    return false;
+  }
+#endif
+  block_ = static_cast<LaunchTimelineBlock*>(view);
+  owner_ = true;
+  pid_ = pid;
+  InitializeLaunchTimelineBlock(block_, pid, CaptureTraceClock().ticksPerSecond);
+  return true;
+}
+
+bool LaunchTimelineMapping::Open(uint32_t pid) {
+  Close();
+  const std::wstring name = NameForProcess(pid);
+#if defined(_WIN32)
+  HANDLE mapping = OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, name.c_str());
+  if (!mapping) {
+    return false;
+  }
+  void* view = MapViewOfFile(mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, sizeof(LaunchTimelineBlock));
+  if (!view) {
+    CloseHandle(mapping);
+    return false;
+  }
+  handle_ = mapping;
+#else
+  int fd = shm_open(WideToUtf8(name).c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    return false;
+  }
+  void* view = mmap(nullptr, sizeof(LaunchTimelineBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED) {
+    return false;
+  }
+#endif
+  block_ = static_cast<LaunchTimelineBlock*>(view);
+  pid_ = pid;
+  if (!IsLaunchTimelineBlockValid(block_)) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void LaunchTimelineMapping::Close() {
+  if (!block_) {
+    return;
+  }
+#if defined(_WIN32)
+  UnmapViewOfFile(block_);
+  CloseHandle(static_cast<HANDLE>(handle_));
+#else
+  munmap(block_, sizeof(LaunchTimelineBlock));
+  if (owner_) {
+    shm_unlink(WideToUtf8(NameForProcess(pid_)).c_str());
+  }
+#endif
+  block_ = nullptr;
+  handle_ = nullptr;
+  owner_ = false;
+  pid_ = 0;
+}
+
+}
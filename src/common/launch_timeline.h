@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace twinshim {
+
+// Launch timeline: named spans on the shared monotonic trace clock
+// (TraceTicks, QPC on Windows), written by the wrapper and by the shim inside
+// the target into one shared-memory block the wrapper creates. QPC is
+// system-wide, so spans from both processes line up on one axis.
+//
+// Writers never lock: a span claims a slot with one atomic increment and
+// publishes it with a release store. The layout uses fixed-width types only,
+// so 32-bit shims and 64-bit wrappers share it; bump the version when it
+// changes.
+
+constexpr uint32_t kLaunchTimelineMagic = 0x4C545754; // 'TWTL'
+constexpr uint32_t kLaunchTimelineVersion = 1;
+constexpr size_t kLaunchTimelineCapacity = 256;
+constexpr size_t kLaunchTimelineNameBytes = 48;
+
+struct LaunchTimelineSlot {
+  std::atomic<uint32_t> state; // 0 unused, 1 open, 2 closed
+  uint32_t pid;
+  uint32_t tid;
+  uint32_t reserved;
+  uint64_t start;
+  uint64_t end;
+  char name[kLaunchTimelineNameBytes]; // UTF-8, NUL-terminated
+};
+
+struct LaunchTimelineBlock {
+  std::atomic<uint32_t> magic; // written last; zero until the block is usable
+  uint32_t version;
+  uint32_t capacity;
+  uint32_t creatorPid;
+  uint64_t ticksPerSecond;
+  std::atomic<uint32_t> next; // slots claimed, may run past capacity
+  uint32_t reserved;
+  LaunchTimelineSlot slots[kLaunchTimelineCapacity];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "timeline state lives in shared memory");
+static_assert(offsetof(LaunchTimelineBlock, slots) % 8 == 0, "slots must be 8-byte aligned on every ABI");
+
+// Prepares freshly mapped (zeroed) memory and publishes the magic last.
+void InitializeLaunchTimelineBlock(LaunchTimelineBlock* block, uint32_t creatorPid, uint64_t ticksPerSecond);
+bool IsLaunchTimelineBlockValid(const LaunchTimelineBlock* block);
+
+struct LaunchSpan {
+  std::string name;
+  uint32_t pid = 0;
+  uint32_t tid = 0;
+  uint64_t start = 0;
+  uint64_t end = 0;
+};
+
+// Span API over a block. A recorder without a block does nothing, so call
+// sites need no checks of their own.
+class LaunchTimeline {
+public:
+  static constexpr uint32_t kNoSpan = UINT32_MAX;
+
+  LaunchTimeline() = default;
+  explicit LaunchTimeline(LaunchTimelineBlock* block) : block_(block) {}
+
+  void Attach(LaunchTimelineBlock* block) { block_ = block; }
+  bool Enabled() const { return block_ != nullptr; }
+
+  // Opens a span starting now; kNoSpan when disabled or the block is full.
+  uint32_t Begin(const char* name);
+  void End(uint32_t span);
+  // Adds a span measured elsewhere, in TraceTicks units.
+  void Record(const char* name, uint64_t start, uint64_t end);
+
+  // Closed spans, ordered by start time.
+  std::vector<LaunchSpan> Spans() const;
+  // Spans that could not be recorded because the block was full.
+  uint32_t Dropped() const;
+  uint64_t TicksPerSecond() const;
+
+private:
+  uint32_t Claim(const char* name, uint64_t start);
+
+  LaunchTimelineBlock* block_ = nullptr;
+};
+
+// Begin/End for one scope.
+class LaunchTimelineScope {
+public:
+  LaunchTimelineScope(LaunchTimeline& timeline, const char* name)
+      : timeline_(timeline), span_(timeline.Begin(name)) {}
+  ~LaunchTimelineScope() { timeline_.End(span_); }
+
+  LaunchTimelineScope(const LaunchTimelineScope&) = delete;
+  LaunchTimelineScope& operator=(const LaunchTimelineScope&) = delete;
+
+private:
+  LaunchTimeline& timeline_;
+  uint32_t span_;
+};
+
+// Per-phase breakdown, one row per span: offset from the earliest span,
+// duration, pid and name, indented under the span of the same process that
+// contains it. `processNames` labels pids (e.g. wrapper, target); others show
+// as numbers.
+std::wstring FormatLaunchTimeline(const std::vector<LaunchSpan>& spans,
+                                  uint64_t ticksPerSecond,
+                                  const std::vector<std::pair<uint32_t, std::wstring>>& processNames = {});
+
+// Chrome trace event JSON (chrome://tracing, Perfetto): one complete ("X")
+// event per span, timestamps in microseconds from the earliest span.
+std::string FormatLaunchTimelineChromeTrace(const std::vector<LaunchSpan>& spans, uint64_t ticksPerSecond);
+
+// Named mapping holding the timeline of one launch, keyed by the wrapper's pid
+// and passed to the shim in TWINSHIM_TIMELINE.
+class LaunchTimelineMapping {
+public:
+  LaunchTimelineMapping() = default;
+  ~LaunchTimelineMapping();
+
+  LaunchTimelineMapping(const LaunchTimelineMapping&) = delete;
+  LaunchTimelineMapping& operator=(const LaunchTimelineMapping&) = delete;
+
+  // "Local\TwinShimTimeline.<pid>" on Windows, "/twinshim-timeline.<pid>" elsewhere.
+  static std::wstring NameForProcess(uint32_t pid);
+
+  // Wrapper: creates the mapping and initializes the block.
+  bool Create(uint32_t pid);
+  // Shim: maps an existing block for writing and validates its layout.
+  bool Open(uint32_t pid);
+  void Close();
+
+  LaunchTimelineBlock* Block() const { return block_; }
+
+private:
+  LaunchTimelineBlock* block_ = nullptr;
+  void* handle_ = nullptr;
+  bool owner_ = false;
+  uint32_t pid_ = 0;
+};
+
+}
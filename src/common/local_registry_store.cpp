@@ -4,6 +4,7 @@
 
 #include <sqlite3.h>
 
+#include <algorithm>
 #include <ctime>
 #include <cstring>
 #include <cwctype>
@@ -28,6 +29,40 @@ static std::wstring CaseFoldWide(const std::wstring& s) {
   return out;
 }
 
+// Matches SQLite's built-in NOCASE collation, which only folds ASCII.
+static std::wstring AsciiFoldWide(const std::wstring& s) {
+  std::wstring out = s;
+  for (auto& ch : out) {
+    if (ch >= L'A' && ch <= L'Z') {
+      ch = (wchar_t)(ch - L'A' + L'a');
+    }
+  }
+  return out;
+}
+
+// FNV-1a over the same ASCII folding, for the lookup filter.
+constexpr uint64_t kFnvOffset = 0xCBF29CE484222325ull;
+constexpr uint64_t kFnvPrime = 0x100000001B3ull;
+
+static uint64_t FoldedHashStep(uint64_t h, wchar_t ch) {
+  if (ch >= L'A' && ch <= L'Z') {
+    ch = (wchar_t)(ch - L'A' + L'a');
+  }
+  return (h ^ (uint64_t)(uint32_t)ch) * kFnvPrime;
+}
+
+static uint64_t FoldedHash(const std::wstring& s, uint64_t h = kFnvOffset) {
+  for (wchar_t ch : s) {
+    h = FoldedHashStep(h, ch);
+  }
+  return h;
+}
+
+static uint64_t ValueFilterHash(const std::wstring& keyPath, const std::wstring& valueName) {
+  // U+FFFF is a noncharacter, so it can't end a key path or start a name.
+  return FoldedHash(valueName, FoldedHashStep(FoldedHash(keyPath), (wchar_t)0xFFFF));
+}
+
 static bool StartsWithNoCase(const std::wstring& s, const std::wstring& prefix) {
   if (prefix.size() > s.size()) {
     return false;
@@ -94,8 +129,9 @@ bool LocalRegistryStore::Open(const std::wstring& dbPath) {
 
   // Support concurrent wrapper + hklmreg access (WAL allows readers during writes,
   // but writers can contend). Give operations a chance to wait instead of
-  // immediately failing with SQLITE_BUSY.
-  (void)sqlite3_busy_timeout(db_, 5000);
+  // immediately failing with SQLITE_BUSY; OnBusy caps the wait at 5 s or at
+  // the caller's BusyBudget.
+  (void)sqlite3_busy_handler(db_, &LocalRegistryStore::OnBusy, this);
 
   // Enable extended result codes so callers can distinguish SQLITE_BUSY variants
   // when debugging. (We still treat them as failure in this layer.)
@@ -109,7 +145,14 @@ bool LocalRegistryStore::Open(const std::wstring& dbPath) {
   // This doesn't affect visibility (readers can always see committed WAL pages),
   // but improves steady-state behavior.
   (void)sqlite3_wal_autocheckpoint(db_, 256);
-  return EnsureSchema();
+  if (!EnsureSchema()) {
+    return false;
+  }
+  // A different file invalidates everything resolved against the old one.
+  generation_++;
+  externalGeneration_++;
+  dataVersion_ = DataVersion();
+  return true;
 }
 
 void LocalRegistryStore::Close() {
@@ -124,10 +167,235 @@ void LocalRegistryStore::Close() {
     (void)sqlite3_wal_checkpoint_v2(db_, nullptr, SQLITE_CHECKPOINT_TRUNCATE, nullptr, nullptr);
     sqlite3_close(db_);
     db_ = nullptr;
+    generation_++;
+    externalGeneration_++;
+  }
+  filter_.Clear();
+  tombstones_.clear();
+  filterGeneration_ = 0;
+  filterMinCapacity_ = 0;
+}
+
+LocalRegistryStore::WriteScope::WriteScope(LocalRegistryStore& s) : store(s) {
+  store.Generation();
+}
+
+LocalRegistryStore::WriteScope::~WriteScope() {
+  // Our own commit moved the data version too; absorb it so it isn't counted
+  // again as an external change.
+  store.generation_++;
+  store.dataVersion_ = store.DataVersion();
+}
+
+LocalRegistryStore::BusyBudget::BusyBudget(LocalRegistryStore& store, std::chrono::milliseconds budget)
+    : store_(store) {
+  store_.timedOut_ = false;
+  store_.deadline_ = budget.count() > 0 ? std::chrono::steady_clock::now() + budget
+                                        : std::chrono::steady_clock::time_point{};
+}
+
+LocalRegistryStore::BusyBudget::~BusyBudget() {
+  store_.deadline_ = std::chrono::steady_clock::time_point{};
+}
+
+int LocalRegistryStore::OnBusy(void* self, int count) {
+  // Same backoff schedule as sqlite3_busy_timeout.
+  static constexpr int kDelaysMs[] = {1, 2, 5, 10, 15, 20, 25, 25, 25, 50, 50, 100};
+  constexpr auto kBusyTimeout = std::chrono::milliseconds(5000);
+
+  auto* store = static_cast<LocalRegistryStore*>(self);
+  const auto now = std::chrono::steady_clock::now();
+  if (count == 0) {
+    store->busySince_ = now;
+  }
+  const bool budgeted = store->deadline_ != std::chrono::steady_clock::time_point{};
+  const auto deadline = budgeted ? store->deadline_ : store->busySince_ + kBusyTimeout;
+  if (now >= deadline) {
+    // One overrun per scope, however many statements in it give up.
+    if (budgeted && !store->timedOut_) {
+      store->timedOut_ = true;
+      store->busyOverruns_++;
+    }
+    return 0;
+  }
+  const size_t step = std::min<size_t>((size_t)count, sizeof(kDelaysMs) / sizeof(kDelaysMs[0]) - 1);
+  const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+  sqlite3_sleep((int)std::max<long long>(1, std::min<long long>(kDelaysMs[step], remaining)));
+  return 1;
+}
+
+uint32_t LocalRegistryStore::DataVersion() {
+  unsigned int version = 0;
+#ifdef SQLITE_FCNTL_DATA_VERSION
+  if (db_) {
+    (void)sqlite3_file_control(db_, "main", SQLITE_FCNTL_DATA_VERSION, &version);
+  }
+#endif
+  return (uint32_t)version;
+}
+
+uint64_t LocalRegistryStore::Generation() {
+  const uint32_t version = DataVersion();
+  if (version != dataVersion_) {
+    dataVersion_ = version;
+    generation_++;
+    externalGeneration_++;
+  }
+  return generation_;
+}
+
+uint64_t LocalRegistryStore::ExternalGeneration() {
+  Generation();
+  return externalGeneration_;
+}
+
+void LocalRegistryStore::PollExternalChanges() {
+  if (db_) {
+    // Opens (and ends) a read transaction without touching any table.
+    Exec("PRAGMA data_version;");
+  }
+}
+
+bool LocalRegistryStore::IsCurrent(const ResolvedKey& key) {
+  return key.generation != 0 && key.generation == Generation();
+}
+
+bool LocalRegistryStore::LookupFilterCurrent() {
+  constexpr auto kFilterPollInterval = std::chrono::milliseconds(50);
+  if (!db_) {
+    return false;
+  }
+  // A negative answer runs no SQL, so nothing else would notice another
+  // connection's commit; look for one now and then.
+  const auto now = std::chrono::steady_clock::now();
+  if (now >= nextFilterPoll_) {
+    nextFilterPoll_ = now + kFilterPollInterval;
+    PollExternalChanges();
+  }
+  if (filterGeneration_ != 0 && filterGeneration_ == ExternalGeneration()) {
+    if (!filter_.Saturated()) {
+      return true;
+    }
+    // Rebuilt at the same size it would saturate again by the next lookup
+    // (deep paths add more ancestors than the row count allows for), so give
+    // it room for twice what it holds now.
+    filterMinCapacity_ = std::max(filterMinCapacity_, filter_.Count() * 2);
+  }
+  return RebuildLookupFilter();
+}
+
+bool LocalRegistryStore::RebuildLookupFilter() {
+  filter_.Clear();
+  tombstones_.clear();
+  filterGeneration_ = 0;
+
+  // One read transaction, so both scans and the generation stamped below
+  // describe the same snapshot.
+  const bool ownTransaction = sqlite3_get_autocommit(db_) != 0;
+  if (ownTransaction && !Exec("BEGIN;")) {
+    return false;
+  }
+  sqlite3_stmt* st = nullptr;
+  bool ok = Prepare("SELECT (SELECT COUNT(*) FROM keys) + (SELECT COUNT(*) FROM values_tbl);", &st) == SQLITE_OK &&
+            sqlite3_step(st) == SQLITE_ROW;
+  if (ok) {
+    // Ancestor paths and later writes need room too.
+    filter_.Reset(std::max((size_t)sqlite3_column_int64(st, 0) * 2 + 1024, filterMinCapacity_));
+  }
+  sqlite3_finalize(st);
+
+  if (ok && (ok = Prepare("SELECT key_path, is_deleted FROM keys;", &st) == SQLITE_OK)) {
+    int rc;
+    while ((rc = sqlite3_step(st)) == SQLITE_ROW) {
+      const std::wstring keyPath = ColumnWideText(st, 0);
+      FilterAddKey(keyPath);
+      if (sqlite3_column_int(st, 1) != 0) {
+        FilterAddTombstone(keyPath);
+      }
+    }
+    ok = rc == SQLITE_DONE;
+    sqlite3_finalize(st);
+  }
+  if (ok && (ok = Prepare("SELECT key_path, value_name FROM values_tbl;", &st) == SQLITE_OK)) {
+    int rc;
+    while ((rc = sqlite3_step(st)) == SQLITE_ROW) {
+      FilterAddValue(ColumnWideText(st, 0), ColumnWideText(st, 1));
+    }
+    ok = rc == SQLITE_DONE;
+    sqlite3_finalize(st);
   }
+  if (ownTransaction) {
+    Exec(ok ? "COMMIT;" : "ROLLBACK;");
+  }
+  if (!ok) {
+    filter_.Clear();
+    tombstones_.clear();
+    return false;
+  }
+  filterGeneration_ = ExternalGeneration();
+  return true;
+}
+
+void LocalRegistryStore::FilterAddKey(const std::wstring& keyPath) {
+  // The path and every ancestor: a row anywhere below a key makes it visible.
+  uint64_t h = kFnvOffset;
+  for (wchar_t ch : keyPath) {
+    if (ch == L'\\') {
+      filter_.Add(h);
+    }
+    h = FoldedHashStep(h, ch);
+  }
+  filter_.Add(h);
+}
+
+void LocalRegistryStore::FilterAddValue(const std::wstring& keyPath, const std::wstring& valueName) {
+  FilterAddKey(keyPath);
+  filter_.Add(ValueFilterHash(keyPath, valueName));
+}
+
+void LocalRegistryStore::FilterAddTombstone(const std::wstring& keyPath) {
+  tombstones_.insert(AsciiFoldWide(keyPath));
+}
+
+bool LocalRegistryStore::KnownAbsent(const std::wstring& keyPath) {
+  if (!LookupFilterCurrent() || filter_.MayContain(FoldedHash(keyPath))) {
+    return false;
+  }
+  filteredMisses_++;
+  return true;
+}
+
+bool LocalRegistryStore::KnownAbsent(const std::wstring& keyPath, const std::wstring& valueName) {
+  if (!LookupFilterCurrent() || filter_.MayContain(ValueFilterHash(keyPath, valueName))) {
+    return false;
+  }
+  filteredMisses_++;
+  return true;
+}
+
+bool LocalRegistryStore::KnownNotDeleted(const std::wstring& keyPath) {
+  if (!LookupFilterCurrent()) {
+    return false;
+  }
+  if (tombstones_.empty()) {
+    return true;
+  }
+  const std::wstring folded = AsciiFoldWide(keyPath);
+  for (size_t pos = folded.find(L'\\'); pos != std::wstring::npos; pos = folded.find(L'\\', pos + 1)) {
+    if (tombstones_.count(folded.substr(0, pos)) != 0) {
+      return false;
+    }
+  }
+  return tombstones_.count(folded) == 0;
+}
+
+int LocalRegistryStore::Prepare(const char* sql, sqlite3_stmt** st) {
+  statements_++;
+  return sqlite3_prepare_v2(db_, sql, -1, st, nullptr);
 }
 
 bool LocalRegistryStore::Exec(const char* sql) {
+  statements_++;
   char* err = nullptr;
   int rc = sqlite3_exec(db_, sql, nullptr, nullptr, &err);
   if (err) {
@@ -153,7 +421,13 @@ bool LocalRegistryStore::EnsureSchema() {
              "  updated_at INTEGER NOT NULL,"
              "  PRIMARY KEY(key_path, value_name)"
              ");") &&
-         Exec("CREATE INDEX IF NOT EXISTS idx_values_key ON values_tbl(key_path);");
+         Exec("CREATE INDEX IF NOT EXISTS idx_values_key ON values_tbl(key_path);") &&
+         Exec(
+             "CREATE TABLE IF NOT EXISTS access_profile("
+             "  seq INTEGER PRIMARY KEY,"
+             "  key_path TEXT NOT NULL,"
+             "  value_name TEXT"
+             ");");
 }
 
 bool LocalRegistryStore::PutKey(const std::wstring& keyPathRaw) {
@@ -163,13 +437,15 @@ bool LocalRegistryStore::PutKey(const std::wstring& keyPathRaw) {
 
   const std::wstring keyPath = NormalizeHivePrefix(keyPathRaw);
   const auto now = NowUnixSeconds();
+  WriteScope write(*this);
+  FilterAddKey(keyPath);
 
   // Registry keys are case-insensitive. Prefer updating any existing row that
   // matches case-insensitively; only insert if nothing matches.
   {
     sqlite3_stmt* st = nullptr;
     const char* sql = "UPDATE keys SET is_deleted=0, updated_at=? WHERE key_path=? COLLATE NOCASE;";
-    if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+    if (Prepare(sql, &st) != SQLITE_OK) {
       return false;
     }
     sqlite3_bind_int64(st, 1, now);
@@ -187,7 +463,7 @@ bool LocalRegistryStore::PutKey(const std::wstring& keyPathRaw) {
       sqlite3_stmt* stIns = nullptr;
       const char* sqlIns = "INSERT INTO keys(key_path, is_deleted, updated_at) VALUES(?,0,?) "
                            "ON CONFLICT(key_path) DO UPDATE SET is_deleted=0, updated_at=excluded.updated_at;";
-      if (sqlite3_prepare_v2(db_, sqlIns, -1, &stIns, nullptr) != SQLITE_OK) {
+      if (Prepare(sqlIns, &stIns) != SQLITE_OK) {
         return false;
       }
       if (!BindWideText(stIns, 1, keyPath)) {
@@ -208,7 +484,7 @@ bool LocalRegistryStore::PutKey(const std::wstring& keyPathRaw) {
   {
     sqlite3_stmt* st = nullptr;
     const char* sql = "UPDATE keys SET is_deleted=0, updated_at=? WHERE key_path=? COLLATE NOCASE;";
-    if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+    if (Prepare(sql, &st) != SQLITE_OK) {
       return false;
     }
     auto prefixes = KeyPrefixes(keyPath);
@@ -238,6 +514,9 @@ bool LocalRegistryStore::DeleteKeyTree(const std::wstring& keyPathRaw) {
   }
 
   const std::wstring keyPath = NormalizeHivePrefix(keyPathRaw);
+  WriteScope write(*this);
+  FilterAddKey(keyPath);
+  FilterAddTombstone(keyPath);
 
   Exec("BEGIN IMMEDIATE;");
 
@@ -245,7 +524,7 @@ bool LocalRegistryStore::DeleteKeyTree(const std::wstring& keyPathRaw) {
   {
     sqlite3_stmt* st = nullptr;
     const char* sql = "UPDATE keys SET is_deleted=1, updated_at=? WHERE key_path=? COLLATE NOCASE;";
-    if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+    if (Prepare(sql, &st) != SQLITE_OK) {
       Exec("ROLLBACK;");
       return false;
     }
@@ -266,7 +545,7 @@ bool LocalRegistryStore::DeleteKeyTree(const std::wstring& keyPathRaw) {
       sqlite3_stmt* stIns = nullptr;
       const char* sqlIns = "INSERT INTO keys(key_path, is_deleted, updated_at) VALUES(?,1,?) "
                            "ON CONFLICT(key_path) DO UPDATE SET is_deleted=1, updated_at=excluded.updated_at;";
-      if (sqlite3_prepare_v2(db_, sqlIns, -1, &stIns, nullptr) != SQLITE_OK) {
+      if (Prepare(sqlIns, &stIns) != SQLITE_OK) {
         Exec("ROLLBACK;");
         return false;
       }
@@ -291,7 +570,7 @@ bool LocalRegistryStore::DeleteKeyTree(const std::wstring& keyPathRaw) {
     like.append(L"\\%");
     sqlite3_stmt* st = nullptr;
     const char* sql = "UPDATE values_tbl SET is_deleted=1, updated_at=? WHERE key_path=? COLLATE NOCASE OR (key_path COLLATE NOCASE) LIKE ?;";
-    if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+    if (Prepare(sql, &st) != SQLITE_OK) {
       Exec("ROLLBACK;");
       return false;
     }
@@ -336,10 +615,13 @@ bool LocalRegistryStore::IsKeyDeleted(const std::wstring& keyPathRaw) {
     return false;
   }
   const std::wstring keyPath = NormalizeHivePrefix(keyPathRaw);
+  if (KnownNotDeleted(keyPath)) {
+    return false;
+  }
   for (const auto& p : KeyPrefixes(keyPath)) {
     sqlite3_stmt* st = nullptr;
     const char* sql = "SELECT MAX(is_deleted) FROM keys WHERE key_path=? COLLATE NOCASE;";
-    if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+    if (Prepare(sql, &st) != SQLITE_OK) {
       return false;
     }
     if (!BindWideText(st, 1, p)) {
@@ -365,7 +647,7 @@ bool LocalRegistryStore::KeyExistsLocally(const std::wstring& keyPathRaw) {
     return false;
   }
   const std::wstring keyPath = NormalizeHivePrefix(keyPathRaw);
-  if (IsKeyDeleted(keyPath)) {
+  if (IsKeyDeleted(keyPath) || KnownAbsent(keyPath)) {
     return false;
   }
 
@@ -373,7 +655,7 @@ bool LocalRegistryStore::KeyExistsLocally(const std::wstring& keyPathRaw) {
   {
     sqlite3_stmt* st = nullptr;
     const char* sql = "SELECT 1 FROM keys WHERE key_path=? COLLATE NOCASE AND is_deleted=0 LIMIT 1;";
-    if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+    if (Prepare(sql, &st) != SQLITE_OK) {
       return false;
     }
     if (!BindWideText(st, 1, keyPath)) {
@@ -386,11 +668,15 @@ bool LocalRegistryStore::KeyExistsLocally(const std::wstring& keyPathRaw) {
       return true;
     }
   }
+  return HasLiveValueOrChild(keyPath);
+}
+
+bool LocalRegistryStore::HasLiveValueOrChild(const std::wstring& keyPath) {
   // Any value under the key.
   {
     sqlite3_stmt* st = nullptr;
     const char* sql = "SELECT 1 FROM values_tbl WHERE key_path=? COLLATE NOCASE AND is_deleted=0 LIMIT 1;";
-    if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+    if (Prepare(sql, &st) != SQLITE_OK) {
       return false;
     }
     if (!BindWideText(st, 1, keyPath)) {
@@ -416,7 +702,7 @@ std::wstring LocalRegistryStore::ResolveCanonicalKeyPath(const std::wstring& key
   }
   sqlite3_stmt* st = nullptr;
   const char* sql = "SELECT key_path FROM keys WHERE key_path=? COLLATE NOCASE AND is_deleted=0 LIMIT 1;";
-  if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+  if (Prepare(sql, &st) != SQLITE_OK) {
     return keyPath;
   }
   if (!BindWideText(st, 1, keyPath)) {
@@ -433,6 +719,44 @@ std::wstring LocalRegistryStore::ResolveCanonicalKeyPath(const std::wstring& key
   return found.empty() ? keyPath : found;
 }
 
+bool LocalRegistryStore::ResolveKey(const std::wstring& keyPathRaw, ResolvedKey& out) {
+  // keyPathRaw may alias out.keyPath (refreshing a key in place).
+  std::wstring keyPath = NormalizeHivePrefix(keyPathRaw);
+  out = ResolvedKey{};
+  out.keyPath = std::move(keyPath);
+  if (!db_) {
+    return false;
+  }
+  out.generation = Generation();
+  out.deleted = IsKeyDeleted(out.keyPath);
+  if (out.deleted || KnownAbsent(out.keyPath)) {
+    return true;
+  }
+
+  sqlite3_stmt* st = nullptr;
+  const char* sql = "SELECT rowid, key_path FROM keys WHERE key_path=? COLLATE NOCASE AND is_deleted=0 LIMIT 1;";
+  if (Prepare(sql, &st) != SQLITE_OK) {
+    out.generation = 0;
+    return false;
+  }
+  if (!BindWideText(st, 1, out.keyPath)) {
+    sqlite3_finalize(st);
+    out.generation = 0;
+    return false;
+  }
+  if (sqlite3_step(st) == SQLITE_ROW) {
+    out.rowId = sqlite3_column_int64(st, 0);
+    std::wstring found = ColumnWideText(st, 1);
+    if (!found.empty()) {
+      out.keyPath = std::move(found);
+    }
+  }
+  sqlite3_finalize(st);
+
+  out.localExists = out.rowId != 0 || HasLiveValueOrChild(out.keyPath);
+  return true;
+}
+
 bool LocalRegistryStore::PutValue(const std::wstring& keyPathRaw,
                                  const std::wstring& valueName,
                                  uint32_t type,
@@ -442,14 +766,72 @@ bool LocalRegistryStore::PutValue(const std::wstring& keyPathRaw,
     return false;
   }
   const std::wstring keyPath = NormalizeHivePrefix(keyPathRaw);
+  if (!IsKeyDeleted(keyPath) && MatchesLiveValue(keyPath, valueName, type, data, dataSize)) {
+    return true;
+  }
+  WriteScope write(*this);
   PutKey(keyPath);
 
   // Resolve canonical key-path casing from the keys table so that all values
   // under the same logical key share a single key_path spelling regardless of
   // the casing the caller happened to use.
   const std::wstring canonKey = ResolveCanonicalKeyPath(keyPath);
+  return UpsertValue(canonKey, valueName, type, data, dataSize);
+}
 
+bool LocalRegistryStore::PutValue(ResolvedKey& key,
+                                 const std::wstring& valueName,
+                                 uint32_t type,
+                                 const void* data,
+                                 uint32_t dataSize) {
+  if (!db_) {
+    return false;
+  }
+  const uint64_t before = Generation();
+  if (key.generation != before || key.deleted || key.rowId == 0) {
+    // The write may create or undelete the key row; resolve again next time.
+    key.generation = 0;
+    return PutValue(key.keyPath, valueName, type, data, dataSize);
+  }
+  if (MatchesLiveValue(key.keyPath, valueName, type, data, dataSize)) {
+    // Nothing changes, so `key` stays current.
+    return true;
+  }
+  bool ok = false;
+  {
+    WriteScope write(*this);
+    ok = UpsertValue(key.keyPath, valueName, type, data, dataSize);
+  }
+  // The key row is live, so the write cannot change what `key` says about it;
+  // keep it current unless somebody else changed the store meanwhile.
+  key.generation = Generation() == before + 1 ? before + 1 : 0;
+  return ok;
+}
+
+bool LocalRegistryStore::MatchesLiveValue(const std::wstring& keyPath,
+                                         const std::wstring& valueName,
+                                         uint32_t type,
+                                         const void* data,
+                                         uint32_t dataSize) {
+  const auto current = SelectValue(keyPath, valueName);
+  if (!current || current->isDeleted || current->type != type) {
+    return false;
+  }
+  const size_t size = data ? dataSize : 0;
+  if (current->data.size() != size || (size && std::memcmp(current->data.data(), data, size) != 0)) {
+    return false;
+  }
+  elidedWrites_++;
+  return true;
+}
+
+bool LocalRegistryStore::UpsertValue(const std::wstring& canonKey,
+                                    const std::wstring& valueName,
+                                    uint32_t type,
+                                    const void* data,
+                                    uint32_t dataSize) {
   const auto now = NowUnixSeconds();
+  FilterAddValue(canonKey, valueName);
 
   // Update any existing row matching case-insensitively; only insert if nothing matches.
   {
@@ -457,7 +839,7 @@ bool LocalRegistryStore::PutValue(const std::wstring& keyPathRaw,
     const char* sql =
         "UPDATE values_tbl SET type=?, data=?, is_deleted=0, updated_at=? "
         "WHERE key_path=? COLLATE NOCASE AND value_name=? COLLATE NOCASE;";
-    if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+    if (Prepare(sql, &st) != SQLITE_OK) {
       return false;
     }
     sqlite3_bind_int(st, 1, (int)type);
@@ -486,7 +868,7 @@ bool LocalRegistryStore::PutValue(const std::wstring& keyPathRaw,
       "INSERT INTO values_tbl(key_path, value_name, type, data, is_deleted, updated_at) VALUES(?,?,?,?,0,?) "
       "ON CONFLICT(key_path, value_name) DO UPDATE SET type=excluded.type, data=excluded.data, is_deleted=0, "
       "updated_at=excluded.updated_at;";
-  if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+  if (Prepare(sql, &st) != SQLITE_OK) {
     return false;
   }
   if (!BindWideText(st, 1, canonKey) || !BindWideText(st, 2, valueName)) {
@@ -510,17 +892,40 @@ bool LocalRegistryStore::DeleteValue(const std::wstring& keyPathRaw, const std::
     return false;
   }
   const std::wstring keyPath = NormalizeHivePrefix(keyPathRaw);
+  WriteScope write(*this);
   PutKey(keyPath);
 
   const std::wstring canonKey = ResolveCanonicalKeyPath(keyPath);
+  return TombstoneValue(canonKey, valueName);
+}
 
+bool LocalRegistryStore::DeleteValue(ResolvedKey& key, const std::wstring& valueName) {
+  if (!db_) {
+    return false;
+  }
+  const uint64_t before = Generation();
+  if (key.generation != before || key.deleted || key.rowId == 0) {
+    key.generation = 0;
+    return DeleteValue(key.keyPath, valueName);
+  }
+  bool ok = false;
+  {
+    WriteScope write(*this);
+    ok = TombstoneValue(key.keyPath, valueName);
+  }
+  key.generation = Generation() == before + 1 ? before + 1 : 0;
+  return ok;
+}
+
+bool LocalRegistryStore::TombstoneValue(const std::wstring& canonKey, const std::wstring& valueName) {
   const auto now = NowUnixSeconds();
+  FilterAddValue(canonKey, valueName);
 
   // Update any existing row matching case-insensitively; only insert if nothing matches.
   {
     sqlite3_stmt* st = nullptr;
     const char* sql = "UPDATE values_tbl SET is_deleted=1, updated_at=? WHERE key_path=? COLLATE NOCASE AND value_name=? COLLATE NOCASE;";
-    if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+    if (Prepare(sql, &st) != SQLITE_OK) {
       return false;
     }
     sqlite3_bind_int64(st, 1, now);
@@ -542,7 +947,7 @@ bool LocalRegistryStore::DeleteValue(const std::wstring& keyPathRaw, const std::
   const char* sql =
       "INSERT INTO values_tbl(key_path, value_name, type, data, is_deleted, updated_at) VALUES(?,?,0,NULL,1,?) "
       "ON CONFLICT(key_path, value_name) DO UPDATE SET is_deleted=1, updated_at=excluded.updated_at;";
-  if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+  if (Prepare(sql, &st) != SQLITE_OK) {
     return false;
   }
   if (!BindWideText(st, 1, canonKey) || !BindWideText(st, 2, valueName)) {
@@ -565,12 +970,34 @@ std::optional<StoredValue> LocalRegistryStore::GetValue(const std::wstring& keyP
     tombstone.isDeleted = true;
     return tombstone;
   }
+  return SelectValue(keyPath, valueName);
+}
+
+std::optional<StoredValue> LocalRegistryStore::GetValue(const ResolvedKey& key, const std::wstring& valueName) {
+  if (!db_) {
+    return std::nullopt;
+  }
+  if (!IsCurrent(key)) {
+    return GetValue(key.keyPath, valueName);
+  }
+  if (key.deleted) {
+    StoredValue tombstone;
+    tombstone.isDeleted = true;
+    return tombstone;
+  }
+  return SelectValue(key.keyPath, valueName);
+}
+
+std::optional<StoredValue> LocalRegistryStore::SelectValue(const std::wstring& keyPath, const std::wstring& valueName) {
+  if (KnownAbsent(keyPath, valueName)) {
+    return std::nullopt;
+  }
   sqlite3_stmt* st = nullptr;
   const char* sql =
       "SELECT type, data, is_deleted FROM values_tbl "
       "WHERE key_path=? COLLATE NOCASE AND value_name=? COLLATE NOCASE "
       "ORDER BY updated_at DESC LIMIT 1;";
-  if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+  if (Prepare(sql, &st) != SQLITE_OK) {
     return std::nullopt;
   }
   if (!BindWideText(st, 1, keyPath) || !BindWideText(st, 2, valueName)) {
@@ -596,13 +1023,111 @@ std::optional<StoredValue> LocalRegistryStore::GetValue(const std::wstring& keyP
   return v;
 }
 
+std::vector<std::optional<StoredValue>> LocalRegistryStore::GetValues(const std::wstring& keyPathRaw,
+                                                                    const std::vector<std::wstring>& names) {
+  if (!db_) {
+    return std::vector<std::optional<StoredValue>>(names.size());
+  }
+  const std::wstring keyPath = NormalizeHivePrefix(keyPathRaw);
+  if (IsKeyDeleted(keyPath)) {
+    StoredValue tombstone;
+    tombstone.isDeleted = true;
+    return std::vector<std::optional<StoredValue>>(names.size(), tombstone);
+  }
+  return SelectValues(keyPath, names);
+}
+
+std::vector<std::optional<StoredValue>> LocalRegistryStore::GetValues(const ResolvedKey& key,
+                                                                    const std::vector<std::wstring>& names) {
+  if (!db_) {
+    return std::vector<std::optional<StoredValue>>(names.size());
+  }
+  if (!IsCurrent(key)) {
+    return GetValues(key.keyPath, names);
+  }
+  if (key.deleted) {
+    StoredValue tombstone;
+    tombstone.isDeleted = true;
+    return std::vector<std::optional<StoredValue>>(names.size(), tombstone);
+  }
+  return SelectValues(key.keyPath, names);
+}
+
+std::vector<std::optional<StoredValue>> LocalRegistryStore::SelectValues(const std::wstring& keyPath,
+                                                                       const std::vector<std::wstring>& names) {
+  std::vector<std::optional<StoredValue>> out(names.size());
+  if (names.empty() ||
+      std::all_of(names.begin(), names.end(), [&](const std::wstring& n) { return KnownAbsent(keyPath, n); })) {
+    return out;
+  }
+
+  // Distinct names under SQLite's NOCASE (ASCII-only) folding, each mapped
+  // back to every request slot that spelled it.
+  std::map<std::wstring, std::vector<size_t>> slotsByFolded;
+  std::vector<const std::wstring*> distinct;
+  for (size_t i = 0; i < names.size(); i++) {
+    auto& slots = slotsByFolded[AsciiFoldWide(names[i])];
+    if (slots.empty()) {
+      distinct.push_back(&names[i]);
+    }
+    slots.push_back(i);
+  }
+
+  // Stay well under SQLITE_MAX_VARIABLE_NUMBER (999 on older builds).
+  constexpr size_t kMaxNamesPerQuery = 500;
+  for (size_t first = 0; first < distinct.size(); first += kMaxNamesPerQuery) {
+    const size_t count = std::min(kMaxNamesPerQuery, distinct.size() - first);
+    std::string sql =
+        "SELECT value_name, type, data, is_deleted FROM values_tbl "
+        "WHERE key_path=? COLLATE NOCASE AND value_name COLLATE NOCASE IN (";
+    for (size_t i = 0; i < count; i++) {
+      sql += i ? ",?" : "?";
+    }
+    // Newest row first, so the first row per name wins like GetValue's LIMIT 1.
+    sql += ") ORDER BY updated_at DESC;";
+
+    sqlite3_stmt* st = nullptr;
+    if (Prepare(sql.c_str(), &st) != SQLITE_OK) {
+      return out;
+    }
+    bool bound = BindWideText(st, 1, keyPath);
+    for (size_t i = 0; bound && i < count; i++) {
+      bound = BindWideText(st, (int)(i + 2), *distinct[first + i]);
+    }
+    if (!bound) {
+      sqlite3_finalize(st);
+      return out;
+    }
+    while (sqlite3_step(st) == SQLITE_ROW) {
+      auto it = slotsByFolded.find(AsciiFoldWide(ColumnWideText(st, 0)));
+      if (it == slotsByFolded.end() || out[it->second.front()].has_value()) {
+        continue;
+      }
+      StoredValue v;
+      v.type = (uint32_t)sqlite3_column_int(st, 1);
+      const void* blob = sqlite3_column_blob(st, 2);
+      int blobSize = sqlite3_column_bytes(st, 2);
+      v.isDeleted = sqlite3_column_int(st, 3) != 0;
+      if (blob && blobSize > 0) {
+        v.data.resize((size_t)blobSize);
+        std::memcpy(v.data.data(), blob, (size_t)blobSize);
+      }
+      for (size_t slot : it->second) {
+        out[slot] = v;
+      }
+    }
+    sqlite3_finalize(st);
+  }
+  return out;
+}
+
 std::vector<LocalRegistryStore::ValueRow> LocalRegistryStore::ListValues(const std::wstring& keyPathRaw) {
   std::vector<ValueRow> rows;
   if (!db_) {
     return rows;
   }
   const std::wstring keyPath = NormalizeHivePrefix(keyPathRaw);
-  if (IsKeyDeleted(keyPath)) {
+  if (IsKeyDeleted(keyPath) || KnownAbsent(keyPath)) {
     return rows;
   }
 
@@ -611,7 +1136,7 @@ std::vector<LocalRegistryStore::ValueRow> LocalRegistryStore::ListValues(const s
       "SELECT value_name, type, data, is_deleted, updated_at FROM values_tbl "
       "WHERE key_path=? COLLATE NOCASE "
       "ORDER BY value_name COLLATE NOCASE ASC, updated_at DESC;";
-  if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+  if (Prepare(sql, &st) != SQLITE_OK) {
     return rows;
   }
   if (!BindWideText(st, 1, keyPath)) {
@@ -651,7 +1176,7 @@ std::vector<std::wstring> LocalRegistryStore::ListImmediateSubKeys(const std::ws
     return subkeys;
   }
   const std::wstring keyPath = NormalizeHivePrefix(keyPathRaw);
-  if (IsKeyDeleted(keyPath)) {
+  if (IsKeyDeleted(keyPath) || KnownAbsent(keyPath)) {
     return subkeys;
   }
 
@@ -660,7 +1185,7 @@ std::vector<std::wstring> LocalRegistryStore::ListImmediateSubKeys(const std::ws
 
   sqlite3_stmt* st = nullptr;
   const char* sql = "SELECT key_path, is_deleted FROM keys WHERE (key_path COLLATE NOCASE) LIKE ?;";
-  if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+  if (Prepare(sql, &st) != SQLITE_OK) {
     return subkeys;
   }
   if (!BindWideText(st, 1, like)) {
@@ -704,6 +1229,156 @@ std::vector<std::wstring> LocalRegistryStore::ListImmediateSubKeys(const std::ws
   return subkeys;
 }
 
+std::vector<LocalRegistryStore::SubKeyEntry> LocalRegistryStore::ListImmediateSubKeyEntries(const std::wstring& keyPathRaw) {
+  std::vector<SubKeyEntry> entries;
+  if (!db_) {
+    return entries;
+  }
+  const std::wstring keyPath = NormalizeHivePrefix(keyPathRaw);
+  if (IsKeyDeleted(keyPath) || KnownAbsent(keyPath)) {
+    return entries;
+  }
+
+  std::wstring like = keyPath;
+  like.append(L"\\%");
+
+  sqlite3_stmt* st = nullptr;
+  const char* sql = "SELECT key_path, is_deleted FROM keys WHERE (key_path COLLATE NOCASE) LIKE ?;";
+  if (Prepare(sql, &st) != SQLITE_OK) {
+    return entries;
+  }
+  if (!BindWideText(st, 1, like)) {
+    sqlite3_finalize(st);
+    return entries;
+  }
+
+  // A child is a tombstone when its own row is deleted; it is visible when any
+  // live row exists at or below it (deeper rows under a deleted child are
+  // hidden by the ancestor check, so they don't count).
+  struct ChildState {
+    std::wstring display;
+    bool selfDeleted = false;
+    bool anyLive = false;
+  };
+  std::map<std::wstring, ChildState> children;
+  const std::wstring prefix = keyPath + L"\\";
+  while (sqlite3_step(st) == SQLITE_ROW) {
+    std::wstring full = ColumnWideText(st, 0);
+    const bool deleted = sqlite3_column_int(st, 1) != 0;
+    if (full.size() <= prefix.size() || !StartsWithNoCase(full, prefix)) {
+      continue;
+    }
+    std::wstring rem = full.substr(prefix.size());
+    auto pos = rem.find(L'\\');
+    const bool isSelf = pos == std::wstring::npos;
+    std::wstring child = isSelf ? rem : rem.substr(0, pos);
+    if (child.empty()) {
+      continue;
+    }
+    auto& state = children[CaseFoldWide(child)];
+    if (state.display.empty()) {
+      state.display = child;
+    }
+    if (isSelf && deleted) {
+      state.selfDeleted = true;
+    } else if (!deleted) {
+      state.anyLive = true;
+    }
+  }
+  sqlite3_finalize(st);
+
+  entries.reserve(children.size());
+  for (auto& kv : children) {
+    if (!kv.second.selfDeleted && !kv.second.anyLive) {
+      continue;
+    }
+    SubKeyEntry e;
+    e.name = std::move(kv.second.display);
+    e.isDeleted = kv.second.selfDeleted;
+    entries.push_back(std::move(e));
+  }
+  return entries;
+}
+
+LocalRegistryStore::WarmResult LocalRegistryStore::Warm(uint64_t maxBytes) {
+  WarmResult result;
+  if (!db_) {
+    return result;
+  }
+  LookupFilterCurrent();
+  // Keys first: every lookup resolves its key before touching values.
+  static const char* const kScans[] = {
+      "SELECT key_path, is_deleted FROM keys;",
+      "SELECT key_path, value_name, type, data, is_deleted FROM values_tbl;",
+  };
+  for (const char* sql : kScans) {
+    sqlite3_stmt* st = nullptr;
+    if (Prepare(sql, &st) != SQLITE_OK) {
+      return result;
+    }
+    const int columns = sqlite3_column_count(st);
+    while (result.bytes < maxBytes && sqlite3_step(st) == SQLITE_ROW) {
+      result.rows++;
+      // Asking for the size makes SQLite load the column, overflow pages included.
+      for (int c = 0; c < columns; c++) {
+        result.bytes += (uint64_t)sqlite3_column_bytes(st, c);
+      }
+    }
+    sqlite3_finalize(st);
+  }
+  return result;
+}
+
+bool LocalRegistryStore::SaveAccessProfile(const std::vector<AccessProfileEntry>& entries) {
+  if (!db_) {
+    return false;
+  }
+  bool ok = Exec("BEGIN IMMEDIATE;");
+  // With the write lock held nobody else can commit; fold in earlier commits
+  // by other connections so only ours is absorbed below.
+  Generation();
+  ok = ok && Exec("DELETE FROM access_profile;");
+  sqlite3_stmt* st = nullptr;
+  ok = ok && Prepare("INSERT INTO access_profile(key_path, value_name) VALUES(?,?);", &st) == SQLITE_OK;
+  for (size_t i = 0; ok && i < entries.size(); i++) {
+    const AccessProfileEntry& e = entries[i];
+    sqlite3_reset(st);
+    ok = BindWideText(st, 1, e.keyPath) &&
+         (e.isKey ? sqlite3_bind_null(st, 2) == SQLITE_OK : BindWideText(st, 2, e.valueName)) &&
+         sqlite3_step(st) == SQLITE_DONE;
+  }
+  sqlite3_finalize(st);
+  ok = ok && Exec("COMMIT;");
+  if (!ok) {
+    Exec("ROLLBACK;");
+  }
+  // Not a key/value change: nothing resolved against the store went stale.
+  dataVersion_ = DataVersion();
+  return ok;
+}
+
+std::vector<AccessProfileEntry> LocalRegistryStore::LoadAccessProfile() {
+  std::vector<AccessProfileEntry> out;
+  if (!db_) {
+    return out;
+  }
+  sqlite3_stmt* st = nullptr;
+  if (Prepare("SELECT key_path, value_name FROM access_profile ORDER BY seq;", &st) != SQLITE_OK) {
+    return out;
+  }
+  while (sqlite3_step(st) == SQLITE_ROW) {
+    AccessProfileEntry e;
+    e.keyPath = ColumnWideText(st, 0);
+    e.isKey = sqlite3_column_type(st, 1) == SQLITE_NULL;
+    if (!e.isKey) {
+      e.valueName = ColumnWideText(st, 1);
+    }
+    out.push_back(std::move(e));
+  }
+  sqlite3_finalize(st);
+  return out;
+}
+
 std::vector<LocalRegistryStore::ExportRow> LocalRegistryStore::ExportAll() {
   std::vector<ExportRow> rows;
   if (!db_) {
@@ -726,7 +1401,7 @@ std::vector<LocalRegistryStore::ExportRow> LocalRegistryStore::ExportAll() {
   {
     sqlite3_stmt* st = nullptr;
     const char* sql = "SELECT key_path, value_name, type, data FROM values_tbl WHERE is_deleted=0 ORDER BY key_path, value_name;";
-    if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+    if (Prepare(sql, &st) != SQLITE_OK) {
       return rows;
     }
     while (sqlite3_step(st) == SQLITE_ROW) {
@@ -762,7 +1437,7 @@ std::vector<LocalRegistryStore::ExportRow> LocalRegistryStore::ExportAll() {
   {
     sqlite3_stmt* st = nullptr;
     const char* sql = "SELECT key_path FROM keys WHERE is_deleted=0 ORDER BY key_path;";
-    if (sqlite3_prepare_v2(db_, sql, -1, &st, nullptr) != SQLITE_OK) {
+    if (Prepare(sql, &st) != SQLITE_OK) {
       return rows;
     }
     while (sqlite3_step(st) == SQLITE_ROW) {
@@ -1,11 +1,16 @@
 #pragma once
 
+#include "common/bloom_filter.h"
+
+#include <chrono>
 #include <cstdint>
 #include <optional>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 struct sqlite3;
+struct sqlite3_stmt;
 
 namespace twinshim {
 
@@ -15,6 +20,24 @@ struct StoredValue {
   std::vector<uint8_t> data;
 };
 
+// Everything a caller needs to know about one key path before touching its
+// values. Open handles keep one and reuse it while `generation` still matches
+// LocalRegistryStore::Generation(); 0 means "not resolved yet".
+struct ResolvedKey {
+  std::wstring keyPath;     // canonical spelling: the live keys-table row, else the normalized input
+  int64_t rowId = 0;        // rowid of the live keys-table row, 0 when there is none
+  bool deleted = false;     // key or an ancestor is tombstoned
+  bool localExists = false; // key row, value, or live child exists locally
+  uint64_t generation = 0;
+};
+
+// One key or value a run looked up, as saved in the access profile.
+struct AccessProfileEntry {
+  std::wstring keyPath;
+  bool isKey = false;     // a key open/probe; valueName is unused
+  std::wstring valueName;
+};
+
 class LocalRegistryStore {
 public:
   LocalRegistryStore();
@@ -35,6 +58,89 @@ public:
   bool DeleteValue(const std::wstring& keyPath, const std::wstring& valueName);
   std::optional<StoredValue> GetValue(const std::wstring& keyPath, const std::wstring& valueName);
 
+  // GetValue for several names of one key in a single query; result[i]
+  // answers names[i] (duplicates and case variants share a row).
+  std::vector<std::optional<StoredValue>> GetValues(const std::wstring& keyPath, const std::vector<std::wstring>& names);
+
+  // Changes whenever the store may have changed: on every write through this
+  // object and, once this connection next reads, on commits by other
+  // connections (hklmreg editing a DB a title has open).
+  uint64_t Generation();
+
+  // Reads the keys and values tables through this connection so the page
+  // cache (and the OS file cache under it) is hot before the first lookup.
+  // Lookups compare paths with COLLATE NOCASE and so scan these tables rather
+  // than their indexes. Stops once about maxBytes of row data has been read.
+  // Builds the lookup filter first if it isn't current.
+  struct WarmResult {
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+  };
+  WarmResult Warm(uint64_t maxBytes);
+
+  // Advances like Generation() but only for changes this object didn't make:
+  // commits by other connections and reopening. In-memory copies of store
+  // data that track this object's own writes stay valid while it holds.
+  uint64_t ExternalGeneration();
+  // Other connections' commits only register once this connection reads;
+  // callers answering from memory for a while run this cheap read first.
+  void PollExternalChanges();
+
+  // The access profile side table: what a run looked up early on, in
+  // first-access order, for the next run to prefetch. Saving replaces the
+  // previous profile and doesn't count as a change to keys or values.
+  bool SaveAccessProfile(const std::vector<AccessProfileEntry>& entries);
+  std::vector<AccessProfileEntry> LoadAccessProfile();
+
+  // SQL statements prepared or executed so far, for benchmarks.
+  uint64_t StatementCount() const { return statements_; }
+
+  // Lookups of keys and values the tables have never held are answered from
+  // memory: a Bloom filter over every row's key path (with its ancestors) and
+  // (key path, value name) pair, plus the exact set of tombstoned key paths,
+  // both ASCII-folded like COLLATE NOCASE. Built on the first lookup (or by
+  // Warm), kept up to date by this object's writes and rebuilt once commits by
+  // other connections are seen, polling for them at most every 50 ms.
+  // Lookups the filter ruled out since Open, for benchmarks.
+  uint64_t FilteredMissCount() const { return filteredMisses_; }
+
+  // PutValue calls that found a live value with the same type and data and
+  // returned without writing (no WAL frame, no generation bump, updated_at
+  // left as is), since Open.
+  uint64_t ElidedWriteCount() const { return elidedWrites_; }
+
+  // Bounds how long calls made while the scope is alive wait for another
+  // connection's lock. A call that runs out of budget gives up (false or an
+  // empty result) and sets TimedOut(); outside a scope, or with a zero budget,
+  // the store waits up to its 5 s busy timeout. Scopes don't nest.
+  class BusyBudget {
+  public:
+    BusyBudget(LocalRegistryStore& store, std::chrono::milliseconds budget);
+    ~BusyBudget();
+
+    BusyBudget(const BusyBudget&) = delete;
+    BusyBudget& operator=(const BusyBudget&) = delete;
+
+  private:
+    LocalRegistryStore& store_;
+  };
+  // True once a call in the current (or last) BusyBudget scope gave up.
+  bool TimedOut() const { return timedOut_; }
+  // BusyBudget scopes that ran out since Open.
+  uint64_t BusyOverrunCount() const { return busyOverruns_; }
+
+  // Resolves keyPath and stamps the result with the current generation.
+  bool ResolveKey(const std::wstring& keyPath, ResolvedKey& out);
+
+  // Variants for a key resolved at the current generation: reads skip the
+  // ancestor tombstone walk, and writes to a live key row skip PutKey and the
+  // canonical-spelling lookup. Writes keep `key` current when they were the
+  // only change; a stale `key` falls back to the path-based calls.
+  std::optional<StoredValue> GetValue(const ResolvedKey& key, const std::wstring& valueName);
+  std::vector<std::optional<StoredValue>> GetValues(const ResolvedKey& key, const std::vector<std::wstring>& names);
+  bool PutValue(ResolvedKey& key, const std::wstring& valueName, uint32_t type, const void* data, uint32_t dataSize);
+  bool DeleteValue(ResolvedKey& key, const std::wstring& valueName);
+
   struct ValueRow {
     std::wstring valueName;
     bool isDeleted = false;
@@ -44,6 +150,14 @@ public:
   std::vector<ValueRow> ListValues(const std::wstring& keyPath);
   std::vector<std::wstring> ListImmediateSubKeys(const std::wstring& keyPath);
 
+  // Immediate children including tombstoned ones, so overlay callers can hide
+  // real-registry subkeys that were deleted locally.
+  struct SubKeyEntry {
+    std::wstring name;
+    bool isDeleted = false;
+  };
+  std::vector<SubKeyEntry> ListImmediateSubKeyEntries(const std::wstring& keyPath);
+
   struct ExportRow {
     std::wstring keyPath;
     bool isKeyOnly = false;
@@ -56,11 +170,56 @@ public:
 private:
   bool EnsureSchema();
   bool Exec(const char* sql);
+  int Prepare(const char* sql, sqlite3_stmt** st);
   bool PrepareAndStep(const char* sql);
 
   std::wstring ResolveCanonicalKeyPath(const std::wstring& keyPath);
+  bool HasLiveValueOrChild(const std::wstring& keyPath);
+  std::optional<StoredValue> SelectValue(const std::wstring& keyPath, const std::wstring& valueName);
+  std::vector<std::optional<StoredValue>> SelectValues(const std::wstring& keyPath, const std::vector<std::wstring>& names);
+  // True (and counted) when the live value already has this type and data.
+  bool MatchesLiveValue(const std::wstring& keyPath, const std::wstring& valueName, uint32_t type, const void* data, uint32_t dataSize);
+  bool UpsertValue(const std::wstring& canonKey, const std::wstring& valueName, uint32_t type, const void* data, uint32_t dataSize);
+  bool TombstoneValue(const std::wstring& canonKey, const std::wstring& valueName);
+  uint32_t DataVersion();
+  static int OnBusy(void* self, int count);
+  bool IsCurrent(const ResolvedKey& key);
+
+  // Lookup filter. The Known* checks take normalized paths and are false
+  // whenever the filter can't vouch for the answer.
+  bool LookupFilterCurrent();
+  bool RebuildLookupFilter();
+  void FilterAddKey(const std::wstring& keyPath);
+  void FilterAddValue(const std::wstring& keyPath, const std::wstring& valueName);
+  void FilterAddTombstone(const std::wstring& keyPath);
+  bool KnownAbsent(const std::wstring& keyPath);
+  bool KnownAbsent(const std::wstring& keyPath, const std::wstring& valueName);
+  bool KnownNotDeleted(const std::wstring& keyPath);
+
+  // Held for the duration of every write method: folds in other connections'
+  // commits first, then bumps the generation once this object's write is done.
+  struct WriteScope {
+    explicit WriteScope(LocalRegistryStore& store);
+    ~WriteScope();
+    LocalRegistryStore& store;
+  };
 
   sqlite3* db_ = nullptr;
+  uint64_t generation_ = 1;
+  uint64_t externalGeneration_ = 1;
+  uint32_t dataVersion_ = 0;
+  uint64_t statements_ = 0;
+  std::chrono::steady_clock::time_point deadline_{}; // zero: no BusyBudget scope
+  std::chrono::steady_clock::time_point busySince_{};
+  bool timedOut_ = false;
+  uint64_t busyOverruns_ = 0;
+  BloomFilter filter_;
+  std::unordered_set<std::wstring> tombstones_; // folded paths of keys rows ever seen deleted
+  uint64_t filterGeneration_ = 0;               // ExternalGeneration() the filter was built at
+  size_t filterMinCapacity_ = 0;                // raised each time the filter saturates
+  std::chrono::steady_clock::time_point nextFilterPoll_{};
+  uint64_t filteredMisses_ = 0;
+  uint64_t elidedWrites_ = 0;
 };
 
 }
@@ -0,0 +1,182 @@
+#include "common/real_key_pool.h"
+
+#include "common/registry_path.h"
+
+namespace twinshim {
+
+namespace {
+
+// KEY_WOW64_64KEY | KEY_WOW64_32KEY: the only access bits that change which
+// key a path names.
+constexpr uint32_t kViewMask = 0x0100 | 0x0200;
+
+} // namespace
+
+RealKeyPool::RealKeyPool(RealRegistryBackend& inner, std::chrono::milliseconds idleTimeout)
+    : inner_(inner), idleTimeout_(idleTimeout) {}
+
+RealKeyPool::~RealKeyPool() {
+  Clear();
+}
+
+std::wstring RealKeyPool::PoolKey(const std::wstring& keyPath, uint32_t viewFlags) {
+  return std::to_wstring(viewFlags & kViewMask) + L":" + FoldCase(keyPath);
+}
+
+RealKeyHandle RealKeyPool::OpenKey(const std::wstring& keyPath, uint32_t viewFlags) {
+  const std::wstring key = PoolKey(keyPath, viewFlags);
+  std::vector<RealKeyHandle> idle;
+  RealKeyHandle hit = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CollectIdleLocked(Clock::now(), idle);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+      it->second.refs++;
+      counters_.hits++;
+      hit = it->second.handle;
+    }
+  }
+  // Closing expired handles is a kernel call; never under the lock.
+  CloseAll(idle);
+  if (hit) {
+    return hit;
+  }
+
+  // Open outside the lock so a slow real registry doesn't serialize hits.
+  RealKeyHandle opened = inner_.OpenKey(keyPath, viewFlags);
+  if (!opened) {
+    return nullptr;
+  }
+  RealKeyHandle redundant = nullptr;
+  RealKeyHandle h = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counters_.opens++;
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+      // Another thread pooled the same key meanwhile; share its handle.
+      redundant = opened;
+      it->second.refs++;
+      h = it->second.handle;
+    } else {
+      Entry& e = entries_[key];
+      e.handle = opened;
+      e.refs = 1;
+      handleKeys_.emplace(opened, key);
+      h = opened;
+    }
+  }
+  if (redundant) {
+    CloseAll({redundant});
+  }
+  return h;
+}
+
+void RealKeyPool::CloseKey(RealKeyHandle key) {
+  if (!key) {
+    return;
+  }
+  std::vector<RealKeyHandle> idle;
+  bool pooled = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Clock::time_point now = Clock::now();
+    auto hk = handleKeys_.find(key);
+    if (hk != handleKeys_.end()) {
+      pooled = true;
+      Entry& e = entries_[hk->second];
+      if (e.refs > 0 && --e.refs == 0) {
+        e.idleSince = now;
+      }
+    }
+    CollectIdleLocked(now, idle);
+  }
+  if (!pooled) {
+    inner_.CloseKey(key);
+  }
+  CloseAll(idle);
+}
+
+std::vector<std::wstring> RealKeyPool::EnumValueNames(RealKeyHandle key) {
+  return inner_.EnumValueNames(key);
+}
+
+std::vector<std::wstring> RealKeyPool::EnumSubKeyNames(RealKeyHandle key) {
+  return inner_.EnumSubKeyNames(key);
+}
+
+long RealKeyPool::QueryValue(RealKeyHandle key,
+                             const std::wstring& valueName,
+                             uint32_t* type,
+                             std::vector<uint8_t>* data) {
+  return inner_.QueryValue(key, valueName, type, data);
+}
+
+void RealKeyPool::CollectIdleLocked(Clock::time_point now, std::vector<RealKeyHandle>& out) {
+  // Scanning is O(pool size); at most a couple of times per timeout period.
+  if (now < nextTrim_) {
+    return;
+  }
+  nextTrim_ = now + idleTimeout_ / 2;
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    const Entry& e = it->second;
+    if (e.refs == 0 && now - e.idleSince >= idleTimeout_) {
+      out.push_back(e.handle);
+      handleKeys_.erase(e.handle);
+      it = entries_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void RealKeyPool::CloseAll(const std::vector<RealKeyHandle>& handles) {
+  for (RealKeyHandle h : handles) {
+    inner_.CloseKey(h);
+  }
+  if (!handles.empty()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counters_.closes += handles.size();
+  }
+}
+
+size_t RealKeyPool::Trim(Clock::time_point now) {
+  std::vector<RealKeyHandle> idle;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    nextTrim_ = Clock::time_point{};
+    CollectIdleLocked(now, idle);
+  }
+  CloseAll(idle);
+  return idle.size();
+}
+
+void RealKeyPool::Clear() {
+  std::vector<RealKeyHandle> idle;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      if (it->second.refs == 0) {
+        idle.push_back(it->second.handle);
+        handleKeys_.erase(it->second.handle);
+        it = entries_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  CloseAll(idle);
+}
+
+RealKeyPool::Counters RealKeyPool::GetCounters() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return counters_;
+}
+
+size_t RealKeyPool::PooledHandleCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "common/real_registry_backend.h"
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace twinshim {
+
+// Reference-counted pool of real-registry handles in front of another
+// backend. OpenKey hands every caller asking for the same key (folded path and
+// KEY_WOW64_* view) one shared handle; CloseKey drops a reference, and a handle
+// nobody holds stays open until it has been idle for `idleTimeout`, so
+// open/close loops on one key cost a map lookup instead of a kernel call.
+//
+// Idle handles are closed opportunistically from OpenKey/CloseKey or by an
+// explicit Trim. A pooled handle can outlive the real key it names (deleted
+// and recreated by another process); the idle timeout bounds that window the
+// same way it bounds an application holding the key open.
+//
+// Handles the pool didn't open are passed through to the inner backend.
+class RealKeyPool final : public RealRegistryBackend {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit RealKeyPool(RealRegistryBackend& inner,
+                       std::chrono::milliseconds idleTimeout = std::chrono::milliseconds(5000));
+  ~RealKeyPool() override;
+
+  RealKeyPool(const RealKeyPool&) = delete;
+  RealKeyPool& operator=(const RealKeyPool&) = delete;
+
+  RealKeyHandle OpenKey(const std::wstring& keyPath, uint32_t viewFlags) override;
+  void CloseKey(RealKeyHandle key) override;
+  std::vector<std::wstring> EnumValueNames(RealKeyHandle key) override;
+  std::vector<std::wstring> EnumSubKeyNames(RealKeyHandle key) override;
+  long QueryValue(RealKeyHandle key, const std::wstring& valueName, uint32_t* type, std::vector<uint8_t>* data) override;
+
+  // Closes handles that have had no references for at least the idle
+  // timeout as of `now`; returns how many were closed.
+  size_t Trim(Clock::time_point now);
+  size_t Trim() { return Trim(Clock::now()); }
+  // Closes every unreferenced handle (shutdown). Referenced ones stay valid.
+  void Clear();
+
+  struct Counters {
+    uint64_t hits = 0;   // OpenKey served by an already-open handle
+    uint64_t opens = 0;  // OpenKey that reached the inner backend
+    uint64_t closes = 0; // handles closed on the inner backend
+  };
+  Counters GetCounters() const;
+  size_t PooledHandleCount() const;
+
+private:
+  struct Entry {
+    RealKeyHandle handle = nullptr;
+    uint32_t refs = 0;
+    Clock::time_point idleSince;
+  };
+
+  static std::wstring PoolKey(const std::wstring& keyPath, uint32_t viewFlags);
+  // Unlinks idle entries due by `now` into `out`; caller holds mutex_.
+  void CollectIdleLocked(Clock::time_point now, std::vector<RealKeyHandle>& out);
+  void CloseAll(const std::vector<RealKeyHandle>& handles);
+
+  RealRegistryBackend& inner_;
+  const Clock::duration idleTimeout_;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::wstring, Entry> entries_;           // pool key -> entry
+  std::unordered_map<RealKeyHandle, std::wstring> handleKeys_; // handle -> pool key
+  Clock::time_point nextTrim_{};
+  Counters counters_;
+};
+
+}
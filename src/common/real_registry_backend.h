@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace twinshim {
+
+// Opaque real-registry key handle as seen by a RealRegistryBackend. The Win32
+// backend hands out HKEYs; the in-memory fake hands out small integers.
+using RealKeyHandle = void*;
+
+// Win32 status codes used by the portable overlay layers. They are spelled out
+// here so hklm_common doesn't need <windows.h>; the values match winerror.h.
+namespace regstatus {
+constexpr long kSuccess = 0;           // ERROR_SUCCESS
+constexpr long kFileNotFound = 2;      // ERROR_FILE_NOT_FOUND
+constexpr long kWriteFault = 29;       // ERROR_WRITE_FAULT
+constexpr long kInvalidParameter = 87; // ERROR_INVALID_PARAMETER
+constexpr long kMoreData = 234;        // ERROR_MORE_DATA
+constexpr long kNoMoreItems = 259;     // ERROR_NO_MORE_ITEMS
+} // namespace regstatus
+
+// Read-only view of the machine's real HKLM, used by the overlay engine for
+// read-through. Key paths are canonical "HKLM\..." spellings; viewFlags carries
+// the caller's KEY_WOW64_* bits untouched.
+class RealRegistryBackend {
+public:
+  virtual ~RealRegistryBackend() = default;
+
+  // Returns nullptr when the key doesn't exist (or can't be opened for read).
+  virtual RealKeyHandle OpenKey(const std::wstring& keyPath, uint32_t viewFlags) = 0;
+  virtual void CloseKey(RealKeyHandle key) = 0;
+
+  // Names in the backend's native order; the engine sorts merged results.
+  virtual std::vector<std::wstring> EnumValueNames(RealKeyHandle key) = 0;
+  virtual std::vector<std::wstring> EnumSubKeyNames(RealKeyHandle key) = 0;
+
+  // Returns a regstatus code. Data is always the wide (W-API) representation.
+  virtual long QueryValue(RealKeyHandle key, const std::wstring& valueName, uint32_t* type, std::vector<uint8_t>* data) = 0;
+};
+
+}
@@ -0,0 +1,78 @@
+#include "common/registry_api_table.h"
+
+#include <cwctype>
+#include <vector>
+
+namespace twinshim {
+namespace {
+
+std::wstring NormalizeApiToken(const std::wstring& in) {
+  std::wstring out;
+  out.reserve(in.size());
+  for (wchar_t ch : in) {
+    if (!std::iswspace(ch)) {
+      out.push_back((wchar_t)std::towlower(ch));
+    }
+  }
+  return out;
+}
+
+std::wstring StripAnsiWideSuffix(const std::wstring& apiNameNorm) {
+  if (apiNameNorm.size() > 1) {
+    wchar_t tail = apiNameNorm.back();
+    if (tail == L'a' || tail == L'w') {
+      return apiNameNorm.substr(0, apiNameNorm.size() - 1);
+    }
+  }
+  return apiNameNorm;
+}
+
+bool TokenSelectsApi(const std::wstring& tokenNoAw, const std::wstring& apiNoAw) {
+  if (tokenNoAw == apiNoAw) {
+    return true;
+  }
+  return tokenNoAw.size() + 2 == apiNoAw.size() && apiNoAw.compare(0, tokenNoAw.size(), tokenNoAw) == 0 &&
+         apiNoAw.compare(tokenNoAw.size(), 2, L"ex") == 0;
+}
+
+} // namespace
+
+RegistryApiMask ParseRegistryApiList(const std::wstring& csv) {
+  std::vector<std::wstring> tokens;
+  size_t start = 0;
+  while (start <= csv.size()) {
+    size_t comma = csv.find(L',', start);
+    size_t end = (comma == std::wstring::npos) ? csv.size() : comma;
+    std::wstring token = NormalizeApiToken(csv.substr(start, end - start));
+    if (!token.empty()) {
+      if (token == L"all") {
+        return kAllRegistryApis;
+      }
+      tokens.push_back(StripAnsiWideSuffix(token));
+    }
+    if (comma == std::wstring::npos) {
+      break;
+    }
+    start = comma + 1;
+  }
+
+  RegistryApiMask mask = 0;
+  for (size_t i = 0; i < kRegistryApiCount; i++) {
+    const std::wstring apiNoAw = StripAnsiWideSuffix(NormalizeApiToken(kRegistryApiInfo[i].name));
+    for (const auto& token : tokens) {
+      if (TokenSelectsApi(token, apiNoAw)) {
+        mask |= RegistryApiBit(static_cast<RegistryApi>(i));
+        break;
+      }
+    }
+  }
+  return mask;
+}
+
+void RegistryApiCounters::Reset() {
+  for (auto& count : counts_) {
+    count.store(0, std::memory_order_relaxed);
+  }
+}
+
+}
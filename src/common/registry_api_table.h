@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace twinshim {
+
+// When and whether a hook is installed:
+//   Core             - always, and failure aborts installation
+//   CoreOptional     - always, but missing on older systems is tolerated
+//   Extended         - only in full (ANSI + W) hook mode
+//   ExtendedOptional - full mode, tolerated when missing
+enum class RegistryApiGroup : uint8_t { Core, CoreOptional, Extended, ExtendedOptional };
+
+// Every hooked registry API, in installation order. Hook installation, the
+// original-function pointers, trace filtering and call counters are all
+// generated from this list; add an API here and nowhere else.
+#define TWINSHIM_REGISTRY_API_TABLE(X)         \
+  X(RegOpenKeyExW, Core)                       \
+  X(RegCreateKeyExW, Core)                     \
+  X(RegCloseKey, Core)                         \
+  X(RegGetValueW, Core)                        \
+  X(RegSetValueExW, Core)                      \
+  X(RegQueryValueExW, Core)                    \
+  X(RegDeleteValueW, Core)                     \
+  X(RegDeleteKeyW, Core)                       \
+  X(RegOpenKeyW, Core)                         \
+  X(RegCreateKeyW, Core)                       \
+  X(RegQueryValueW, Core)                      \
+  X(RegSetValueW, Core)                        \
+  X(RegEnumValueW, Core)                       \
+  X(RegEnumKeyExW, Core)                       \
+  X(RegEnumKeyW, Core)                         \
+  X(RegQueryInfoKeyW, Core)                    \
+  X(RegSetKeyValueW, CoreOptional)             \
+  X(RegDeleteKeyExW, CoreOptional)             \
+  X(RegOpenKeyExA, Extended)                   \
+  X(RegCreateKeyExA, Extended)                 \
+  X(RegSetValueExA, Extended)                  \
+  X(RegQueryValueExA, Extended)                \
+  X(RegDeleteValueA, Extended)                 \
+  X(RegDeleteKeyA, Extended)                   \
+  X(RegGetValueA, Extended)                    \
+  X(RegOpenKeyA, Extended)                     \
+  X(RegCreateKeyA, Extended)                   \
+  X(RegQueryValueA, Extended)                  \
+  X(RegSetValueA, Extended)                    \
+  X(RegEnumValueA, Extended)                   \
+  X(RegEnumKeyExA, Extended)                   \
+  X(RegEnumKeyA, Extended)                     \
+  X(RegQueryInfoKeyA, Extended)                \
+  X(RegSetKeyValueA, ExtendedOptional)         \
+  X(RegQueryMultipleValuesW, CoreOptional)     \
+  X(RegQueryMultipleValuesA, ExtendedOptional) \
+  X(RegNotifyChangeKeyValue, CoreOptional)
+
+enum class RegistryApi : uint8_t {
+#define TWINSHIM_REGISTRY_API_ENUM(name, group) name,
+  TWINSHIM_REGISTRY_API_TABLE(TWINSHIM_REGISTRY_API_ENUM)
+#undef TWINSHIM_REGISTRY_API_ENUM
+  Count
+};
+
+constexpr size_t kRegistryApiCount = static_cast<size_t>(RegistryApi::Count);
+
+// One bit per RegistryApi, so "is this API selected" is a single load + test.
+using RegistryApiMask = uint64_t;
+static_assert(kRegistryApiCount <= 64, "RegistryApiMask has one bit per API");
+
+constexpr RegistryApiMask RegistryApiBit(RegistryApi api) {
+  return RegistryApiMask(1) << static_cast<unsigned>(api);
+}
+
+constexpr RegistryApiMask kAllRegistryApis =
+    kRegistryApiCount == 64 ? ~RegistryApiMask(0) : (RegistryApiMask(1) << kRegistryApiCount) - 1;
+
+struct RegistryApiInfo {
+  const wchar_t* name;  // e.g. L"RegOpenKeyExW" (trace output)
+  const char* procName; // e.g. "RegOpenKeyExW" (GetProcAddress / MinHook)
+  RegistryApiGroup group;
+  bool ansi;            // string data crosses the API boundary as ANSI
+};
+
+inline constexpr RegistryApiInfo kRegistryApiInfo[] = {
+#define TWINSHIM_REGISTRY_API_INFO(name, group) \
+  {L"" #name, #name, RegistryApiGroup::group, #name[sizeof(#name) - 2] == 'A'},
+    TWINSHIM_REGISTRY_API_TABLE(TWINSHIM_REGISTRY_API_INFO)
+#undef TWINSHIM_REGISTRY_API_INFO
+};
+static_assert(sizeof(kRegistryApiInfo) / sizeof(kRegistryApiInfo[0]) == kRegistryApiCount, "API table out of sync");
+
+constexpr const RegistryApiInfo& GetRegistryApiInfo(RegistryApi api) {
+  return kRegistryApiInfo[static_cast<size_t>(api)];
+}
+
+// Resolves a TWINSHIM_DEBUG_APIS style list ("RegOpenKey, RegQueryValueExA")
+// to a mask. Tokens are case- and whitespace-insensitive; a token without an
+// A/W suffix selects both variants, and "RegFoo" also selects "RegFooEx".
+// "all" selects every API.
+RegistryApiMask ParseRegistryApiList(const std::wstring& csv);
+
+// Per-API call counters. Relaxed atomics: counts are diagnostics and never
+// used to order other memory.
+class RegistryApiCounters {
+public:
+  void Add(RegistryApi api) { counts_[static_cast<size_t>(api)].fetch_add(1, std::memory_order_relaxed); }
+  uint64_t Get(RegistryApi api) const { return counts_[static_cast<size_t>(api)].load(std::memory_order_relaxed); }
+  void Reset();
+
+private:
+  std::atomic<uint64_t> counts_[kRegistryApiCount] = {};
+};
+
+}
@@ -0,0 +1,122 @@
+#include "common/registry_change_notifier.h"
+
+#include "common/registry_path.h"
+
+namespace twinshim {
+
+namespace {
+
+// True when `path` is strictly below `key` (both folded).
+bool IsBelow(const std::wstring& path, const std::wstring& key) {
+  return path.size() > key.size() && path[key.size()] == L'\\' && path.compare(0, key.size(), key) == 0;
+}
+
+std::wstring ParentOf(const std::wstring& path) {
+  const size_t pos = path.find_last_of(L'\\');
+  return pos == std::wstring::npos ? std::wstring() : path.substr(0, pos);
+}
+
+} // namespace
+
+void RegistryChangeNotifier::Watch(const std::wstring& keyPath,
+                                   bool subtree,
+                                   uint32_t filter,
+                                   const void* owner,
+                                   Callback fire) {
+  WatchEntry w;
+  w.folded = FoldCase(keyPath);
+  w.subtree = subtree;
+  w.filter = filter;
+  w.owner = owner;
+  w.fire = std::move(fire);
+  std::lock_guard<std::mutex> lock(mutex_);
+  watches_.push_back(std::move(w));
+  count_.store(watches_.size(), std::memory_order_release);
+}
+
+void RegistryChangeNotifier::KeyCreated(const std::wstring& keyPath) {
+  Report(keyPath, Change::Created);
+}
+
+void RegistryChangeNotifier::KeyDeleted(const std::wstring& keyPath) {
+  Report(keyPath, Change::Deleted);
+}
+
+void RegistryChangeNotifier::ValueChanged(const std::wstring& keyPath) {
+  Report(keyPath, Change::Value);
+}
+
+void RegistryChangeNotifier::Report(const std::wstring& keyPath, Change change) {
+  if (!HasWatches()) {
+    return;
+  }
+  const std::wstring folded = FoldCase(keyPath);
+  const std::wstring parent = ParentOf(folded);
+  std::vector<Callback> fired;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fired = TakeLocked([&](const WatchEntry& w) {
+      if (change == Change::Value) {
+        return (w.filter & kRegNotifyChangeLastSet) != 0 &&
+               (w.folded == folded || (w.subtree && IsBelow(folded, w.folded)));
+      }
+      if (change == Change::Deleted && (w.folded == folded || IsBelow(w.folded, folded))) {
+        return true;
+      }
+      return (w.filter & kRegNotifyChangeName) != 0 &&
+             (w.folded == parent || (w.subtree && IsBelow(folded, w.folded)));
+    });
+  }
+  RunAll(fired);
+}
+
+size_t RegistryChangeNotifier::CloseOwner(const void* owner) {
+  if (!HasWatches()) {
+    return 0;
+  }
+  std::vector<Callback> fired;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fired = TakeLocked([&](const WatchEntry& w) { return w.owner == owner; });
+  }
+  return RunAll(fired);
+}
+
+size_t RegistryChangeNotifier::FireAll() {
+  std::vector<Callback> fired;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fired = TakeLocked([](const WatchEntry&) { return true; });
+  }
+  return RunAll(fired);
+}
+
+template <typename Pred>
+std::vector<RegistryChangeNotifier::Callback> RegistryChangeNotifier::TakeLocked(Pred pred) {
+  std::vector<Callback> out;
+  size_t kept = 0;
+  for (size_t i = 0; i < watches_.size(); i++) {
+    if (pred(watches_[i])) {
+      out.push_back(std::move(watches_[i].fire));
+    } else {
+      if (kept != i) {
+        watches_[kept] = std::move(watches_[i]);
+      }
+      kept++;
+    }
+  }
+  watches_.resize(kept);
+  count_.store(kept, std::memory_order_release);
+  return out;
+}
+
+size_t RegistryChangeNotifier::RunAll(std::vector<Callback>& callbacks) {
+  for (auto& fire : callbacks) {
+    if (fire) {
+      fire();
+    }
+  }
+  return callbacks.size();
+}
+
+}
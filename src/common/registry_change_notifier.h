@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace twinshim {
+
+// RegNotifyChangeKeyValue dwNotifyFilter bits.
+constexpr uint32_t kRegNotifyChangeName = 0x1;       // REG_NOTIFY_CHANGE_NAME: subkey added or deleted
+constexpr uint32_t kRegNotifyChangeAttributes = 0x2; // REG_NOTIFY_CHANGE_ATTRIBUTES
+constexpr uint32_t kRegNotifyChangeLastSet = 0x4;    // REG_NOTIFY_CHANGE_LAST_SET: value set or deleted
+constexpr uint32_t kRegNotifyChangeSecurity = 0x8;   // REG_NOTIFY_CHANGE_SECURITY
+constexpr uint32_t kRegNotifyChangeAll = 0xF;
+
+// Platform-neutral RegNotifyChangeKeyValue for keys that live in the local
+// store. A watch names a key path, whether it covers the whole subtree, and a
+// filter; the overlay engine reports each change it makes and the watch fires
+// once, the first time a change matches, then is gone (callers re-arm it, as
+// with the Win32 API). Deleting the watched key fires it whatever the filter.
+//
+// The local store has no attributes or security descriptors, so watches that
+// only ask for those fire on deletion, owner close or FireAll alone.
+//
+// Every watch's callback runs exactly once: on a matching change, when its
+// owner is closed, or from FireAll. Callbacks run on the reporting thread with
+// no locks held and must not block.
+class RegistryChangeNotifier {
+public:
+  using Callback = std::function<void()>;
+
+  RegistryChangeNotifier() = default;
+  RegistryChangeNotifier(const RegistryChangeNotifier&) = delete;
+  RegistryChangeNotifier& operator=(const RegistryChangeNotifier&) = delete;
+
+  // `owner` identifies the handle the watch was made on, for CloseOwner.
+  void Watch(const std::wstring& keyPath, bool subtree, uint32_t filter, const void* owner, Callback fire);
+
+  // Changes, by canonical key path. A created or deleted key is a name change
+  // of its parent; a deleted key also fires every watch at or below it.
+  void KeyCreated(const std::wstring& keyPath);
+  void KeyDeleted(const std::wstring& keyPath);
+  void ValueChanged(const std::wstring& keyPath);
+
+  // Fires every watch made on `owner` (its handle was closed). Returns how many.
+  size_t CloseOwner(const void* owner);
+  // Fires everything: a change this process can't attribute to a key, such as
+  // another process committing to the store, or shutdown.
+  size_t FireAll();
+
+  bool HasWatches() const { return count_.load(std::memory_order_acquire) != 0; }
+  size_t WatchCount() const { return count_.load(std::memory_order_acquire); }
+
+private:
+  enum class Change { Created, Deleted, Value };
+  struct WatchEntry {
+    std::wstring folded; // FoldCase(keyPath)
+    bool subtree = false;
+    uint32_t filter = 0;
+    const void* owner = nullptr;
+    Callback fire;
+  };
+
+  void Report(const std::wstring& keyPath, Change change);
+  // Moves the callbacks of entries matching `pred` out of watches_; caller
+  // holds mutex_ and runs them after releasing it.
+  template <typename Pred>
+  std::vector<Callback> TakeLocked(Pred pred);
+  static size_t RunAll(std::vector<Callback>& callbacks);
+
+  mutable std::mutex mutex_;
+  std::vector<WatchEntry> watches_;
+  std::atomic<size_t> count_{0};
+};
+
+}
@@ -0,0 +1,1008 @@
+#include "common/registry_overlay_engine.h"
+
+#include "common/registry_path.h"
+#include "common/registry_stats.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+namespace twinshim {
+namespace {
+
+// Store lock that, under an active RegistryStatsCall, charges the wait to the
+// caller's lock-wait histogram and the hold time to its SQLite histogram.
+// Uncontended acquisitions record a zero wait without reading the clock.
+class TimedStoreLock {
+public:
+  explicit TimedStoreLock(std::mutex& mutex) : lock_(mutex, std::defer_lock), timed_(RegistryStatsActive()) {
+    if (!timed_) {
+      lock_.lock();
+      return;
+    }
+    if (lock_.try_lock()) {
+      RecordRegistryStatsLockWaitNs(0);
+    } else {
+      const uint64_t waitStart = RegistryStatsNowNs();
+      lock_.lock();
+      RecordRegistryStatsLockWaitNs(RegistryStatsNowNs() - waitStart);
+    }
+    heldSince_ = RegistryStatsNowNs();
+  }
+
+  ~TimedStoreLock() {
+    if (timed_) {
+      RecordRegistryStatsSqliteNs(RegistryStatsNowNs() - heldSince_);
+    }
+  }
+
+private:
+  std::unique_lock<std::mutex> lock_;
+  bool timed_ = false;
+  uint64_t heldSince_ = 0;
+};
+
+// Apps read a value twice (a size probe, then the data, plus a retry after
+// ERROR_MORE_DATA), so each thread keeps its last handle-scoped local lookup
+// and serves repeats from memory while the store generation is unchanged.
+// Reuse is capped so a thread polling one value still reaches SQLite, which is
+// what makes other connections' commits visible.
+constexpr uint32_t kLastValueMaxReuses = 3;
+
+struct LastValueSlot {
+  const RegistryOverlayEngine* engine = nullptr;
+  const ResolvedKey* key = nullptr;
+  std::wstring keyPath;
+  std::wstring valueName;
+  uint64_t generation = 0;
+  uint32_t reusesLeft = 0;
+  RegistryOverlayEngine::Value value;
+};
+
+thread_local LastValueSlot t_lastValue;
+
+// Bounds for the overrun fallbacks: past these, writes wait instead of
+// queueing and the last-known map starts over.
+constexpr size_t kMaxPendingWrites = 1024;
+constexpr size_t kMaxLastKnownValues = 4096;
+
+std::wstring LastKnownKey(const std::wstring& keyPath, const std::wstring& valueName) {
+  return FoldCase(keyPath) + L"\n" + FoldCase(valueName);
+}
+
+// Caps the access profile; a title past this is enumerating, not starting up.
+constexpr size_t kMaxProfileEntries = 16384;
+// Prefetched answers never reach SQLite, so they check for other
+// connections' commits this often; that bounds how stale they can get.
+constexpr std::chrono::milliseconds kPrefetchPollInterval(50);
+
+// Whether folded path `a` is `b` or lies under it.
+bool IsSameOrUnder(const std::wstring& a, const std::wstring& b) {
+  return a.size() >= b.size() && a.compare(0, b.size(), b) == 0 && (a.size() == b.size() || a[b.size()] == L'\\');
+}
+
+RegistryOverlayEngine::Value ValueFromStore(std::optional<StoredValue>&& v) {
+  RegistryOverlayEngine::Value out;
+  if (v.has_value() && v->isDeleted) {
+    out.source = RegistryOverlayEngine::Value::Source::Tombstone;
+  } else if (v.has_value()) {
+    out.status = regstatus::kSuccess;
+    out.source = RegistryOverlayEngine::Value::Source::Local;
+    out.type = v->type;
+    out.data = std::move(v->data);
+  }
+  return out;
+}
+
+} // namespace
+
+RegistryOverlayEngine::RegistryOverlayEngine(LocalRegistryStore& store, RealRegistryBackend* backend)
+    : store_(store), backend_(backend) {}
+
+RegistryOverlayEngine::~RegistryOverlayEngine() {
+  FlushPendingWrites();
+}
+
+void RegistryOverlayEngine::SetReadThrough(bool enabled) {
+  readThrough_.store(enabled, std::memory_order_release);
+}
+
+bool RegistryOverlayEngine::ReadThrough() const {
+  return readThrough_.load(std::memory_order_acquire) && backend_ != nullptr;
+}
+
+void RegistryOverlayEngine::SetChangeNotifier(RegistryChangeNotifier* notifier) {
+  TimedStoreLock lock(mutex_);
+  notifier_ = notifier;
+  notifyGeneration_ = 0;
+}
+
+bool RegistryOverlayEngine::CheckExternalChanges() {
+  bool changed = false;
+  {
+    TimedStoreLock lock(mutex_);
+    if (!notifier_) {
+      return false;
+    }
+    store_.PollExternalChanges();
+    const uint64_t generation = store_.ExternalGeneration();
+    // The first check only sets the baseline; commits nobody was watching for
+    // are nobody's business.
+    changed = notifyGeneration_ != 0 && generation != notifyGeneration_ && notifier_->HasWatches();
+    notifyGeneration_ = generation;
+  }
+  return changed && notifier_->FireAll() != 0;
+}
+
+void RegistryOverlayEngine::RefreshLocked(const std::wstring& keyPath, ResolvedKey& cache) {
+  if (cache.generation == 0 || cache.generation != store_.Generation()) {
+    store_.ResolveKey(keyPath, cache);
+  }
+}
+
+void RegistryOverlayEngine::SetStoreBudgets(std::chrono::milliseconds read, std::chrono::milliseconds write) {
+  TimedStoreLock lock(mutex_);
+  readBudget_ = read;
+  writeBudget_ = write;
+  if (readBudget_.count() <= 0) {
+    lastKnown_.clear();
+  }
+}
+
+bool RegistryOverlayEngine::FlushPendingWrites(std::chrono::milliseconds budget) {
+  TimedStoreLock lock(mutex_);
+  return FlushPendingLocked(budget);
+}
+
+size_t RegistryOverlayEngine::PendingWriteCount() {
+  TimedStoreLock lock(mutex_);
+  return pending_.size();
+}
+
+LocalRegistryStore::WarmResult RegistryOverlayEngine::WarmStore(uint64_t maxBytes) {
+  TimedStoreLock lock(mutex_);
+  return store_.Warm(maxBytes);
+}
+
+void RegistryOverlayEngine::StartAccessProfile(std::chrono::steady_clock::time_point until) {
+  TimedStoreLock lock(mutex_);
+  profiling_ = true;
+  profileUntil_ = until;
+  profile_.clear();
+  profileSeen_.clear();
+}
+
+std::vector<AccessProfileEntry> RegistryOverlayEngine::TakeAccessProfile() {
+  TimedStoreLock lock(mutex_);
+  profiling_ = false;
+  profileSeen_.clear();
+  return std::move(profile_);
+}
+
+bool RegistryOverlayEngine::SaveAccessProfile(const std::vector<AccessProfileEntry>& profile) {
+  TimedStoreLock lock(mutex_);
+  return store_.SaveAccessProfile(profile);
+}
+
+std::vector<AccessProfileEntry> RegistryOverlayEngine::LoadAccessProfile() {
+  TimedStoreLock lock(mutex_);
+  return store_.LoadAccessProfile();
+}
+
+size_t RegistryOverlayEngine::Prefetch(const std::vector<AccessProfileEntry>& profile) {
+  struct KeyGroup {
+    std::wstring keyPath;
+    std::vector<std::wstring> names;
+  };
+  std::vector<KeyGroup> groups;
+  std::unordered_map<std::wstring, size_t> groupOf;
+  for (const auto& e : profile) {
+    auto it = groupOf.emplace(FoldCase(e.keyPath), groups.size()).first;
+    if (it->second == groups.size()) {
+      groups.push_back(KeyGroup{e.keyPath, {}});
+    }
+    if (!e.isKey) {
+      groups[it->second].names.push_back(e.valueName);
+    }
+  }
+
+  size_t loaded = 0;
+  for (const auto& g : groups) {
+    TimedStoreLock lock(mutex_);
+    const uint64_t external = store_.ExternalGeneration();
+    if (external != prefetchGeneration_) {
+      prefetchedKeys_.clear();
+      prefetchedValues_.clear();
+      prefetchGeneration_ = external;
+    }
+    // This lock hold reads the store anyway.
+    nextPrefetchPoll_ = std::chrono::steady_clock::now() + kPrefetchPollInterval;
+    ResolvedKey key;
+    if (!store_.ResolveKey(g.keyPath, key)) {
+      continue;
+    }
+    auto values = g.names.empty() ? std::vector<std::optional<StoredValue>>() : store_.GetValues(key, g.names);
+    for (size_t i = 0; i < values.size(); i++) {
+      prefetchedValues_[LastKnownKey(g.keyPath, g.names[i])] = ValueFromStore(std::move(values[i]));
+    }
+    prefetchedKeys_[FoldCase(g.keyPath)] = std::move(key);
+    loaded += 1 + values.size();
+  }
+  TimedStoreLock lock(mutex_);
+  prefetchCounters_.entries += loaded;
+  return loaded;
+}
+
+RegistryOverlayEngine::PrefetchCounters RegistryOverlayEngine::GetPrefetchCounters() {
+  TimedStoreLock lock(mutex_);
+  return prefetchCounters_;
+}
+
+RegistryOverlayEngine::KeyState RegistryOverlayEngine::ProbeKey(const std::wstring& keyPath, ResolvedKey* cache) {
+  KeyState state;
+  TimedStoreLock lock(mutex_);
+  NoteAccessLocked(keyPath, nullptr);
+  if (HasPendingKeyLocked(keyPath)) {
+    state.localExists = true;
+    NoteRegistryStatsLocalLookup(true);
+    return state;
+  }
+  ResolvedKey prefetched;
+  if (PrefetchedKeyLocked(keyPath, prefetched)) {
+    state.deleted = prefetched.deleted;
+    state.localExists = prefetched.localExists;
+    if (cache) {
+      *cache = std::move(prefetched);
+    }
+    NoteRegistryStatsLocalLookup(state.deleted || state.localExists);
+    return state;
+  }
+  // What the cache said before this lookup, for when the store is busy.
+  const bool cacheKnown = cache && cache->generation != 0;
+  const KeyState cached{cacheKnown && cache->deleted, cacheKnown && cache->localExists};
+  bool timedOut = false;
+  {
+    LocalRegistryStore::BusyBudget budget(store_, readBudget_);
+    if (cache) {
+      RefreshLocked(keyPath, *cache);
+      state.deleted = cache->deleted;
+      state.localExists = cache->localExists;
+    } else {
+      state.deleted = store_.IsKeyDeleted(keyPath);
+      if (!state.deleted) {
+        state.localExists = store_.KeyExistsLocally(keyPath);
+      }
+    }
+    timedOut = store_.TimedOut();
+  }
+  if (timedOut) {
+    NoteRegistryStatsBudgetOverrun();
+    if (cache) {
+      cache->generation = 0;
+      cache->deleted = cached.deleted;
+      cache->localExists = cached.localExists;
+    }
+    if (cacheKnown) {
+      // The last resolved state. A key with no local state is left to the
+      // real registry; a tombstone or override keeps hiding it.
+      NoteRegistryStatsLocalLookup(cached.deleted || cached.localExists);
+      return cached;
+    }
+    // Nothing to degrade to: wait like an unbudgeted call.
+    state = KeyState{};
+    state.deleted = store_.IsKeyDeleted(keyPath);
+    if (!state.deleted) {
+      state.localExists = store_.KeyExistsLocally(keyPath);
+    }
+  }
+  NoteRegistryStatsLocalLookup(state.deleted || state.localExists);
+  return state;
+}
+
+RealKeyHandle RegistryOverlayEngine::OpenRealKey(const std::wstring& keyPath, uint32_t viewFlags) {
+  if (!ReadThrough()) {
+    return nullptr;
+  }
+  NoteRegistryStatsReadThrough();
+  return backend_->OpenKey(keyPath, viewFlags);
+}
+
+void RegistryOverlayEngine::CloseRealKey(RealKeyHandle key) {
+  if (key && backend_) {
+    backend_->CloseKey(key);
+  }
+}
+
+RegistryOverlayEngine::Value RegistryOverlayEngine::LookupLocalValue(const std::wstring& keyPath,
+                                                                     const std::wstring& valueName,
+                                                                     ResolvedKey* cache) {
+  Value out;
+  TimedStoreLock lock(mutex_);
+  NoteAccessLocked(keyPath, &valueName);
+  if (FindPendingValueLocked(keyPath, valueName, out)) {
+    NoteRegistryStatsLocalLookup(true);
+    return out;
+  }
+  if (PrefetchedValueLocked(keyPath, valueName, out)) {
+    NoteRegistryStatsLocalLookup(out.source != Value::Source::None);
+    return out;
+  }
+  // A key the cache last saw without local state can't hold a local value.
+  const bool keyHasNoLocalState = cache && cache->generation != 0 && !cache->deleted && !cache->localExists;
+  std::optional<StoredValue> v;
+  bool timedOut = false;
+  {
+    LocalRegistryStore::BusyBudget budget(store_, readBudget_);
+    if (!cache) {
+      v = store_.GetValue(keyPath, valueName);
+    } else {
+      RefreshLocked(keyPath, *cache);
+      LastValueSlot& slot = t_lastValue;
+      // RefreshLocked just stamped cache with the current generation.
+      if (slot.reusesLeft > 0 && slot.engine == this && slot.key == cache && slot.generation == cache->generation &&
+          slot.generation != 0 && slot.keyPath == cache->keyPath && slot.valueName == valueName) {
+        slot.reusesLeft--;
+        NoteRegistryStatsLocalLookup(slot.value.source != Value::Source::None);
+        return slot.value;
+      }
+      v = store_.GetValue(*cache, valueName);
+    }
+    timedOut = store_.TimedOut();
+  }
+  if (timedOut) {
+    NoteRegistryStatsBudgetOverrun();
+    if (cache) {
+      cache->generation = 0;
+    }
+    if (RecallLocked(keyPath, valueName, out)) {
+      return out;
+    }
+    if (keyHasNoLocalState) {
+      // Source::None leaves the answer to the real registry.
+      return out;
+    }
+    // Nothing to degrade to: wait like an unbudgeted call. Answering from the
+    // real registry here could resurrect a value deleted or overridden locally.
+    v = store_.GetValue(keyPath, valueName);
+  }
+  NoteRegistryStatsLocalLookup(v.has_value());
+  if (v.has_value() && v->isDeleted) {
+    out.source = Value::Source::Tombstone;
+  } else if (v.has_value()) {
+    out.status = regstatus::kSuccess;
+    out.source = Value::Source::Local;
+    out.type = v->type;
+    out.data = std::move(v->data);
+  }
+  if (cache && cache->generation != 0) {
+    LastValueSlot& slot = t_lastValue;
+    slot.engine = this;
+    slot.key = cache;
+    slot.keyPath = cache->keyPath;
+    slot.valueName = valueName;
+    slot.generation = cache->generation;
+    slot.reusesLeft = kLastValueMaxReuses;
+    slot.value = out;
+  }
+  RememberLocked(keyPath, valueName, out);
+  return out;
+}
+
+RegistryOverlayEngine::Value RegistryOverlayEngine::ReadValue(const std::wstring& keyPath,
+                                                              const std::wstring& valueName,
+                                                              RealKeyHandle real,
+                                                              ResolvedKey* cache,
+                                                              uint32_t viewFlags) {
+  Value out = LookupLocalValue(keyPath, valueName, cache);
+  if (out.source != Value::Source::None) {
+    return out;
+  }
+
+  if (!ReadThrough()) {
+    return out;
+  }
+
+  NoteRegistryStatsReadThrough();
+  RealKeyHandle opened = nullptr;
+  if (!real) {
+    opened = backend_->OpenKey(keyPath, viewFlags);
+    real = opened;
+  }
+  if (!real) {
+    return out;
+  }
+  uint32_t type = 0;
+  std::vector<uint8_t> data;
+  const long rc = backend_->QueryValue(real, valueName, &type, &data);
+  if (opened) {
+    backend_->CloseKey(opened);
+  }
+  out.status = rc;
+  if (rc == regstatus::kSuccess) {
+    out.source = Value::Source::Real;
+    out.type = type;
+    out.data = std::move(data);
+  }
+  return out;
+}
+
+std::vector<RegistryOverlayEngine::Value> RegistryOverlayEngine::ReadValues(const std::wstring& keyPath,
+                                                                           const std::vector<std::wstring>& names,
+                                                                           RealKeyHandle real,
+                                                                           ResolvedKey* cache,
+                                                                           uint32_t viewFlags) {
+  std::vector<Value> out(names.size());
+  bool anyMiss = false;
+  {
+    TimedStoreLock lock(mutex_);
+    bool allInMemory = true;
+    for (size_t i = 0; i < names.size(); i++) {
+      NoteAccessLocked(keyPath, &names[i]);
+      if (!FindPendingValueLocked(keyPath, names[i], out[i]) && !PrefetchedValueLocked(keyPath, names[i], out[i])) {
+        allInMemory = false;
+      }
+    }
+    if (allInMemory) {
+      for (const Value& v : out) {
+        NoteRegistryStatsLocalLookup(v.source != Value::Source::None);
+        anyMiss = anyMiss || v.source == Value::Source::None;
+      }
+    }
+    std::vector<std::optional<StoredValue>> local;
+    const bool keyHasNoLocalState = cache && cache->generation != 0 && !cache->deleted && !cache->localExists;
+    bool timedOut = false;
+    if (!allInMemory) {
+      out.assign(names.size(), Value{});
+      LocalRegistryStore::BusyBudget budget(store_, readBudget_);
+      if (cache) {
+        RefreshLocked(keyPath, *cache);
+        local = store_.GetValues(*cache, names);
+      } else {
+        local = store_.GetValues(keyPath, names);
+      }
+      timedOut = store_.TimedOut();
+    }
+    if (timedOut) {
+      NoteRegistryStatsBudgetOverrun();
+      if (cache) {
+        cache->generation = 0;
+      }
+      // Degrade only to remembered values, or to the real registry for a key
+      // with no local state; otherwise wait like an unbudgeted call.
+      bool recalled = true;
+      for (size_t i = 0; recalled && i < names.size(); i++) {
+        Value probe;
+        recalled = FindPendingValueLocked(keyPath, names[i], probe) || RecallLocked(keyPath, names[i], probe);
+      }
+      if (keyHasNoLocalState) {
+        local.assign(names.size(), std::nullopt);
+      } else if (!recalled) {
+        local = store_.GetValues(keyPath, names);
+        timedOut = false;
+      }
+    }
+    for (size_t i = 0; !allInMemory && i < out.size(); i++) {
+      if (FindPendingValueLocked(keyPath, names[i], out[i]) ||
+          (timedOut && RecallLocked(keyPath, names[i], out[i]))) {
+        NoteRegistryStatsLocalLookup(out[i].source != Value::Source::None);
+        anyMiss = anyMiss || out[i].source == Value::Source::None;
+        continue;
+      }
+      auto& v = local[i];
+      NoteRegistryStatsLocalLookup(v.has_value());
+      if (!v.has_value()) {
+        anyMiss = true;
+      } else if (v->isDeleted) {
+        out[i].source = Value::Source::Tombstone;
+      } else {
+        out[i].status = regstatus::kSuccess;
+        out[i].source = Value::Source::Local;
+        out[i].type = v->type;
+        out[i].data = std::move(v->data);
+      }
+      if (!timedOut) {
+        RememberLocked(keyPath, names[i], out[i]);
+      }
+    }
+  }
+
+  if (!anyMiss || !ReadThrough()) {
+    return out;
+  }
+
+  NoteRegistryStatsReadThrough();
+  RealKeyHandle opened = nullptr;
+  if (!real) {
+    opened = backend_->OpenKey(keyPath, viewFlags);
+    real = opened;
+  }
+  if (!real) {
+    return out;
+  }
+  for (size_t i = 0; i < out.size(); i++) {
+    if (out[i].source != Value::Source::None) {
+      continue;
+    }
+    uint32_t type = 0;
+    std::vector<uint8_t> data;
+    out[i].status = backend_->QueryValue(real, names[i], &type, &data);
+    if (out[i].status == regstatus::kSuccess) {
+      out[i].source = Value::Source::Real;
+      out[i].type = type;
+      out[i].data = std::move(data);
+    }
+  }
+  if (opened) {
+    backend_->CloseKey(opened);
+  }
+  return out;
+}
+
+bool RegistryOverlayEngine::LoadLocalValueNames(const std::wstring& keyPath, LocalValueNames& out) {
+  TimedStoreLock lock(mutex_);
+  if (store_.IsKeyDeleted(keyPath)) {
+    return false;
+  }
+  for (auto& r : store_.ListValues(keyPath)) {
+    out.shadowFolded.push_back(FoldCase(r.valueName));
+    if (r.isDeleted) {
+      continue;
+    }
+    out.maxLiveDataSize = std::max<uint32_t>(out.maxLiveDataSize, (uint32_t)r.data.size());
+    out.live.push_back(std::move(r.valueName));
+  }
+  return true;
+}
+
+std::vector<std::wstring> RegistryOverlayEngine::MergedValueNames(const std::wstring& keyPath, RealKeyHandle real) {
+  LocalValueNames local;
+  if (!LoadLocalValueNames(keyPath, local)) {
+    return {};
+  }
+
+  std::vector<std::wstring> names = std::move(local.live);
+  if (ReadThrough() && real) {
+    NoteRegistryStatsReadThrough();
+    std::unordered_set<std::wstring> shadow(local.shadowFolded.begin(), local.shadowFolded.end());
+    for (auto& name : backend_->EnumValueNames(real)) {
+      if (shadow.insert(FoldCase(name)).second) {
+        names.push_back(std::move(name));
+      }
+    }
+  }
+
+  std::sort(names.begin(), names.end(), LessNoCase);
+  return names;
+}
+
+std::vector<std::wstring> RegistryOverlayEngine::MergedSubKeyNames(const std::wstring& keyPath, RealKeyHandle real) {
+  std::vector<std::wstring> out;
+  std::unordered_set<std::wstring> shadow;
+  {
+    TimedStoreLock lock(mutex_);
+    if (store_.IsKeyDeleted(keyPath)) {
+      return out;
+    }
+    for (auto& child : store_.ListImmediateSubKeyEntries(keyPath)) {
+      shadow.insert(FoldCase(child.name));
+      if (!child.isDeleted) {
+        out.push_back(std::move(child.name));
+      }
+    }
+  }
+
+  if (ReadThrough() && real) {
+    NoteRegistryStatsReadThrough();
+    for (auto& name : backend_->EnumSubKeyNames(real)) {
+      if (shadow.insert(FoldCase(name)).second) {
+        out.push_back(std::move(name));
+      }
+    }
+  }
+
+  std::sort(out.begin(), out.end(), LessNoCase);
+  return out;
+}
+
+RegistryOverlayEngine::KeyInfo RegistryOverlayEngine::QueryInfo(const std::wstring& keyPath, RealKeyHandle real) {
+  KeyInfo info;
+  const auto subkeys = MergedSubKeyNames(keyPath, real);
+  info.subKeyCount = (uint32_t)subkeys.size();
+  for (const auto& s : subkeys) {
+    info.maxSubKeyLen = std::max<uint32_t>(info.maxSubKeyLen, (uint32_t)s.size());
+  }
+
+  LocalValueNames local;
+  if (!LoadLocalValueNames(keyPath, local)) {
+    return info;
+  }
+  // Max data length only covers local values; sizing real values would cost a
+  // backend query per name and callers re-probe with ERROR_MORE_DATA anyway.
+  info.maxValueLen = local.maxLiveDataSize;
+
+  std::vector<std::wstring> names = std::move(local.live);
+  if (ReadThrough() && real) {
+    NoteRegistryStatsReadThrough();
+    std::unordered_set<std::wstring> shadow(local.shadowFolded.begin(), local.shadowFolded.end());
+    for (auto& name : backend_->EnumValueNames(real)) {
+      if (shadow.insert(FoldCase(name)).second) {
+        names.push_back(std::move(name));
+      }
+    }
+  }
+  info.valueCount = (uint32_t)names.size();
+  for (const auto& s : names) {
+    info.maxValueNameLen = std::max<uint32_t>(info.maxValueNameLen, (uint32_t)s.size());
+  }
+  return info;
+}
+
+bool RegistryOverlayEngine::CreateKey(const std::wstring& keyPath) {
+  bool ok = false;
+  bool created = false;
+  {
+    TimedStoreLock lock(mutex_);
+    // The existence check only matters to watchers; skip it when there are none.
+    created = notifier_ && notifier_->HasWatches() && !HasPendingKeyLocked(keyPath) &&
+              !store_.KeyExistsLocally(keyPath);
+    PendingWrite write;
+    write.kind = PendingWrite::Kind::CreateKey;
+    write.keyPath = keyPath;
+    ok = WriteLocked(std::move(write), nullptr);
+  }
+  if (ok && created) {
+    notifier_->KeyCreated(keyPath);
+  }
+  return ok;
+}
+
+bool RegistryOverlayEngine::SetValue(const std::wstring& keyPath,
+                                     const std::wstring& valueName,
+                                     uint32_t type,
+                                     const void* data,
+                                     uint32_t dataSize,
+                                     ResolvedKey* cache) {
+  bool ok = false;
+  {
+    TimedStoreLock lock(mutex_);
+    PendingWrite write;
+    write.kind = PendingWrite::Kind::SetValue;
+    write.keyPath = keyPath;
+    write.valueName = valueName;
+    write.type = type;
+    if (data && dataSize) {
+      const auto* bytes = static_cast<const uint8_t*>(data);
+      write.data.assign(bytes, bytes + dataSize);
+    }
+    ok = WriteLocked(std::move(write), cache);
+  }
+  if (ok && notifier_) {
+    notifier_->ValueChanged(keyPath);
+  }
+  return ok;
+}
+
+bool RegistryOverlayEngine::DeleteValue(const std::wstring& keyPath, const std::wstring& valueName, ResolvedKey* cache) {
+  bool ok = false;
+  {
+    TimedStoreLock lock(mutex_);
+    PendingWrite write;
+    write.kind = PendingWrite::Kind::DeleteValue;
+    write.keyPath = keyPath;
+    write.valueName = valueName;
+    ok = WriteLocked(std::move(write), cache);
+  }
+  if (ok && notifier_) {
+    notifier_->ValueChanged(keyPath);
+  }
+  return ok;
+}
+
+bool RegistryOverlayEngine::DeleteKeyTree(const std::wstring& keyPath) {
+  bool ok = false;
+  {
+    TimedStoreLock lock(mutex_);
+    // Queued writes may target the subtree; they must land before it goes.
+    FlushPendingLocked(std::chrono::milliseconds(0));
+    lastKnown_.clear();
+    ForgetPrefetchedLocked(keyPath);
+    ok = store_.DeleteKeyTree(keyPath);
+  }
+  if (ok && notifier_) {
+    notifier_->KeyDeleted(keyPath);
+  }
+  return ok;
+}
+
+bool RegistryOverlayEngine::WriteLocked(PendingWrite write, ResolvedKey* cache) {
+  // Earlier queued writes go first; if they can't, this one queues behind them.
+  bool queue = !pending_.empty() && !FlushPendingLocked(writeBudget_);
+  bool ok = false;
+  if (!queue) {
+    LocalRegistryStore::BusyBudget budget(store_, writeBudget_);
+    ok = ApplyLocked(write, cache);
+    queue = store_.TimedOut();
+  }
+  if (queue) {
+    NoteRegistryStatsBudgetOverrun();
+    if (cache) {
+      cache->generation = 0;
+    }
+    if (pending_.size() < kMaxPendingWrites) {
+      pending_.push_back(write);
+      ok = true;
+    } else {
+      // Too far behind to keep queueing: wait for the store after all.
+      FlushPendingLocked(std::chrono::milliseconds(0));
+      ok = ApplyLocked(write, nullptr);
+    }
+  }
+  if (ok && write.kind != PendingWrite::Kind::CreateKey) {
+    RememberLocked(write.keyPath, write.valueName, ValueOf(write));
+  }
+  return ok;
+}
+
+bool RegistryOverlayEngine::ApplyLocked(const PendingWrite& write, ResolvedKey* cache) {
+  ForgetPrefetchedLocked(write.keyPath);
+  if (cache) {
+    RefreshLocked(write.keyPath, *cache);
+  }
+  switch (write.kind) {
+    case PendingWrite::Kind::CreateKey:
+      return store_.PutKey(write.keyPath);
+    case PendingWrite::Kind::SetValue: {
+      // PutValue recreates (undeletes) the key itself, so a write under a
+      // tombstoned key makes it visible again.
+      const void* data = write.data.empty() ? nullptr : write.data.data();
+      const uint32_t size = (uint32_t)write.data.size();
+      const uint64_t elided = store_.ElidedWriteCount();
+      const bool ok = cache ? store_.PutValue(*cache, write.valueName, write.type, data, size)
+                            : store_.PutValue(write.keyPath, write.valueName, write.type, data, size);
+      if (store_.ElidedWriteCount() != elided) {
+        NoteRegistryStatsElidedWrite();
+      }
+      return ok;
+    }
+    case PendingWrite::Kind::DeleteValue:
+      return cache ? store_.DeleteValue(*cache, write.valueName) : store_.DeleteValue(write.keyPath, write.valueName);
+  }
+  return false;
+}
+
+bool RegistryOverlayEngine::FlushPendingLocked(std::chrono::milliseconds budget) {
+  if (pending_.empty()) {
+    return true;
+  }
+  LocalRegistryStore::BusyBudget scope(store_, budget);
+  size_t done = 0;
+  while (done < pending_.size()) {
+    ApplyLocked(pending_[done], nullptr);
+    if (store_.TimedOut()) {
+      break;
+    }
+    done++;
+  }
+  pending_.erase(pending_.begin(), pending_.begin() + (ptrdiff_t)done);
+  return pending_.empty();
+}
+
+RegistryOverlayEngine::Value RegistryOverlayEngine::ValueOf(const PendingWrite& write) {
+  Value v;
+  if (write.kind == PendingWrite::Kind::SetValue) {
+    v.status = regstatus::kSuccess;
+    v.source = Value::Source::Local;
+    v.type = write.type;
+    v.data = write.data;
+  } else {
+    v.source = Value::Source::Tombstone;
+  }
+  return v;
+}
+
+bool RegistryOverlayEngine::FindPendingValueLocked(const std::wstring& keyPath,
+                                                   const std::wstring& valueName,
+                                                   Value& out) const {
+  if (pending_.empty()) {
+    return false;
+  }
+  const std::wstring key = FoldCase(keyPath);
+  const std::wstring name = FoldCase(valueName);
+  for (auto it = pending_.rbegin(); it != pending_.rend(); ++it) {
+    if (it->kind != PendingWrite::Kind::CreateKey && FoldCase(it->keyPath) == key && FoldCase(it->valueName) == name) {
+      out = ValueOf(*it);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool RegistryOverlayEngine::HasPendingKeyLocked(const std::wstring& keyPath) const {
+  if (pending_.empty()) {
+    return false;
+  }
+  const std::wstring key = FoldCase(keyPath);
+  for (const auto& w : pending_) {
+    if (w.kind != PendingWrite::Kind::DeleteValue && FoldCase(w.keyPath) == key) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void RegistryOverlayEngine::RememberLocked(const std::wstring& keyPath, const std::wstring& valueName, const Value& value) {
+  if (readBudget_.count() <= 0) {
+    return;
+  }
+  if (lastKnown_.size() >= kMaxLastKnownValues) {
+    lastKnown_.clear();
+  }
+  lastKnown_[LastKnownKey(keyPath, valueName)] = value;
+}
+
+bool RegistryOverlayEngine::RecallLocked(const std::wstring& keyPath, const std::wstring& valueName, Value& out) const {
+  if (lastKnown_.empty()) {
+    return false;
+  }
+  auto it = lastKnown_.find(LastKnownKey(keyPath, valueName));
+  if (it == lastKnown_.end()) {
+    return false;
+  }
+  out = it->second;
+  return true;
+}
+
+void RegistryOverlayEngine::NoteAccessLocked(const std::wstring& keyPath, const std::wstring* valueName) {
+  if (!profiling_) {
+    return;
+  }
+  if (profile_.size() >= kMaxProfileEntries || std::chrono::steady_clock::now() >= profileUntil_) {
+    profiling_ = false;
+    return;
+  }
+  std::wstring id = FoldCase(keyPath);
+  if (valueName) {
+    id += L'\n';
+    id += FoldCase(*valueName);
+  }
+  if (profileSeen_.insert(std::move(id)).second) {
+    AccessProfileEntry e;
+    e.keyPath = keyPath;
+    e.isKey = valueName == nullptr;
+    if (valueName) {
+      e.valueName = *valueName;
+    }
+    profile_.push_back(std::move(e));
+  }
+}
+
+bool RegistryOverlayEngine::PrefetchValidLocked() {
+  if (prefetchedKeys_.empty() && prefetchedValues_.empty()) {
+    return false;
+  }
+  const auto now = std::chrono::steady_clock::now();
+  if (now >= nextPrefetchPoll_) {
+    store_.PollExternalChanges();
+    nextPrefetchPoll_ = now + kPrefetchPollInterval;
+  }
+  if (store_.ExternalGeneration() != prefetchGeneration_) {
+    prefetchedKeys_.clear();
+    prefetchedValues_.clear();
+    return false;
+  }
+  return true;
+}
+
+bool RegistryOverlayEngine::PrefetchedKeyLocked(const std::wstring& keyPath, ResolvedKey& out) {
+  if (!PrefetchValidLocked()) {
+    return false;
+  }
+  auto it = prefetchedKeys_.find(FoldCase(keyPath));
+  if (it == prefetchedKeys_.end()) {
+    prefetchCounters_.misses++;
+    return false;
+  }
+  prefetchCounters_.hits++;
+  out = it->second;
+  // Still matches the store, whatever this engine wrote since: writes that
+  // could change it dropped it.
+  out.generation = store_.Generation();
+  return true;
+}
+
+bool RegistryOverlayEngine::PrefetchedValueLocked(const std::wstring& keyPath,
+                                                  const std::wstring& valueName,
+                                                  Value& out) {
+  if (!PrefetchValidLocked()) {
+    return false;
+  }
+  auto it = prefetchedValues_.find(LastKnownKey(keyPath, valueName));
+  if (it == prefetchedValues_.end()) {
+    prefetchCounters_.misses++;
+    return false;
+  }
+  prefetchCounters_.hits++;
+  out = it->second;
+  return true;
+}
+
+void RegistryOverlayEngine::ForgetPrefetchedLocked(const std::wstring& keyPath) {
+  if (prefetchedKeys_.empty() && prefetchedValues_.empty()) {
+    return;
+  }
+  // A write can create or undelete the key, which changes what its ancestors
+  // (live children) and descendants (tombstoned ancestor) resolve to.
+  const std::wstring folded = FoldCase(keyPath);
+  for (auto it = prefetchedKeys_.begin(); it != prefetchedKeys_.end();) {
+    if (IsSameOrUnder(folded, it->first) || IsSameOrUnder(it->first, folded)) {
+      it = prefetchedKeys_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (auto it = prefetchedValues_.begin(); it != prefetchedValues_.end();) {
+    if (IsSameOrUnder(it->first.substr(0, it->first.find(L'\n')), folded)) {
+      it = prefetchedValues_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+bool ParseStoreBudgets(const std::wstring& spec, std::chrono::milliseconds& read, std::chrono::milliseconds& write) {
+  auto parse = [](const std::wstring& s, std::chrono::milliseconds& out) {
+    if (s.empty() || s.size() > 7 || s.find_first_not_of(L"0123456789") != std::wstring::npos) {
+      return false;
+    }
+    out = std::chrono::milliseconds(std::stoul(s));
+    return true;
+  };
+  std::chrono::milliseconds r{0};
+  std::chrono::milliseconds w{0};
+  const size_t comma = spec.find(L',');
+  if (comma == std::wstring::npos) {
+    if (!parse(spec, r)) {
+      return false;
+    }
+    w = r;
+  } else if (!parse(spec.substr(0, comma), r) || !parse(spec.substr(comma + 1), w)) {
+    return false;
+  }
+  read = r;
+  write = w;
+  return true;
+}
+
+long PackMultipleValues(const std::vector<RegistryOverlayEngine::Value>& values,
+                        uint8_t* buffer,
+                        uint32_t& size,
+                        std::vector<uint32_t>& offsets) {
+  uint64_t total = 0;
+  for (const auto& v : values) {
+    if (v.status != regstatus::kSuccess) {
+      return v.status;
+    }
+    total += v.data.size();
+  }
+  if (total > UINT32_MAX) {
+    return regstatus::kInvalidParameter;
+  }
+
+  const uint32_t capacity = size;
+  size = (uint32_t)total;
+  if (!buffer || total > capacity) {
+    return regstatus::kMoreData;
+  }
+  offsets.assign(values.size(), 0);
+  uint32_t at = 0;
+  for (size_t i = 0; i < values.size(); i++) {
+    offsets[i] = at;
+    if (!values[i].data.empty()) {
+      std::memcpy(buffer + at, values[i].data.data(), values[i].data.size());
+    }
+    at += (uint32_t)values[i].data.size();
+  }
+  return regstatus::kSuccess;
+}
+
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include "common/local_registry_store.h"
+#include "common/real_registry_backend.h"
+#include "common/registry_change_notifier.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace twinshim {
+
+// Platform-neutral HKLM overlay: the local store is consulted first, local
+// tombstones hide real entries, and (in read-through mode) misses fall back to
+// the real registry through a RealRegistryBackend. The shim's registry hooks
+// are thin adapters over this class; tests and benchmarks drive it natively
+// with InMemoryRealRegistry.
+//
+// All store access is serialized on an internal mutex. Backend calls are made
+// outside that lock so a slow real registry never blocks local lookups.
+//
+// Calls that take a `ResolvedKey* cache` accept the state a hook keeps on an
+// open handle for exactly keyPath. The engine only touches it under its lock,
+// re-resolves it when the store generation moved, and otherwise skips the
+// per-call key resolution; pass null for one-off paths.
+class RegistryOverlayEngine {
+public:
+  RegistryOverlayEngine(LocalRegistryStore& store, RealRegistryBackend* backend);
+  // Commits any queued writes, waiting for the store if it has to.
+  ~RegistryOverlayEngine();
+
+  RegistryOverlayEngine(const RegistryOverlayEngine&) = delete;
+  RegistryOverlayEngine& operator=(const RegistryOverlayEngine&) = delete;
+
+  void SetReadThrough(bool enabled);
+  bool ReadThrough() const;
+  RealRegistryBackend* Backend() const { return backend_; }
+  // For diagnostics (statement counts); callers must not use it concurrently
+  // with the engine.
+  LocalRegistryStore& Store() const { return store_; }
+
+  // Per-call budgets for waiting on another connection's store lock (hklmreg
+  // or a second title holding the write lock); zero, the default, waits up to
+  // the store's busy timeout. A read that runs out of budget is answered from
+  // the last value this engine saw for that name or the key's cached
+  // ResolvedKey; it is left to the real registry (in read-through mode) only
+  // when that cache shows the key has no local state, so local tombstones and
+  // overrides keep hiding it. Otherwise it waits in full. A write that runs out is queued and committed, in order, ahead of
+  // the next write or by FlushPendingWrites; lookups see queued writes, name
+  // enumeration only once they commit. DeleteKeyTree always waits.
+  void SetStoreBudgets(std::chrono::milliseconds read, std::chrono::milliseconds write);
+  // Commits queued writes, waiting at most `budget` (zero: the busy timeout).
+  // Returns true when nothing is left queued.
+  bool FlushPendingWrites(std::chrono::milliseconds budget = std::chrono::milliseconds(0));
+  size_t PendingWriteCount();
+
+  // Reports every write this engine makes (queued ones included, as they are
+  // visible to lookups at once) to `notifier` after the store lock is
+  // released; null, the default, reports nothing. Creating a key that already
+  // existed isn't a change. Set it before the engine takes calls.
+  void SetChangeNotifier(RegistryChangeNotifier* notifier);
+  // Polls the store for commits by other connections. The store can't say
+  // which keys those touched, so if there were any since the last check while
+  // watches were armed, every watch fires. Returns true when it fired some.
+  bool CheckExternalChanges();
+
+  // LocalRegistryStore::Warm under the engine lock, for warming the store
+  // while hooks may already be taking calls.
+  LocalRegistryStore::WarmResult WarmStore(uint64_t maxBytes);
+
+  // Access profiles (LocalRegistryStore::SaveAccessProfile). While recording,
+  // each key probe and value lookup made before `until` is noted once,
+  // case-insensitively, in first-access order. Name enumeration isn't noted.
+  void StartAccessProfile(std::chrono::steady_clock::time_point until);
+  // Stops recording and hands over what was noted.
+  std::vector<AccessProfileEntry> TakeAccessProfile();
+  // LocalRegistryStore's profile table, under the engine lock.
+  bool SaveAccessProfile(const std::vector<AccessProfileEntry>& profile);
+  std::vector<AccessProfileEntry> LoadAccessProfile();
+
+  // Reads every key and value `profile` names into memory, one key per lock
+  // hold so calls arriving meanwhile interleave. Lookups are then answered
+  // from memory, misses included, until another connection changes the
+  // store (noticed within 50 ms); this engine's own writes drop just the
+  // entries they affect.
+  // Returns the number of entries loaded.
+  size_t Prefetch(const std::vector<AccessProfileEntry>& profile);
+  struct PrefetchCounters {
+    uint64_t entries = 0; // keys and values loaded by Prefetch
+    uint64_t hits = 0;    // lookups answered from prefetched entries
+    uint64_t misses = 0;  // lookups prefetched entries didn't cover
+  };
+  PrefetchCounters GetPrefetchCounters();
+
+  struct KeyState {
+    bool deleted = false;     // key or an ancestor is tombstoned locally
+    bool localExists = false; // key row, value, or live child exists locally
+  };
+  KeyState ProbeKey(const std::wstring& keyPath, ResolvedKey* cache = nullptr);
+
+  struct Value {
+    // None: no local opinion; Tombstone: deleted locally (hides real value).
+    enum class Source { None, Tombstone, Local, Real };
+    long status = regstatus::kFileNotFound;
+    Source source = Source::None;
+    uint32_t type = 0;
+    std::vector<uint8_t> data;
+  };
+  // Local store only. Hooks that forward misses to the real API with the
+  // caller's own buffers use this to keep exact Win32 sizing semantics.
+  Value LookupLocalValue(const std::wstring& keyPath, const std::wstring& valueName, ResolvedKey* cache = nullptr);
+
+  // Local value, then (read-through only) the real registry. When `real` is
+  // null the engine opens keyPath through the backend for the duration of the
+  // call, in the registry view `viewFlags` names (KEY_WOW64_32KEY/64KEY, as
+  // the caller opened the key with). A local tombstone always wins over the
+  // real value.
+  Value ReadValue(const std::wstring& keyPath,
+                  const std::wstring& valueName,
+                  RealKeyHandle real,
+                  ResolvedKey* cache = nullptr,
+                  uint32_t viewFlags = 0);
+
+  // ReadValue for several names of one key: one store query for all of them,
+  // then (read-through only) the real registry for the names that missed
+  // locally. result[i] answers names[i].
+  std::vector<Value> ReadValues(const std::wstring& keyPath,
+                                const std::vector<std::wstring>& names,
+                                RealKeyHandle real,
+                                ResolvedKey* cache = nullptr,
+                                uint32_t viewFlags = 0);
+
+  // Merged, case-insensitively sorted names: local live entries plus real
+  // entries not shadowed by a local entry or tombstone.
+  std::vector<std::wstring> MergedValueNames(const std::wstring& keyPath, RealKeyHandle real);
+  std::vector<std::wstring> MergedSubKeyNames(const std::wstring& keyPath, RealKeyHandle real);
+
+  struct KeyInfo {
+    uint32_t subKeyCount = 0;
+    uint32_t maxSubKeyLen = 0;
+    uint32_t valueCount = 0;
+    uint32_t maxValueNameLen = 0;
+    uint32_t maxValueLen = 0;
+  };
+  KeyInfo QueryInfo(const std::wstring& keyPath, RealKeyHandle real);
+
+  bool CreateKey(const std::wstring& keyPath);
+  bool SetValue(const std::wstring& keyPath,
+                const std::wstring& valueName,
+                uint32_t type,
+                const void* data,
+                uint32_t dataSize,
+                ResolvedKey* cache = nullptr);
+  bool DeleteValue(const std::wstring& keyPath, const std::wstring& valueName, ResolvedKey* cache = nullptr);
+  bool DeleteKeyTree(const std::wstring& keyPath);
+
+  // Opens keyPath in the real registry when read-through is enabled; callers
+  // that cache the handle own it and must CloseRealKey it.
+  RealKeyHandle OpenRealKey(const std::wstring& keyPath, uint32_t viewFlags);
+  void CloseRealKey(RealKeyHandle key);
+
+private:
+  struct LocalValueNames {
+    std::vector<std::wstring> live;
+    std::vector<std::wstring> shadowFolded; // live + tombstoned, case-folded
+    uint32_t maxLiveDataSize = 0;
+  };
+  bool LoadLocalValueNames(const std::wstring& keyPath, LocalValueNames& out);
+  // Brings *cache up to date for keyPath; caller holds mutex_.
+  void RefreshLocked(const std::wstring& keyPath, ResolvedKey& cache);
+
+  // A write that ran out of store budget, waiting to be committed.
+  struct PendingWrite {
+    enum class Kind { CreateKey, SetValue, DeleteValue };
+    Kind kind = Kind::CreateKey;
+    std::wstring keyPath;
+    std::wstring valueName;
+    uint32_t type = 0;
+    std::vector<uint8_t> data;
+  };
+  // The rest run with mutex_ held.
+  bool WriteLocked(PendingWrite write, ResolvedKey* cache);
+  bool ApplyLocked(const PendingWrite& write, ResolvedKey* cache);
+  bool FlushPendingLocked(std::chrono::milliseconds budget);
+  static Value ValueOf(const PendingWrite& write);
+  bool FindPendingValueLocked(const std::wstring& keyPath, const std::wstring& valueName, Value& out) const;
+  bool HasPendingKeyLocked(const std::wstring& keyPath) const;
+  void RememberLocked(const std::wstring& keyPath, const std::wstring& valueName, const Value& value);
+  bool RecallLocked(const std::wstring& keyPath, const std::wstring& valueName, Value& out) const;
+  // `valueName` null notes a key probe.
+  void NoteAccessLocked(const std::wstring& keyPath, const std::wstring* valueName);
+  bool PrefetchValidLocked();
+  bool PrefetchedKeyLocked(const std::wstring& keyPath, ResolvedKey& out);
+  bool PrefetchedValueLocked(const std::wstring& keyPath, const std::wstring& valueName, Value& out);
+  // Drops prefetched entries a write to keyPath may have changed.
+  void ForgetPrefetchedLocked(const std::wstring& keyPath);
+
+  LocalRegistryStore& store_;
+  RealRegistryBackend* backend_ = nullptr;
+  RegistryChangeNotifier* notifier_ = nullptr;
+  uint64_t notifyGeneration_ = 0; // ExternalGeneration() at the last CheckExternalChanges
+  std::mutex mutex_;
+  std::atomic<bool> readThrough_{false};
+
+  std::chrono::milliseconds readBudget_{0};
+  std::chrono::milliseconds writeBudget_{0};
+  std::vector<PendingWrite> pending_;
+  // Last value seen per folded "key\nname", kept only while a read budget is
+  // set so an overrun has something to answer with.
+  std::unordered_map<std::wstring, Value> lastKnown_;
+
+  bool profiling_ = false;
+  std::chrono::steady_clock::time_point profileUntil_{};
+  std::vector<AccessProfileEntry> profile_;
+  std::unordered_set<std::wstring> profileSeen_;
+  // Folded key path -> resolved key, and LastKnownKey -> value; both match
+  // the store as of ExternalGeneration() == prefetchGeneration_.
+  std::unordered_map<std::wstring, ResolvedKey> prefetchedKeys_;
+  std::unordered_map<std::wstring, Value> prefetchedValues_;
+  uint64_t prefetchGeneration_ = 0;
+  std::chrono::steady_clock::time_point nextPrefetchPoll_{};
+  PrefetchCounters prefetchCounters_;
+};
+
+// Parses "<read ms>[,<write ms>]" (TWINSHIM_STORE_BUDGET_MS, the wrapper's
+// --store-budget); a single number applies to both. False on malformed input.
+bool ParseStoreBudgets(const std::wstring& spec, std::chrono::milliseconds& read, std::chrono::milliseconds& write);
+
+// RegQueryMultipleValues packing: values[i] lands at buffer + offsets[i], back
+// to back. `size` is the capacity on entry and the required total on return;
+// nothing is written unless everything fits (kMoreData otherwise, also for a
+// null buffer). A value that didn't read successfully fails the whole call with
+// its status and leaves `size` untouched.
+long PackMultipleValues(const std::vector<RegistryOverlayEngine::Value>& values,
+                        uint8_t* buffer,
+                        uint32_t& size,
+                        std::vector<uint32_t>& offsets);
+
+}
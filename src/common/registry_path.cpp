@@ -0,0 +1,69 @@
+#include "common/registry_path.h"
+
+#include <cwctype>
+
+namespace twinshim {
+
+std::wstring FoldCase(const std::wstring& s) {
+  std::wstring out;
+  out.resize(s.size());
+  for (size_t i = 0; i < s.size(); i++) {
+    out[i] = (wchar_t)towlower(s[i]);
+  }
+  return out;
+}
+
+bool LessNoCase(const std::wstring& a, const std::wstring& b) {
+  const size_t n = a.size() < b.size() ? a.size() : b.size();
+  for (size_t i = 0; i < n; i++) {
+    const wchar_t ca = (wchar_t)towlower(a[i]);
+    const wchar_t cb = (wchar_t)towlower(b[i]);
+    if (ca != cb) {
+      return ca < cb;
+    }
+  }
+  return a.size() < b.size();
+}
+
+bool EqualsNoCase(const std::wstring& a, const std::wstring& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if ((wchar_t)towlower(a[i]) != (wchar_t)towlower(b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::wstring CanonicalizeSubKey(const std::wstring& s) {
+  std::wstring out = s;
+  while (!out.empty() && (out.front() == L'\\' || out.front() == L'/')) {
+    out.erase(out.begin());
+  }
+  while (!out.empty() && (out.back() == L'\\' || out.back() == L'/')) {
+    out.pop_back();
+  }
+  for (auto& ch : out) {
+    if (ch == L'/') {
+      ch = L'\\';
+    }
+  }
+  return out;
+}
+
+std::wstring JoinKeyPath(const std::wstring& base, const std::wstring& sub) {
+  if (sub.empty()) {
+    return base;
+  }
+  if (base.empty()) {
+    return sub;
+  }
+  if (base.back() == L'\\') {
+    return base + sub;
+  }
+  return base + L"\\" + sub;
+}
+
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+namespace twinshim {
+
+// Registry key paths and value names compare case-insensitively. These helpers
+// give the portable layers (overlay engine, pools, filters) one folding rule
+// that matches the store's COLLATE NOCASE lookups for the ASCII range.
+std::wstring FoldCase(const std::wstring& s);
+bool LessNoCase(const std::wstring& a, const std::wstring& b);
+bool EqualsNoCase(const std::wstring& a, const std::wstring& b);
+
+// Strips leading/trailing separators and turns '/' into '\', the way the
+// hooks normalize a caller's lpSubKey before joining it to a handle's path.
+std::wstring CanonicalizeSubKey(const std::wstring& s);
+std::wstring JoinKeyPath(const std::wstring& base, const std::wstring& sub);
+
+}
@@ -0,0 +1,427 @@
+#include "common/registry_stats.h"
+
+#include "common/utf8.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <new>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace twinshim {
+namespace {
+
+thread_local RegistryApiStats* t_currentStats = nullptr;
+thread_local const RegistryStatsBlock* t_shardBlock = nullptr;
+thread_local uint32_t t_shardIndex = 0;
+
+RegistryStatsShard& ShardForThisThread(RegistryStatsBlock* block) {
+  if (t_shardBlock != block) {
+    t_shardIndex = block->nextShard.fetch_add(1, std::memory_order_relaxed) % kRegistryStatsShardCount;
+    t_shardBlock = block;
+  }
+  return block->shards[t_shardIndex];
+}
+
+void AddHistogram(LatencySnapshot& out, const LatencyHistogram& in) {
+  for (size_t i = 0; i < kLatencyBucketCount; i++) {
+    out.buckets[i] += in.buckets[i].load(std::memory_order_relaxed);
+  }
+  out.totalNs += in.totalNs.load(std::memory_order_relaxed);
+}
+
+LatencySnapshot DiffHistogram(const LatencySnapshot& now, const LatencySnapshot& before) {
+  LatencySnapshot out;
+  for (size_t i = 0; i < kLatencyBucketCount; i++) {
+    out.buckets[i] = now.buckets[i] - before.buckets[i];
+  }
+  out.totalNs = now.totalNs - before.totalNs;
+  return out;
+}
+
+std::wstring FormatNs(uint64_t ns) {
+  wchar_t buf[32]{};
+  if (ns < 1000) {
+    std::swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"%lluns", (unsigned long long)ns);
+  } else if (ns < 1000000) {
+    std::swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"%.1fus", ns / 1e3);
+  } else {
+    std::swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"%.1fms", ns / 1e6);
+  }
+  return buf;
+}
+
+std::wstring PadLeft(const std::wstring& s, size_t width) {
+  return s.size() >= width ? s : std::wstring(width - s.size(), L' ') + s;
+}
+
+std::wstring PadRight(const std::wstring& s, size_t width) {
+  return s.size() >= width ? s : s + std::wstring(width - s.size(), L' ');
+}
+
+bool IsProcessAlive(uint32_t pid) {
+#if defined(_WIN32)
+  HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, pid);
+  if (!process) {
+    return false;
+  }
+  const bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+  CloseHandle(process);
+  return alive;
+#else
+  return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+#endif
+}
+
+} // namespace
+
+void InitializeRegistryStatsBlock(RegistryStatsBlock* block, uint32_t pid) {
+  if (!block) {
+    return;
+  }
+  new (block) RegistryStatsBlock();
+  block->version = kRegistryStatsVersion;
+  block->apiCount = (uint32_t)kRegistryApiCount;
+  block->shardCount = (uint32_t)kRegistryStatsShardCount;
+  block->bucketCount = (uint32_t)kLatencyBucketCount;
+  block->pid = pid;
+  block->magic.store(kRegistryStatsMagic, std::memory_order_release);
+}
+
+bool IsRegistryStatsBlockValid(const RegistryStatsBlock* block) {
+  return block && block->magic.load(std::memory_order_acquire) == kRegistryStatsMagic &&
+         block->version == kRegistryStatsVersion && block->apiCount == kRegistryApiCount &&
+         block->shardCount == kRegistryStatsShardCount && block->bucketCount == kLatencyBucketCount;
+}
+
+RegistryStatsCall::RegistryStatsCall(RegistryStatsBlock* block, RegistryApi api) {
+  if (!block || t_currentStats) {
+    return;
+  }
+  stats_ = &ShardForThisThread(block).apis[static_cast<size_t>(api)];
+  stats_->calls.fetch_add(1, std::memory_order_relaxed);
+  t_currentStats = stats_;
+  startNs_ = RegistryStatsNowNs();
+}
+
+RegistryStatsCall::~RegistryStatsCall() {
+  if (!stats_) {
+    return;
+  }
+  stats_->latency.Record(RegistryStatsNowNs() - startNs_);
+  t_currentStats = nullptr;
+}
+
+bool RegistryStatsActive() {
+  return t_currentStats != nullptr;
+}
+
+uint64_t RegistryStatsNowNs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void NoteRegistryStatsLocalLookup(bool hit) {
+  if (auto* stats = t_currentStats) {
+    (hit ? stats->localHits : stats->localMisses).fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void NoteRegistryStatsReadThrough() {
+  if (auto* stats = t_currentStats) {
+    stats->readThroughs.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void NoteRegistryStatsBudgetOverrun() {
+  if (auto* stats = t_currentStats) {
+    stats->budgetOverruns.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void NoteRegistryStatsElidedWrite() {
+  if (auto* stats = t_currentStats) {
+    stats->elidedWrites.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void RecordRegistryStatsSqliteNs(uint64_t ns) {
+  if (auto* stats = t_currentStats) {
+    stats->sqlite.Record(ns);
+  }
+}
+
+void RecordRegistryStatsLockWaitNs(uint64_t ns) {
+  if (auto* stats = t_currentStats) {
+    stats->lockWait.Record(ns);
+  }
+}
+
+uint64_t LatencySnapshot::Count() const {
+  uint64_t n = 0;
+  for (uint64_t b : buckets) {
+    n += b;
+  }
+  return n;
+}
+
+uint64_t LatencySnapshot::PercentileNs(double p) const {
+  const uint64_t count = Count();
+  if (count == 0) {
+    return 0;
+  }
+  // Rank of the sample at the p-th percentile, 1-based and rounded up.
+  uint64_t rank = (uint64_t)((p / 100.0) * (double)count);
+  if ((double)rank < (p / 100.0) * (double)count) {
+    rank++;
+  }
+  rank = std::max<uint64_t>(1, std::min(rank, count));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kLatencyBucketCount; i++) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      return LatencyBucketUpperNs(i);
+    }
+  }
+  return LatencyBucketUpperNs(kLatencyBucketCount - 1);
+}
+
+RegistryStatsSnapshot SnapshotRegistryStats(const RegistryStatsBlock& block) {
+  RegistryStatsSnapshot out;
+  for (const auto& shard : block.shards) {
+    for (size_t i = 0; i < kRegistryApiCount; i++) {
+      const RegistryApiStats& in = shard.apis[i];
+      RegistryApiStatsSnapshot& api = out.apis[i];
+      api.calls += in.calls.load(std::memory_order_relaxed);
+      api.localHits += in.localHits.load(std::memory_order_relaxed);
+      api.localMisses += in.localMisses.load(std::memory_order_relaxed);
+      api.readThroughs += in.readThroughs.load(std::memory_order_relaxed);
+      api.budgetOverruns += in.budgetOverruns.load(std::memory_order_relaxed);
+      api.elidedWrites += in.elidedWrites.load(std::memory_order_relaxed);
+      AddHistogram(api.latency, in.latency);
+      AddHistogram(api.sqlite, in.sqlite);
+      AddHistogram(api.lockWait, in.lockWait);
+    }
+  }
+  return out;
+}
+
+RegistryStatsSnapshot DiffRegistryStats(const RegistryStatsSnapshot& now, const RegistryStatsSnapshot& before) {
+  RegistryStatsSnapshot out;
+  for (size_t i = 0; i < kRegistryApiCount; i++) {
+    const auto& a = now.apis[i];
+    const auto& b = before.apis[i];
+    auto& d = out.apis[i];
+    d.calls = a.calls - b.calls;
+    d.localHits = a.localHits - b.localHits;
+    d.localMisses = a.localMisses - b.localMisses;
+    d.readThroughs = a.readThroughs - b.readThroughs;
+    d.budgetOverruns = a.budgetOverruns - b.budgetOverruns;
+    d.elidedWrites = a.elidedWrites - b.elidedWrites;
+    d.latency = DiffHistogram(a.latency, b.latency);
+    d.sqlite = DiffHistogram(a.sqlite, b.sqlite);
+    d.lockWait = DiffHistogram(a.lockWait, b.lockWait);
+  }
+  return out;
+}
+
+std::wstring FormatRegistryStatsTable(const RegistryStatsSnapshot& totals,
+                                      const RegistryStatsSnapshot* interval,
+                                      double intervalSeconds) {
+  std::vector<size_t> rows;
+  for (size_t i = 0; i < kRegistryApiCount; i++) {
+    if (totals.apis[i].calls) {
+      rows.push_back(i);
+    }
+  }
+  std::stable_sort(rows.begin(), rows.end(), [&](size_t a, size_t b) {
+    return totals.apis[a].latency.totalNs > totals.apis[b].latency.totalNs;
+  });
+
+  std::wstring out;
+  out += PadRight(L"API", 18) + PadLeft(L"calls", 10);
+  if (interval) {
+    out += PadLeft(L"calls/s", 10);
+  }
+  out += PadLeft(L"hit", 9) + PadLeft(L"miss", 9) + PadLeft(L"real", 9) + PadLeft(L"overrun", 9) + PadLeft(L"elided", 9) + PadLeft(L"p50", 9) + PadLeft(L"p99", 9) +
+         PadLeft(L"total", 10) + PadLeft(L"sqlite", 10) + PadLeft(L"lockwait", 10) + L"\n";
+
+  for (size_t i : rows) {
+    const auto& api = totals.apis[i];
+    out += PadRight(GetRegistryApiInfo(static_cast<RegistryApi>(i)).name, 18);
+    out += PadLeft(std::to_wstring(api.calls), 10);
+    if (interval) {
+      const double rate = intervalSeconds > 0 ? (double)interval->apis[i].calls / intervalSeconds : 0.0;
+      wchar_t buf[32]{};
+      std::swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"%.1f", rate);
+      out += PadLeft(buf, 10);
+    }
+    out += PadLeft(std::to_wstring(api.localHits), 9);
+    out += PadLeft(std::to_wstring(api.localMisses), 9);
+    out += PadLeft(std::to_wstring(api.readThroughs), 9);
+    out += PadLeft(std::to_wstring(api.budgetOverruns), 9);
+    out += PadLeft(std::to_wstring(api.elidedWrites), 9);
+    out += PadLeft(FormatNs(api.latency.PercentileNs(50)), 9);
+    out += PadLeft(FormatNs(api.latency.PercentileNs(99)), 9);
+    out += PadLeft(FormatNs(api.latency.totalNs), 10);
+    out += PadLeft(FormatNs(api.sqlite.totalNs), 10);
+    out += PadLeft(FormatNs(api.lockWait.totalNs), 10);
+    out += L"\n";
+  }
+  if (rows.empty()) {
+    out += L"(no registry calls yet)\n";
+  }
+  return out;
+}
+
+RegistryStatsMapping::~RegistryStatsMapping() {
+  Close();
+}
+
+std::wstring RegistryStatsMapping::NameForProcess(uint32_t pid) {
+#if defined(_WIN32)
+  return L"Local\\TwinShimStats." + std::to_wstring(pid);
+#else
+  return L"/twinshim-stats." + std::to_wstring(pid);
+#endif
+}
+
+bool RegistryStatsMapping::Create(uint32_t pid) {
+  Close();
+  const std::wstring name = NameForProcess(pid);
+#if defined(_WIN32)
+  HANDLE mapping = CreateFileMappingW(
+      INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)sizeof(RegistryStatsBlock), name.c_str());
+  if (!mapping) {
+    return false;
+  }
+  void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(RegistryStatsBlock));
+  if (!view) {
+    CloseHandle(mapping);
+    return false;
+  }
+  handle_ = mapping;
+#else
+  const std::string nameUtf8 = WideToUtf8(name);
+  int fd = shm_open(nameUtf8.c_str(), O_CREAT | O_RDWR, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  if (ftruncate(fd, (off_t)sizeof(RegistryStatsBlock)) != 0) {
+    close(fd);
+    shm_unlink(nameUtf8.c_str());
+    return false;
+  }
+  void* view = mmap(nullptr, sizeof(RegistryStatsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED) {
+    shm_unlink(nameUtf8.c_str());
+    return false;
+  }
+#endif
+  block_ = static_cast<RegistryStatsBlock*>(view);
+  owner_ = true;
+  pid_ = pid;
+  InitializeRegistryStatsBlock(block_, pid);
+  return true;
+}
+
+bool RegistryStatsMapping::Open(uint32_t pid) {
+  Close();
+  const std::wstring name = NameForProcess(pid);
+#if defined(_WIN32)
+  HANDLE mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, name.c_str());
+  if (!mapping) {
+    return false;
+  }
+  void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(RegistryStatsBlock));
+  if (!view) {
+    CloseHandle(mapping);
+    return false;
+  }
+  handle_ = mapping;
+#else
+  int fd = shm_open(WideToUtf8(name).c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  void* view = mmap(nullptr, sizeof(RegistryStatsBlock), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED) {
+    return false;
+  }
+#endif
+  block_ = static_cast<RegistryStatsBlock*>(view);
+  pid_ = pid;
+  if (!IsRegistryStatsBlockValid(block_)) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void RegistryStatsMapping::Close() {
+  if (!block_) {
+    return;
+  }
+#if defined(_WIN32)
+  UnmapViewOfFile(block_);
+  CloseHandle(static_cast<HANDLE>(handle_));
+#else
+  munmap(block_, sizeof(RegistryStatsBlock));
+  if (owner_) {
+    shm_unlink(WideToUtf8(NameForProcess(pid_)).c_str());
+  }
+#endif
+  block_ = nullptr;
+  handle_ = nullptr;
+  owner_ = false;
+  pid_ = 0;
+}
+
+int RunRegistryStatsViewer(uint32_t pid, const RegistryStatsViewerOptions& options, std::wostream& out) {
+  RegistryStatsMapping mapping;
+  if (!mapping.Open(pid)) {
+    out << L"No TwinShim stats for process " << pid << L" (not running under the shim?)\n";
+    return 1;
+  }
+
+  RegistryStatsSnapshot previous = SnapshotRegistryStats(*mapping.Block());
+  uint64_t previousNs = RegistryStatsNowNs();
+  for (uint32_t n = 0; options.iterations == 0 || n < options.iterations; n++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.intervalMs));
+    const RegistryStatsSnapshot current = SnapshotRegistryStats(*mapping.Block());
+    const uint64_t nowNs = RegistryStatsNowNs();
+    const RegistryStatsSnapshot delta = DiffRegistryStats(current, previous);
+
+    if (options.clearScreen) {
+      out << L"\x1b[H\x1b[2J";
+    }
+    out << L"TwinShim registry stats: pid " << pid << L"\n\n"
+        << FormatRegistryStatsTable(current, &delta, (double)(nowNs - previousNs) / 1e9);
+    out.flush();
+
+    previous = current;
+    previousNs = nowNs;
+    if (!IsProcessAlive(pid)) {
+      out << L"\nProcess " << pid << L" exited.\n";
+      break;
+    }
+  }
+  return 0;
+}
+
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "common/registry_api_table.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+namespace twinshim {
+
+// Always-on per-API registry instrumentation, published by the shim in a named
+// shared-memory block so an external viewer can sample a running title.
+//
+// Writers never take a lock: each thread is pinned to one of a fixed number of
+// shards and bumps relaxed atomics there. Readers sum the shards, so totals are
+// eventually consistent but never torn. The layout only uses fixed-width types
+// and is shared between 32-bit shims and 64-bit viewers; bump the version when
+// it changes.
+
+constexpr uint32_t kRegistryStatsMagic = 0x54535754; // 'TWST'
+constexpr uint32_t kRegistryStatsVersion = 3;
+constexpr size_t kRegistryStatsShardCount = 16;
+
+// Log2 latency buckets in nanoseconds: bucket 0 holds [0, 2), bucket i holds
+// [2^i, 2^(i+1)) and the last bucket absorbs everything from ~1s up.
+constexpr size_t kLatencyBucketCount = 31;
+
+constexpr size_t LatencyBucketIndex(uint64_t ns) {
+  size_t index = 0;
+  while (ns > 1 && index + 1 < kLatencyBucketCount) {
+    ns >>= 1;
+    index++;
+  }
+  return index;
+}
+
+// Exclusive upper bound of a bucket in nanoseconds (what percentiles report).
+constexpr uint64_t LatencyBucketUpperNs(size_t index) {
+  return uint64_t(1) << (index + 1);
+}
+
+struct LatencyHistogram {
+  std::atomic<uint64_t> buckets[kLatencyBucketCount];
+  std::atomic<uint64_t> totalNs;
+
+  void Record(uint64_t ns) {
+    buckets[LatencyBucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    totalNs.fetch_add(ns, std::memory_order_relaxed);
+  }
+};
+
+struct RegistryApiStats {
+  std::atomic<uint64_t> calls;
+  std::atomic<uint64_t> localHits;    // the local store had an opinion (value or tombstone)
+  std::atomic<uint64_t> localMisses;  // the local store had nothing for the lookup
+  std::atomic<uint64_t> readThroughs; // the call fell back to the real registry
+  std::atomic<uint64_t> budgetOverruns; // a store wait hit its latency budget
+  std::atomic<uint64_t> elidedWrites; // a write matched the stored value and was skipped
+  LatencyHistogram latency;           // whole hooked call
+  LatencyHistogram sqlite;            // time holding the store (SQLite work)
+  LatencyHistogram lockWait;          // time waiting for the store lock
+};
+
+struct RegistryStatsShard {
+  RegistryApiStats apis[kRegistryApiCount];
+};
+
+struct RegistryStatsBlock {
+  std::atomic<uint32_t> magic; // written last; zero until the block is usable
+  uint32_t version;
+  uint32_t apiCount;
+  uint32_t shardCount;
+  uint32_t bucketCount;
+  uint32_t pid;
+  std::atomic<uint32_t> nextShard;
+  uint32_t reserved;
+  RegistryStatsShard shards[kRegistryStatsShardCount];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "stats counters live in shared memory");
+static_assert(offsetof(RegistryStatsBlock, shards) % 8 == 0, "shards must be 8-byte aligned on every ABI");
+
+// Prepares freshly mapped (zeroed) memory and publishes the magic last.
+void InitializeRegistryStatsBlock(RegistryStatsBlock* block, uint32_t pid);
+
+// True once the block was initialized by a writer with a matching layout.
+bool IsRegistryStatsBlockValid(const RegistryStatsBlock* block);
+
+// Times one hooked call and attributes the store work done under it. Only the
+// outermost scope on a thread is active, so internal dispatch (RegOpenKeyW ->
+// RegOpenKeyExW) is charged to the API the application actually called. A null
+// block makes the scope a no-op.
+class RegistryStatsCall {
+public:
+  RegistryStatsCall(RegistryStatsBlock* block, RegistryApi api);
+  ~RegistryStatsCall();
+
+  RegistryStatsCall(const RegistryStatsCall&) = delete;
+  RegistryStatsCall& operator=(const RegistryStatsCall&) = delete;
+
+private:
+  RegistryApiStats* stats_ = nullptr;
+  uint64_t startNs_ = 0;
+};
+
+// Attribution helpers for code running under an active RegistryStatsCall on
+// the same thread; they do nothing otherwise.
+bool RegistryStatsActive();
+uint64_t RegistryStatsNowNs();
+void NoteRegistryStatsLocalLookup(bool hit);
+void NoteRegistryStatsReadThrough();
+void NoteRegistryStatsBudgetOverrun();
+void NoteRegistryStatsElidedWrite();
+void RecordRegistryStatsSqliteNs(uint64_t ns);
+void RecordRegistryStatsLockWaitNs(uint64_t ns);
+
+// Viewer side: plain copies of the shard sums.
+struct LatencySnapshot {
+  std::array<uint64_t, kLatencyBucketCount> buckets{};
+  uint64_t totalNs = 0;
+
+  uint64_t Count() const;
+  // Upper bound of the bucket containing the p-th percentile (0 < p <= 100);
+  // 0 when there are no samples.
+  uint64_t PercentileNs(double p) const;
+};
+
+struct RegistryApiStatsSnapshot {
+  uint64_t calls = 0;
+  uint64_t localHits = 0;
+  uint64_t localMisses = 0;
+  uint64_t readThroughs = 0;
+  uint64_t budgetOverruns = 0;
+  uint64_t elidedWrites = 0;
+  LatencySnapshot latency;
+  LatencySnapshot sqlite;
+  LatencySnapshot lockWait;
+};
+
+struct RegistryStatsSnapshot {
+  std::array<RegistryApiStatsSnapshot, kRegistryApiCount> apis{};
+};
+
+RegistryStatsSnapshot SnapshotRegistryStats(const RegistryStatsBlock& block);
+
+// Per-field `now - before`, for rates over a sampling interval.
+RegistryStatsSnapshot DiffRegistryStats(const RegistryStatsSnapshot& now, const RegistryStatsSnapshot& before);
+
+// One row per API with calls, sorted by total latency; `interval` (may be
+// null) adds a calls/s column computed over intervalSeconds.
+std::wstring FormatRegistryStatsTable(const RegistryStatsSnapshot& totals,
+                                      const RegistryStatsSnapshot* interval,
+                                      double intervalSeconds);
+
+// Named mapping holding a RegistryStatsBlock for one process.
+class RegistryStatsMapping {
+public:
+  RegistryStatsMapping() = default;
+  ~RegistryStatsMapping();
+
+  RegistryStatsMapping(const RegistryStatsMapping&) = delete;
+  RegistryStatsMapping& operator=(const RegistryStatsMapping&) = delete;
+
+  // "Local\TwinShimStats.<pid>" on Windows, "/twinshim-stats.<pid>" elsewhere.
+  static std::wstring NameForProcess(uint32_t pid);
+
+  // Publisher: creates (or reuses) the mapping and initializes the block.
+  bool Create(uint32_t pid);
+  // Viewer: maps an existing block read-only and validates its layout.
+  bool Open(uint32_t pid);
+  void Close();
+
+  RegistryStatsBlock* Block() const { return block_; }
+
+private:
+  RegistryStatsBlock* block_ = nullptr;
+  void* handle_ = nullptr;
+  bool owner_ = false;
+  uint32_t pid_ = 0;
+};
+
+struct RegistryStatsViewerOptions {
+  uint32_t intervalMs = 1000;
+  uint32_t iterations = 0; // 0: until the target exits
+  bool clearScreen = true;
+};
+
+// `top`-like loop shared by `twinshim_cli --stats` and `hklmreg stats-live`.
+// Returns a process exit code.
+int RunRegistryStatsViewer(uint32_t pid, const RegistryStatsViewerOptions& options, std::wostream& out);
+
+}
@@ -0,0 +1,525 @@
+#include "common/registry_workload.h"
+
+#include "common/registry_overlay_engine.h"
+#include "common/registry_path.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+#include <unordered_map>
+
+namespace twinshim {
+namespace {
+
+constexpr uint8_t kTagString = 1;
+constexpr uint8_t kTagOp = 2;
+constexpr size_t kFlushThreshold = 64 * 1024;
+
+uint64_t SteadyNowNs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void PutU8(std::vector<uint8_t>& out, uint8_t v) {
+  out.push_back(v);
+}
+
+void PutU16(std::vector<uint8_t>& out, uint16_t v) {
+  out.push_back(uint8_t(v));
+  out.push_back(uint8_t(v >> 8));
+}
+
+void PutU32(std::vector<uint8_t>& out, uint32_t v) {
+  for (int i = 0; i < 4; i++) {
+    out.push_back(uint8_t(v >> (8 * i)));
+  }
+}
+
+void PutU64(std::vector<uint8_t>& out, uint64_t v) {
+  for (int i = 0; i < 8; i++) {
+    out.push_back(uint8_t(v >> (8 * i)));
+  }
+}
+
+// wchar_t is UTF-16 on Windows and UTF-32 elsewhere; the log is always UTF-16.
+std::vector<uint16_t> ToUtf16Units(const std::wstring& s) {
+  std::vector<uint16_t> units;
+  units.reserve(s.size());
+  for (wchar_t ch : s) {
+    const uint32_t cp = (uint32_t)ch;
+    if (cp > 0xFFFF && cp <= 0x10FFFF) {
+      units.push_back(uint16_t(0xD800 + ((cp - 0x10000) >> 10)));
+      units.push_back(uint16_t(0xDC00 + ((cp - 0x10000) & 0x3FF)));
+    } else {
+      units.push_back(uint16_t(cp));
+    }
+  }
+  return units;
+}
+
+std::wstring FromUtf16Units(const std::vector<uint16_t>& units) {
+  std::wstring out;
+  out.reserve(units.size());
+  for (size_t i = 0; i < units.size(); i++) {
+    const uint16_t u = units[i];
+    if (sizeof(wchar_t) == 4 && u >= 0xD800 && u < 0xDC00 && i + 1 < units.size() && units[i + 1] >= 0xDC00 &&
+        units[i + 1] < 0xE000) {
+      const uint32_t cp = 0x10000 + ((uint32_t(u) - 0xD800) << 10) + (uint32_t(units[i + 1]) - 0xDC00);
+      out.push_back((wchar_t)cp);
+      i++;
+    } else {
+      out.push_back((wchar_t)u);
+    }
+  }
+  return out;
+}
+
+class ByteReader {
+public:
+  explicit ByteReader(const std::vector<uint8_t>& bytes) : bytes_(bytes) {}
+
+  bool AtEnd() const { return pos_ >= bytes_.size(); }
+
+  bool U8(uint8_t& v) {
+    if (pos_ + 1 > bytes_.size()) return false;
+    v = bytes_[pos_++];
+    return true;
+  }
+
+  bool U16(uint16_t& v) {
+    if (pos_ + 2 > bytes_.size()) return false;
+    v = uint16_t(bytes_[pos_] | (bytes_[pos_ + 1] << 8));
+    pos_ += 2;
+    return true;
+  }
+
+  bool U32(uint32_t& v) {
+    if (pos_ + 4 > bytes_.size()) return false;
+    v = 0;
+    for (int i = 0; i < 4; i++) {
+      v |= uint32_t(bytes_[pos_ + i]) << (8 * i);
+    }
+    pos_ += 4;
+    return true;
+  }
+
+  bool U64(uint64_t& v) {
+    if (pos_ + 8 > bytes_.size()) return false;
+    v = 0;
+    for (int i = 0; i < 8; i++) {
+      v |= uint64_t(bytes_[pos_ + i]) << (8 * i);
+    }
+    pos_ += 8;
+    return true;
+  }
+
+private:
+  const std::vector<uint8_t>& bytes_;
+  size_t pos_ = 0;
+};
+
+uint64_t PercentileOfSorted(const std::vector<uint64_t>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t rank = (size_t)((p / 100.0) * (double)sorted.size() + 0.999999);
+  rank = std::max<size_t>(1, std::min(rank, sorted.size()));
+  return sorted[rank - 1];
+}
+
+bool IsReadApi(RegistryApi api) {
+  switch (api) {
+    case RegistryApi::RegQueryValueExW:
+    case RegistryApi::RegQueryValueExA:
+    case RegistryApi::RegGetValueW:
+    case RegistryApi::RegGetValueA:
+    case RegistryApi::RegQueryValueW:
+    case RegistryApi::RegQueryValueA:
+    case RegistryApi::RegQueryMultipleValuesW:
+    case RegistryApi::RegQueryMultipleValuesA:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool IsOpenApi(RegistryApi api) {
+  return api == RegistryApi::RegOpenKeyExW || api == RegistryApi::RegOpenKeyExA || api == RegistryApi::RegOpenKeyW ||
+         api == RegistryApi::RegOpenKeyA;
+}
+
+// True when `record` repeats the previous read instead of starting a new
+// logical one: the size probe / ERROR_MORE_DATA retry pattern.
+bool ContinuesRead(const RegistryWorkloadRecord* prev, const RegistryWorkloadRecord& record) {
+  if (!prev || !IsReadApi(prev->op.api)) {
+    return false;
+  }
+  const bool prevReturnedData = (prev->op.flags & kWorkloadHasBuffer) && prev->op.status == 0;
+  return !prevReturnedData && prev->keyPath == record.keyPath && prev->subKey == record.subKey &&
+         prev->valueName == record.valueName;
+}
+
+// RegQueryMultipleValues records carry their names NUL-separated.
+std::vector<std::wstring> SplitValueNames(const std::wstring& joined) {
+  std::vector<std::wstring> names;
+  size_t start = 0;
+  for (;;) {
+    const size_t end = joined.find(L'\0', start);
+    names.push_back(joined.substr(start, end == std::wstring::npos ? std::wstring::npos : end - start));
+    if (end == std::wstring::npos) {
+      return names;
+    }
+    start = end + 1;
+  }
+}
+
+// Open handles as the shim sees them: the key state cached per handle, keyed
+// by the handle's key path (captures don't carry handle values).
+class ReplayHandles {
+public:
+  explicit ReplayHandles(bool enabled) : enabled_(enabled) {}
+
+  // State for calls made directly on the handle the record names.
+  ResolvedKey* ForHandle(const RegistryWorkloadRecord& record) {
+    if (!enabled_ || !record.subKey.empty() || record.keyPath == L"HKLM") {
+      return nullptr;
+    }
+    return &handles_[record.keyPath];
+  }
+
+  // Fresh state for a handle being opened on `key`.
+  ResolvedKey* ForOpen(const std::wstring& key) {
+    if (!enabled_) {
+      return nullptr;
+    }
+    ResolvedKey& state = handles_[key];
+    state = ResolvedKey{};
+    return &state;
+  }
+
+private:
+  bool enabled_ = false;
+  std::unordered_map<std::wstring, ResolvedKey> handles_;
+};
+
+// Data for the `sequence`th replayed write: its bytes repeated to `size`. Every
+// write differs from the one before, so the store's unchanged-value shortcut
+// doesn't turn a replayed rewrite into a no-op.
+std::vector<uint8_t> ReplayPayload(uint32_t size, uint64_t sequence) {
+  std::vector<uint8_t> data(size);
+  for (uint32_t i = 0; i < size; i++) {
+    data[i] = (uint8_t)(sequence >> (8 * (i % 8)));
+  }
+  return data;
+}
+
+// Performs the engine work the hook for record.op.api does. Returns false for
+// records with nothing to replay. `sequence` numbers the record within the
+// whole replay.
+bool ReplayOne(RegistryOverlayEngine& engine,
+               ReplayHandles& handles,
+               const RegistryWorkloadRecord& record,
+               uint64_t sequence) {
+  const std::wstring key = RegistryWorkloadTargetKey(record);
+  if (key.empty()) {
+    return false;
+  }
+  ResolvedKey* handle = IsOpenApi(record.op.api) ? nullptr : handles.ForHandle(record);
+  switch (record.op.api) {
+    case RegistryApi::RegOpenKeyExW:
+    case RegistryApi::RegOpenKeyExA:
+    case RegistryApi::RegOpenKeyW:
+    case RegistryApi::RegOpenKeyA:
+      engine.ProbeKey(key, handles.ForOpen(key));
+      return true;
+    case RegistryApi::RegCreateKeyExW:
+    case RegistryApi::RegCreateKeyExA:
+    case RegistryApi::RegCreateKeyW:
+    case RegistryApi::RegCreateKeyA:
+      engine.CreateKey(key);
+      return true;
+    case RegistryApi::RegQueryValueExW:
+    case RegistryApi::RegQueryValueExA:
+    case RegistryApi::RegGetValueW:
+    case RegistryApi::RegGetValueA:
+    case RegistryApi::RegQueryValueW:
+    case RegistryApi::RegQueryValueA:
+      engine.ReadValue(key, record.valueName, nullptr, handle);
+      return true;
+    case RegistryApi::RegQueryMultipleValuesW:
+    case RegistryApi::RegQueryMultipleValuesA:
+      engine.ReadValues(key, SplitValueNames(record.valueName), nullptr, handle);
+      return true;
+    case RegistryApi::RegSetValueExW:
+    case RegistryApi::RegSetValueExA:
+    case RegistryApi::RegSetKeyValueW:
+    case RegistryApi::RegSetKeyValueA:
+    case RegistryApi::RegSetValueW:
+    case RegistryApi::RegSetValueA: {
+      const std::vector<uint8_t> data = ReplayPayload(record.op.bufferSize, sequence);
+      engine.SetValue(key, record.valueName, record.op.type, data.data(), (uint32_t)data.size(), handle);
+      return true;
+    }
+    case RegistryApi::RegDeleteValueW:
+    case RegistryApi::RegDeleteValueA:
+      engine.DeleteValue(key, record.valueName, handle);
+      return true;
+    case RegistryApi::RegDeleteKeyW:
+    case RegistryApi::RegDeleteKeyA:
+    case RegistryApi::RegDeleteKeyExW:
+      engine.DeleteKeyTree(key);
+      return true;
+    case RegistryApi::RegEnumValueW:
+    case RegistryApi::RegEnumValueA:
+      engine.MergedValueNames(key, nullptr);
+      return true;
+    case RegistryApi::RegEnumKeyExW:
+    case RegistryApi::RegEnumKeyExA:
+    case RegistryApi::RegEnumKeyW:
+    case RegistryApi::RegEnumKeyA:
+      engine.MergedSubKeyNames(key, nullptr);
+      return true;
+    case RegistryApi::RegQueryInfoKeyW:
+    case RegistryApi::RegQueryInfoKeyA:
+      engine.QueryInfo(key, nullptr);
+      return true;
+    case RegistryApi::RegNotifyChangeKeyValue:
+      // Arming a watch doesn't touch the store; counted as skipped.
+    case RegistryApi::RegCloseKey:
+    case RegistryApi::Count:
+      break;
+  }
+  return false;
+}
+
+} // namespace
+
+RegistryWorkloadWriter::~RegistryWorkloadWriter() {
+  Close();
+}
+
+bool RegistryWorkloadWriter::Open(const std::wstring& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_.is_open()) {
+    return false;
+  }
+  file_.open(std::filesystem::path(path), std::ios::binary | std::ios::trunc);
+  if (!file_) {
+    return false;
+  }
+  buffer_.clear();
+  ids_.clear();
+  PutU32(buffer_, kRegistryWorkloadMagic);
+  PutU32(buffer_, kRegistryWorkloadVersion);
+  PutU32(buffer_, (uint32_t)kRegistryApiCount);
+  PutU32(buffer_, 0);
+  originNs_ = SteadyNowNs();
+  return true;
+}
+
+void RegistryWorkloadWriter::Close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!file_.is_open()) {
+    return;
+  }
+  FlushLocked();
+  file_.close();
+}
+
+bool RegistryWorkloadWriter::IsOpen() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return file_.is_open();
+}
+
+uint64_t RegistryWorkloadWriter::ElapsedNs() const {
+  return SteadyNowNs() - originNs_;
+}
+
+uint32_t RegistryWorkloadWriter::InternLocked(const std::wstring& s) {
+  if (s.empty()) {
+    return 0;
+  }
+  auto it = ids_.find(s);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+  const uint32_t id = (uint32_t)ids_.size() + 1;
+  ids_.emplace(s, id);
+  const std::vector<uint16_t> units = ToUtf16Units(s);
+  PutU8(buffer_, kTagString);
+  PutU32(buffer_, id);
+  PutU32(buffer_, (uint32_t)units.size());
+  for (uint16_t u : units) {
+    PutU16(buffer_, u);
+  }
+  return id;
+}
+
+void RegistryWorkloadWriter::Append(const RegistryWorkloadOp& op,
+                                    const std::wstring& keyPath,
+                                    const std::wstring& subKey,
+                                    const std::wstring& valueName) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!file_.is_open()) {
+    return;
+  }
+  const uint32_t keyId = InternLocked(keyPath);
+  const uint32_t subKeyId = InternLocked(subKey);
+  const uint32_t valueId = InternLocked(valueName);
+  PutU8(buffer_, kTagOp);
+  PutU8(buffer_, (uint8_t)op.api);
+  PutU8(buffer_, op.flags);
+  PutU8(buffer_, 0);
+  PutU32(buffer_, keyId);
+  PutU32(buffer_, subKeyId);
+  PutU32(buffer_, valueId);
+  PutU32(buffer_, op.type);
+  PutU32(buffer_, op.bufferSize);
+  PutU32(buffer_, op.dataSize);
+  PutU32(buffer_, (uint32_t)op.status);
+  PutU64(buffer_, op.startNs);
+  PutU32(buffer_, op.durationNs);
+  if (buffer_.size() >= kFlushThreshold) {
+    FlushLocked();
+  }
+}
+
+void RegistryWorkloadWriter::Flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  FlushLocked();
+}
+
+void RegistryWorkloadWriter::FlushLocked() {
+  if (!file_.is_open() || buffer_.empty()) {
+    return;
+  }
+  file_.write(reinterpret_cast<const char*>(buffer_.data()), (std::streamsize)buffer_.size());
+  file_.flush();
+  buffer_.clear();
+}
+
+bool ReadRegistryWorkload(const std::wstring& path, std::vector<RegistryWorkloadRecord>& out) {
+  out.clear();
+  std::ifstream f(std::filesystem::path(path), std::ios::binary);
+  if (!f) {
+    return false;
+  }
+  const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+  ByteReader r(bytes);
+
+  uint32_t magic = 0, version = 0, apiCount = 0, reserved = 0;
+  if (!r.U32(magic) || !r.U32(version) || !r.U32(apiCount) || !r.U32(reserved)) {
+    return false;
+  }
+  if (magic != kRegistryWorkloadMagic || version != kRegistryWorkloadVersion || apiCount > kRegistryApiCount) {
+    return false;
+  }
+
+  std::vector<std::wstring> strings(1);
+  while (!r.AtEnd()) {
+    uint8_t tag = 0;
+    if (!r.U8(tag)) {
+      return false;
+    }
+    if (tag == kTagString) {
+      uint32_t id = 0, count = 0;
+      if (!r.U32(id) || !r.U32(count) || id != strings.size()) {
+        return false;
+      }
+      std::vector<uint16_t> units(count);
+      for (auto& u : units) {
+        if (!r.U16(u)) {
+          return false;
+        }
+      }
+      strings.push_back(FromUtf16Units(units));
+      continue;
+    }
+    if (tag != kTagOp) {
+      return false;
+    }
+
+    RegistryWorkloadRecord rec;
+    uint8_t api = 0, pad = 0;
+    uint32_t keyId = 0, subKeyId = 0, valueId = 0, status = 0;
+    if (!r.U8(api) || !r.U8(rec.op.flags) || !r.U8(pad) || !r.U32(keyId) || !r.U32(subKeyId) || !r.U32(valueId) ||
+        !r.U32(rec.op.type) || !r.U32(rec.op.bufferSize) || !r.U32(rec.op.dataSize) || !r.U32(status) ||
+        !r.U64(rec.op.startNs) || !r.U32(rec.op.durationNs)) {
+      return false;
+    }
+    if (api >= apiCount || keyId >= strings.size() || subKeyId >= strings.size() || valueId >= strings.size()) {
+      return false;
+    }
+    rec.op.api = static_cast<RegistryApi>(api);
+    rec.op.status = (int32_t)status;
+    rec.keyPath = strings[keyId];
+    rec.subKey = strings[subKeyId];
+    rec.valueName = strings[valueId];
+    out.push_back(std::move(rec));
+  }
+  return true;
+}
+
+std::wstring RegistryWorkloadTargetKey(const RegistryWorkloadRecord& record) {
+  if (record.keyPath != L"HKLM" && record.keyPath.rfind(L"HKLM\\", 0) != 0) {
+    return {};
+  }
+  return JoinKeyPath(record.keyPath, CanonicalizeSubKey(record.subKey));
+}
+
+RegistryWorkloadReplayReport ReplayRegistryWorkload(RegistryOverlayEngine& engine,
+                                                    const std::vector<RegistryWorkloadRecord>& records,
+                                                    const RegistryWorkloadReplayOptions& options) {
+  RegistryWorkloadReplayReport report;
+  std::vector<uint64_t> latencies;
+  latencies.reserve(records.size() * std::max<uint32_t>(1, options.iterations));
+
+  LocalRegistryStore& store = engine.Store();
+  const uint64_t statementsBefore = store.StatementCount();
+  const uint64_t runStart = SteadyNowNs();
+  uint64_t sequence = 0;
+  for (uint32_t iteration = 0; iteration < std::max<uint32_t>(1, options.iterations); iteration++) {
+    ReplayHandles handles(options.handleState);
+    const RegistryWorkloadRecord* prev = nullptr;
+    const uint64_t passStart = SteadyNowNs();
+    for (const auto& record : records) {
+      if (options.originalTiming) {
+        const uint64_t due = passStart + record.op.startNs;
+        const uint64_t now = SteadyNowNs();
+        if (due > now) {
+          std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+        }
+      }
+      const bool read = IsReadApi(record.op.api);
+      const bool continues = ContinuesRead(prev, record);
+      prev = &record;
+      const uint64_t stmt0 = store.StatementCount();
+      const uint64_t t0 = SteadyNowNs();
+      if (!ReplayOne(engine, handles, record, ++sequence)) {
+        report.skipped++;
+        continue;
+      }
+      latencies.push_back(SteadyNowNs() - t0);
+      if (read) {
+        report.readOps++;
+        report.logicalReads += continues ? 0 : 1;
+        report.readStatements += store.StatementCount() - stmt0;
+      }
+      report.perApiOps[static_cast<size_t>(record.op.api)]++;
+      report.ops++;
+    }
+  }
+  report.seconds = (double)(SteadyNowNs() - runStart) / 1e9;
+  report.statements = store.StatementCount() - statementsBefore;
+
+  std::sort(latencies.begin(), latencies.end());
+  report.p50Ns = PercentileOfSorted(latencies, 50);
+  report.p90Ns = PercentileOfSorted(latencies, 90);
+  report.p99Ns = PercentileOfSorted(latencies, 99);
+  report.maxNs = latencies.empty() ? 0 : latencies.back();
+  return report;
+}
+
+}
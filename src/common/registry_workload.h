@@ -0,0 +1,129 @@
+#pragma once
+
+#include "common/registry_api_table.h"
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace twinshim {
+
+class RegistryOverlayEngine;
+
+// Compact binary capture of the registry calls a title makes, for offline
+// replay with twinshim_replay. Little-endian throughout:
+//
+//   header  : u32 magic 'TWWL', u32 version, u32 api count, u32 reserved
+//   string  : u8 tag=1, u32 id, u32 unit count, UTF-16LE code units
+//   op      : u8 tag=2, u8 api, u8 flags, u8 reserved, u32 key id,
+//             u32 subkey id, u32 value id, u32 type, u32 buffer size,
+//             u32 data size, i32 status, u64 start ns, u32 duration ns
+//
+// Key paths and names are interned: each distinct string is written once and
+// later ops refer to it by id (0 means "none"). The RegistryApi numbering is
+// part of the format, so appending to the API table is compatible but
+// reordering it requires a version bump. RegQueryMultipleValues records store
+// all requested names in the value string, separated by NULs.
+
+constexpr uint32_t kRegistryWorkloadMagic = 0x4C575754; // 'TWWL'
+constexpr uint32_t kRegistryWorkloadVersion = 1;
+
+enum RegistryWorkloadFlags : uint8_t {
+  kWorkloadHasBuffer = 1 << 0, // the caller supplied a data buffer (not a size probe)
+};
+
+struct RegistryWorkloadOp {
+  RegistryApi api = RegistryApi::RegCloseKey;
+  uint8_t flags = 0;
+  uint32_t type = 0;
+  uint32_t bufferSize = 0; // caller's *lpcbData (or cch) on entry
+  uint32_t dataSize = 0;   // *lpcbData on return
+  int32_t status = 0;
+  uint64_t startNs = 0; // relative to the start of the capture
+  uint32_t durationNs = 0;
+};
+
+struct RegistryWorkloadRecord {
+  RegistryWorkloadOp op;
+  std::wstring keyPath; // path of the handle the call was made on, e.g. "HKLM\Software"
+  std::wstring subKey;  // caller's lpSubKey, uncanonicalized
+  std::wstring valueName;
+};
+
+// Thread-safe appender. Records are buffered and written in large chunks;
+// Append only copies and interns strings, it never formats.
+class RegistryWorkloadWriter {
+public:
+  RegistryWorkloadWriter() = default;
+  ~RegistryWorkloadWriter();
+
+  RegistryWorkloadWriter(const RegistryWorkloadWriter&) = delete;
+  RegistryWorkloadWriter& operator=(const RegistryWorkloadWriter&) = delete;
+
+  bool Open(const std::wstring& path);
+  void Close();
+  bool IsOpen() const;
+
+  // Nanoseconds since Open; callers stamp RegistryWorkloadOp::startNs with it.
+  uint64_t ElapsedNs() const;
+
+  void Append(const RegistryWorkloadOp& op,
+              const std::wstring& keyPath,
+              const std::wstring& subKey,
+              const std::wstring& valueName);
+  void Flush();
+
+private:
+  uint32_t InternLocked(const std::wstring& s);
+  void FlushLocked();
+
+  mutable std::mutex mutex_;
+  std::ofstream file_;
+  std::vector<uint8_t> buffer_;
+  std::unordered_map<std::wstring, uint32_t> ids_;
+  uint64_t originNs_ = 0;
+};
+
+// Reads a whole capture; false on a missing file, bad header or truncation.
+bool ReadRegistryWorkload(const std::wstring& path, std::vector<RegistryWorkloadRecord>& out);
+
+// Resolved key path a record operates on ("" for handles outside HKLM).
+std::wstring RegistryWorkloadTargetKey(const RegistryWorkloadRecord& record);
+
+struct RegistryWorkloadReplayOptions {
+  bool originalTiming = false; // sleep to reproduce the capture's inter-call gaps
+  uint32_t iterations = 1;
+  bool handleState = true; // reuse per-handle key state and last results as the shim does
+};
+
+struct RegistryWorkloadReplayReport {
+  uint64_t ops = 0;
+  uint64_t skipped = 0; // non-HKLM or unsupported records
+  double seconds = 0;
+  std::vector<uint64_t> perApiOps = std::vector<uint64_t>(kRegistryApiCount, 0);
+  uint64_t p50Ns = 0;
+  uint64_t p90Ns = 0;
+  uint64_t p99Ns = 0;
+  uint64_t maxNs = 0;
+
+  uint64_t statements = 0;     // SQL statements the store ran
+  uint64_t readOps = 0;        // value queries, including size probes and retries
+  uint64_t logicalReads = 0;   // readOps minus probe/ERROR_MORE_DATA repeats of the same value
+  uint64_t readStatements = 0; // statements run by readOps
+
+  double OpsPerSecond() const { return seconds > 0 ? (double)ops / seconds : 0.0; }
+  double StatementsPerLogicalRead() const { return logicalReads ? (double)readStatements / (double)logicalReads : 0.0; }
+};
+
+// Replays captured calls through the overlay engine, mapping each API to the
+// engine operation its hook performs. Written values are synthesized at the
+// captured size, so store cost matches the capture without recording payloads;
+// each write's bytes differ from the last, so rewrites are real writes.
+RegistryWorkloadReplayReport ReplayRegistryWorkload(RegistryOverlayEngine& engine,
+                                                    const std::vector<RegistryWorkloadRecord>& records,
+                                                    const RegistryWorkloadReplayOptions& options);
+
+}
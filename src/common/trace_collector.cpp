@@ -0,0 +1,658 @@
+#include "common/trace_collector.h"
+
+#include "common/utf8.h"
+#include "common/wait_set.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <tuple>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace twinshim {
+
+namespace {
+
+constexpr size_t kReadBufferBytes = 64 * 1024;
+// How long Stop keeps reading from clients that are still connected.
+constexpr std::chrono::milliseconds kDrainGrace{500};
+// Raw mode remembers string definitions per connection for rotated files;
+// past this many it starts over, like the shim's own table.
+constexpr size_t kMaxRememberedStrings = 64 * 1024;
+
+FILE* OpenForWrite(const std::wstring& path) {
+#if defined(_WIN32)
+  return _wfopen(path.c_str(), L"wb");
+#else
+  return std::fopen(WideToUtf8(path).c_str(), "wb");
+#endif
+}
+
+std::filesystem::path RotatedPath(const std::filesystem::path& path, unsigned n) {
+  auto rotated = path;
+  rotated += "." + std::to_string(n);
+  return rotated;
+}
+
+} // namespace
+
+TraceCollector::~TraceCollector() {
+  Stop();
+}
+
+bool TraceCollector::Start(const TraceCollectorOptions& options) {
+  if (writer_.joinable()) {
+    return false;
+  }
+  options_ = options;
+  if (options_.rawPath.empty() ? !options_.console : !OpenRawFile()) {
+    return false;
+  }
+  stopping_ = false;
+  writer_ = std::thread([this] { WriterThreadProc(); });
+  return true;
+}
+
+void TraceCollector::Stop() {
+  if (!writer_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wakeWriter_.notify_one();
+  roomAvailable_.notify_all();
+  writer_.join();
+  if (raw_) {
+    std::fclose(raw_);
+    raw_ = nullptr;
+  }
+}
+
+uint64_t TraceCollector::OpenClient() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const uint64_t id = nextClient_++;
+  clients_.emplace(std::piecewise_construct, std::forward_as_tuple(id), std::forward_as_tuple());
+  stats_.clients++;
+  stats_.peakClients = std::max<uint64_t>(stats_.peakClients, clients_.size());
+  return id;
+}
+
+void TraceCollector::CloseClient(uint64_t id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = clients_.find(id);
+  if (it == clients_.end()) {
+    return;
+  }
+  if (!it->second.pending.empty()) {
+    // The writer went away mid-record.
+    stats_.malformed++;
+  }
+  clients_.erase(it);
+}
+
+void TraceCollector::Receive(uint64_t id, const char* data, size_t size) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  WaitForRoom(lock);
+  auto it = clients_.find(id);
+  if (it == clients_.end()) {
+    return;
+  }
+  Client& client = it->second;
+  stats_.bytesIn += size;
+  if (client.broken) {
+    return;
+  }
+
+  // Whole records straight from `data` where possible; only a record split
+  // across reads goes through `pending`.
+  std::string& pending = client.pending;
+  while (size) {
+    if (!pending.empty()) {
+      if (pending.size() < kTraceRecordHeaderBytes) {
+        const size_t take = std::min(size, kTraceRecordHeaderBytes - pending.size());
+        pending.append(data, take);
+        data += take;
+        size -= take;
+        if (pending.size() < kTraceRecordHeaderBytes) {
+          break;
+        }
+      }
+      const size_t recordSize = TraceRecordSize(pending.data());
+      if (recordSize < kTraceRecordHeaderBytes) {
+        // No way to find the next record boundary; ignore the rest of this
+        // connection.
+        stats_.malformed++;
+        pending.clear();
+        client.broken = true;
+        return;
+      }
+      const size_t take = std::min(size, recordSize - pending.size());
+      pending.append(data, take);
+      data += take;
+      size -= take;
+      if (pending.size() < recordSize) {
+        break;
+      }
+      ConsumeRecord(id, client, pending.data(), recordSize);
+      pending.clear();
+      continue;
+    }
+    if (size < kTraceRecordHeaderBytes) {
+      pending.assign(data, size);
+      break;
+    }
+    const size_t recordSize = TraceRecordSize(data);
+    if (recordSize < kTraceRecordHeaderBytes) {
+      stats_.malformed++;
+      client.broken = true;
+      return;
+    }
+    if (recordSize > size) {
+      pending.assign(data, size);
+      break;
+    }
+    ConsumeRecord(id, client, data, recordSize);
+    data += recordSize;
+    size -= recordSize;
+  }
+
+  stats_.peakQueuedBytes = std::max<uint64_t>(stats_.peakQueuedBytes, queue_.size());
+  if (queue_.size() >= options_.batchBytes) {
+    wakeWriter_.notify_one();
+  }
+}
+
+void TraceCollector::ConsumeRecord(uint64_t id, Client& client, const char* record, size_t size) {
+  stats_.records++;
+  if (options_.rawPath.empty()) {
+    const uint64_t malformed = client.decoder.Malformed();
+    client.decoder.Feed(record, size, queue_);
+    stats_.malformed += client.decoder.Malformed() - malformed;
+    return;
+  }
+
+  const TraceRecordKind kind = TraceRecordKindOf(record);
+  if (kind == TraceRecordKind::Clock) {
+    client.clock.assign(record, size);
+    lastSource_ = id;
+    queue_.append(record, size);
+    return;
+  }
+  if (kind == TraceRecordKind::String) {
+    if (client.strings.size() >= kMaxRememberedStrings) {
+      client.strings.clear();
+    }
+    client.strings[TraceStringRecordKey(record, size)].assign(record, size);
+  }
+  // Records that follow belong to this connection's process.
+  if (lastSource_ != id) {
+    queue_ += client.clock;
+    lastSource_ = id;
+  }
+  queue_.append(record, size);
+}
+
+void TraceCollector::WaitForRoom(std::unique_lock<std::mutex>& lock) {
+  if (queue_.size() < options_.maxQueuedBytes || stopping_) {
+    return;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  stats_.stalls++;
+  wakeWriter_.notify_one();
+  roomAvailable_.wait(lock, [this] { return queue_.size() < options_.maxQueuedBytes || stopping_; });
+  stats_.stallMicros += (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+}
+
+void TraceCollector::WriterThreadProc() {
+  std::string batch;
+  std::string preamble;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    wakeWriter_.wait_for(lock, options_.flushInterval, [this] {
+      return stopping_ || queue_.size() >= std::min(options_.batchBytes, options_.maxQueuedBytes);
+    });
+    if (queue_.empty()) {
+      if (stopping_) {
+        break;
+      }
+      continue;
+    }
+    batch.clear();
+    batch.swap(queue_);
+    // The next batch restates its source's clock, so each one decodes after
+    // a rotation.
+    lastSource_ = 0;
+
+    const bool rotate =
+        raw_ && options_.rotateBytes && rawBytes_ && rawBytes_ + batch.size() > options_.rotateBytes;
+    preamble.clear();
+    if (rotate) {
+      for (const auto& entry : clients_) {
+        preamble += entry.second.clock;
+        for (const auto& s : entry.second.strings) {
+          preamble += s.second;
+        }
+      }
+    }
+    roomAvailable_.notify_all();
+    lock.unlock();
+
+    bool rotated = false;
+    if (rotate) {
+      rotated = RotateRawFile();
+    }
+    const bool prefixOk = preamble.empty() || !rotated || WriteBatch(preamble);
+    const bool ok = WriteBatch(batch);
+
+    lock.lock();
+    stats_.batches++;
+    stats_.rotations += rotated ? 1 : 0;
+    if (ok) {
+      stats_.bytesOut += batch.size();
+    } else {
+      stats_.bytesLost += batch.size();
+    }
+    if (rotated && !preamble.empty()) {
+      (prefixOk ? stats_.bytesOut : stats_.bytesLost) += preamble.size();
+    }
+  }
+}
+
+bool TraceCollector::WriteBatch(const std::string& batch) {
+  FILE* out = raw_ ? raw_ : options_.console;
+  if (!out) {
+    return false;
+  }
+  const bool ok = std::fwrite(batch.data(), 1, batch.size(), out) == batch.size() && std::fflush(out) == 0;
+  if (raw_ && ok) {
+    rawBytes_ += batch.size();
+  }
+  return ok;
+}
+
+bool TraceCollector::OpenRawFile() {
+  raw_ = OpenForWrite(options_.rawPath);
+  rawBytes_ = 0;
+  return raw_ != nullptr;
+}
+
+bool TraceCollector::RotateRawFile() {
+  std::fclose(raw_);
+  raw_ = nullptr;
+  const std::filesystem::path path(options_.rawPath);
+  std::error_code ec;
+  if (options_.keepFiles == 0) {
+    std::filesystem::remove(path, ec);
+  } else {
+    std::filesystem::remove(RotatedPath(path, options_.keepFiles), ec);
+    for (unsigned n = options_.keepFiles; n > 1; n--) {
+      std::filesystem::rename(RotatedPath(path, n - 1), RotatedPath(path, n), ec);
+    }
+    std::filesystem::rename(path, RotatedPath(path, 1), ec);
+  }
+  return OpenRawFile();
+}
+
+TraceCollectorStats TraceCollector::Stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+#if defined(_WIN32)
+
+// A pool of pipe instances, each either waiting for a client or reading from
+// one. The pool grows while every instance is busy so a new client never
+// waits for an old one to go away; one thread waits on all their events.
+struct TraceCollectorServer::Impl {
+  // One wait slot is the stop event.
+  static constexpr size_t kMaxInstances = MAXIMUM_WAIT_OBJECTS - 1;
+
+  struct Instance {
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+    OVERLAPPED ov{};
+    bool connected = false;
+    bool connectedEarly = false; // the client beat ConnectNamedPipe
+    uint64_t client = 0;
+    std::vector<char> buffer = std::vector<char>(kReadBufferBytes);
+
+    ~Instance() {
+      if (pipe != INVALID_HANDLE_VALUE) {
+        CloseHandle(pipe);
+      }
+      if (ov.hEvent) {
+        CloseHandle(ov.hEvent);
+      }
+    }
+  };
+
+  TraceCollector* collector = nullptr;
+  std::wstring name;
+  WaitEvent stop;
+  std::thread io;
+  std::vector<std::unique_ptr<Instance>> instances;
+
+  bool AddInstance() {
+    auto inst = std::make_unique<Instance>();
+    inst->ov.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (!inst->ov.hEvent) {
+      return false;
+    }
+    // The first instance claims the name so nobody else can serve it.
+    const DWORD openMode =
+        PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | (instances.empty() ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0);
+    inst->pipe = CreateNamedPipeW(name.c_str(),
+                                  openMode,
+                                  PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+                                  PIPE_UNLIMITED_INSTANCES,
+                                  (DWORD)kReadBufferBytes,
+                                  (DWORD)kReadBufferBytes,
+                                  0,
+                                  nullptr);
+    if (inst->pipe == INVALID_HANDLE_VALUE || !Listen(*inst)) {
+      return false;
+    }
+    instances.push_back(std::move(inst));
+    return true;
+  }
+
+  bool Listen(Instance& inst) {
+    inst.connected = false;
+    inst.connectedEarly = false;
+    ResetEvent(inst.ov.hEvent);
+    if (ConnectNamedPipe(inst.pipe, &inst.ov)) {
+      return true;
+    }
+    switch (GetLastError()) {
+      case ERROR_IO_PENDING:
+        return true;
+      case ERROR_PIPE_CONNECTED:
+        inst.connectedEarly = true;
+        SetEvent(inst.ov.hEvent);
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  bool Read(Instance& inst) {
+    ResetEvent(inst.ov.hEvent);
+    return ReadFile(inst.pipe, inst.buffer.data(), (DWORD)inst.buffer.size(), nullptr, &inst.ov) ||
+           GetLastError() == ERROR_IO_PENDING;
+  }
+
+  void Disconnect(Instance& inst) {
+    if (inst.connected) {
+      collector->CloseClient(inst.client);
+    }
+    DisconnectNamedPipe(inst.pipe);
+    Listen(inst);
+  }
+
+  // Handles one signaled instance.
+  void Service(Instance& inst) {
+    DWORD bytes = 0;
+    if (!inst.connected) {
+      const bool early = inst.connectedEarly;
+      if (!early && !GetOverlappedResult(inst.pipe, &inst.ov, &bytes, FALSE)) {
+        Disconnect(inst);
+        return;
+      }
+      inst.connected = true;
+      inst.client = collector->OpenClient();
+      const bool allBusy = std::all_of(instances.begin(), instances.end(), [](const auto& i) { return i->connected; });
+      if (allBusy && instances.size() < kMaxInstances) {
+        AddInstance();
+      }
+    } else {
+      if (!GetOverlappedResult(inst.pipe, &inst.ov, &bytes, FALSE)) {
+        Disconnect(inst);
+        return;
+      }
+      if (bytes) {
+        collector->Receive(inst.client, inst.buffer.data(), bytes);
+      }
+    }
+    if (!Read(inst)) {
+      Disconnect(inst);
+    }
+  }
+
+  void Run() {
+    std::vector<HANDLE> handles;
+    std::vector<Instance*> owners;
+    bool draining = false;
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    while (true) {
+      handles.assign(1, stop.Handle());
+      owners.assign(1, nullptr);
+      for (auto& inst : instances) {
+        // While draining, only connected clients matter.
+        if (!draining || inst->connected) {
+          handles.push_back(inst->ov.hEvent);
+          owners.push_back(inst.get());
+        }
+      }
+      if (draining && handles.size() == 1) {
+        break;
+      }
+      DWORD timeout = INFINITE;
+      if (draining) {
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0) {
+          break;
+        }
+        timeout = (DWORD)left.count();
+      }
+      // The stop event stays signaled while draining; skip it then.
+      const DWORD first = draining ? 1 : 0;
+      const DWORD r = WaitForMultipleObjects((DWORD)(handles.size() - first), handles.data() + first, FALSE, timeout);
+      if (r == WAIT_TIMEOUT || r == WAIT_FAILED) {
+        break;
+      }
+      const size_t index = r - WAIT_OBJECT_0 + first;
+      if (index == 0) {
+        draining = true;
+        deadline = std::chrono::steady_clock::now() + kDrainGrace;
+        continue;
+      }
+      if (index < owners.size()) {
+        Service(*owners[index]);
+      }
+    }
+
+    for (auto& inst : instances) {
+      // A connected instance always has a read issued; a listening one may
+      // have a connect pending. Either must finish before the buffer and
+      // OVERLAPPED go away.
+      const bool pending = CancelIoEx(inst->pipe, &inst->ov) != FALSE;
+      DWORD bytes = 0;
+      if (inst->connected) {
+        if (GetOverlappedResult(inst->pipe, &inst->ov, &bytes, TRUE) && bytes) {
+          collector->Receive(inst->client, inst->buffer.data(), bytes);
+        }
+        collector->CloseClient(inst->client);
+      } else if (pending) {
+        GetOverlappedResult(inst->pipe, &inst->ov, &bytes, TRUE);
+      }
+    }
+    instances.clear();
+  }
+};
+
+bool TraceCollectorServer::Start(const std::wstring& endpoint, TraceCollector& collector) {
+  if (impl_ || endpoint.empty()) {
+    return false;
+  }
+  auto impl = std::make_unique<Impl>();
+  impl->collector = &collector;
+  impl->name = endpoint;
+  if (!impl->stop.Create() || !impl->AddInstance()) {
+    return false;
+  }
+  impl->io = std::thread([p = impl.get()] { p->Run(); });
+  endpoint_ = endpoint;
+  impl_ = std::move(impl);
+  return true;
+}
+
+void TraceCollectorServer::Stop() {
+  if (!impl_) {
+    return;
+  }
+  impl_->stop.Set();
+  impl_->io.join();
+  impl_.reset();
+}
+
+#else
+
+struct TraceCollectorServer::Impl {
+  TraceCollector* collector = nullptr;
+  std::string path;
+  int listener = -1;
+  WaitEvent stop;
+  std::thread io;
+
+  ~Impl() {
+    if (listener >= 0) {
+      close(listener);
+    }
+    if (!path.empty()) {
+      unlink(path.c_str());
+    }
+  }
+
+  void Run() {
+    struct Conn {
+      int fd;
+      uint64_t client;
+    };
+    std::vector<Conn> conns;
+    std::vector<pollfd> fds;
+    std::vector<char> buffer(kReadBufferBytes);
+    bool draining = false;
+    auto deadline = std::chrono::steady_clock::time_point::max();
+
+    while (true) {
+      fds.clear();
+      fds.push_back({draining ? -1 : stop.Handle(), POLLIN, 0});
+      fds.push_back({draining ? -1 : listener, POLLIN, 0});
+      for (const auto& c : conns) {
+        fds.push_back({c.fd, POLLIN, 0});
+      }
+      if (draining && conns.empty()) {
+        break;
+      }
+      int timeout = -1;
+      if (draining) {
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0) {
+          break;
+        }
+        timeout = (int)left.count();
+      }
+      const int ready = poll(fds.data(), (nfds_t)fds.size(), timeout);
+      if (ready < 0 && errno == EINTR) {
+        continue;
+      }
+      if (ready <= 0) {
+        break;
+      }
+      if (fds[0].revents & POLLIN) {
+        draining = true;
+        deadline = std::chrono::steady_clock::now() + kDrainGrace;
+      }
+      if (!draining && (fds[1].revents & POLLIN)) {
+        const int fd = accept(listener, nullptr, nullptr);
+        if (fd >= 0) {
+          conns.push_back({fd, collector->OpenClient()});
+        }
+      }
+      // Newly accepted connections have no pollfd yet; they are polled next round.
+      for (size_t i = 2; i < fds.size(); i++) {
+        if (!fds[i].revents) {
+          continue;
+        }
+        auto conn = std::find_if(conns.begin(), conns.end(), [&](const Conn& c) { return c.fd == fds[i].fd; });
+        const ssize_t n = read(conn->fd, buffer.data(), buffer.size());
+        if (n > 0) {
+          collector->Receive(conn->client, buffer.data(), (size_t)n);
+          continue;
+        }
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        collector->CloseClient(conn->client);
+        close(conn->fd);
+        conns.erase(conn);
+      }
+    }
+
+    for (const auto& c : conns) {
+      collector->CloseClient(c.client);
+      close(c.fd);
+    }
+  }
+};
+
+bool TraceCollectorServer::Start(const std::wstring& endpoint, TraceCollector& collector) {
+  if (impl_ || endpoint.empty()) {
+    return false;
+  }
+  auto impl = std::make_unique<Impl>();
+  impl->collector = &collector;
+  const std::string path = WideToUtf8(endpoint);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path) || !impl->stop.Create()) {
+    return false;
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  unlink(path.c_str());
+  impl->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (impl->listener < 0 || bind(impl->listener, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+    return false;
+  }
+  impl->path = path;
+  if (listen(impl->listener, SOMAXCONN) != 0) {
+    return false;
+  }
+  impl->io = std::thread([p = impl.get()] { p->Run(); });
+  endpoint_ = endpoint;
+  impl_ = std::move(impl);
+  return true;
+}
+
+void TraceCollectorServer::Stop() {
+  if (!impl_) {
+    return;
+  }
+  impl_->stop.Set();
+  impl_->io.join();
+  impl_.reset();
+}
+
+#endif
+
+TraceCollectorServer::TraceCollectorServer() = default;
+
+TraceCollectorServer::~TraceCollectorServer() {
+  Stop();
+}
+
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "common/trace_record.h"
+
+namespace twinshim {
+
+struct TraceCollectorOptions {
+  // Decoded text goes here (stdout for --debug) unless rawPath is set.
+  FILE* console = nullptr;
+  // Undecoded records are written to this file instead (--debug-out).
+  std::wstring rawPath;
+  // Past this many bytes the raw file is renamed to <path>.1 (older ones
+  // shift up to <path>.<keepFiles>) and a new one is started. 0 = never.
+  uint64_t rotateBytes = 0;
+  unsigned keepFiles = 4;
+  size_t batchBytes = 256 * 1024;              // output is written in chunks of about this size
+  std::chrono::milliseconds flushInterval{50}; // or at least this often
+  // Past this much undelivered output, readers wait for the writer. The pipe
+  // then fills and the shims drop records in their own rings; nothing in the
+  // traced process ever waits on the console.
+  size_t maxQueuedBytes = 8 * 1024 * 1024;
+};
+
+struct TraceCollectorStats {
+  uint64_t clients = 0;     // connections accepted
+  uint64_t peakClients = 0; // most connected at once
+  uint64_t bytesIn = 0;
+  uint64_t records = 0;
+  uint64_t malformed = 0; // records that failed to decode
+  uint64_t batches = 0;   // output writes
+  uint64_t bytesOut = 0;
+  uint64_t bytesLost = 0; // output writes that failed
+  uint64_t rotations = 0;
+  uint64_t stalls = 0;      // times a reader waited because output fell behind
+  uint64_t stallMicros = 0; // total time spent waiting
+  uint64_t peakQueuedBytes = 0;
+};
+
+// Gathers the binary trace streams (common/trace_record.h) of any number of
+// shim connections into one output. Readers hand in bytes as they arrive; a
+// writer thread drains the combined queue in large batches, so a slow console
+// costs one write per batch rather than one per read.
+//
+// In raw mode records are copied whole, never interleaved mid-record, and the
+// sending process's clock record is repeated whenever the source changes, so
+// the file decodes with `hklmreg trace-decode` however many processes wrote
+// to it. Each rotated file starts with every live connection's clock and
+// string definitions and decodes on its own.
+class TraceCollector {
+public:
+  TraceCollector() = default;
+  ~TraceCollector();
+
+  TraceCollector(const TraceCollector&) = delete;
+  TraceCollector& operator=(const TraceCollector&) = delete;
+
+  bool Start(const TraceCollectorOptions& options);
+  // Writes out everything queued and stops the writer.
+  void Stop();
+
+  // Connection lifetime, called by the I/O side (TraceCollectorServer).
+  uint64_t OpenClient();
+  void Receive(uint64_t client, const char* data, size_t size);
+  void CloseClient(uint64_t client);
+
+  TraceCollectorStats Stats() const;
+
+private:
+  struct Client {
+    std::string pending; // partial record
+    bool broken = false; // framing lost; the rest of the stream is ignored
+    TraceDecoder decoder;
+    std::string clock;                               // raw mode: last clock record
+    std::unordered_map<uint64_t, std::string> strings; // raw mode: (tid << 32 | id) -> definition
+  };
+
+  void ConsumeRecord(uint64_t id, Client& client, const char* record, size_t size);
+  void WaitForRoom(std::unique_lock<std::mutex>& lock);
+  void WriterThreadProc();
+  bool WriteBatch(const std::string& batch);
+  bool OpenRawFile();
+  bool RotateRawFile();
+
+  TraceCollectorOptions options_;
+  std::thread writer_;
+  bool stopping_ = false;
+
+  mutable std::mutex mutex_;
+  std::condition_variable wakeWriter_;
+  std::condition_variable roomAvailable_;
+  std::map<uint64_t, Client> clients_;
+  uint64_t nextClient_ = 1;
+  uint64_t lastSource_ = 0; // raw mode: whose clock applies to the queue's tail
+  std::string queue_;
+  TraceCollectorStats stats_;
+
+  // Writer thread only.
+  FILE* raw_ = nullptr;
+  uint64_t rawBytes_ = 0;
+};
+
+// Accepts shim connections on the debug endpoint and feeds them to a
+// collector: a multi-instance named pipe served with overlapped I/O on
+// Windows, a UNIX domain socket served with poll() elsewhere. One I/O thread
+// serves every client.
+class TraceCollectorServer {
+public:
+  TraceCollectorServer();
+  ~TraceCollectorServer();
+
+  TraceCollectorServer(const TraceCollectorServer&) = delete;
+  TraceCollectorServer& operator=(const TraceCollectorServer&) = delete;
+
+  bool Start(const std::wstring& endpoint, TraceCollector& collector);
+  // Stops accepting, reads what connected clients already sent, then closes
+  // them.
+  void Stop();
+
+  const std::wstring& Endpoint() const { return endpoint_; }
+
+private:
+  struct Impl;
+
+  std::wstring endpoint_;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
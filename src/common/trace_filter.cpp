@@ -0,0 +1,327 @@
+#include "common/trace_filter.h"
+
+#include <algorithm>
+#include <cwctype>
+
+namespace twinshim {
+namespace {
+
+// Win32 error codes, spelled out so this file stays portable.
+constexpr int32_t kErrorFileNotFound = 2;
+constexpr int32_t kErrorPathNotFound = 3;
+constexpr int32_t kErrorMoreData = 234;
+constexpr int32_t kErrorNoMoreItems = 259;
+
+wchar_t Fold(wchar_t ch) {
+  return (wchar_t)towlower(ch);
+}
+
+std::wstring Trim(const std::wstring& s) {
+  size_t begin = 0;
+  size_t end = s.size();
+  while (begin < end && iswspace(s[begin])) {
+    begin++;
+  }
+  while (end > begin && iswspace(s[end - 1])) {
+    end--;
+  }
+  return s.substr(begin, end - begin);
+}
+
+std::vector<std::wstring> Split(const std::wstring& s, wchar_t separator) {
+  std::vector<std::wstring> parts;
+  size_t start = 0;
+  while (true) {
+    const size_t at = s.find(separator, start);
+    parts.push_back(Trim(s.substr(start, at == std::wstring::npos ? std::wstring::npos : at - start)));
+    if (at == std::wstring::npos) {
+      return parts;
+    }
+    start = at + 1;
+  }
+}
+
+bool ParseCount(const std::wstring& text, uint32_t& out) {
+  if (text.empty() || text.size() > 9) {
+    return false;
+  }
+  uint32_t value = 0;
+  for (wchar_t ch : text) {
+    if (ch < L'0' || ch > L'9') {
+      return false;
+    }
+    value = value * 10 + (uint32_t)(ch - L'0');
+  }
+  if (value == 0) {
+    return false;
+  }
+  out = value;
+  return true;
+}
+
+std::wstring CanonicalPrefix(const std::wstring& prefix) {
+  std::wstring out = prefix;
+  std::replace(out.begin(), out.end(), L'/', L'\\');
+  const size_t begin = out.find_first_not_of(L'\\');
+  if (begin == std::wstring::npos) {
+    return {};
+  }
+  out = out.substr(begin, out.find_last_not_of(L'\\') - begin + 1);
+  for (auto& ch : out) {
+    ch = Fold(ch);
+  }
+  static const std::wstring kLongRoot = L"hkey_local_machine";
+  if (out.compare(0, kLongRoot.size(), kLongRoot) == 0 &&
+      (out.size() == kLongRoot.size() || out[kLongRoot.size()] == L'\\')) {
+    out = L"hklm" + out.substr(kLongRoot.size());
+  }
+  return out;
+}
+
+bool ParseKeyList(const std::wstring& value, TraceFilterSpec& out) {
+  for (const std::wstring& item : Split(value, L'|')) {
+    const bool exclude = !item.empty() && item[0] == L'!';
+    const std::wstring prefix = CanonicalPrefix(exclude ? item.substr(1) : item);
+    if (prefix.empty()) {
+      return false;
+    }
+    (exclude ? out.excludeKeys : out.includeKeys).push_back(prefix);
+  }
+  return true;
+}
+
+bool ParseResultList(const std::wstring& value, uint8_t& out) {
+  for (std::wstring item : Split(value, L'|')) {
+    for (auto& ch : item) {
+      ch = Fold(ch);
+    }
+    if (item == L"ok") {
+      out |= kTraceResultOk;
+    } else if (item == L"miss") {
+      out |= kTraceResultMiss;
+    } else if (item == L"error") {
+      out |= kTraceResultError;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint64_t HashFoldedKey(const wchar_t* path, size_t size) {
+  uint64_t hash = 1469598103934665603ull;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= (uint64_t)Fold(path[i]);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+} // namespace
+
+uint8_t ClassifyTraceResult(int32_t status) {
+  switch (status) {
+    case 0:
+    case kErrorMoreData:
+    case kErrorNoMoreItems:
+      return kTraceResultOk;
+    case kErrorFileNotFound:
+    case kErrorPathNotFound:
+      return kTraceResultMiss;
+    default:
+      return kTraceResultError;
+  }
+}
+
+bool TraceFilterSpec::Empty() const {
+  return includeKeys.empty() && excludeKeys.empty() && results == 0 && sampleEvery <= 1 && apiRate == 0 &&
+         keyRate == 0;
+}
+
+bool ParseTraceFilterSpec(const std::wstring& spec, TraceFilterSpec& out, std::wstring* error) {
+  TraceFilterSpec parsed;
+  for (const std::wstring& clause : Split(spec, L';')) {
+    if (clause.empty()) {
+      continue;
+    }
+    const size_t eq = clause.find(L'=');
+    std::wstring name = Trim(clause.substr(0, eq));
+    for (auto& ch : name) {
+      ch = Fold(ch);
+    }
+    const std::wstring value = eq == std::wstring::npos ? std::wstring() : Trim(clause.substr(eq + 1));
+    bool ok = false;
+    if (name == L"key") {
+      ok = ParseKeyList(value, parsed);
+    } else if (name == L"result") {
+      ok = ParseResultList(value, parsed.results);
+    } else if (name == L"sample") {
+      ok = ParseCount(value, parsed.sampleEvery);
+    } else if (name == L"rate") {
+      ok = ParseCount(value, parsed.apiRate);
+    } else if (name == L"keyrate") {
+      ok = ParseCount(value, parsed.keyRate);
+    }
+    if (!ok) {
+      if (error) {
+        *error = clause;
+      }
+      return false;
+    }
+  }
+  out = std::move(parsed);
+  return true;
+}
+
+uint32_t KeyPrefixTrie::Child(uint32_t node, wchar_t ch) const {
+  for (uint32_t child = nodes_[node].firstChild; child; child = nodes_[child].nextSibling) {
+    if (nodes_[child].ch == ch) {
+      return child;
+    }
+  }
+  return 0;
+}
+
+void KeyPrefixTrie::Add(const std::wstring& prefix, bool include) {
+  const std::wstring folded = CanonicalPrefix(prefix);
+  if (folded.empty()) {
+    return;
+  }
+  uint32_t node = 0;
+  for (wchar_t ch : folded) {
+    uint32_t child = Child(node, ch);
+    if (!child) {
+      child = (uint32_t)nodes_.size();
+      Node added;
+      added.ch = ch;
+      added.nextSibling = nodes_[node].firstChild;
+      nodes_.push_back(added);
+      nodes_[node].firstChild = child;
+    }
+    node = child;
+  }
+  nodes_[node].rule = include ? 1 : -1;
+  hasIncludes_ = hasIncludes_ || include;
+}
+
+int KeyPrefixTrie::Match(const wchar_t* path, size_t size) const {
+  int rule = 0;
+  uint32_t node = 0;
+  for (size_t i = 0; i < size; i++) {
+    node = Child(node, Fold(path[i]));
+    if (!node) {
+      break;
+    }
+    if (nodes_[node].rule && (i + 1 == size || path[i + 1] == L'\\')) {
+      rule = nodes_[node].rule;
+    }
+  }
+  return rule;
+}
+
+void TraceRateLimiter::Reset(uint32_t perSecond, size_t slots, uint64_t ticksPerSecond) {
+  interval_ = perSecond ? std::max<uint64_t>(1, ticksPerSecond / perSecond) : 0;
+  burst_ = std::max(interval_, ticksPerSecond);
+  slots_.assign(perSecond ? std::max<size_t>(1, slots) : 0, Slot{});
+  refused_.store(0, std::memory_order_relaxed);
+}
+
+bool TraceRateLimiter::Admit(size_t slot, uint64_t tag, uint64_t now, uint64_t& suppressed) {
+  suppressed = 0;
+  const size_t index = slot % slots_.size();
+  std::lock_guard<std::mutex> lock(LockFor(index));
+  Slot& s = slots_[index];
+  if (s.tag != tag) {
+    s = Slot{};
+    s.tag = tag;
+  }
+  // Past fullAt the bucket is full; each event pushes it one interval out,
+  // and the bucket is empty once that lies more than a burst ahead.
+  const uint64_t from = std::max(s.fullAt, now);
+  if (from + interval_ - now > burst_) {
+    s.suppressed++;
+    refused_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  s.fullAt = from + interval_;
+  suppressed = s.suppressed;
+  s.suppressed = 0;
+  return true;
+}
+
+void TraceRateLimiter::Unadmit(size_t slot, uint64_t tag, uint64_t suppressed) {
+  const size_t index = slot % slots_.size();
+  std::lock_guard<std::mutex> lock(LockFor(index));
+  Slot& s = slots_[index];
+  if (s.tag != tag) {
+    return;
+  }
+  s.fullAt -= std::min(s.fullAt, interval_);
+  s.suppressed += suppressed + 1;
+}
+
+void TraceFilter::Configure(const TraceFilterSpec& spec, size_t apiCount, uint64_t ticksPerSecond) {
+  keys_ = KeyPrefixTrie();
+  for (const auto& prefix : spec.includeKeys) {
+    keys_.Add(prefix, true);
+  }
+  for (const auto& prefix : spec.excludeKeys) {
+    keys_.Add(prefix, false);
+  }
+  results_ = spec.results;
+  sampleEvery_ = std::max<uint32_t>(1, spec.sampleEvery);
+  apiRate_.Reset(spec.apiRate, apiCount, ticksPerSecond);
+  keyRate_.Reset(spec.keyRate, kKeyRateSlots, ticksPerSecond);
+  filtered_.store(0, std::memory_order_relaxed);
+  sampledOut_.store(0, std::memory_order_relaxed);
+  active_ = !spec.Empty();
+}
+
+bool TraceFilter::Admit(uint16_t api,
+                        const wchar_t* keyPath,
+                        size_t keySize,
+                        const int32_t* status,
+                        uint64_t now,
+                        uint32_t& sampleCounter,
+                        TraceSuppressedEvents& suppressed) {
+  suppressed = {};
+  if (!keys_.Empty()) {
+    const int rule = keys_.Match(keyPath, keySize);
+    if (rule < 0 || (rule == 0 && keys_.HasIncludes())) {
+      filtered_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+  if (results_ && (!status || !(ClassifyTraceResult(*status) & results_))) {
+    filtered_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  if (sampleEvery_ > 1 && sampleCounter++ % sampleEvery_ != 0) {
+    sampledOut_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  if (apiRate_.Enabled() && !apiRate_.Admit(api, api, now, suppressed.byApi)) {
+    return false;
+  }
+  if (keyRate_.Enabled()) {
+    const uint64_t hash = HashFoldedKey(keyPath, keySize);
+    if (!keyRate_.Admit((size_t)(hash % keyRate_.Slots()), hash, now, suppressed.byKey)) {
+      if (apiRate_.Enabled()) {
+        apiRate_.Unadmit(api, api, suppressed.byApi);
+        suppressed.byApi = 0;
+      }
+      return false;
+    }
+  }
+  return true;
+}
+
+TraceFilterCounters TraceFilter::Counters() const {
+  TraceFilterCounters counters;
+  counters.filtered = filtered_.load(std::memory_order_relaxed);
+  counters.sampledOut = sampledOut_.load(std::memory_order_relaxed);
+  counters.rateLimited = apiRate_.Refused() + keyRate_.Refused();
+  return counters;
+}
+
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace twinshim {
+
+// Selectors applied to registry trace events after the per-API mask
+// (TWINSHIM_DEBUG_APIS), so a busy title can stay traced without flooding the
+// pipe. The spec (--debug-filter, TWINSHIM_DEBUG_FILTER) is a ';'-separated
+// list of clauses:
+//
+//   key=<prefix>|!<prefix>|...  key paths under an included prefix, minus
+//                               those under a longer excluded one
+//   result=miss|error|ok        only reads with these outcomes; events that
+//                               carry no result are not traced
+//   sample=<N>                  1 in N of the events that passed the above
+//   rate=<N>                    at most N events per second per API
+//   keyrate=<N>                 at most N events per second per key path
+//
+// e.g. "key=HKLM\Software\Game|!HKLM\Software\Game\Cache;result=miss;rate=200"
+
+// Outcome classes for result=.
+constexpr uint8_t kTraceResultOk = 0x01;
+constexpr uint8_t kTraceResultMiss = 0x02;  // ERROR_FILE_NOT_FOUND / ERROR_PATH_NOT_FOUND
+constexpr uint8_t kTraceResultError = 0x04; // anything else that failed
+// ERROR_MORE_DATA and ERROR_NO_MORE_ITEMS count as ok: they are how callers
+// size buffers and end enumerations.
+uint8_t ClassifyTraceResult(int32_t status);
+
+struct TraceFilterSpec {
+  std::vector<std::wstring> includeKeys;
+  std::vector<std::wstring> excludeKeys;
+  uint8_t results = 0; // kTraceResult* bits; 0 = any
+  uint32_t sampleEvery = 1;
+  uint32_t apiRate = 0; // events per second; 0 = unlimited
+  uint32_t keyRate = 0;
+
+  bool Empty() const;
+};
+
+// False (with `error` naming the clause) for a malformed spec.
+bool ParseTraceFilterSpec(const std::wstring& spec, TraceFilterSpec& out, std::wstring* error = nullptr);
+
+// Key-path prefixes folded to lower case and merged into one character trie,
+// so matching costs one walk of the path however many prefixes there are. A
+// prefix matches whole components only: "HKLM\Software\Game" covers
+// "...\Game" and "...\Game\Video" but not "...\Games".
+class KeyPrefixTrie {
+public:
+  // Slashes become backslashes, surrounding separators are dropped and a
+  // leading HKEY_LOCAL_MACHINE is shortened to HKLM, as in trace key paths.
+  void Add(const std::wstring& prefix, bool include);
+
+  // The longest matching prefix decides: +1 included, -1 excluded, 0 when no
+  // prefix matches.
+  int Match(const wchar_t* path, size_t size) const;
+
+  bool Empty() const { return nodes_.size() <= 1; }
+  bool HasIncludes() const { return hasIncludes_; }
+
+private:
+  struct Node {
+    uint32_t firstChild = 0; // 0 = none (the root is never a child)
+    uint32_t nextSibling = 0;
+    wchar_t ch = 0;
+    int8_t rule = 0;
+  };
+
+  uint32_t Child(uint32_t node, wchar_t ch) const;
+
+  std::vector<Node> nodes_{Node{}};
+  bool hasIncludes_ = false;
+};
+
+// Token bucket in its virtual-scheduling form: each slot keeps only the time
+// its bucket would next be full, so a check is one compare and one add.
+// Buckets allow a burst of one second's worth of events. Events refused are
+// counted per slot and handed back with the next event the slot admits, so the
+// trace can say how many were suppressed in between.
+class TraceRateLimiter {
+public:
+  // Not safe to call while other threads are in Admit or Unadmit.
+  void Reset(uint32_t perSecond, size_t slots, uint64_t ticksPerSecond);
+  bool Enabled() const { return interval_ != 0; }
+  size_t Slots() const { return slots_.size(); }
+
+  // `tag` tells keys sharing a slot apart: a different tag takes the slot over
+  // with a full bucket. On admission `suppressed` is the count refused since
+  // the slot's previous admitted event.
+  bool Admit(size_t slot, uint64_t tag, uint64_t now, uint64_t& suppressed);
+  // Undoes an Admit whose event another limiter then refused: the token goes
+  // back and the event joins the slot's suppressed count.
+  void Unadmit(size_t slot, uint64_t tag, uint64_t suppressed);
+
+  uint64_t Refused() const { return refused_.load(std::memory_order_relaxed); }
+
+private:
+  struct Slot {
+    uint64_t tag = 0;
+    uint64_t fullAt = 0;
+    uint64_t suppressed = 0;
+  };
+
+  // Slots are guarded by striped locks, so threads tracing different APIs or
+  // keys rarely meet on one. Each stripe has its own cache line.
+  static constexpr size_t kLockStripes = 64;
+  struct alignas(64) Stripe {
+    std::mutex mutex;
+  };
+  std::mutex& LockFor(size_t index) { return stripes_[index % kLockStripes].mutex; }
+
+  Stripe stripes_[kLockStripes];
+  std::vector<Slot> slots_;
+  uint64_t interval_ = 0; // ticks per event
+  uint64_t burst_ = 0;    // ticks of credit a full bucket holds
+  std::atomic<uint64_t> refused_{0};
+};
+
+struct TraceFilterCounters {
+  uint64_t filtered = 0;    // key or result selectors said no
+  uint64_t sampledOut = 0;  // skipped by sample=
+  uint64_t rateLimited = 0; // refused by rate= or keyrate=
+};
+
+// Events suppressed by a rate limit, reported with the next one let through.
+struct TraceSuppressedEvents {
+  uint64_t byApi = 0;
+  uint64_t byKey = 0;
+};
+
+// All selectors of one spec. Thread-safe; the caller supplies the per-thread
+// sampling counter so sampling needs no shared state.
+class TraceFilter {
+public:
+  static constexpr size_t kKeyRateSlots = 1024;
+
+  void Configure(const TraceFilterSpec& spec, size_t apiCount, uint64_t ticksPerSecond);
+  // False when every event passes, so callers can skip the rest.
+  bool Active() const { return active_; }
+
+  // `status` is null for events that carry no result.
+  bool Admit(uint16_t api,
+             const wchar_t* keyPath,
+             size_t keySize,
+             const int32_t* status,
+             uint64_t now,
+             uint32_t& sampleCounter,
+             TraceSuppressedEvents& suppressed);
+
+  TraceFilterCounters Counters() const;
+
+private:
+  bool active_ = false;
+  KeyPrefixTrie keys_;
+  uint8_t results_ = 0;
+  uint32_t sampleEvery_ = 1;
+  TraceRateLimiter apiRate_;
+  TraceRateLimiter keyRate_;
+  std::atomic<uint64_t> filtered_{0};
+  std::atomic<uint64_t> sampledOut_{0};
+};
+
+}
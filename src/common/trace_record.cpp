@@ -0,0 +1,723 @@
+#include "common/trace_record.h"
+
+#include "common/registry_api_table.h"
+#include "common/utf8.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace twinshim {
+
+namespace {
+
+// REG_* values; the decoder also runs where <windows.h> doesn't exist.
+constexpr uint32_t kRegNone = 0;
+constexpr uint32_t kRegSz = 1;
+constexpr uint32_t kRegExpandSz = 2;
+constexpr uint32_t kRegBinary = 3;
+constexpr uint32_t kRegDword = 4;
+constexpr uint32_t kRegMultiSz = 7;
+constexpr uint32_t kRegQword = 11;
+
+constexpr int32_t kErrorSuccess = 0;
+constexpr int32_t kErrorMoreData = 234;
+
+// Reads larger than this were never rendered, only marked <data_present>.
+constexpr uint32_t kMaxTraceDataBytes = 1024;
+
+constexpr size_t kHeaderBytes = kTraceRecordHeaderBytes;
+constexpr size_t kClockBytes = 36;
+constexpr size_t kStringFixedBytes = 12;
+constexpr size_t kTextFixedBytes = 16;
+constexpr size_t kMaxRecordBytes = UINT16_MAX;
+
+template <typename T>
+void Put(char* out, size_t offset, T value) {
+  std::memcpy(out + offset, &value, sizeof(value));
+}
+
+template <typename T>
+T Get(const uint8_t* in, size_t offset) {
+  T value{};
+  std::memcpy(&value, in + offset, sizeof(value));
+  return value;
+}
+
+void PutHeader(char* out, size_t size, TraceRecordKind kind, uint8_t flags) {
+  Put<uint16_t>(out, 0, (uint16_t)size);
+  Put<uint8_t>(out, 2, (uint8_t)kind);
+  Put<uint8_t>(out, 3, flags);
+}
+
+// UTF-16 code units (as stored in records and registry data) to wchar_t.
+std::wstring WideFromUtf16(const uint8_t* bytes, size_t units) {
+  std::wstring out;
+  out.reserve(units);
+  for (size_t i = 0; i < units; i++) {
+    uint32_t cp = Get<uint16_t>(bytes, i * 2);
+#if !defined(_WIN32)
+    if (cp >= 0xD800u && cp <= 0xDBFFu && i + 1 < units) {
+      const uint32_t low = Get<uint16_t>(bytes, (i + 1) * 2);
+      if (low >= 0xDC00u && low <= 0xDFFFu) {
+        cp = 0x10000u + ((cp - 0xD800u) << 10) + (low - 0xDC00u);
+        i++;
+      }
+    }
+#endif
+    out.push_back((wchar_t)cp);
+  }
+  return out;
+}
+
+size_t Utf16Length(const uint8_t* bytes, size_t units) {
+  size_t end = 0;
+  while (end < units && Get<uint16_t>(bytes, end * 2) != 0) {
+    end++;
+  }
+  return end;
+}
+
+std::wstring AnsiBytesToWideBestEffort(const char* bytes, size_t len) {
+  if (!bytes || len == 0) {
+    return {};
+  }
+#if defined(_WIN32)
+  // Prefer strict conversion when supported; fall back to Windows' default substitution behavior.
+  const DWORD flagsToTry[] = {MB_ERR_INVALID_CHARS, 0};
+  for (DWORD flags : flagsToTry) {
+    int needed = MultiByteToWideChar(CP_ACP, flags, bytes, (int)len, nullptr, 0);
+    if (needed <= 0) {
+      continue;
+    }
+    std::wstring out;
+    out.resize((size_t)needed);
+    if (MultiByteToWideChar(CP_ACP, flags, bytes, (int)len, out.data(), needed) <= 0) {
+      continue;
+    }
+    return out;
+  }
+  return {};
+#else
+  // No code page here; Latin-1 keeps every byte visible.
+  return std::wstring(reinterpret_cast<const unsigned char*>(bytes),
+                      reinterpret_cast<const unsigned char*>(bytes) + len);
+#endif
+}
+
+std::wstring SanitizeForLog(const std::wstring& value, size_t maxChars = 140) {
+  std::wstring out;
+  out.reserve(value.size());
+  for (wchar_t ch : value) {
+    if (ch == L'\r' || ch == L'\n' || ch == L'\t') {
+      out.push_back(L' ');
+    } else {
+      out.push_back(ch);
+    }
+  }
+  if (out.size() > maxChars) {
+    out.resize(maxChars);
+    out += L"...";
+  }
+  return out;
+}
+
+std::wstring HexPreview(const uint8_t* data, size_t available, uint32_t cbData, size_t maxBytes = 24) {
+  if (!data || cbData == 0) {
+    return L"<empty>";
+  }
+  static const wchar_t* kHex = L"0123456789ABCDEF";
+  size_t used = std::min<size_t>(available, maxBytes);
+  std::wstring out;
+  out.reserve(used * 2 + 8);
+  for (size_t i = 0; i < used; i++) {
+    uint8_t b = data[i];
+    out.push_back(kHex[(b >> 4) & 0xF]);
+    out.push_back(kHex[b & 0xF]);
+  }
+  if (used < cbData) {
+    out += L"...";
+  }
+  return out;
+}
+
+std::wstring HexEncodeAll(const uint8_t* data, size_t available, uint32_t cbData) {
+  return HexPreview(data, available, cbData, available);
+}
+
+void AppendJsonString(std::string& out, const std::string& s) {
+  out.push_back('"');
+  for (char ch : s) {
+    switch (ch) {
+      case '"':  out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n";  break;
+      case '\r': out += "\\r";  break;
+      case '\t': out += "\\t";  break;
+      default:
+        if (static_cast<unsigned char>(ch) < 0x20) {
+          char buf[8];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(ch));
+          out += buf;
+        } else {
+          out.push_back(ch);
+        }
+        break;
+    }
+  }
+  out.push_back('"');
+}
+
+} // namespace
+
+const char* TraceOpName(TraceOp op) {
+  static const char* const kNames[] = {"call", "open_key", "create_key", "close_key", "set_value", "query_value",
+                                       "delete_value", "delete_key", "enum_key", "enum_value", "query_info", "notify"};
+  static_assert(sizeof(kNames) / sizeof(kNames[0]) == (size_t)TraceOp::Count, "one name per TraceOp");
+  return (size_t)op < (size_t)TraceOp::Count ? kNames[(size_t)op] : "call";
+}
+
+uint64_t TraceTicks() {
+#if defined(_WIN32)
+  LARGE_INTEGER now{};
+  QueryPerformanceCounter(&now);
+  return (uint64_t)now.QuadPart;
+#else
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+uint32_t TraceThreadId() {
+#if defined(_WIN32)
+  return (uint32_t)GetCurrentThreadId();
+#else
+  static thread_local const uint32_t tid = (uint32_t)syscall(SYS_gettid);
+  return tid;
+#endif
+}
+
+TraceClock CaptureTraceClock() {
+  TraceClock clock;
+  clock.baseTicks = TraceTicks();
+  const auto now = std::chrono::system_clock::now();
+  clock.baseUnixMicros = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+  const std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+#if defined(_WIN32)
+  clock.pid = (uint32_t)GetCurrentProcessId();
+  LARGE_INTEGER frequency{};
+  QueryPerformanceFrequency(&frequency);
+  clock.ticksPerSecond = (uint64_t)frequency.QuadPart;
+  std::tm local{};
+  std::tm utc{};
+  localtime_s(&local, &seconds);
+  gmtime_s(&utc, &seconds);
+  // mktime treats both as local time, so their difference is the offset.
+  utc.tm_isdst = local.tm_isdst;
+  clock.utcOffsetMinutes = (int32_t)(std::difftime(std::mktime(&local), std::mktime(&utc)) / 60);
+#else
+  clock.pid = (uint32_t)getpid();
+  clock.ticksPerSecond = 1000000000ull;
+  std::tm local{};
+  localtime_r(&seconds, &local);
+  clock.utcOffsetMinutes = (int32_t)(local.tm_gmtoff / 60);
+#endif
+  return clock;
+}
+
+size_t EncodeTraceClock(const TraceClock& clock, char* out, size_t capacity) {
+  if (capacity < kClockBytes) {
+    return 0;
+  }
+  PutHeader(out, kClockBytes, TraceRecordKind::Clock, 0);
+  Put<uint32_t>(out, 4, clock.pid);
+  Put<uint64_t>(out, 8, clock.ticksPerSecond);
+  Put<uint64_t>(out, 16, clock.baseTicks);
+  Put<int64_t>(out, 24, clock.baseUnixMicros);
+  Put<int32_t>(out, 32, clock.utcOffsetMinutes);
+  return kClockBytes;
+}
+
+size_t EncodeTraceEvent(const TraceEvent& event, const void* data, size_t dataSize, char* out, size_t capacity) {
+  const size_t prefix = data ? std::min(dataSize, kTraceDataPrefixBytes) : 0;
+  const size_t size = kTraceEventFixedBytes + prefix;
+  if (capacity < size) {
+    return 0;
+  }
+  PutHeader(out, size, TraceRecordKind::Event, event.flags);
+  Put<uint32_t>(out, 4, event.tid);
+  Put<uint64_t>(out, 8, event.ticks);
+  Put<uint16_t>(out, 16, event.api);
+  Put<uint8_t>(out, 18, (uint8_t)event.op);
+  Put<uint8_t>(out, 19, 0);
+  Put<int32_t>(out, 20, event.status);
+  Put<uint32_t>(out, 24, event.type);
+  Put<uint32_t>(out, 28, event.cbData);
+  Put<uint32_t>(out, 32, event.index);
+  Put<uint32_t>(out, 36, event.keyId);
+  Put<uint32_t>(out, 40, event.nameId);
+  Put<uint16_t>(out, 44, (uint16_t)prefix);
+  if (prefix) {
+    std::memcpy(out + kTraceEventFixedBytes, data, prefix);
+  }
+  return size;
+}
+
+size_t EncodeTraceString(uint32_t tid, uint32_t id, const uint16_t* units, size_t count, char* out, size_t capacity) {
+  count = std::min(count, kTraceMaxStringUnits);
+  const size_t size = kStringFixedBytes + count * sizeof(uint16_t);
+  if (capacity < size) {
+    return 0;
+  }
+  PutHeader(out, size, TraceRecordKind::String, 0);
+  Put<uint32_t>(out, 4, tid);
+  Put<uint32_t>(out, 8, id);
+  if (count) {
+    std::memcpy(out + kStringFixedBytes, units, count * sizeof(uint16_t));
+  }
+  return size;
+}
+
+bool EncodeTraceText(uint32_t tid, uint64_t ticks, const char* text, size_t size, std::string& out) {
+  if (kTextFixedBytes + size > kMaxRecordBytes) {
+    return false;
+  }
+  out.resize(kTextFixedBytes + size);
+  PutHeader(&out[0], out.size(), TraceRecordKind::Text, 0);
+  Put<uint32_t>(&out[0], 4, tid);
+  Put<uint64_t>(&out[0], 8, ticks);
+  if (size) {
+    std::memcpy(&out[kTextFixedBytes], text, size);
+  }
+  return true;
+}
+
+size_t TraceRecordSize(const char* header) {
+  return Get<uint16_t>(reinterpret_cast<const uint8_t*>(header), 0);
+}
+
+TraceRecordKind TraceRecordKindOf(const char* header) {
+  return (TraceRecordKind)Get<uint8_t>(reinterpret_cast<const uint8_t*>(header), 2);
+}
+
+uint64_t TraceStringRecordKey(const char* record, size_t size) {
+  if (size < kStringFixedBytes) {
+    return 0;
+  }
+  const auto* rec = reinterpret_cast<const uint8_t*>(record);
+  return ((uint64_t)Get<uint32_t>(rec, 4) << 32) | Get<uint32_t>(rec, 8);
+}
+
+std::wstring FormatRegType(uint32_t type) {
+  switch (type) {
+    case kRegNone:
+      return L"REG_NONE";
+    case kRegSz:
+      return L"REG_SZ";
+    case kRegExpandSz:
+      return L"REG_EXPAND_SZ";
+    case kRegBinary:
+      return L"REG_BINARY";
+    case kRegDword:
+      return L"REG_DWORD";
+    case kRegMultiSz:
+      return L"REG_MULTI_SZ";
+    case kRegQword:
+      return L"REG_QWORD";
+    default:
+      return L"REG_" + std::to_wstring(type);
+  }
+}
+
+std::wstring FormatValuePreview(uint32_t type, const uint8_t* data, size_t available, uint32_t cbData) {
+  if (!data || cbData == 0 || available == 0) {
+    return L"<empty>";
+  }
+  const bool truncated = available < cbData;
+
+  if (type == kRegDword && available >= sizeof(uint32_t)) {
+    return L"dword:" + std::to_wstring(Get<uint32_t>(data, 0));
+  }
+  if (type == kRegQword && available >= sizeof(uint64_t)) {
+    return L"qword:" + std::to_wstring(Get<uint64_t>(data, 0));
+  }
+
+  if (type == kRegSz || type == kRegExpandSz) {
+    const size_t chars = available / 2;
+    const size_t end = Utf16Length(data, chars);
+    std::wstring text = SanitizeForLog(WideFromUtf16(data, end));
+    if (truncated && end == chars && text.size() <= 140) {
+      text += L"...";
+    }
+    return L"str:\"" + text + L"\"";
+  }
+
+  if (type == kRegMultiSz) {
+    const size_t chars = available / 2;
+    size_t i = 0;
+    std::vector<std::wstring> parts;
+    while (i < chars) {
+      size_t start = i;
+      i += Utf16Length(data + start * 2, chars - start);
+      if (i == start) {
+        break;
+      }
+      parts.push_back(WideFromUtf16(data + start * 2, i - start));
+      i++;
+      if (parts.size() >= 2) {
+        break;
+      }
+    }
+    std::wstring joined;
+    for (size_t idx = 0; idx < parts.size(); idx++) {
+      if (idx) {
+        joined += L"|";
+      }
+      joined += SanitizeForLog(parts[idx], 40);
+    }
+    if (joined.empty()) {
+      joined = L"<empty>";
+    }
+    if (parts.size() >= 2 || (truncated && i >= chars)) {
+      joined += L"|...";
+    }
+    return L"multi:\"" + joined + L"\"";
+  }
+
+  return L"hex:" + HexPreview(data, available, cbData);
+}
+
+std::wstring FormatValueForTrace(bool typeKnown, uint32_t type, const uint8_t* data, size_t available,
+                                 uint32_t cbData, bool ansiStrings) {
+  if (!data || cbData == 0 || available == 0) {
+    return L"<empty>";
+  }
+  const bool truncated = available < cbData;
+
+  if (!typeKnown) {
+    return L"hex:" + HexEncodeAll(data, available, cbData);
+  }
+
+  if (type == kRegDword && available >= sizeof(uint32_t)) {
+    return L"dword:" + std::to_wstring(Get<uint32_t>(data, 0));
+  }
+  if (type == kRegQword && available >= sizeof(uint64_t)) {
+    return L"qword:" + std::to_wstring(Get<uint64_t>(data, 0));
+  }
+
+  if (type == kRegSz || type == kRegExpandSz) {
+    std::wstring text;
+    bool cut = false;
+    if (ansiStrings) {
+      const char* bytes = reinterpret_cast<const char*>(data);
+      size_t end = 0;
+      while (end < available && bytes[end] != '\0') {
+        end++;
+      }
+      if (end == 0) {
+        return L"str:\"\"";
+      }
+      text = AnsiBytesToWideBestEffort(bytes, end);
+      if (text.empty()) {
+        return L"hex:" + HexPreview(data, available, cbData);
+      }
+      cut = truncated && end == available;
+    } else {
+      const size_t chars = available / 2;
+      const size_t end = Utf16Length(data, chars);
+      text = WideFromUtf16(data, end);
+      cut = truncated && end == chars;
+    }
+    return L"str:\"" + SanitizeForLog(text, 512) + (cut ? L"..." : L"") + L"\"";
+  }
+
+  if (type == kRegMultiSz) {
+    std::wstring joined;
+    bool cut = false;
+    if (ansiStrings) {
+      const char* bytes = reinterpret_cast<const char*>(data);
+      size_t i = 0;
+      while (i < available) {
+        size_t start = i;
+        while (i < available && bytes[i] != '\0') {
+          i++;
+        }
+        if (i == start) {
+          break;
+        }
+        if (!joined.empty()) {
+          joined += L"|";
+        }
+        std::wstring part = AnsiBytesToWideBestEffort(bytes + start, i - start);
+        if (part.empty()) {
+          joined += L"<hex:" + HexPreview(data + start, i - start, (uint32_t)(i - start)) + L">";
+        } else {
+          joined += SanitizeForLog(part, 256);
+        }
+        // Skip the NUL separator.
+        i++;
+      }
+      cut = truncated && i >= available;
+    } else {
+      const size_t chars = available / 2;
+      size_t i = 0;
+      while (i < chars) {
+        size_t start = i;
+        i += Utf16Length(data + start * 2, chars - start);
+        if (i == start) {
+          break;
+        }
+        if (!joined.empty()) {
+          joined += L"|";
+        }
+        joined += SanitizeForLog(WideFromUtf16(data + start * 2, i - start), 256);
+        i++;
+      }
+      cut = truncated && i >= chars;
+    }
+    if (joined.empty()) {
+      joined = L"<empty>";
+    }
+    if (cut) {
+      joined += L"...";
+    }
+    return L"multi:\"" + joined + L"\"";
+  }
+
+  return L"hex:" + HexEncodeAll(data, available, cbData);
+}
+
+void TraceDecoder::Feed(const char* data, size_t size, std::string& out) {
+  pending_.append(data, size);
+  size_t at = 0;
+  while (pending_.size() - at >= kHeaderBytes) {
+    const auto* rec = reinterpret_cast<const uint8_t*>(pending_.data() + at);
+    const size_t recSize = Get<uint16_t>(rec, 0);
+    if (recSize < kHeaderBytes) {
+      // No way to find the next record boundary.
+      malformed_++;
+      at = pending_.size();
+      break;
+    }
+    if (pending_.size() - at < recSize) {
+      break;
+    }
+    DecodeRecord(rec, recSize, out);
+    at += recSize;
+  }
+  pending_.erase(0, at);
+}
+
+bool TraceDecoder::Finish(std::string& out) {
+  if (!pending_.empty()) {
+    malformed_++;
+    if (format_ == Format::Text) {
+      out += "[trace] " + std::to_string(pending_.size()) + " trailing bytes (truncated record)\n";
+    }
+    pending_.clear();
+  }
+  return malformed_ == 0;
+}
+
+void TraceDecoder::DecodeRecord(const uint8_t* rec, size_t size, std::string& out) {
+  const auto kind = (TraceRecordKind)Get<uint8_t>(rec, 2);
+  const uint8_t flags = Get<uint8_t>(rec, 3);
+  switch (kind) {
+    case TraceRecordKind::Clock:
+      if (size < kClockBytes) {
+        break;
+      }
+      clock_.pid = Get<uint32_t>(rec, 4);
+      clock_.ticksPerSecond = Get<uint64_t>(rec, 8);
+      clock_.baseTicks = Get<uint64_t>(rec, 16);
+      clock_.baseUnixMicros = Get<int64_t>(rec, 24);
+      clock_.utcOffsetMinutes = Get<int32_t>(rec, 32);
+      haveClock_ = clock_.ticksPerSecond != 0;
+      return;
+    case TraceRecordKind::String: {
+      if (size < kStringFixedBytes) {
+        break;
+      }
+      const uint64_t key = ((uint64_t)Get<uint32_t>(rec, 4) << 32) | Get<uint32_t>(rec, 8);
+      strings_[clock_.pid][key] = WideFromUtf16(rec + kStringFixedBytes, (size - kStringFixedBytes) / 2);
+      return;
+    }
+    case TraceRecordKind::Event: {
+      if (size < kTraceEventFixedBytes) {
+        break;
+      }
+      TraceEvent e;
+      e.flags = flags;
+      e.tid = Get<uint32_t>(rec, 4);
+      e.ticks = Get<uint64_t>(rec, 8);
+      e.api = Get<uint16_t>(rec, 16);
+      e.op = (TraceOp)Get<uint8_t>(rec, 18);
+      e.status = Get<int32_t>(rec, 20);
+      e.type = Get<uint32_t>(rec, 24);
+      e.cbData = Get<uint32_t>(rec, 28);
+      e.index = Get<uint32_t>(rec, 32);
+      e.keyId = Get<uint32_t>(rec, 36);
+      e.nameId = Get<uint32_t>(rec, 40);
+      const size_t prefix = Get<uint16_t>(rec, 44);
+      if (e.api >= kRegistryApiCount || kTraceEventFixedBytes + prefix > size) {
+        break;
+      }
+      EmitEvent(e, rec + kTraceEventFixedBytes, prefix, out);
+      return;
+    }
+    case TraceRecordKind::Text:
+      if (size < kTextFixedBytes) {
+        break;
+      }
+      EmitText(Get<uint32_t>(rec, 4), Get<uint64_t>(rec, 8), reinterpret_cast<const char*>(rec + kTextFixedBytes),
+               size - kTextFixedBytes, out);
+      return;
+  }
+  malformed_++;
+}
+
+std::wstring TraceDecoder::Lookup(uint32_t tid, uint32_t id) const {
+  if (id == 0) {
+    return L"-";
+  }
+  auto process = strings_.find(clock_.pid);
+  if (process != strings_.end()) {
+    auto it = process->second.find(((uint64_t)tid << 32) | id);
+    if (it != process->second.end()) {
+      return it->second.empty() ? L"-" : it->second;
+    }
+  }
+  // The definition was dropped (full ring) or predates this stream.
+  return L"<str:" + std::to_wstring(id) + L">";
+}
+
+int64_t TraceDecoder::UnixMicros(uint64_t ticks) const {
+  const int64_t delta = (int64_t)(ticks - clock_.baseTicks);
+  const int64_t whole = delta / (int64_t)clock_.ticksPerSecond;
+  const int64_t part = delta % (int64_t)clock_.ticksPerSecond;
+  return clock_.baseUnixMicros + whole * 1000000 + part * 1000000 / (int64_t)clock_.ticksPerSecond;
+}
+
+std::string TraceDecoder::FormatTime(uint64_t ticks) const {
+  if (!haveClock_) {
+    return "(--:--:--.---)";
+  }
+  constexpr int64_t kMicrosPerDay = 86400ll * 1000000;
+  int64_t local = UnixMicros(ticks) + (int64_t)clock_.utcOffsetMinutes * 60 * 1000000;
+  local = ((local % kMicrosPerDay) + kMicrosPerDay) % kMicrosPerDay;
+  const int64_t ms = local / 1000;
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "(%02d:%02d:%02d.%03d)", (int)(ms / 3600000), (int)(ms / 60000 % 60),
+                (int)(ms / 1000 % 60), (int)(ms % 1000));
+  return buf;
+}
+
+void TraceDecoder::EmitEvent(const TraceEvent& e, const uint8_t* data, size_t dataSize, std::string& out) {
+  events_++;
+  const RegistryApiInfo& info = GetRegistryApiInfo((RegistryApi)e.api);
+  const bool hasIndex = (e.flags & kTraceEventHasIndex) != 0;
+  std::wstring name = Lookup(e.tid, e.nameId);
+  std::wstring value;
+
+  if (e.flags & kTraceEventHasResult) {
+    if (e.op == TraceOp::EnumValue && hasIndex) {
+      value = L"idx=" + std::to_wstring(e.index) + L" ";
+      if (e.nameId == 0) {
+        name = L"index:" + std::to_wstring(e.index);
+      }
+    }
+    value += L"rc=" + std::to_wstring((uint32_t)e.status);
+    if (e.flags & kTraceEventTypeKnown) {
+      value += L" type=" + FormatRegType(e.type);
+    }
+    value += L" cb=" + std::to_wstring(e.cbData);
+    if (e.status == kErrorSuccess) {
+      if ((e.flags & kTraceEventHasData) && e.cbData) {
+        if (e.cbData <= kMaxTraceDataBytes) {
+          value += L" data=" + FormatValueForTrace((e.flags & kTraceEventTypeKnown) != 0, e.type, data, dataSize,
+                                                   e.cbData, info.ansi);
+        } else {
+          value += L" <data_present>";
+        }
+      } else if (e.flags & kTraceEventSizeOnly) {
+        value += L" <size_only>";
+      }
+    } else if (e.status == kErrorMoreData) {
+      value += L" <more_data>";
+    }
+  } else if (e.op == TraceOp::SetValue) {
+    value = FormatRegType(e.type) + L":" + FormatValuePreview(e.type, data, dataSize, e.cbData);
+  } else if (hasIndex) {
+    name = L"index";
+    value = std::to_wstring(e.index);
+  } else if (e.op == TraceOp::Notify) {
+    value = (e.flags & kTraceEventSubtree) ? L"subtree" : L"key";
+  } else {
+    value = L"-";
+  }
+
+  const std::wstring key = Lookup(e.tid, e.keyId);
+  if (format_ == Format::Text) {
+    out += FormatTime(e.ticks);
+    out += " [" + std::to_string(clock_.pid) + ":" + std::to_string(e.tid) + "] api=";
+    out += WideToUtf8(info.name);
+    out += " op=";
+    out += TraceOpName(e.op);
+    out += " key=\"" + WideToUtf8(SanitizeForLog(key)) + "\" name=\"" + WideToUtf8(SanitizeForLog(name)) +
+           "\" value=\"" + WideToUtf8(SanitizeForLog(value)) + "\"\n";
+    return;
+  }
+
+  out += "{\"ts_us\":" + std::to_string(haveClock_ ? UnixMicros(e.ticks) : 0);
+  out += ",\"pid\":" + std::to_string(clock_.pid) + ",\"tid\":" + std::to_string(e.tid) + ",\"api\":";
+  AppendJsonString(out, WideToUtf8(info.name));
+  out += ",\"op\":";
+  AppendJsonString(out, TraceOpName(e.op));
+  out += ",\"key\":";
+  AppendJsonString(out, WideToUtf8(key));
+  out += ",\"name\":";
+  AppendJsonString(out, WideToUtf8(name));
+  if (e.flags & kTraceEventHasResult) {
+    out += ",\"rc\":" + std::to_string(e.status);
+    if (e.flags & kTraceEventTypeKnown) {
+      out += ",\"type\":";
+      AppendJsonString(out, WideToUtf8(FormatRegType(e.type)));
+    }
+    out += ",\"cb\":" + std::to_string(e.cbData);
+  }
+  if (hasIndex) {
+    out += ",\"index\":" + std::to_string(e.index);
+  }
+  out += ",\"value\":";
+  AppendJsonString(out, WideToUtf8(value));
+  out += "}\n";
+}
+
+void TraceDecoder::EmitText(uint32_t tid, uint64_t ticks, const char* text, size_t size, std::string& out) {
+  if (format_ == Format::Text) {
+    // Subsystem lines carry their own layout; pass them through untouched.
+    out.append(text, size);
+    return;
+  }
+  std::string line(text, size);
+  while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+    line.pop_back();
+  }
+  out += "{\"ts_us\":" + std::to_string(haveClock_ ? UnixMicros(ticks) : 0);
+  out += ",\"pid\":" + std::to_string(clock_.pid) + ",\"tid\":" + std::to_string(tid) + ",\"text\":";
+  AppendJsonString(out, line);
+  out += "}\n";
+}
+
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace twinshim {
+
+// Binary trace records. The shim writes these instead of text lines; the
+// wrapper (live) or `hklmreg trace-decode` (offline) turns them back into the
+// familiar "api=... op=... key=... name=... value=..." lines or JSON lines.
+//
+// Every record starts with a 4-byte header: uint16 total size (header
+// included), uint8 kind, uint8 flags. Fields are little-endian and packed.
+// Key paths and value names are interned per writing thread: a String record
+// defines (tid, id) -> text once, later events refer to the id. Because a
+// thread's records stay in order through the transport, a definition always
+// precedes its uses.
+
+enum class TraceRecordKind : uint8_t {
+  Clock = 1,  // pid and the tick <-> wall clock mapping; first on every connection
+  String = 2, // interned key path / value name
+  Event = 3,  // one registry API event
+  Text = 4,   // a preformatted line from another subsystem
+};
+
+enum class TraceOp : uint8_t {
+  Call = 0,
+  OpenKey,
+  CreateKey,
+  CloseKey,
+  SetValue,
+  QueryValue,
+  DeleteValue,
+  DeleteKey,
+  EnumKey,
+  EnumValue,
+  QueryInfo,
+  Notify,
+  Count
+};
+
+const char* TraceOpName(TraceOp op);
+
+// Event flags (header flags byte).
+constexpr uint8_t kTraceEventHasResult = 0x01; // status/type/cbData describe a completed read
+constexpr uint8_t kTraceEventTypeKnown = 0x02;
+constexpr uint8_t kTraceEventHasIndex = 0x04;  // enum index is meaningful
+constexpr uint8_t kTraceEventSizeOnly = 0x08;  // caller asked for the size only
+constexpr uint8_t kTraceEventHasData = 0x10;   // the read returned the value, not just its size
+constexpr uint8_t kTraceEventSubtree = 0x20;   // notify: whole subtree watched
+
+// Value bytes carried per event. Previews never needed more than this; reads
+// larger than the prefix are decoded with a trailing "...".
+constexpr size_t kTraceDataPrefixBytes = 256;
+// Interned strings are cut to this many UTF-16 units.
+constexpr size_t kTraceMaxStringUnits = 1024;
+
+constexpr size_t kTraceRecordHeaderBytes = 4;
+constexpr size_t kTraceEventFixedBytes = 46;
+constexpr size_t kTraceEventMaxBytes = kTraceEventFixedBytes + kTraceDataPrefixBytes;
+
+struct TraceClock {
+  uint32_t pid = 0;
+  uint64_t ticksPerSecond = 0;
+  uint64_t baseTicks = 0;
+  int64_t baseUnixMicros = 0;   // wall clock at baseTicks, UTC
+  int32_t utcOffsetMinutes = 0; // local time = UTC + offset
+};
+
+// Monotonic high-resolution ticks (QPC on Windows, steady_clock elsewhere).
+uint64_t TraceTicks();
+uint32_t TraceThreadId();
+// Pairs "now" in ticks with the wall clock for the current process.
+TraceClock CaptureTraceClock();
+
+struct TraceEvent {
+  uint8_t flags = 0;
+  uint32_t tid = 0;
+  uint64_t ticks = 0;
+  uint16_t api = 0; // RegistryApi
+  TraceOp op = TraceOp::Call;
+  int32_t status = 0;
+  uint32_t type = 0;
+  uint32_t cbData = 0; // full size; the record may carry only a prefix
+  uint32_t index = 0;
+  uint32_t keyId = 0;  // 0 = none
+  uint32_t nameId = 0; // 0 = none
+};
+
+// Encoders write into caller storage and return the record size (0 if it
+// doesn't fit). No allocation, so they are cheap on hooked call paths.
+size_t EncodeTraceClock(const TraceClock& clock, char* out, size_t capacity);
+// Copies at most kTraceDataPrefixBytes of `data` after the fixed fields.
+size_t EncodeTraceEvent(const TraceEvent& event, const void* data, size_t dataSize, char* out, size_t capacity);
+// `units` are UTF-16 code units, cut to kTraceMaxStringUnits.
+size_t EncodeTraceString(uint32_t tid, uint32_t id, const uint16_t* units, size_t count, char* out, size_t capacity);
+// Text records may need a heap buffer; returns false if `text` is too long.
+bool EncodeTraceText(uint32_t tid, uint64_t ticks, const char* text, size_t size, std::string& out);
+
+// Framing for code that routes records without decoding them. `header` must
+// hold kTraceRecordHeaderBytes; a size below that means the stream is broken.
+size_t TraceRecordSize(const char* header);
+TraceRecordKind TraceRecordKindOf(const char* header);
+// (tid << 32 | id) of a String record.
+uint64_t TraceStringRecordKey(const char* record, size_t size);
+
+// Decodes a stream of records into text lines (the pre-binary trace format)
+// or JSON lines. Feed accepts arbitrary chunks; a partial record is kept until
+// the rest arrives.
+class TraceDecoder {
+public:
+  enum class Format { Text, Json };
+
+  explicit TraceDecoder(Format format = Format::Text) : format_(format) {}
+
+  void Feed(const char* data, size_t size, std::string& out);
+  // Reports a trailing partial record, if any. Returns false if the stream was
+  // malformed anywhere.
+  bool Finish(std::string& out);
+
+  uint64_t Events() const { return events_; }
+  uint64_t Malformed() const { return malformed_; }
+
+private:
+  void DecodeRecord(const uint8_t* rec, size_t size, std::string& out);
+  void EmitEvent(const TraceEvent& e, const uint8_t* data, size_t dataSize, std::string& out);
+  void EmitText(uint32_t tid, uint64_t ticks, const char* text, size_t size, std::string& out);
+  std::wstring Lookup(uint32_t tid, uint32_t id) const;
+  std::string FormatTime(uint64_t ticks) const;
+  int64_t UnixMicros(uint64_t ticks) const;
+
+  Format format_;
+  TraceClock clock_;
+  bool haveClock_ = false;
+  std::string pending_;
+  // pid -> (tid << 32 | id) -> text. A merged stream (the collector's raw
+  // file) switches processes with a Clock record, and ids are per process.
+  std::unordered_map<uint32_t, std::unordered_map<uint64_t, std::wstring>> strings_;
+  uint64_t events_ = 0;
+  uint64_t malformed_ = 0;
+};
+
+// Value formatting shared by the decoder and its tests; `type` is a REG_*
+// value. `available` bytes of a `cbData`-byte value are present.
+std::wstring FormatRegType(uint32_t type);
+// Short preview used for writes (set_value).
+std::wstring FormatValuePreview(uint32_t type, const uint8_t* data, size_t available, uint32_t cbData);
+// Fuller rendering used for completed reads.
+std::wstring FormatValueForTrace(bool typeKnown, uint32_t type, const uint8_t* data, size_t available,
+                                 uint32_t cbData, bool ansiStrings);
+
+}
@@ -0,0 +1,373 @@
+#include "common/trace_transport.h"
+
+#include "common/utf8.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace twinshim {
+
+namespace {
+
+constexpr std::chrono::seconds kReconnectInterval{1};
+
+class FileTraceSink : public TraceSink {
+public:
+  explicit FileTraceSink(FILE* f) : f_(f) {}
+  ~FileTraceSink() override {
+    std::fclose(f_);
+  }
+
+  bool Write(const char* data, size_t size) override {
+    return std::fwrite(data, 1, size, f_) == size && std::fflush(f_) == 0;
+  }
+
+private:
+  FILE* f_;
+};
+
+class PipeTraceSink : public TraceSink {
+public:
+  PipeTraceSink(std::wstring name, std::string preamble) : name_(std::move(name)), preamble_(std::move(preamble)) {}
+  ~PipeTraceSink() override {
+    Disconnect();
+  }
+
+  bool Write(const char* data, size_t size) override {
+    if (!Connected() && !Connect()) {
+      return false;
+    }
+    if (WriteAll(data, size)) {
+      return true;
+    }
+    Disconnect();
+    nextAttempt_ = std::chrono::steady_clock::now() + kReconnectInterval;
+    return false;
+  }
+
+private:
+  bool Connect() {
+    const auto now = std::chrono::steady_clock::now();
+    if (now < nextAttempt_) {
+      return false;
+    }
+    nextAttempt_ = now + kReconnectInterval;
+#if defined(_WIN32)
+    HANDLE h = CreateFileW(name_.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+      return false;
+    }
+    handle_ = h;
+#else
+    const std::string path = WideToUtf8(name_);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+      return false;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+      return false;
+    }
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+      close(fd);
+      return false;
+    }
+    fd_ = fd;
+#endif
+    if (!preamble_.empty() && !WriteAll(preamble_.data(), preamble_.size())) {
+      Disconnect();
+      return false;
+    }
+    return true;
+  }
+
+  bool WriteAll(const char* data, size_t size) {
+#if defined(_WIN32)
+    while (size) {
+      DWORD written = 0;
+      if (!WriteFile(handle_, data, (DWORD)size, &written, nullptr)) {
+        return false;
+      }
+      data += written;
+      size -= written;
+    }
+#else
+    while (size) {
+      const ssize_t sent = send(fd_, data, size, MSG_NOSIGNAL);
+      if (sent < 0 && errno == EINTR) {
+        continue;
+      }
+      if (sent <= 0) {
+        return false;
+      }
+      data += sent;
+      size -= (size_t)sent;
+    }
+#endif
+    return true;
+  }
+
+#if defined(_WIN32)
+  bool Connected() const { return handle_ != INVALID_HANDLE_VALUE; }
+  void Disconnect() {
+    if (handle_ != INVALID_HANDLE_VALUE) {
+      CloseHandle(handle_);
+      handle_ = INVALID_HANDLE_VALUE;
+    }
+  }
+  HANDLE handle_ = INVALID_HANDLE_VALUE;
+#else
+  bool Connected() const { return fd_ >= 0; }
+  void Disconnect() {
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+  int fd_ = -1;
+#endif
+
+  std::wstring name_;
+  std::string preamble_;
+  std::chrono::steady_clock::time_point nextAttempt_{};
+};
+
+// The calling thread's ring for each transport it has written to. Rings are
+// shared with the transport, so either side may go away first.
+struct ThreadRings {
+  struct Entry {
+    uint64_t transportId;
+    std::shared_ptr<TraceRing> ring;
+  };
+  std::vector<Entry> entries;
+
+  ~ThreadRings() {
+    for (auto& e : entries) {
+      e.ring->abandoned.store(true, std::memory_order_release);
+    }
+  }
+};
+
+thread_local ThreadRings t_rings;
+
+} // namespace
+
+std::unique_ptr<TraceSink> MakeFileTraceSink(const std::wstring& path) {
+#if defined(_WIN32)
+  FILE* f = _wfopen(path.c_str(), L"ab");
+#else
+  FILE* f = std::fopen(WideToUtf8(path).c_str(), "ab");
+#endif
+  if (!f) {
+    return nullptr;
+  }
+  return std::make_unique<FileTraceSink>(f);
+}
+
+std::unique_ptr<TraceSink> MakePipeTraceSink(const std::wstring& name, std::string preamble) {
+  if (name.empty()) {
+    return nullptr;
+  }
+  return std::make_unique<PipeTraceSink>(name, std::move(preamble));
+}
+
+TraceRing::TraceRing(size_t capacity) : buffer_(capacity) {}
+
+void TraceRing::CopyIn(uint64_t at, const void* data, size_t size) {
+  const size_t offset = (size_t)(at % buffer_.size());
+  const size_t first = std::min(size, buffer_.size() - offset);
+  std::memcpy(buffer_.data() + offset, data, first);
+  std::memcpy(buffer_.data(), static_cast<const char*>(data) + first, size - first);
+}
+
+void TraceRing::CopyOut(uint64_t at, void* data, size_t size) const {
+  const size_t offset = (size_t)(at % buffer_.size());
+  const size_t first = std::min(size, buffer_.size() - offset);
+  std::memcpy(data, buffer_.data() + offset, first);
+  std::memcpy(static_cast<char*>(data) + first, buffer_.data(), size - first);
+}
+
+bool TraceRing::Push(const void* data, size_t size) {
+  const uint64_t head = head_.load(std::memory_order_relaxed);
+  const uint64_t tail = tail_.load(std::memory_order_acquire);
+  const size_t need = sizeof(uint32_t) + size;
+  if (size > UINT32_MAX || need > buffer_.size() - (size_t)(head - tail)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  const uint32_t length = (uint32_t)size;
+  CopyIn(head, &length, sizeof(length));
+  CopyIn(head + sizeof(length), data, size);
+  head_.store(head + need, std::memory_order_release);
+  return true;
+}
+
+size_t TraceRing::DrainTo(std::string& out, size_t limit) {
+  const uint64_t tail = tail_.load(std::memory_order_relaxed);
+  const uint64_t head = head_.load(std::memory_order_acquire);
+  uint64_t at = tail;
+  while (at != head && out.size() < limit) {
+    uint32_t length = 0;
+    CopyOut(at, &length, sizeof(length));
+    const size_t start = out.size();
+    out.resize(start + length);
+    CopyOut(at + sizeof(length), &out[start], length);
+    at += sizeof(length) + length;
+  }
+  tail_.store(at, std::memory_order_release);
+  return (size_t)(at - tail);
+}
+
+size_t TraceRing::Used() const {
+  return (size_t)(head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire));
+}
+
+uint64_t TraceTransport::NextId() {
+  static std::atomic<uint64_t> next{1};
+  return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+TraceTransport::~TraceTransport() {
+  Stop();
+}
+
+bool TraceTransport::Start(std::unique_ptr<TraceSink> sink, const TraceTransportOptions& options) {
+  if (!sink || Running() || drain_.joinable()) {
+    return false;
+  }
+  sink_ = std::move(sink);
+  options_ = options;
+  batch_.reserve(options_.batchBytes * 2);
+  stopping_.store(false, std::memory_order_release);
+  running_.store(true, std::memory_order_release);
+  drain_ = std::thread([this] { DrainThreadProc(); });
+  return true;
+}
+
+void TraceTransport::Stop() {
+  if (!drain_.joinable()) {
+    return;
+  }
+  running_.store(false, std::memory_order_release);
+  {
+    std::lock_guard<std::mutex> lock(wakeMutex_);
+    stopping_.store(true, std::memory_order_release);
+  }
+  wake_.notify_one();
+  drain_.join();
+  Flush();
+}
+
+bool TraceTransport::Write(const void* data, size_t size) {
+  if (!Running()) {
+    return false;
+  }
+  TraceRing* ring = RingForThisThread();
+  if (!ring || !ring->Push(data, size)) {
+    return false;
+  }
+  records_.fetch_add(1, std::memory_order_relaxed);
+  // Past half full, don't wait for the next interval. A wakeup lost to the
+  // unlocked notify only delays the drain by one interval.
+  if (ring->Used() * 2 > ring->Capacity()) {
+    wake_.notify_one();
+  }
+  return true;
+}
+
+TraceRing* TraceTransport::RingForThisThread() {
+  for (auto& e : t_rings.entries) {
+    if (e.transportId == id_) {
+      return e.ring.get();
+    }
+  }
+  std::shared_ptr<TraceRing> ring;
+  {
+    std::lock_guard<std::mutex> lock(ringsMutex_);
+    // Reuse a ring whose thread exited once the drain has emptied it.
+    for (auto& r : rings_) {
+      if (r->abandoned.load(std::memory_order_acquire) && r->Used() == 0) {
+        r->abandoned.store(false, std::memory_order_relaxed);
+        ring = r;
+        break;
+      }
+    }
+    if (!ring) {
+      ring = std::make_shared<TraceRing>(options_.ringBytes);
+      rings_.push_back(ring);
+    }
+  }
+  t_rings.entries.push_back({id_, ring});
+  return ring.get();
+}
+
+void TraceTransport::DrainThreadProc() {
+  std::unique_lock<std::mutex> lock(wakeMutex_);
+  while (!stopping_.load(std::memory_order_acquire)) {
+    wake_.wait_for(lock, options_.drainInterval);
+    lock.unlock();
+    Flush();
+    lock.lock();
+  }
+}
+
+void TraceTransport::Flush() {
+  std::lock_guard<std::mutex> lock(drainMutex_);
+  DrainOnce();
+}
+
+void TraceTransport::DrainOnce() {
+  if (!sink_) {
+    return;
+  }
+  std::vector<std::shared_ptr<TraceRing>> rings;
+  {
+    std::lock_guard<std::mutex> lock(ringsMutex_);
+    rings = rings_;
+  }
+  auto writeBatch = [this] {
+    batches_.fetch_add(1, std::memory_order_relaxed);
+    if (sink_->Write(batch_.data(), batch_.size())) {
+      bytesWritten_.fetch_add(batch_.size(), std::memory_order_relaxed);
+    } else {
+      bytesLost_.fetch_add(batch_.size(), std::memory_order_relaxed);
+    }
+    batch_.clear();
+  };
+  for (const auto& ring : rings) {
+    while (ring->DrainTo(batch_, options_.batchBytes) && batch_.size() >= options_.batchBytes) {
+      writeBatch();
+    }
+  }
+  if (!batch_.empty()) {
+    writeBatch();
+  }
+}
+
+TraceTransportCounters TraceTransport::Counters() const {
+  TraceTransportCounters c;
+  c.records = records_.load(std::memory_order_relaxed);
+  c.batches = batches_.load(std::memory_order_relaxed);
+  c.bytesWritten = bytesWritten_.load(std::memory_order_relaxed);
+  c.bytesLost = bytesLost_.load(std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(ringsMutex_);
+  c.rings = rings_.size();
+  for (const auto& ring : rings_) {
+    c.droppedRecords += ring->Dropped();
+  }
+  return c;
+}
+
+}
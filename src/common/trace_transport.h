@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace twinshim {
+
+// Where drained trace batches go. Only the drain (or a Flush caller) writes,
+// one batch at a time, so sinks need no locking of their own.
+class TraceSink {
+public:
+  virtual ~TraceSink() = default;
+  // Writes one batch; false means the bytes were lost.
+  virtual bool Write(const char* data, size_t size) = 0;
+};
+
+// Appends to a file, created if missing.
+std::unique_ptr<TraceSink> MakeFileTraceSink(const std::wstring& path);
+
+// The wrapper's debug endpoint: a named pipe on Windows, a UNIX domain socket
+// elsewhere. Connects on the first batch and keeps the connection; after a
+// failure it drops batches and tries again at most once a second. `preamble`,
+// if given, is sent first on every new connection (the binary trace format's
+// clock record, so a reader can decode from any point).
+std::unique_ptr<TraceSink> MakePipeTraceSink(const std::wstring& name, std::string preamble = {});
+
+// Single-producer/single-consumer byte ring holding length-prefixed records.
+// The owning thread appends; the drain consumes. Neither side locks.
+class TraceRing {
+public:
+  explicit TraceRing(size_t capacity);
+
+  // False (and counted) when the record doesn't fit; the writer never waits.
+  bool Push(const void* data, size_t size);
+  // Appends record payloads to `out` until it holds at least `limit` bytes or
+  // the ring is empty; returns bytes consumed.
+  size_t DrainTo(std::string& out, size_t limit);
+
+  size_t Used() const;
+  size_t Capacity() const { return buffer_.size(); }
+  uint64_t Dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  // Set when the owning thread exits; the ring is reused once drained.
+  std::atomic<bool> abandoned{false};
+
+private:
+  void CopyIn(uint64_t at, const void* data, size_t size);
+  void CopyOut(uint64_t at, void* data, size_t size) const;
+
+  std::vector<char> buffer_;
+  std::atomic<uint64_t> head_{0}; // written by the producer
+  std::atomic<uint64_t> tail_{0}; // written by the consumer
+  std::atomic<uint64_t> dropped_{0};
+};
+
+struct TraceTransportOptions {
+  size_t ringBytes = 64 * 1024;                // per writing thread
+  size_t batchBytes = 64 * 1024;               // largest single sink write
+  std::chrono::milliseconds drainInterval{20}; // drain wakes at least this often
+};
+
+struct TraceTransportCounters {
+  uint64_t records = 0;        // accepted by Write
+  uint64_t droppedRecords = 0; // a ring was full
+  uint64_t batches = 0;        // sink writes attempted
+  uint64_t bytesWritten = 0;   // bytes the sink accepted
+  uint64_t bytesLost = 0;      // bytes the sink refused
+  size_t rings = 0;
+};
+
+// Asynchronous trace transport shared by every shim subsystem. Write copies a
+// record into the calling thread's ring and returns; a background drain
+// thread gathers all rings into batches and hands each batch to the sink in
+// one call. Nothing on the writing side blocks: a full ring drops the record
+// and counts it, and a failing sink loses whole batches, also counted.
+//
+// Records from one thread stay in order; records from different threads are
+// ordered only by batch.
+class TraceTransport {
+public:
+  TraceTransport() = default;
+  ~TraceTransport();
+
+  TraceTransport(const TraceTransport&) = delete;
+  TraceTransport& operator=(const TraceTransport&) = delete;
+
+  // Starts the drain thread. Until then, and after Stop, Write returns false.
+  bool Start(std::unique_ptr<TraceSink> sink, const TraceTransportOptions& options = {});
+  // Drains what is left and joins the drain thread.
+  void Stop();
+  bool Running() const { return running_.load(std::memory_order_acquire); }
+
+  bool Write(const void* data, size_t size);
+  bool Write(const std::string& text) { return Write(text.data(), text.size()); }
+
+  // Drains every ring into the sink on the calling thread. Safe to call while
+  // the drain thread runs, and from contexts that must not wait on it (DLL
+  // unload): it never joins.
+  void Flush();
+
+  TraceTransportCounters Counters() const;
+
+private:
+  TraceRing* RingForThisThread();
+  void DrainThreadProc();
+  void DrainOnce();
+
+  const uint64_t id_ = NextId();
+  static uint64_t NextId();
+
+  std::unique_ptr<TraceSink> sink_;
+  TraceTransportOptions options_;
+  std::atomic<bool> running_{false};
+  std::atomic<bool> stopping_{false};
+  std::thread drain_;
+  std::mutex wakeMutex_;
+  std::condition_variable wake_;
+
+  mutable std::mutex ringsMutex_;
+  std::vector<std::shared_ptr<TraceRing>> rings_;
+
+  std::mutex drainMutex_; // one consumer at a time
+  std::string batch_;
+
+  std::atomic<uint64_t> records_{0};
+  std::atomic<uint64_t> batches_{0};
+  std::atomic<uint64_t> bytesWritten_{0};
+  std::atomic<uint64_t> bytesLost_{0};
+};
+
+}
@@ -0,0 +1,154 @@
+#include "common/wait_set.h"
+
+#include <chrono>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace twinshim {
+
+WaitEvent::~WaitEvent() {
+#if defined(_WIN32)
+  if (event_) {
+    CloseHandle(static_cast<HANDLE>(event_));
+  }
+#else
+  for (int fd : fds_) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+#endif
+}
+
+bool WaitEvent::Create() {
+#if defined(_WIN32)
+  if (!event_) {
+    event_ = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+  }
+  return event_ != nullptr;
+#else
+  if (fds_[0] >= 0) {
+    return true;
+  }
+  if (pipe(fds_) != 0) {
+    fds_[0] = fds_[1] = -1;
+    return false;
+  }
+  for (int fd : fds_) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+  return true;
+#endif
+}
+
+void WaitEvent::Set() {
+#if defined(_WIN32)
+  SetEvent(static_cast<HANDLE>(event_));
+#else
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!set_ && fds_[1] >= 0) {
+    const char one = 1;
+    set_ = write(fds_[1], &one, 1) == 1;
+  }
+#endif
+}
+
+void WaitEvent::Reset() {
+#if defined(_WIN32)
+  ResetEvent(static_cast<HANDLE>(event_));
+#else
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (set_) {
+    char drain[16];
+    while (read(fds_[0], drain, sizeof(drain)) > 0) {
+    }
+    set_ = false;
+  }
+#endif
+}
+
+bool WaitEvent::IsSet() const {
+#if defined(_WIN32)
+  return event_ && WaitForSingleObject(static_cast<HANDLE>(event_), 0) == WAIT_OBJECT_0;
+#else
+  std::lock_guard<std::mutex> lock(mutex_);
+  return set_;
+#endif
+}
+
+WaitableHandle WaitEvent::Handle() const {
+#if defined(_WIN32)
+  return event_;
+#else
+  return fds_[0];
+#endif
+}
+
+size_t WaitSet::Add(WaitableHandle handle) {
+  handles_.push_back(handle);
+  return handles_.size() - 1;
+}
+
+size_t WaitSet::Wait(int timeoutMs) const {
+  if (handles_.empty()) {
+    return kFailed;
+  }
+#if defined(_WIN32)
+  if (handles_.size() > MAXIMUM_WAIT_OBJECTS) {
+    return kFailed;
+  }
+  const DWORD r = WaitForMultipleObjects(
+      (DWORD)handles_.size(), handles_.data(), FALSE, timeoutMs < 0 ? INFINITE : (DWORD)timeoutMs);
+  if (r == WAIT_TIMEOUT) {
+    return kTimeout;
+  }
+  // An abandoned mutex still counts as signaled.
+  if (r >= WAIT_OBJECT_0 && r < WAIT_OBJECT_0 + handles_.size()) {
+    return r - WAIT_OBJECT_0;
+  }
+  if (r >= WAIT_ABANDONED_0 && r < WAIT_ABANDONED_0 + handles_.size()) {
+    return r - WAIT_ABANDONED_0;
+  }
+  return kFailed;
+#else
+  std::vector<pollfd> fds;
+  fds.reserve(handles_.size());
+  for (int fd : handles_) {
+    fds.push_back({fd, POLLIN, 0});
+  }
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs < 0 ? 0 : timeoutMs);
+  int timeout = timeoutMs < 0 ? -1 : timeoutMs;
+  while (true) {
+    const int ready = poll(fds.data(), (nfds_t)fds.size(), timeout);
+    if (ready > 0) {
+      for (size_t i = 0; i < fds.size(); i++) {
+        if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+          return i;
+        }
+      }
+      return kFailed; // only POLLNVAL: a closed descriptor
+    }
+    if (ready == 0) {
+      return kTimeout;
+    }
+    if (errno != EINTR) {
+      return kFailed;
+    }
+    if (timeoutMs >= 0) {
+      const auto left =
+          std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+      timeout = left > 0 ? (int)left : 0;
+    }
+  }
+#endif
+}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace twinshim {
+
+// Something a WaitSet can block on: a HANDLE on Windows (events, processes,
+// threads), a file descriptor elsewhere, signaled while it is readable.
+#if defined(_WIN32)
+using WaitableHandle = void*;
+constexpr WaitableHandle kNoWaitable = nullptr;
+#else
+using WaitableHandle = int;
+constexpr WaitableHandle kNoWaitable = -1;
+#endif
+
+// Manual-reset event usable in a WaitSet: a Win32 event on Windows, a
+// non-blocking self-pipe elsewhere. Set and Reset may be called from any
+// thread.
+class WaitEvent {
+public:
+  WaitEvent() = default;
+  ~WaitEvent();
+
+  WaitEvent(const WaitEvent&) = delete;
+  WaitEvent& operator=(const WaitEvent&) = delete;
+
+  bool Create();
+  void Set();
+  void Reset();
+  bool IsSet() const;
+
+  WaitableHandle Handle() const;
+
+private:
+#if defined(_WIN32)
+  void* event_ = nullptr;
+#else
+  int fds_[2] = {-1, -1};
+  mutable std::mutex mutex_; // keeps the flag and the pipe's byte in step
+  bool set_ = false;
+#endif
+};
+
+// Blocks until one of several sources is signaled, without waking up in
+// between: WaitForMultipleObjects on Windows (at most 64 sources), poll()
+// elsewhere.
+class WaitSet {
+public:
+  static constexpr size_t kTimeout = SIZE_MAX;
+  static constexpr size_t kFailed = SIZE_MAX - 1;
+  static constexpr int kInfinite = -1;
+
+  // Returns the index Wait reports for this source.
+  size_t Add(WaitableHandle handle);
+  void Clear() { handles_.clear(); }
+  size_t Size() const { return handles_.size(); }
+
+  // Index of the first signaled source, kTimeout once `timeoutMs` have passed,
+  // or kFailed. A negative timeout waits forever.
+  size_t Wait(int timeoutMs = kInfinite) const;
+
+private:
+  std::vector<WaitableHandle> handles_;
+};
+
+}
@@ -1,4 +1,6 @@
 #include "common/local_registry_store.h"
+#include "common/registry_stats.h"
+#include "common/trace_record.h"
 #include "common/utf8.h"
 #include "hklmreg/reg_file.h"
 
@@ -14,6 +16,7 @@
 #include <vector>
 
 #include <cstring>
+#include <cwchar>
 #include <cwctype>
 
 #if defined(_WIN32)
@@ -29,7 +32,7 @@ using twinshim::regfile::ParseData;
 using twinshim::regfile::ParseType;
 
 static void PrintUsage() {
-  std::wcerr << L"hklmreg [--db <path>] <add|delete|export|import|dump> [options]\n"
+  std::wcerr << L"hklmreg [--db <path>] <add|delete|export|import|dump|stats-live|trace-decode> [options]\n"
                 L"\n"
                 L"Commands (REG-like subset):\n"
                 L"  add    <KeyName> /v <ValueName> [/t <Type>] /d <Data> [/f]\n"
@@ -37,6 +40,11 @@ static void PrintUsage() {
                 L"  export <FileName> [<KeyNamePrefix>]\n"
                 L"  dump   [<KeyNamePrefix>]\n"
                 L"  import <FileName>\n"
+                L"  stats-live <pid> [--interval <ms>] [--count <n>]\n"
+                L"         Live per-API registry stats of a process running under the shim\n"
+                L"  trace-decode <FileName> [--json]\n"
+                L"         Decode a binary trace saved with twinshim --debug-out into text\n"
+                L"         (the live --debug format) or JSON lines\n"
                 L"\n"
                 L"Default DB: .\\HKLM.sqlite (current directory)\n"
                 L"\n"
@@ -82,6 +90,88 @@ static bool StdoutIsConsole() {
 }
 #endif
 
+static bool ParseUInt32(const std::wstring& s, uint32_t& out) {
+  if (s.empty()) return false;
+  wchar_t* end = nullptr;
+  const unsigned long v = std::wcstoul(s.c_str(), &end, 10);
+  if (!end || *end != L'\0') return false;
+  out = (uint32_t)v;
+  return true;
+}
+
+static int RunStatsLive(int argc, wchar_t** argv, int i) {
+  uint32_t pid = 0;
+  if (i >= argc || !ParseUInt32(argv[i++], pid) || pid == 0) {
+    std::wcerr << L"stats-live expects a process id\n";
+    PrintUsage();
+    return 2;
+  }
+  RegistryStatsViewerOptions options;
+  while (i < argc) {
+    std::wstring opt = argv[i++];
+    if (opt == L"--interval" && i < argc && ParseUInt32(argv[i], options.intervalMs) && options.intervalMs > 0) {
+      i++;
+    } else if (opt == L"--count" && i < argc && ParseUInt32(argv[i], options.iterations)) {
+      i++;
+    } else {
+      std::wcerr << L"Unknown option: " << opt << L"\n";
+      return 2;
+    }
+  }
+  return RunRegistryStatsViewer(pid, options, std::wcout);
+}
+
+static int RunTraceDecode(int argc, wchar_t** argv, int i) {
+  if (i >= argc) {
+    std::wcerr << L"trace-decode expects a file name\n";
+    PrintUsage();
+    return 2;
+  }
+  const std::wstring inPath = argv[i++];
+  TraceDecoder::Format format = TraceDecoder::Format::Text;
+  while (i < argc) {
+    std::wstring opt = argv[i++];
+    if (opt == L"--json") {
+      format = TraceDecoder::Format::Json;
+    } else {
+      std::wcerr << L"Unknown option: " << opt << L"\n";
+      return 2;
+    }
+  }
+
+  std::ifstream in(WideToUtf8(inPath), std::ios::binary);
+  if (!in) {
+    std::wcerr << L"Failed to read: " << inPath << L"\n";
+    return 1;
+  }
+#if defined(_WIN32)
+  // Decoded output is UTF-8.
+  (void)_setmode(_fileno(stdout), _O_BINARY);
+#endif
+  TraceDecoder decoder(format);
+  std::vector<char> buffer(64 * 1024);
+  std::string out;
+  while (in) {
+    in.read(buffer.data(), (std::streamsize)buffer.size());
+    const size_t got = (size_t)in.gcount();
+    if (got == 0) {
+      break;
+    }
+    out.clear();
+    decoder.Feed(buffer.data(), got, out);
+    std::cout.write(out.data(), (std::streamsize)out.size());
+  }
+  out.clear();
+  const bool clean = decoder.Finish(out);
+  std::cout.write(out.data(), (std::streamsize)out.size());
+  std::cout.flush();
+  if (!clean) {
+    std::wcerr << L"trace-decode: " << decoder.Malformed() << L" malformed record(s) skipped\n";
+    return 1;
+  }
+  return 0;
+}
+
 static int RunMain(int argc, wchar_t** argv) {
   if (argc < 2) {
     PrintUsage();
@@ -106,6 +196,13 @@ static int RunMain(int argc, wchar_t** argv) {
   }
   std::wstring cmd = argv[i++];
 
+  if (cmd == L"stats-live") {
+    return RunStatsLive(argc, argv, i);
+  }
+  if (cmd == L"trace-decode") {
+    return RunTraceDecode(argc, argv, i);
+  }
+
   LocalRegistryStore store;
   if (!store.Open(dbPath)) {
     std::wcerr << L"Failed to open DB: " << dbPath << L"\n";
@@ -0,0 +1,203 @@
+#include "common/local_registry_store.h"
+#include "common/registry_api_table.h"
+#include "common/registry_overlay_engine.h"
+#include "common/registry_workload.h"
+#include "common/utf8.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cwchar>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+using namespace twinshim;
+
+static void PrintUsage() {
+  std::wcerr << L"twinshim_replay [--db <path>] [--original-timing] [--iterations <n>] [--no-handle-cache] [--profile] <capture>\n"
+                L"\n"
+                L"Replays a registry workload captured with twinshim --record against the local\n"
+                L"store and overlay engine, then reports throughput and latency percentiles.\n"
+                L"\n"
+                L"  --db <path>         Seed DB; it is copied first so every run starts from the\n"
+                L"                      same state (default: start from an empty DB)\n"
+                L"  --original-timing   Reproduce the capture's gaps between calls\n"
+                L"  --iterations <n>    Replay the capture n times (default: 1)\n"
+                L"  --no-handle-cache   Resolve every call from scratch instead of reusing\n"
+                L"                      per-handle key state and last results like the shim\n"
+                L"  --profile           Replay once to record an access profile, then prefetch it\n"
+                L"                      before the measured replay, like a repeat launch\n";
+}
+
+static std::wstring FormatNs(uint64_t ns) {
+  wchar_t buf[32]{};
+  if (ns < 1000) {
+    std::swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"%lluns", (unsigned long long)ns);
+  } else if (ns < 1000000) {
+    std::swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"%.1fus", ns / 1e3);
+  } else {
+    std::swprintf(buf, sizeof(buf) / sizeof(buf[0]), L"%.2fms", ns / 1e6);
+  }
+  return buf;
+}
+
+static int RunMain(int argc, wchar_t** argv) {
+  std::wstring seedDb;
+  std::wstring capturePath;
+  RegistryWorkloadReplayOptions options;
+  bool profile = false;
+
+  for (int i = 1; i < argc; i++) {
+    const std::wstring arg = argv[i];
+    if (arg == L"--db" && i + 1 < argc) {
+      seedDb = argv[++i];
+    } else if (arg == L"--original-timing") {
+      options.originalTiming = true;
+    } else if (arg == L"--iterations" && i + 1 < argc) {
+      options.iterations = (uint32_t)std::wcstoul(argv[++i], nullptr, 10);
+      if (options.iterations == 0) {
+        std::wcerr << L"--iterations must be at least 1\n";
+        return 2;
+      }
+    } else if (arg == L"--no-handle-cache") {
+      options.handleState = false;
+    } else if (arg == L"--profile") {
+      profile = true;
+    } else if (!arg.empty() && arg[0] != L'-' && capturePath.empty()) {
+      capturePath = arg;
+    } else {
+      PrintUsage();
+      return 2;
+    }
+  }
+  if (capturePath.empty()) {
+    PrintUsage();
+    return 2;
+  }
+
+  std::vector<RegistryWorkloadRecord> records;
+  if (!ReadRegistryWorkload(capturePath, records)) {
+    std::wcerr << L"Failed to read capture: " << capturePath << L"\n";
+    return 1;
+  }
+
+  const std::filesystem::path scratch = std::filesystem::path(capturePath).concat(L".replay.sqlite");
+  std::error_code ec;
+  auto resetScratch = [&] {
+    std::filesystem::remove(scratch, ec);
+    if (!seedDb.empty() && !std::filesystem::copy_file(std::filesystem::path(seedDb), scratch, ec)) {
+      std::wcerr << L"Failed to copy seed DB: " << seedDb << L"\n";
+      return false;
+    }
+    return true;
+  };
+  if (!resetScratch()) {
+    return 1;
+  }
+
+  // The "previous launch": replays once against its own copy of the seed.
+  std::vector<AccessProfileEntry> accessProfile;
+  if (profile) {
+    {
+      LocalRegistryStore store;
+      if (!store.Open(scratch.wstring())) {
+        std::wcerr << L"Failed to open DB: " << scratch.wstring() << L"\n";
+        return 1;
+      }
+      RegistryOverlayEngine engine(store, nullptr);
+      engine.StartAccessProfile(std::chrono::steady_clock::time_point::max());
+      RegistryWorkloadReplayOptions once = options;
+      once.originalTiming = false;
+      once.iterations = 1;
+      (void)ReplayRegistryWorkload(engine, records, once);
+      accessProfile = engine.TakeAccessProfile();
+    }
+    if (!resetScratch()) {
+      return 1;
+    }
+  }
+
+  int rc = 0;
+  {
+    LocalRegistryStore store;
+    if (!store.Open(scratch.wstring())) {
+      std::wcerr << L"Failed to open DB: " << scratch.wstring() << L"\n";
+      return 1;
+    }
+    RegistryOverlayEngine engine(store, nullptr);
+    const auto prefetchStart = std::chrono::steady_clock::now();
+    const size_t prefetched = profile ? engine.Prefetch(accessProfile) : 0;
+    const double prefetchMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - prefetchStart).count();
+    const RegistryWorkloadReplayReport report = ReplayRegistryWorkload(engine, records, options);
+
+    wchar_t line[160]{};
+    std::swprintf(line,
+                  sizeof(line) / sizeof(line[0]),
+                  L"ops: %llu (skipped %llu) in %.3f s, %.0f ops/s\n",
+                  (unsigned long long)report.ops,
+                  (unsigned long long)report.skipped,
+                  report.seconds,
+                  report.OpsPerSecond());
+    std::wcout << line;
+    std::wcout << L"latency: p50 " << FormatNs(report.p50Ns) << L"  p90 " << FormatNs(report.p90Ns) << L"  p99 "
+               << FormatNs(report.p99Ns) << L"  max " << FormatNs(report.maxNs) << L"\n";
+    std::swprintf(line,
+                  sizeof(line) / sizeof(line[0]),
+                  L"sql: %llu statements, %.2f per logical read (%llu reads, %llu logical)\n",
+                  (unsigned long long)report.statements,
+                  report.StatementsPerLogicalRead(),
+                  (unsigned long long)report.readOps,
+                  (unsigned long long)report.logicalReads);
+    std::wcout << line;
+    std::wcout << L"filter: " << engine.Store().FilteredMissCount() << L" lookups of absent keys/values ruled out without SQL\n";
+    std::wcout << L"elided: " << engine.Store().ElidedWriteCount() << L" writes matched the stored value\n";
+    if (profile) {
+      const auto counters = engine.GetPrefetchCounters();
+      const uint64_t lookups = counters.hits + counters.misses;
+      std::swprintf(line,
+                    sizeof(line) / sizeof(line[0]),
+                    L"profile: %zu entries prefetched in %.2f ms, %llu/%llu lookups hit (%.1f%%)\n",
+                    prefetched,
+                    prefetchMs,
+                    (unsigned long long)counters.hits,
+                    (unsigned long long)lookups,
+                    lookups ? 100.0 * (double)counters.hits / (double)lookups : 0.0);
+      std::wcout << line;
+    }
+    for (size_t i = 0; i < kRegistryApiCount; i++) {
+      if (report.perApiOps[i]) {
+        std::wcout << L"  " << GetRegistryApiInfo(static_cast<RegistryApi>(i)).name << L": " << report.perApiOps[i]
+                   << L"\n";
+      }
+    }
+    if (!std::wcout) {
+      rc = 1;
+    }
+  }
+  std::filesystem::remove(scratch, ec);
+  return rc;
+}
+
+#if defined(_WIN32)
+int wmain(int argc, wchar_t** argv) {
+  return RunMain(argc, argv);
+}
+#else
+int main(int argc, char** argv) {
+  std::vector<std::wstring> argvWide;
+  argvWide.reserve(static_cast<size_t>(argc));
+  for (int i = 0; i < argc; i++) {
+    argvWide.push_back(Utf8ToWide(argv[i] != nullptr ? std::string(argv[i]) : std::string()));
+  }
+
+  std::vector<wchar_t*> argvWidePtrs;
+  argvWidePtrs.reserve(argvWide.size());
+  for (auto& arg : argvWide) {
+    argvWidePtrs.push_back(arg.data());
+  }
+  return RunMain(argc, argvWidePtrs.data());
+}
+#endif
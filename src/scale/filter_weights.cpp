@@ -0,0 +1,307 @@
+#include "scale/filter_weights.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace twinshim {
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+// --- Filters ---
+
+double FilterSupport(ScaleFilter filter) {
+  switch (filter) {
+    case ScaleFilter::kPoint:
+      return 0.5;
+    case ScaleFilter::kBilinear:
+      return 1.0;
+    case ScaleFilter::kBicubic:
+    case ScaleFilter::kCatmullRom:
+    case ScaleFilter::kLanczos2:
+      return 2.0;
+    case ScaleFilter::kLanczos3:
+      return 3.0;
+  }
+  return 1.0;
+}
+
+double Lanczos(double x, double lobes) {
+  if (x == 0.0) {
+    return 1.0;
+  }
+  if (x >= lobes) {
+    return 0.0;
+  }
+  return lobes * std::sin(kPi * x) * std::sin(kPi * x / lobes) / (kPi * kPi * x * x);
+}
+
+double MitchellNetravali(double x, double b, double c) {
+  if (x < 1.0) {
+    return ((12 - 9 * b - 6 * c) * x * x * x + (-18 + 12 * b + 6 * c) * x * x + (6 - 2 * b)) / 6.0;
+  }
+  if (x < 2.0) {
+    return ((-b - 6 * c) * x * x * x + (6 * b + 30 * c) * x * x + (-12 * b - 48 * c) * x + (8 * b + 24 * c)) / 6.0;
+  }
+  return 0.0;
+}
+
+double KeysCubic(double x, double a) {
+  if (x < 1.0) {
+    return ((a + 2) * x - (a + 3)) * x * x + 1;
+  }
+  if (x < 2.0) {
+    return ((a * x - 5 * a) * x + 8 * a) * x - 4 * a;
+  }
+  return 0.0;
+}
+
+double FilterWeight(ScaleFilter filter, double x) {
+  x = std::fabs(x);
+  switch (filter) {
+    case ScaleFilter::kPoint:
+      return x < 0.5 ? 1.0 : 0.0;
+    case ScaleFilter::kBilinear:
+      return x < 1.0 ? 1.0 - x : 0.0;
+    case ScaleFilter::kBicubic:
+      return MitchellNetravali(x, 1.0 / 3.0, 1.0 / 3.0);
+    case ScaleFilter::kCatmullRom:
+      return KeysCubic(x, -0.5);
+    case ScaleFilter::kLanczos2:
+      return Lanczos(x, 2.0);
+    case ScaleFilter::kLanczos3:
+      return Lanczos(x, 3.0);
+  }
+  return 0.0;
+}
+
+// --- Tables ---
+
+int Gcd(int a, int b) {
+  while (b != 0) {
+    const int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// Normalizes `n` raw weights to Q14, then gives the rounding error to the
+// largest one (or its mirrored twin pair) so they sum to exactly
+// kFilterWeightOne. False if they sum to 0.
+bool Quantize(const double* w, int n, int16_t* q) {
+  double total = 0.0;
+  for (int k = 0; k < n; k++) {
+    total += w[k];
+  }
+  if (total == 0.0) {
+    return false;
+  }
+  int32_t sum = 0;
+  int largest = 0;
+  for (int k = 0; k < n; k++) {
+    q[k] = (int16_t)std::lround(w[k] / total * kFilterWeightOne);
+    sum += q[k];
+    if (w[k] > w[largest]) {
+      largest = k;
+    }
+  }
+  const int32_t residual = kFilterWeightOne - sum;
+  const int twin = n - 1 - largest;
+  if (twin != largest && w[twin] == w[largest]) {
+    // Split between a symmetric pair so the window stays (nearly) symmetric.
+    q[largest] = (int16_t)(q[largest] + residual / 2);
+    q[twin] = (int16_t)(q[twin] + (residual - residual / 2));
+  } else {
+    q[largest] = (int16_t)(q[largest] + residual);
+  }
+  return true;
+}
+
+// One sampling phase: output p + m * phases has its window at lo + m * step.
+struct Phase {
+  int lo = 0;
+  std::vector<double> raw;        // unnormalized filter values over the window
+  std::vector<int16_t> quantized; // Quantize(raw), for unclipped windows
+};
+
+} // namespace
+
+FilterWeightTable BuildFilterWeightTable(int srcSize, int dstSize, ScaleFilter filter) {
+  FilterWeightTable out;
+  if (srcSize <= 0 || dstSize <= 0) {
+    return out;
+  }
+  out.srcSize = srcSize;
+  out.dstSize = dstSize;
+  out.filter = filter;
+  const int g = Gcd(srcSize, dstSize);
+  const int phaseCount = dstSize / g;
+  const int step = srcSize / g;
+  out.phases = phaseCount;
+
+  // Outputs [0, half) are computed; the rest mirror them.
+  const int half = (dstSize + 1) / 2;
+  std::vector<int32_t> lo((size_t)dstSize);
+  std::vector<int32_t> hi((size_t)dstSize);
+  std::vector<Phase> phases;
+
+  if (filter == ScaleFilter::kPoint) {
+    out.taps = 1;
+    for (int i = 0; i < half; i++) {
+      const int64_t s = ((int64_t)(2 * i + 1) * srcSize) / (2 * (int64_t)dstSize);
+      lo[(size_t)i] = (int32_t)std::min<int64_t>(s, srcSize - 1);
+      hi[(size_t)i] = lo[(size_t)i] + 1;
+    }
+  } else {
+    const double scale = (double)srcSize / (double)dstSize;
+    const double filterScale = std::max(scale, 1.0);
+    const double support = FilterSupport(filter) * filterScale;
+    phases.resize((size_t)phaseCount);
+    for (int p = 0; p < phaseCount; p++) {
+      Phase& ph = phases[(size_t)p];
+      const int mirror = phaseCount - 1 - p;
+      if (mirror < p) {
+        // Already built: this phase is its mirror image.
+        const Phase& m = phases[(size_t)mirror];
+        ph.lo = step - (m.lo + (int)m.raw.size());
+        ph.raw.assign(m.raw.rbegin(), m.raw.rend());
+        ph.quantized.assign(m.quantized.rbegin(), m.quantized.rend());
+        continue;
+      }
+      // The middle phase is centred on step / 2 exactly.
+      const double center = (mirror == p) ? step * 0.5 : (p + 0.5) * scale;
+      ph.lo = (int)std::floor(center - support + 0.5);
+      int end = (mirror == p) ? step - ph.lo : (int)std::floor(center + support + 0.5);
+      if (end <= ph.lo) {
+        end = ph.lo + 1;
+      }
+      for (int s = ph.lo; s < end; s++) {
+        ph.raw.push_back(FilterWeight(filter, (s - center + 0.5) / filterScale));
+      }
+      ph.quantized.resize(ph.raw.size());
+      if (!Quantize(ph.raw.data(), (int)ph.raw.size(), ph.quantized.data())) {
+        ph.quantized.clear();
+      }
+    }
+
+    for (int i = 0; i < half; i++) {
+      const Phase& ph = phases[(size_t)(i % phaseCount)];
+      const int start = ph.lo + (i / phaseCount) * step;
+      int l = std::max(start, 0);
+      int h = std::min(start + (int)ph.raw.size(), srcSize);
+      if (h <= l) {
+        l = std::min(std::max(start, 0), srcSize - 1);
+        h = l + 1;
+      }
+      lo[(size_t)i] = l;
+      hi[(size_t)i] = h;
+      out.taps = std::max(out.taps, h - l);
+    }
+  }
+
+  out.first.resize((size_t)dstSize);
+  out.weights.assign((size_t)dstSize * (size_t)out.taps, 0);
+  std::vector<double> clipped;
+  for (int i = 0; i < half; i++) {
+    const int l = lo[(size_t)i];
+    const int h = hi[(size_t)i];
+    const int32_t first = std::min(l, srcSize - out.taps);
+    int16_t* q = &out.weights[(size_t)i * (size_t)out.taps + (size_t)(l - first)];
+    out.first[(size_t)i] = first;
+    if (filter == ScaleFilter::kPoint) {
+      q[0] = (int16_t)kFilterWeightOne;
+      continue;
+    }
+    const Phase& ph = phases[(size_t)(i % phaseCount)];
+    const int start = ph.lo + (i / phaseCount) * step;
+    if (l == start && h - l == (int)ph.raw.size() && !ph.quantized.empty()) {
+      std::copy(ph.quantized.begin(), ph.quantized.end(), q);
+      continue;
+    }
+    clipped.clear();
+    for (int s = l; s < h; s++) {
+      const int k = s - start;
+      clipped.push_back((k >= 0 && k < (int)ph.raw.size()) ? ph.raw[(size_t)k] : 0.0);
+    }
+    if (!Quantize(clipped.data(), h - l, q)) {
+      // Nothing of the filter left inside the image: take the nearest sample.
+      const double center = (i + 0.5) * srcSize / (double)dstSize;
+      q[std::min(h - l - 1, std::max(0, (int)center - l))] = (int16_t)kFilterWeightOne;
+    }
+  }
+  for (int i = half; i < dstSize; i++) {
+    const int j = dstSize - 1 - i;
+    out.first[(size_t)i] = srcSize - out.first[(size_t)j] - out.taps;
+    const int16_t* from = &out.weights[(size_t)j * (size_t)out.taps];
+    int16_t* to = &out.weights[(size_t)i * (size_t)out.taps];
+    std::reverse_copy(from, from + out.taps, to);
+  }
+
+  const auto range = std::minmax_element(out.first.begin(), out.first.end());
+  out.sourceBegin = *range.first;
+  out.sourceEnd = *range.second + out.taps;
+  return out;
+}
+
+FilterWeightCache::FilterWeightCache(size_t capacity) : capacity_(std::max<size_t>(capacity, 1)) {}
+
+std::shared_ptr<const FilterWeightTable> FilterWeightCache::Get(int srcSize, int dstSize, ScaleFilter filter) {
+  if (srcSize <= 0 || dstSize <= 0) {
+    return nullptr;
+  }
+  auto matches = [&](const std::shared_ptr<const FilterWeightTable>& t) {
+    return t->srcSize == srcSize && t->dstSize == dstSize && t->filter == filter;
+  };
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    const auto it = std::find_if(lru_.begin(), lru_.end(), matches);
+    if (it != lru_.end()) {
+      lru_.splice(lru_.begin(), lru_, it);
+      hits_++;
+      return lru_.front();
+    }
+    misses_++;
+  }
+
+  // Build outside the lock; if another thread got there first, use theirs.
+  auto table = std::make_shared<const FilterWeightTable>(BuildFilterWeightTable(srcSize, dstSize, filter));
+  std::lock_guard<std::mutex> lock(mu_);
+  const auto it = std::find_if(lru_.begin(), lru_.end(), matches);
+  if (it != lru_.end()) {
+    lru_.splice(lru_.begin(), lru_, it);
+    return lru_.front();
+  }
+  lru_.push_front(table);
+  while (lru_.size() > capacity_) {
+    lru_.pop_back();
+  }
+  return table;
+}
+
+size_t FilterWeightCache::Size() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return lru_.size();
+}
+
+uint64_t FilterWeightCache::Hits() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return hits_;
+}
+
+uint64_t FilterWeightCache::Misses() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return misses_;
+}
+
+void FilterWeightCache::Clear() {
+  std::lock_guard<std::mutex> lock(mu_);
+  lru_.clear();
+}
+
+FilterWeightCache& SharedFilterWeightCache() {
+  static FilterWeightCache cache;
+  return cache;
+}
+
+}
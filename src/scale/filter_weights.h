@@ -0,0 +1,73 @@
+#pragma once
+
+#include "scale/image_scale.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace twinshim {
+
+// Fixed-point resampling weights for one axis, srcSize -> dstSize samples.
+//
+// Output i reads `taps` consecutive source samples from first[i], weighted by
+// weights[i * taps + k]. Weights are Q14 and every output's weights sum to
+// exactly kFilterWeightOne, so flat areas stay flat. Windows are clipped to
+// the source and renormalized there; shorter windows are zero-padded.
+//
+// Tables are polyphase: the sampling phase repeats every `phases` outputs
+// (dstSize / gcd(srcSize, dstSize)) and every unclipped output of a phase
+// gets the same weights, computed once. They are also mirror symmetric:
+// output dstSize-1-i uses the reversed weights of output i. The one output
+// that is its own mirror can be off by one unit between tied taps.
+
+constexpr int kFilterWeightBits = 14;
+constexpr int32_t kFilterWeightOne = 1 << kFilterWeightBits;
+
+struct FilterWeightTable {
+  int srcSize = 0;
+  int dstSize = 0;
+  ScaleFilter filter = ScaleFilter::kPoint;
+  int taps = 0;
+  int phases = 0;
+  // Source samples any output reads: [sourceBegin, sourceEnd).
+  int sourceBegin = 0;
+  int sourceEnd = 0;
+  std::vector<int32_t> first;
+  std::vector<int16_t> weights;
+};
+
+// Empty table (taps == 0) for non-positive sizes.
+FilterWeightTable BuildFilterWeightTable(int srcSize, int dstSize, ScaleFilter filter);
+
+// Keeps the most recently used tables so per-frame scaling does not rebuild
+// them. Thread-safe; tables are immutable once handed out.
+class FilterWeightCache {
+public:
+  static constexpr size_t kDefaultCapacity = 16;
+
+  explicit FilterWeightCache(size_t capacity = kDefaultCapacity);
+
+  // Null for non-positive sizes.
+  std::shared_ptr<const FilterWeightTable> Get(int srcSize, int dstSize, ScaleFilter filter);
+
+  size_t Size() const;
+  uint64_t Hits() const;
+  uint64_t Misses() const;
+  void Clear();
+
+private:
+  mutable std::mutex mu_;
+  size_t capacity_;
+  std::list<std::shared_ptr<const FilterWeightTable>> lru_; // most recent first
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+// The process-wide cache ImageScaler uses.
+FilterWeightCache& SharedFilterWeightCache();
+
+}
@@ -0,0 +1,248 @@
+#include "scale/image_scale.h"
+
+#include "scale/filter_weights.h"
+#include "scale/image_scale_kernels.h"
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#include <cpuid.h>
+#endif
+
+namespace twinshim {
+namespace {
+
+// --- CPU features ---
+
+#if (defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))) || \
+    ((defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__)))
+#define TWINSHIM_SCALE_X86 1
+
+void CpuId(uint32_t leaf, uint32_t sub, uint32_t regs[4]) {
+#if defined(_MSC_VER)
+  int r[4];
+  __cpuidex(r, (int)leaf, (int)sub);
+  for (int i = 0; i < 4; i++) {
+    regs[i] = (uint32_t)r[i];
+  }
+#else
+  __cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+uint64_t ReadXcr0() {
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  uint32_t lo = 0;
+  uint32_t hi = 0;
+  __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+bool CpuHasSse2() {
+#if defined(_M_X64) || defined(__x86_64__)
+  return true;
+#else
+  uint32_t regs[4];
+  CpuId(1, 0, regs);
+  return (regs[3] & (1u << 26)) != 0;
+#endif
+}
+
+bool CpuHasAvx2() {
+  uint32_t regs[4];
+  CpuId(0, 0, regs);
+  if (regs[0] < 7) {
+    return false;
+  }
+  CpuId(1, 0, regs);
+  const bool osxsave = (regs[2] & (1u << 27)) != 0;
+  const bool avx = (regs[2] & (1u << 28)) != 0;
+  // The OS must save the YMM registers across context switches.
+  if (!osxsave || !avx || (ReadXcr0() & 0x6) != 0x6) {
+    return false;
+  }
+  CpuId(7, 0, regs);
+  return (regs[1] & (1u << 5)) != 0;
+}
+#endif
+
+bool IsaRunsHere(ScaleIsa isa) {
+  switch (isa) {
+    case ScaleIsa::kScalar:
+      return true;
+#if defined(TWINSHIM_SCALE_X86)
+    case ScaleIsa::kSse2:
+      return CpuHasSse2();
+    case ScaleIsa::kAvx2:
+      return CpuHasAvx2();
+#endif
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+    case ScaleIsa::kNeon:
+      return true; // baseline on AArch64 and on the ARMv7 builds that enable it
+#endif
+    default:
+      return false;
+  }
+}
+
+bool GetKernels(ScaleIsa isa, ScaleKernels* out) {
+  switch (isa) {
+    case ScaleIsa::kScalar:
+      return GetScalarScaleKernels(out);
+    case ScaleIsa::kSse2:
+      return GetSse2ScaleKernels(out);
+    case ScaleIsa::kAvx2:
+      return GetAvx2ScaleKernels(out);
+    case ScaleIsa::kNeon:
+      return GetNeonScaleKernels(out);
+  }
+  return false;
+}
+
+bool IsValid(const uint8_t* pixels, int width, int height, ptrdiff_t pitch) {
+  return pixels && width > 0 && height > 0 && pitch >= (ptrdiff_t)width * 4;
+}
+
+// --- Scalar kernels ---
+
+void HorizontalScalar(const uint8_t* srcRow,
+                      uint8_t* dstRow,
+                      int dstWidth,
+                      const int32_t* first,
+                      const int16_t* weights,
+                      int taps) {
+  for (int x = 0; x < dstWidth; x++) {
+    const uint8_t* s = srcRow + (size_t)first[x] * 4;
+    const int16_t* w = weights + (size_t)x * (size_t)taps;
+    int32_t sum[4] = {0, 0, 0, 0};
+    for (int k = 0; k < taps; k++) {
+      for (int c = 0; c < 4; c++) {
+        sum[c] += (int32_t)s[k * 4 + c] * w[k];
+      }
+    }
+    for (int c = 0; c < 4; c++) {
+      dstRow[x * 4 + c] = ScaleRoundToByte(sum[c]);
+    }
+  }
+}
+
+void VerticalScalar(const uint8_t* const* rows, const int16_t* weights, int taps, uint8_t* dstRow, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    int32_t sum = 0;
+    for (int k = 0; k < taps; k++) {
+      sum += (int32_t)rows[k][i] * weights[k];
+    }
+    dstRow[i] = ScaleRoundToByte(sum);
+  }
+}
+
+} // namespace
+
+bool GetScalarScaleKernels(ScaleKernels* out) {
+  out->horizontal = HorizontalScalar;
+  out->vertical = VerticalScalar;
+  return true;
+}
+
+bool GetScaleKernels(ScaleIsa isa, ScaleKernels* out) {
+  return GetKernels(isa, out) && IsaRunsHere(isa);
+}
+
+const char* ScaleFilterName(ScaleFilter filter) {
+  switch (filter) {
+    case ScaleFilter::kPoint:
+      return "point";
+    case ScaleFilter::kBilinear:
+      return "bilinear";
+    case ScaleFilter::kBicubic:
+      return "bicubic";
+    case ScaleFilter::kCatmullRom:
+      return "catmull-rom";
+    case ScaleFilter::kLanczos2:
+      return "lanczos2";
+    case ScaleFilter::kLanczos3:
+      return "lanczos3";
+  }
+  return "unknown";
+}
+
+const char* ScaleIsaName(ScaleIsa isa) {
+  switch (isa) {
+    case ScaleIsa::kScalar:
+      return "scalar";
+    case ScaleIsa::kSse2:
+      return "sse2";
+    case ScaleIsa::kAvx2:
+      return "avx2";
+    case ScaleIsa::kNeon:
+      return "neon";
+  }
+  return "unknown";
+}
+
+std::vector<ScaleIsa> SupportedScaleIsas() {
+  std::vector<ScaleIsa> isas;
+  ScaleKernels kernels{};
+  for (ScaleIsa isa : {ScaleIsa::kScalar, ScaleIsa::kSse2, ScaleIsa::kAvx2, ScaleIsa::kNeon}) {
+    if (GetScaleKernels(isa, &kernels)) {
+      isas.push_back(isa);
+    }
+  }
+  return isas;
+}
+
+ScaleIsa BestScaleIsa() {
+  static const ScaleIsa best = SupportedScaleIsas().back();
+  return best;
+}
+
+ImageScaler::ImageScaler(ScaleIsa isa) : isa_(isa) {}
+
+bool ImageScaler::Scale(const ImageView& src, const MutableImageView& dst, ScaleFilter filter) {
+  ScaleKernels kernels{};
+  if (!IsValid(src.pixels, src.width, src.height, src.pitch) || !IsValid(dst.pixels, dst.width, dst.height, dst.pitch) ||
+      !GetScaleKernels(isa_, &kernels)) {
+    return false;
+  }
+
+  FilterWeightCache& cache = SharedFilterWeightCache();
+  const std::shared_ptr<const FilterWeightTable> h = cache.Get(src.width, dst.width, filter);
+  const std::shared_ptr<const FilterWeightTable> v = cache.Get(src.height, dst.height, filter);
+
+  // Horizontal pass over just the source rows the vertical pass reads.
+  const int rowBegin = v->sourceBegin;
+  const int rowEnd = v->sourceEnd;
+  const size_t interPitch = (size_t)dst.width * 4;
+  intermediate_.resize(interPitch * (size_t)(rowEnd - rowBegin));
+  for (int y = rowBegin; y < rowEnd; y++) {
+    kernels.horizontal(src.pixels + (ptrdiff_t)y * src.pitch,
+                       intermediate_.data() + interPitch * (size_t)(y - rowBegin),
+                       dst.width,
+                       h->first.data(),
+                       h->weights.data(),
+                       h->taps);
+  }
+
+  rows_.resize((size_t)v->taps);
+  for (int y = 0; y < dst.height; y++) {
+    for (int k = 0; k < v->taps; k++) {
+      rows_[(size_t)k] = intermediate_.data() + interPitch * (size_t)(v->first[(size_t)y] + k - rowBegin);
+    }
+    kernels.vertical(rows_.data(),
+                     v->weights.data() + (size_t)y * (size_t)v->taps,
+                     v->taps,
+                     dst.pixels + (ptrdiff_t)y * dst.pitch,
+                     (int)interPitch);
+  }
+  return true;
+}
+
+bool ScaleImage(const ImageView& src, const MutableImageView& dst, ScaleFilter filter) {
+  ImageScaler scaler;
+  return scaler.Scale(src, dst, filter);
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace twinshim {
+
+// CPU image scaling for 32bpp pixels: four interleaved 8-bit channels, such as
+// the B,G,R,A bytes of A8R8G8B8/X8R8G8B8. Every channel is filtered alike
+// (alpha is not premultiplied).
+//
+// Scaling is separable: a horizontal pass into an intermediate image, then a
+// vertical pass. Filter weights are 14-bit fixed point tables kept in
+// SharedFilterWeightCache (scale/filter_weights.h), and each kernel set
+// (scalar, SSE2, AVX2, NEON) does the same integer arithmetic, so all of them
+// produce identical bytes. When shrinking, the filter is widened by the scale
+// factor so every source pixel contributes.
+
+enum class ScaleFilter {
+  kPoint,
+  kBilinear,
+  kBicubic,    // Mitchell-Netravali (B = C = 1/3): smooth, no ringing
+  kCatmullRom, // Keys cubic, a = -0.5: sharper
+  kLanczos2,
+  kLanczos3,
+};
+
+enum class ScaleIsa {
+  kScalar,
+  kSse2,
+  kAvx2,
+  kNeon,
+};
+
+struct ImageView {
+  const uint8_t* pixels = nullptr;
+  int width = 0;
+  int height = 0;
+  ptrdiff_t pitch = 0; // bytes between rows
+};
+
+struct MutableImageView {
+  uint8_t* pixels = nullptr;
+  int width = 0;
+  int height = 0;
+  ptrdiff_t pitch = 0;
+};
+
+const char* ScaleFilterName(ScaleFilter filter);
+const char* ScaleIsaName(ScaleIsa isa);
+
+// Kernel sets compiled into this binary that this CPU can run, scalar first.
+std::vector<ScaleIsa> SupportedScaleIsas();
+ScaleIsa BestScaleIsa();
+
+// Scales whole images. Keeps its intermediate buffers between calls, so a
+// scaler reused every frame does not allocate. Not thread-safe.
+class ImageScaler {
+public:
+  explicit ImageScaler(ScaleIsa isa = BestScaleIsa());
+
+  // False for empty views or views smaller than their pitch implies.
+  bool Scale(const ImageView& src, const MutableImageView& dst, ScaleFilter filter);
+
+  ScaleIsa Isa() const { return isa_; }
+
+private:
+  ScaleIsa isa_;
+  std::vector<uint8_t> intermediate_;
+  std::vector<const uint8_t*> rows_; // vertical taps' source rows
+};
+
+// One-off convenience over ImageScaler.
+bool ScaleImage(const ImageView& src, const MutableImageView& dst, ScaleFilter filter);
+
+}
@@ -0,0 +1,126 @@
+#include "scale/image_scale_kernels.h"
+
+// GCC and Clang build this file with -mavx2; MSVC allows the intrinsics
+// anywhere. Either way it only runs after the CPU check in image_scale.cpp.
+#if defined(__AVX2__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#define TWINSHIM_SCALE_AVX2 1
+#include <immintrin.h>
+
+#include <cstring>
+#endif
+
+namespace twinshim {
+
+#if defined(TWINSHIM_SCALE_AVX2)
+namespace {
+
+int32_t PackWeights(int16_t w0, int16_t w1) {
+  return (int32_t)((uint32_t)(uint16_t)w0 | ((uint32_t)(uint16_t)w1 << 16));
+}
+
+void HorizontalAvx2(const uint8_t* srcRow,
+                    uint8_t* dstRow,
+                    int dstWidth,
+                    const int32_t* first,
+                    const int16_t* weights,
+                    int taps) {
+  const __m128i zero = _mm_setzero_si128();
+  // Four pixels p0..p3 -> p0c0 p1c0 p0c1 p1c1 p0c2 p1c2 p0c3 p1c3 | same for p2, p3.
+  const __m128i interleave = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+  for (int x = 0; x < dstWidth; x++) {
+    const uint8_t* s = srcRow + (size_t)first[x] * 4;
+    const int16_t* w = weights + (size_t)x * (size_t)taps;
+    __m256i wide = _mm256_setzero_si256();
+    int k = 0;
+    for (; k + 3 < taps; k += 4) {
+      const __m128i quad = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + k * 4));
+      const __m256i samples = _mm256_cvtepu8_epi16(_mm_shuffle_epi8(quad, interleave));
+      const __m256i pairs = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi32(PackWeights(w[k], w[k + 1]))),
+                                                    _mm_set1_epi32(PackWeights(w[k + 2], w[k + 3])),
+                                                    1);
+      wide = _mm256_add_epi32(wide, _mm256_madd_epi16(samples, pairs));
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(wide), _mm256_extracti128_si256(wide, 1));
+    sum = _mm_add_epi32(sum, _mm_set1_epi32(kScaleWeightOne >> 1));
+    for (; k + 1 < taps; k += 2) {
+      const __m128i pair = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(s + k * 4));
+      const __m128i mixed = _mm_unpacklo_epi8(pair, _mm_srli_si128(pair, 4));
+      sum = _mm_add_epi32(sum,
+                          _mm_madd_epi16(_mm_unpacklo_epi8(mixed, zero), _mm_set1_epi32(PackWeights(w[k], w[k + 1]))));
+    }
+    if (k < taps) {
+      int32_t v;
+      std::memcpy(&v, s + k * 4, 4);
+      const __m128i px = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero);
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi16(px, zero), _mm_set1_epi32(PackWeights(w[k], 0))));
+    }
+    sum = _mm_srai_epi32(sum, kScaleWeightBits);
+    const int32_t out = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(sum, sum), zero));
+    std::memcpy(dstRow + (size_t)x * 4, &out, 4);
+  }
+}
+
+void VerticalAvx2(const uint8_t* const* rows, const int16_t* weights, int taps, uint8_t* dstRow, int bytes) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i round = _mm256_set1_epi32(kScaleWeightOne >> 1);
+  int i = 0;
+  // Unpack and pack both work within 128-bit lanes, so bytes come back in order.
+  for (; i + 32 <= bytes; i += 32) {
+    __m256i s0 = round;
+    __m256i s1 = round;
+    __m256i s2 = round;
+    __m256i s3 = round;
+    int k = 0;
+    for (; k + 1 < taps; k += 2) {
+      const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k] + i));
+      const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k + 1] + i));
+      const __m256i w = _mm256_set1_epi32(PackWeights(weights[k], weights[k + 1]));
+      const __m256i lo = _mm256_unpacklo_epi8(a, b);
+      const __m256i hi = _mm256_unpackhi_epi8(a, b);
+      s0 = _mm256_add_epi32(s0, _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), w));
+      s1 = _mm256_add_epi32(s1, _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), w));
+      s2 = _mm256_add_epi32(s2, _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), w));
+      s3 = _mm256_add_epi32(s3, _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), w));
+    }
+    if (k < taps) {
+      const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k] + i));
+      const __m256i w = _mm256_set1_epi32(PackWeights(weights[k], 0));
+      const __m256i lo = _mm256_unpacklo_epi8(a, zero);
+      const __m256i hi = _mm256_unpackhi_epi8(a, zero);
+      s0 = _mm256_add_epi32(s0, _mm256_madd_epi16(_mm256_unpacklo_epi16(lo, zero), w));
+      s1 = _mm256_add_epi32(s1, _mm256_madd_epi16(_mm256_unpackhi_epi16(lo, zero), w));
+      s2 = _mm256_add_epi32(s2, _mm256_madd_epi16(_mm256_unpacklo_epi16(hi, zero), w));
+      s3 = _mm256_add_epi32(s3, _mm256_madd_epi16(_mm256_unpackhi_epi16(hi, zero), w));
+    }
+    const __m256i p01 =
+        _mm256_packs_epi32(_mm256_srai_epi32(s0, kScaleWeightBits), _mm256_srai_epi32(s1, kScaleWeightBits));
+    const __m256i p23 =
+        _mm256_packs_epi32(_mm256_srai_epi32(s2, kScaleWeightBits), _mm256_srai_epi32(s3, kScaleWeightBits));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dstRow + i), _mm256_packus_epi16(p01, p23));
+  }
+  for (; i < bytes; i++) {
+    int32_t sum = 0;
+    for (int k = 0; k < taps; k++) {
+      sum += (int32_t)rows[k][i] * weights[k];
+    }
+    dstRow[i] = ScaleRoundToByte(sum);
+  }
+}
+
+} // namespace
+
+bool GetAvx2ScaleKernels(ScaleKernels* out) {
+  out->horizontal = HorizontalAvx2;
+  out->vertical = VerticalAvx2;
+  return true;
+}
+
+#else
+
+bool GetAvx2ScaleKernels(ScaleKernels*) {
+  return false;
+}
+
+#endif
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "scale/filter_weights.h"
+
+#include <cstdint>
+
+namespace twinshim {
+
+// Internal to the scaling library: the per-ISA inner loops behind
+// ImageScaler and TiledImageScaler. Every implementation must match the
+// scalar one bit for bit.
+
+constexpr int kScaleWeightBits = kFilterWeightBits;
+constexpr int32_t kScaleWeightOne = kFilterWeightOne;
+
+struct ScaleKernels {
+  // For each of `dstWidth` output pixels x, sums `taps` source pixels
+  // starting at srcRow + 4 * first[x], weighted by weights[x * taps + k].
+  void (*horizontal)(const uint8_t* srcRow,
+                     uint8_t* dstRow,
+                     int dstWidth,
+                     const int32_t* first,
+                     const int16_t* weights,
+                     int taps);
+  // Byte i of dstRow = sum over k of rows[k][i] * weights[k], for i < bytes.
+  void (*vertical)(const uint8_t* const* rows, const int16_t* weights, int taps, uint8_t* dstRow, int bytes);
+};
+
+// Each fills `out` and returns true when that kernel set is compiled in;
+// whether the CPU can run it is checked by the caller.
+bool GetScalarScaleKernels(ScaleKernels* out);
+bool GetSse2ScaleKernels(ScaleKernels* out);
+bool GetAvx2ScaleKernels(ScaleKernels* out);
+bool GetNeonScaleKernels(ScaleKernels* out);
+
+// The kernel set for `isa` if it is compiled in and this CPU can run it.
+bool GetScaleKernels(ScaleIsa isa, ScaleKernels* out);
+
+// Rounds a 14-bit fixed-point sum to a byte, as every kernel must. Static so
+// each kernel TU keeps its own copy: the linker must not pick the one built
+// with -mavx2 for the scalar path.
+static inline uint8_t ScaleRoundToByte(int32_t sum) {
+  const int32_t v = (sum + (kScaleWeightOne >> 1)) >> kScaleWeightBits;
+  return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+}
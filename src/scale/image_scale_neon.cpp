@@ -0,0 +1,92 @@
+#include "scale/image_scale_kernels.h"
+
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+#define TWINSHIM_SCALE_NEON 1
+#include <arm_neon.h>
+
+#include <cstring>
+#endif
+
+namespace twinshim {
+
+#if defined(TWINSHIM_SCALE_NEON)
+namespace {
+
+int16x4_t LoadPixel(const uint8_t* p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return vreinterpret_s16_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(v)))));
+}
+
+// (sum + round) >> bits, saturated to bytes; vshrq_n_s32 is an arithmetic shift.
+uint8x8_t Narrow(int32x4_t lo, int32x4_t hi) {
+  const int16x8_t words =
+      vcombine_s16(vqmovn_s32(vshrq_n_s32(lo, kScaleWeightBits)), vqmovn_s32(vshrq_n_s32(hi, kScaleWeightBits)));
+  return vqmovun_s16(words);
+}
+
+void HorizontalNeon(const uint8_t* srcRow,
+                    uint8_t* dstRow,
+                    int dstWidth,
+                    const int32_t* first,
+                    const int16_t* weights,
+                    int taps) {
+  const int32x4_t round = vdupq_n_s32(kScaleWeightOne >> 1);
+  for (int x = 0; x < dstWidth; x++) {
+    const uint8_t* s = srcRow + (size_t)first[x] * 4;
+    const int16_t* w = weights + (size_t)x * (size_t)taps;
+    int32x4_t sum = round;
+    for (int k = 0; k < taps; k++) {
+      sum = vmlal_n_s16(sum, LoadPixel(s + k * 4), w[k]);
+    }
+    const uint8x8_t bytes = Narrow(sum, sum);
+    const uint32_t out = vget_lane_u32(vreinterpret_u32_u8(bytes), 0);
+    std::memcpy(dstRow + (size_t)x * 4, &out, 4);
+  }
+}
+
+void VerticalNeon(const uint8_t* const* rows, const int16_t* weights, int taps, uint8_t* dstRow, int bytes) {
+  const int32x4_t round = vdupq_n_s32(kScaleWeightOne >> 1);
+  int i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    int32x4_t s0 = round;
+    int32x4_t s1 = round;
+    int32x4_t s2 = round;
+    int32x4_t s3 = round;
+    for (int k = 0; k < taps; k++) {
+      const uint8x16_t a = vld1q_u8(rows[k] + i);
+      const int16x8_t lo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(a)));
+      const int16x8_t hi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(a)));
+      s0 = vmlal_n_s16(s0, vget_low_s16(lo), weights[k]);
+      s1 = vmlal_n_s16(s1, vget_high_s16(lo), weights[k]);
+      s2 = vmlal_n_s16(s2, vget_low_s16(hi), weights[k]);
+      s3 = vmlal_n_s16(s3, vget_high_s16(hi), weights[k]);
+    }
+    vst1q_u8(dstRow + i, vcombine_u8(Narrow(s0, s1), Narrow(s2, s3)));
+  }
+  for (; i < bytes; i++) {
+    int32_t sum = 0;
+    for (int k = 0; k < taps; k++) {
+      sum += (int32_t)rows[k][i] * weights[k];
+    }
+    dstRow[i] = ScaleRoundToByte(sum);
+  }
+}
+
+} // namespace
+
+bool GetNeonScaleKernels(ScaleKernels* out) {
+  out->horizontal = HorizontalNeon;
+  out->vertical = VerticalNeon;
+  return true;
+}
+
+#else
+
+bool GetNeonScaleKernels(ScaleKernels*) {
+  return false;
+}
+
+#endif
+
+}
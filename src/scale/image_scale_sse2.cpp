@@ -0,0 +1,117 @@
+#include "scale/image_scale_kernels.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TWINSHIM_SCALE_SSE2 1
+#include <emmintrin.h>
+
+#include <cstring>
+#endif
+
+namespace twinshim {
+
+#if defined(TWINSHIM_SCALE_SSE2)
+namespace {
+
+// Two 16-bit weights in every 32-bit lane, for _mm_madd_epi16 over pairs of
+// interleaved samples.
+__m128i WeightPair(int16_t w0, int16_t w1) {
+  return _mm_set1_epi32((int32_t)((uint32_t)(uint16_t)w0 | ((uint32_t)(uint16_t)w1 << 16)));
+}
+
+__m128i LoadPixel(const uint8_t* p) {
+  int32_t v;
+  std::memcpy(&v, p, 4);
+  return _mm_cvtsi32_si128(v);
+}
+
+void HorizontalSse2(const uint8_t* srcRow,
+                    uint8_t* dstRow,
+                    int dstWidth,
+                    const int32_t* first,
+                    const int16_t* weights,
+                    int taps) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i round = _mm_set1_epi32(kScaleWeightOne >> 1);
+  for (int x = 0; x < dstWidth; x++) {
+    const uint8_t* s = srcRow + (size_t)first[x] * 4;
+    const int16_t* w = weights + (size_t)x * (size_t)taps;
+    __m128i sum = round;
+    int k = 0;
+    for (; k + 1 < taps; k += 2) {
+      // p0c0 p1c0 p0c1 p1c1 ... as 16-bit lanes.
+      const __m128i pair = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(s + k * 4));
+      const __m128i mixed = _mm_unpacklo_epi8(pair, _mm_srli_si128(pair, 4));
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi8(mixed, zero), WeightPair(w[k], w[k + 1])));
+    }
+    if (k < taps) {
+      const __m128i px = _mm_unpacklo_epi8(LoadPixel(s + k * 4), zero);
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi16(px, zero), WeightPair(w[k], 0)));
+    }
+    sum = _mm_srai_epi32(sum, kScaleWeightBits);
+    const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(sum, sum), zero);
+    const int32_t out = _mm_cvtsi128_si32(bytes);
+    std::memcpy(dstRow + (size_t)x * 4, &out, 4);
+  }
+}
+
+void VerticalSse2(const uint8_t* const* rows, const int16_t* weights, int taps, uint8_t* dstRow, int bytes) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i round = _mm_set1_epi32(kScaleWeightOne >> 1);
+  int i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    __m128i s0 = round;
+    __m128i s1 = round;
+    __m128i s2 = round;
+    __m128i s3 = round;
+    int k = 0;
+    for (; k + 1 < taps; k += 2) {
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k] + i));
+      const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k + 1] + i));
+      const __m128i w = WeightPair(weights[k], weights[k + 1]);
+      const __m128i lo = _mm_unpacklo_epi8(a, b);
+      const __m128i hi = _mm_unpackhi_epi8(a, b);
+      s0 = _mm_add_epi32(s0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), w));
+      s1 = _mm_add_epi32(s1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), w));
+      s2 = _mm_add_epi32(s2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), w));
+      s3 = _mm_add_epi32(s3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), w));
+    }
+    if (k < taps) {
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k] + i));
+      const __m128i w = WeightPair(weights[k], 0);
+      const __m128i lo = _mm_unpacklo_epi8(a, zero);
+      const __m128i hi = _mm_unpackhi_epi8(a, zero);
+      s0 = _mm_add_epi32(s0, _mm_madd_epi16(_mm_unpacklo_epi16(lo, zero), w));
+      s1 = _mm_add_epi32(s1, _mm_madd_epi16(_mm_unpackhi_epi16(lo, zero), w));
+      s2 = _mm_add_epi32(s2, _mm_madd_epi16(_mm_unpacklo_epi16(hi, zero), w));
+      s3 = _mm_add_epi32(s3, _mm_madd_epi16(_mm_unpackhi_epi16(hi, zero), w));
+    }
+    const __m128i p01 = _mm_packs_epi32(_mm_srai_epi32(s0, kScaleWeightBits), _mm_srai_epi32(s1, kScaleWeightBits));
+    const __m128i p23 = _mm_packs_epi32(_mm_srai_epi32(s2, kScaleWeightBits), _mm_srai_epi32(s3, kScaleWeightBits));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dstRow + i), _mm_packus_epi16(p01, p23));
+  }
+  for (; i < bytes; i++) {
+    int32_t sum = 0;
+    for (int k = 0; k < taps; k++) {
+      sum += (int32_t)rows[k][i] * weights[k];
+    }
+    dstRow[i] = ScaleRoundToByte(sum);
+  }
+}
+
+} // namespace
+
+bool GetSse2ScaleKernels(ScaleKernels* out) {
+  out->horizontal = HorizontalSse2;
+  out->vertical = VerticalSse2;
+  return true;
+}
+
+#else
+
+bool GetSse2ScaleKernels(ScaleKernels*) {
+  return false;
+}
+
+#endif
+
+}
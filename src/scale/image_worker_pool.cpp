@@ -0,0 +1,253 @@
+#include "scale/image_worker_pool.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace twinshim {
+namespace {
+
+// A participant's remaining tasks [begin, end), packed so the owner and
+// thieves can update it with one compare-exchange.
+uint64_t PackRange(uint32_t begin, uint32_t end) {
+  return ((uint64_t)begin << 32) | end;
+}
+
+uint32_t RangeBegin(uint64_t r) {
+  return (uint32_t)(r >> 32);
+}
+
+uint32_t RangeEnd(uint64_t r) {
+  return (uint32_t)r;
+}
+
+uint32_t RangeSize(uint64_t r) {
+  return RangeEnd(r) > RangeBegin(r) ? RangeEnd(r) - RangeBegin(r) : 0;
+}
+
+// The logical CPUs this process may run on, in ascending order. Falls back to
+// every CPU when the affinity mask can't be read. On Windows only the
+// process's own processor group is seen.
+std::vector<int> AllowedCpus() {
+  std::vector<int> cpus;
+#if defined(_WIN32)
+  DWORD_PTR processMask = 0;
+  DWORD_PTR systemMask = 0;
+  if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+    for (int cpu = 0; cpu < (int)(sizeof(DWORD_PTR) * 8); cpu++) {
+      if (processMask & ((DWORD_PTR)1 << cpu)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+#elif defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+#endif
+  if (cpus.empty()) {
+    const int count = std::max(1, (int)std::thread::hardware_concurrency());
+    for (int cpu = 0; cpu < count; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+// Pins the calling thread to one logical CPU. Best effort: CPUs outside the
+// first affinity group (or mask) are left unpinned.
+void PinCurrentThread(int cpu) {
+#if defined(_WIN32)
+  if (cpu < (int)(sizeof(DWORD_PTR) * 8)) {
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu);
+  }
+#elif defined(__linux__)
+  if (cpu < CPU_SETSIZE) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+#else
+  (void)cpu;
+#endif
+}
+
+} // namespace
+
+// Own cache line each, so a busy owner does not slow its neighbours.
+struct alignas(64) ImageWorkerPool::Slot {
+  std::atomic<uint64_t> range{0};
+};
+
+int ProcessCpuCount() {
+  return (int)AllowedCpus().size();
+}
+
+ImageWorkerPool::ImageWorkerPool(int workers, bool pinToCpus) {
+  const std::vector<int> cpus = AllowedCpus();
+  if (workers < 0) {
+    workers = (int)cpus.size() - 1;
+  }
+  participants_ = workers + 1;
+  slots_.reset(new Slot[(size_t)participants_]);
+  threads_.reserve((size_t)workers);
+  for (int i = 0; i < workers; i++) {
+    // Participant p runs on the p-th allowed CPU; the caller stays where the
+    // OS put it, and workers beyond the allowed CPUs aren't pinned.
+    const int participant = i + 1;
+    const int cpu = pinToCpus && participant < (int)cpus.size() ? cpus[(size_t)participant] : -1;
+    threads_.emplace_back(&ImageWorkerPool::WorkerMain, this, participant, cpu);
+  }
+}
+
+ImageWorkerPool::~ImageWorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& t : threads_) {
+    t.join();
+  }
+}
+
+void ImageWorkerPool::ParallelFor(int count, const std::function<void(int, int)>& fn) {
+  if (count <= 0) {
+    return;
+  }
+  if (participants_ == 1 || count == 1) {
+    for (int i = 0; i < count; i++) {
+      fn(i, 0);
+    }
+    return;
+  }
+
+  std::lock_guard<std::mutex> run(runMu_);
+  // Every worker finished the previous job before it returned, so nobody is
+  // looking at the slots while they are refilled.
+  for (int p = 0; p < participants_; p++) {
+    const int64_t begin = (int64_t)count * p / participants_;
+    const int64_t end = (int64_t)count * (p + 1) / participants_;
+    slots_[p].range.store(PackRange((uint32_t)begin, (uint32_t)end), std::memory_order_relaxed);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    job_ = &fn;
+    busy_ = participants_ - 1;
+    generation_++;
+  }
+  wake_.notify_all();
+
+  RunParticipant(0, fn);
+
+  std::unique_lock<std::mutex> lock(mu_);
+  done_.wait(lock, [&] { return busy_ == 0; });
+  job_ = nullptr;
+}
+
+void ImageWorkerPool::WorkerMain(int participant, int cpu) {
+  if (cpu >= 0) {
+    PinCurrentThread(cpu);
+  }
+
+  uint64_t seen = 0;
+  for (;;) {
+    const std::function<void(int, int)>* job = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+      job = job_;
+    }
+    RunParticipant(participant, *job);
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (--busy_ == 0) {
+        done_.notify_one();
+      }
+    }
+  }
+}
+
+void ImageWorkerPool::RunParticipant(int participant, const std::function<void(int, int)>& fn) {
+  for (;;) {
+    int task = 0;
+    if (PopFront(participant, &task)) {
+      fn(task, participant);
+    } else if (!Steal(participant)) {
+      return;
+    }
+  }
+}
+
+bool ImageWorkerPool::PopFront(int participant, int* task) {
+  std::atomic<uint64_t>& range = slots_[participant].range;
+  uint64_t r = range.load(std::memory_order_acquire);
+  while (RangeSize(r) > 0) {
+    if (range.compare_exchange_weak(r, PackRange(RangeBegin(r) + 1, RangeEnd(r)), std::memory_order_acq_rel)) {
+      *task = (int)RangeBegin(r);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ImageWorkerPool::Steal(int thief) {
+  for (;;) {
+    int victim = -1;
+    uint64_t r = 0;
+    for (int p = 0; p < participants_; p++) {
+      const uint64_t candidate = slots_[p].range.load(std::memory_order_acquire);
+      if (p != thief && RangeSize(candidate) > RangeSize(r)) {
+        victim = p;
+        r = candidate;
+      }
+    }
+    if (victim < 0) {
+      return false; // every task is taken; some may still be running
+    }
+    // Take the back half, rounded up, so a single remaining task moves too.
+    const uint32_t mid = RangeBegin(r) + RangeSize(r) / 2;
+    if (slots_[victim].range.compare_exchange_strong(r, PackRange(RangeBegin(r), mid), std::memory_order_acq_rel)) {
+      // The thief's own range is empty, so nobody else changes it meanwhile.
+      slots_[thief].range.store(PackRange(mid, RangeEnd(r)), std::memory_order_release);
+      steals_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+}
+
+ImageWorkerPool& SharedImageWorkerPool() {
+  // Never destroyed: joining threads from a DLL's static destructors can
+  // deadlock on the loader lock, and the OS reclaims them at exit anyway.
+  // Since the workers outlive any FreeLibrary, the module holding this code
+  // is pinned so it is never unmapped under them.
+  static ImageWorkerPool* pool = [] {
+#if defined(_WIN32)
+    HMODULE self = nullptr;
+    GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN,
+                       reinterpret_cast<LPCWSTR>(&SharedImageWorkerPool),
+                       &self);
+#endif
+    return new ImageWorkerPool();
+  }();
+  return *pool;
+}
+
+}
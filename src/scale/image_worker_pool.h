@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace twinshim {
+
+// Persistent threads for CPU image work (tiled scaling, pixel conversion).
+//
+// ParallelFor hands [0, count) out as one contiguous range per participant:
+// the calling thread plus every worker. A participant takes tasks from the
+// front of its own range; once that is empty it steals the back half of the
+// largest range left, so a few slow stripes do not hold up the frame. Workers
+// sleep on a condition variable between calls and are pinned one per CPU in
+// the process's affinity mask, starting after the first.
+class ImageWorkerPool {
+public:
+  // `workers` threads besides the caller; negative starts one per CPU the
+  // process may run on but the first. Zero runs everything on the caller.
+  explicit ImageWorkerPool(int workers = -1, bool pinToCpus = true);
+  ~ImageWorkerPool();
+
+  ImageWorkerPool(const ImageWorkerPool&) = delete;
+  ImageWorkerPool& operator=(const ImageWorkerPool&) = delete;
+
+  // Threads a ParallelFor runs on, the caller included.
+  int Concurrency() const { return participants_; }
+
+  // Calls fn(task, participant) exactly once for each task in [0, count) and
+  // returns when all of them have finished. participant is in
+  // [0, Concurrency()); 0 is the calling thread. Calls from several threads
+  // take turns.
+  void ParallelFor(int count, const std::function<void(int task, int participant)>& fn);
+
+  // Ranges taken from another participant so far.
+  uint64_t Steals() const { return steals_.load(std::memory_order_relaxed); }
+
+private:
+  struct Slot;
+
+  void WorkerMain(int participant, int cpu); // cpu < 0: not pinned
+  void RunParticipant(int participant, const std::function<void(int, int)>& fn);
+  bool PopFront(int participant, int* task);
+  bool Steal(int thief);
+
+  int participants_;
+  std::unique_ptr<Slot[]> slots_;
+  std::vector<std::thread> threads_;
+
+  std::mutex runMu_; // one ParallelFor at a time
+  std::mutex mu_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  uint64_t generation_ = 0;
+  const std::function<void(int, int)>* job_ = nullptr;
+  int busy_ = 0; // workers still on the current job
+  bool stop_ = false;
+  std::atomic<uint64_t> steals_{0};
+};
+
+// Logical CPUs in the process's affinity mask (at least 1): what a default
+// ImageWorkerPool sizes itself to.
+int ProcessCpuCount();
+
+// The process-wide pool, started on first use and shared by all CPU image
+// work in the process.
+ImageWorkerPool& SharedImageWorkerPool();
+
+}
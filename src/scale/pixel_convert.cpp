@@ -0,0 +1,302 @@
+#include "scale/pixel_convert.h"
+
+#include "scale/pixel_convert_kernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace twinshim {
+namespace {
+
+int CountBits(uint32_t v) {
+  int c = 0;
+  while (v) {
+    c += (int)(v & 1u);
+    v >>= 1;
+  }
+  return c;
+}
+
+int CountTrailingZeros(uint32_t v) {
+  if (v == 0) {
+    return 0;
+  }
+  int c = 0;
+  while ((v & 1u) == 0) {
+    c++;
+    v >>= 1;
+  }
+  return c;
+}
+
+bool IsExactRgb565(const PixelFormatInfo& f) {
+  return f.bytesPerPixel == 2 && f.rMask == 0xF800 && f.gMask == 0x07E0 && f.bMask == 0x001F && f.aMask == 0;
+}
+
+bool IsExactArgb8888(const PixelFormatInfo& f, bool withAlpha) {
+  return f.bytesPerPixel == 4 && f.rMask == 0x00FF0000 && f.gMask == 0x0000FF00 && f.bMask == 0x000000FF &&
+         f.aMask == (withAlpha ? 0xFF000000u : 0u);
+}
+
+// Top bits repeated into the low ones; only used for 5 and 6 bit fields.
+uint8_t ReplicateTo8(uint32_t v, int bits) {
+  return (uint8_t)((v << (uint32_t)(8 - bits)) | (v >> (uint32_t)(2 * bits - 8)));
+}
+
+bool SameFormat(const PixelFormatInfo& a, const PixelFormatInfo& b) {
+  return a.rMask == b.rMask && a.gMask == b.gMask && a.bMask == b.bMask && a.aMask == b.aMask &&
+         a.bytesPerPixel == b.bytesPerPixel && a.palettized == b.palettized;
+}
+
+// Searches for mul/add/post with (v * mul + add) >> post == expand[v] for
+// every field value and no intermediate above 0xFFFF.
+void FindExactForm(PixelChannelPlan* c) {
+  const int64_t maxv = (int64_t)c->fieldMask;
+  for (int post = 0; post <= 8; post++) {
+    const int64_t unit = (int64_t)1 << post;
+    const int64_t guess = (255 * unit) / std::max<int64_t>(1, maxv);
+    for (int64_t mul = std::max<int64_t>(1, guess - 2); mul <= guess + 2; mul++) {
+      int64_t lo = 0;
+      int64_t hi = 0xFFFF;
+      for (int64_t v = 0; v <= maxv && lo <= hi; v++) {
+        const int64_t t = c->expand[v];
+        lo = std::max(lo, t * unit - mul * v);
+        hi = std::min(hi, (t + 1) * unit - 1 - mul * v);
+      }
+      if (lo <= hi && mul <= 0xFFFF && mul * maxv + lo <= 0xFFFF) {
+        c->exact = true;
+        c->mul = (uint16_t)mul;
+        c->add = (uint16_t)lo;
+        c->post = post;
+        return;
+      }
+    }
+  }
+}
+
+void PlanChannel(uint32_t mask, int shift, int bits, int outShift, bool replicate, PixelChannelPlan* c) {
+  *c = PixelChannelPlan{};
+  c->fieldMask = mask >> (uint32_t)shift;
+  c->shift = shift;
+  c->bits = bits;
+  c->outShift = outShift;
+  c->table = bits <= 8 && c->fieldMask == (1u << (uint32_t)bits) - 1u;
+  if (!c->table) {
+    return;
+  }
+  for (uint32_t v = 0; v <= c->fieldMask; v++) {
+    c->expand[v] = replicate ? ReplicateTo8(v, bits) : ExpandChannelTo8(v, bits);
+  }
+  FindExactForm(c);
+}
+
+// --- Scalar rows ---
+
+void CopyRow(const PixelConvertPlan&, const uint8_t* src, uint32_t* dst, int width) {
+  std::memcpy(dst, src, (size_t)width * 4);
+}
+
+void OpaqueRow(const PixelConvertPlan&, const uint8_t* src, uint32_t* dst, int width) {
+  for (int x = 0; x < width; x++) {
+    uint32_t p;
+    std::memcpy(&p, src + (size_t)x * 4, 4);
+    dst[x] = p | 0xFF000000u;
+  }
+}
+
+void PaletteRow(const PixelConvertPlan& plan, const uint8_t* src, uint32_t* dst, int width) {
+  for (int x = 0; x < width; x++) {
+    dst[x] = plan.palette[src[x]];
+  }
+}
+
+void Row16(const PixelConvertPlan& plan, const uint8_t* src, uint32_t* dst, int width) {
+  for (int x = 0; x < width; x++) {
+    uint16_t p;
+    std::memcpy(&p, src + (size_t)x * 2, 2);
+    dst[x] = ConvertPixelWithPlan(plan, p);
+  }
+}
+
+void Row32(const PixelConvertPlan& plan, const uint8_t* src, uint32_t* dst, int width) {
+  for (int x = 0; x < width; x++) {
+    uint32_t p;
+    std::memcpy(&p, src + (size_t)x * 4, 4);
+    dst[x] = ConvertPixelWithPlan(plan, p);
+  }
+}
+
+} // namespace
+
+bool DescribeRgbPixelFormat(uint32_t bitCount,
+                            uint32_t rMask,
+                            uint32_t gMask,
+                            uint32_t bMask,
+                            uint32_t aMask,
+                            PixelFormatInfo* out) {
+  if (!out) {
+    return false;
+  }
+  PixelFormatInfo info;
+  if (bitCount == 16) {
+    info.bytesPerPixel = 2;
+    // Some wrappers report 16bpp RGB but leave masks zero. Assume 565.
+    if (rMask == 0 && gMask == 0 && bMask == 0) {
+      rMask = 0xF800;
+      gMask = 0x07E0;
+      bMask = 0x001F;
+    }
+  } else if (bitCount == 32) {
+    info.bytesPerPixel = 4;
+    // Some wrappers report 32bpp RGB but leave masks zero. Assume XRGB8888.
+    if (rMask == 0 && gMask == 0 && bMask == 0) {
+      rMask = 0x00FF0000;
+      gMask = 0x0000FF00;
+      bMask = 0x000000FF;
+      aMask = 0;
+    }
+  } else {
+    return false;
+  }
+
+  info.rMask = rMask;
+  info.gMask = gMask;
+  info.bMask = bMask;
+  info.aMask = aMask;
+  info.rShift = CountTrailingZeros(rMask);
+  info.gShift = CountTrailingZeros(gMask);
+  info.bShift = CountTrailingZeros(bMask);
+  info.aShift = CountTrailingZeros(aMask);
+  info.rBits = CountBits(rMask);
+  info.gBits = CountBits(gMask);
+  info.bBits = CountBits(bMask);
+  info.aBits = CountBits(aMask);
+
+  if (info.rMask == 0 || info.gMask == 0 || info.bMask == 0) {
+    return false;
+  }
+  *out = info;
+  return true;
+}
+
+PixelFormatInfo Palettized8PixelFormat() {
+  PixelFormatInfo info;
+  info.bytesPerPixel = 1;
+  info.palettized = true;
+  return info;
+}
+
+uint32_t ConvertPixelToArgb(const PixelFormatInfo& f, uint32_t px) {
+  if (IsExactRgb565(f)) {
+    const uint32_t r5 = (px >> 11) & 0x1F;
+    const uint32_t g6 = (px >> 5) & 0x3F;
+    const uint32_t b5 = px & 0x1F;
+    const uint32_t r8 = (r5 << 3) | (r5 >> 2);
+    const uint32_t g8 = (g6 << 2) | (g6 >> 4);
+    const uint32_t b8 = (b5 << 3) | (b5 >> 2);
+    return 0xFF000000u | (r8 << 16) | (g8 << 8) | b8;
+  }
+  const uint32_t rv = f.rMask ? ((px & f.rMask) >> (uint32_t)f.rShift) : 0;
+  const uint32_t gv = f.gMask ? ((px & f.gMask) >> (uint32_t)f.gShift) : 0;
+  const uint32_t bv = f.bMask ? ((px & f.bMask) >> (uint32_t)f.bShift) : 0;
+  const uint32_t av = f.aMask ? ((px & f.aMask) >> (uint32_t)f.aShift) : 0;
+  const uint32_t a = f.aMask ? ExpandChannelTo8(av, f.aBits) : 255u;
+  return (a << 24) | ((uint32_t)ExpandChannelTo8(rv, f.rBits) << 16) | ((uint32_t)ExpandChannelTo8(gv, f.gBits) << 8) |
+         (uint32_t)ExpandChannelTo8(bv, f.bBits);
+}
+
+PixelConverter::PixelConverter(ScaleIsa isa) : isa_(isa) {}
+
+PixelConverter::~PixelConverter() = default;
+
+bool PixelConverter::Reset(const PixelFormatInfo& format, const uint32_t* palette) {
+  if (format.palettized) {
+    if (format.bytesPerPixel != 1 || !palette) {
+      return false;
+    }
+  } else if (format.bytesPerPixel != 2 && format.bytesPerPixel != 4) {
+    return false;
+  }
+
+  if (plan_ && plan_->row && SameFormat(plan_->format, format)) {
+    if (!format.palettized) {
+      return true;
+    }
+    if (std::memcmp(plan_->palette, palette, sizeof(plan_->palette)) == 0) {
+      return true;
+    }
+  }
+
+  if (!plan_) {
+    plan_.reset(new PixelConvertPlan());
+  }
+  PixelConvertPlan& plan = *plan_;
+  plan = PixelConvertPlan{};
+  plan.format = format;
+
+  if (format.palettized) {
+    std::memcpy(plan.palette, palette, sizeof(plan.palette));
+    plan.row = PaletteRow;
+    return true;
+  }
+  if (IsExactArgb8888(format, /*withAlpha=*/true)) {
+    plan.row = CopyRow;
+    return true;
+  }
+  if (IsExactArgb8888(format, /*withAlpha=*/false)) {
+    plan.row = OpaqueRow;
+    return true;
+  }
+
+  const bool replicate = IsExactRgb565(format);
+  PlanChannel(format.rMask, format.rShift, format.rBits, 16, replicate, &plan.channels[0]);
+  PlanChannel(format.gMask, format.gShift, format.gBits, 8, replicate, &plan.channels[1]);
+  PlanChannel(format.bMask, format.bShift, format.bBits, 0, replicate, &plan.channels[2]);
+  plan.channelCount = 3;
+  plan.opaque = 0xFF000000u;
+  if (format.aMask) {
+    PlanChannel(format.aMask, format.aShift, format.aBits, 24, false, &plan.channels[3]);
+    plan.channelCount = 4;
+    plan.opaque = 0;
+  }
+  plan.row = (format.bytesPerPixel == 2) ? Row16 : Row32;
+
+  if (isa_ == ScaleIsa::kSse2 || isa_ == ScaleIsa::kAvx2) {
+    const std::vector<ScaleIsa> supported = SupportedScaleIsas();
+    const bool runs = std::find(supported.begin(), supported.end(), ScaleIsa::kSse2) != supported.end();
+    PixelConvertRowFn simd = nullptr;
+    if (runs && GetSse2PixelConvertRow(plan, &simd)) {
+      plan.row = simd;
+      plan.vectorized = true;
+    }
+  }
+  return true;
+}
+
+void PixelConverter::ConvertRow(const uint8_t* src, uint32_t* dst, int width) const {
+  if (plan_ && plan_->row && width > 0) {
+    plan_->row(*plan_, src, dst, width);
+  }
+}
+
+bool PixelConverter::ConvertRect(const uint8_t* src,
+                                 ptrdiff_t srcPitch,
+                                 int width,
+                                 int height,
+                                 uint32_t* dst,
+                                 ptrdiff_t dstPitch) const {
+  if (!plan_ || !plan_->row || !src || !dst || width <= 0 || height <= 0 || dstPitch < width ||
+      srcPitch < (ptrdiff_t)width * plan_->format.bytesPerPixel) {
+    return false;
+  }
+  for (int y = 0; y < height; y++) {
+    plan_->row(*plan_, src + (ptrdiff_t)y * srcPitch, dst + (ptrdiff_t)y * dstPitch, width);
+  }
+  return true;
+}
+
+bool PixelConverter::Vectorized() const {
+  return plan_ && plan_->vectorized;
+}
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "scale/image_scale.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace twinshim {
+
+struct PixelConvertPlan;
+
+// Conversion of DirectDraw surface pixels to A8R8G8B8 (the layout ImageScaler
+// and D3DFMT_A8R8G8B8 textures use).
+//
+// Channels narrower than 8 bits are widened by rounding, v * 255 / max,
+// except for exact 5:6:5 which replicates the top bits. Formats without an
+// alpha mask come out opaque.
+
+struct PixelFormatInfo {
+  uint32_t rMask = 0;
+  uint32_t gMask = 0;
+  uint32_t bMask = 0;
+  uint32_t aMask = 0;
+  int rShift = 0;
+  int gShift = 0;
+  int bShift = 0;
+  int aShift = 0;
+  int rBits = 0;
+  int gBits = 0;
+  int bBits = 0;
+  int aBits = 0;
+  int bytesPerPixel = 0;
+  bool palettized = false; // 8-bit indices into a 256-entry palette
+};
+
+// Fills `out` for a 16 or 32 bpp RGB format. Some wrappers leave the masks
+// zero; those are taken as 5:6:5 and X8R8G8B8. Returns false for other bit
+// counts or when a colour channel is still missing.
+bool DescribeRgbPixelFormat(uint32_t bitCount,
+                            uint32_t rMask,
+                            uint32_t gMask,
+                            uint32_t bMask,
+                            uint32_t aMask,
+                            PixelFormatInfo* out);
+
+// 8-bit palette indices.
+PixelFormatInfo Palettized8PixelFormat();
+
+// Converts one pixel value (as read from memory, little endian) the slow way.
+// PixelConverter must agree with this for every input.
+uint32_t ConvertPixelToArgb(const PixelFormatInfo& format, uint32_t pixel);
+
+class PixelConverter {
+ public:
+  // Uses SSE2 rows when `isa` is SSE2 or AVX2 and the CPU has it; other
+  // choices convert with per-channel lookup tables.
+  explicit PixelConverter(ScaleIsa isa = BestScaleIsa());
+  ~PixelConverter();
+
+  PixelConverter(const PixelConverter&) = delete;
+  PixelConverter& operator=(const PixelConverter&) = delete;
+
+  // Prepares tables for `format`. Palettized formats need `palette`: 256
+  // A8R8G8B8 entries. Cheap when nothing changed since the last call.
+  bool Reset(const PixelFormatInfo& format, const uint32_t* palette = nullptr);
+
+  // Converts `width` pixels. Requires a successful Reset.
+  void ConvertRow(const uint8_t* src, uint32_t* dst, int width) const;
+
+  // dstPitch is in pixels.
+  bool ConvertRect(const uint8_t* src,
+                   ptrdiff_t srcPitch,
+                   int width,
+                   int height,
+                   uint32_t* dst,
+                   ptrdiff_t dstPitch) const;
+
+  // True when the last Reset picked a SIMD row routine.
+  bool Vectorized() const;
+
+ private:
+  ScaleIsa isa_;
+  std::unique_ptr<PixelConvertPlan> plan_;
+};
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "scale/pixel_convert.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace twinshim {
+
+// Internal to the scaling library: the prepared state behind PixelConverter
+// and its per-ISA row routines. Every routine must match the scalar one bit
+// for bit.
+
+struct PixelChannelPlan {
+  uint32_t fieldMask = 0; // mask >> shift
+  int shift = 0;
+  int bits = 0;
+  int outShift = 0; // 16 for red, 8 green, 0 blue, 24 alpha
+  // Contiguous fields of up to 8 bits widen through `expand`; wider or
+  // holed ones are computed per pixel.
+  bool table = false;
+  uint8_t expand[256] = {};
+  // When `exact`, expand[v] == (v * mul + add) >> post for every field
+  // value, with no intermediate above 0xFFFF: 16-bit SIMD lanes can do it.
+  bool exact = false;
+  uint16_t mul = 0;
+  uint16_t add = 0;
+  int post = 0;
+};
+
+struct PixelConvertPlan;
+
+using PixelConvertRowFn = void (*)(const PixelConvertPlan& plan, const uint8_t* src, uint32_t* dst, int width);
+
+struct PixelConvertPlan {
+  PixelFormatInfo format;
+  uint32_t palette[256] = {};
+  PixelChannelPlan channels[4]; // red, green, blue, alpha
+  int channelCount = 0;         // 3 when the format has no alpha
+  uint32_t opaque = 0;          // 0xFF000000 when there is no alpha channel
+  bool vectorized = false;
+  PixelConvertRowFn row = nullptr;
+};
+
+// v * 255 / max, rounded; fields of 8 bits or more saturate instead.
+inline uint8_t ExpandChannelTo8(uint32_t v, int bits) {
+  if (bits <= 0) {
+    return 0;
+  }
+  if (bits >= 8) {
+    return (uint8_t)std::min<uint32_t>(255u, v);
+  }
+  const uint32_t maxv = (1u << (uint32_t)bits) - 1u;
+  return (uint8_t)((v * 255u + (maxv / 2u)) / maxv);
+}
+
+// One 16/32 bpp pixel through the plan's tables; the scalar rows and every
+// SIMD tail use this.
+inline uint32_t ConvertPixelWithPlan(const PixelConvertPlan& plan, uint32_t pixel) {
+  uint32_t out = plan.opaque;
+  for (int i = 0; i < plan.channelCount; i++) {
+    const PixelChannelPlan& c = plan.channels[i];
+    const uint32_t v = (pixel >> (uint32_t)c.shift) & c.fieldMask;
+    const uint32_t byte = c.table ? c.expand[v] : ExpandChannelTo8(v, c.bits);
+    out |= byte << (uint32_t)c.outShift;
+  }
+  return out;
+}
+
+// Returns false when the SSE2 routines are not compiled in or cannot handle
+// `plan` (palettized, 24 bpp, or a channel without an exact 16-bit form).
+bool GetSse2PixelConvertRow(const PixelConvertPlan& plan, PixelConvertRowFn* out);
+
+}
@@ -0,0 +1,135 @@
+#include "scale/pixel_convert_kernels.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TWINSHIM_CONVERT_SSE2 1
+#include <emmintrin.h>
+
+#include <cstring>
+#endif
+
+namespace twinshim {
+
+#if defined(TWINSHIM_CONVERT_SSE2)
+namespace {
+
+// One channel's constants, loaded once per row. Shift counts live in the low
+// quadword as _mm_srl_* expects.
+struct ChannelRegs {
+  __m128i shift;
+  __m128i fieldMask;
+  __m128i mul;
+  __m128i add;
+  __m128i post;
+  __m128i outShift;
+};
+
+ChannelRegs LoadChannel16(const PixelChannelPlan& c) {
+  ChannelRegs r;
+  r.shift = _mm_cvtsi32_si128(c.shift);
+  r.fieldMask = _mm_set1_epi16((short)c.fieldMask);
+  r.mul = _mm_set1_epi16((short)c.mul);
+  r.add = _mm_set1_epi16((short)c.add);
+  r.post = _mm_cvtsi32_si128(c.post);
+  r.outShift = _mm_setzero_si128();
+  return r;
+}
+
+// 32-bit lanes: fields are at most 8 bits, so the 16-bit multiply only ever
+// sees the low half of each lane and the high half stays zero.
+ChannelRegs LoadChannel32(const PixelChannelPlan& c) {
+  ChannelRegs r;
+  r.shift = _mm_cvtsi32_si128(c.shift);
+  r.fieldMask = _mm_set1_epi32((int)c.fieldMask);
+  r.mul = _mm_set1_epi32(c.mul);
+  r.add = _mm_set1_epi32(c.add);
+  r.post = _mm_cvtsi32_si128(c.post);
+  r.outShift = _mm_cvtsi32_si128(c.outShift);
+  return r;
+}
+
+// Eight 16-bit pixels -> the channel's 8-bit values in 16-bit lanes.
+__m128i Expand16(__m128i px, const ChannelRegs& r) {
+  const __m128i v = _mm_and_si128(_mm_srl_epi16(px, r.shift), r.fieldMask);
+  return _mm_srl_epi16(_mm_add_epi16(_mm_mullo_epi16(v, r.mul), r.add), r.post);
+}
+
+// Four 32-bit pixels -> the channel's byte, already in its A8R8G8B8 position.
+__m128i Expand32(__m128i px, const ChannelRegs& r) {
+  const __m128i v = _mm_and_si128(_mm_srl_epi32(px, r.shift), r.fieldMask);
+  const __m128i e = _mm_srl_epi32(_mm_add_epi16(_mm_mullo_epi16(v, r.mul), r.add), r.post);
+  return _mm_sll_epi32(e, r.outShift);
+}
+
+void Row16Sse2(const PixelConvertPlan& plan, const uint8_t* src, uint32_t* dst, int width) {
+  const ChannelRegs red = LoadChannel16(plan.channels[0]);
+  const ChannelRegs green = LoadChannel16(plan.channels[1]);
+  const ChannelRegs blue = LoadChannel16(plan.channels[2]);
+  const bool hasAlpha = plan.channelCount == 4;
+  const ChannelRegs alpha = LoadChannel16(plan.channels[hasAlpha ? 3 : 0]);
+  const __m128i opaque = _mm_set1_epi16(0xFF);
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (size_t)x * 2));
+    const __m128i r = Expand16(px, red);
+    const __m128i g = Expand16(px, green);
+    const __m128i b = Expand16(px, blue);
+    const __m128i a = hasAlpha ? Expand16(px, alpha) : opaque;
+    // Little-endian A8R8G8B8 is the bytes B, G, R, A.
+    const __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+    const __m128i ra = _mm_or_si128(r, _mm_slli_epi16(a, 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x + 4), _mm_unpackhi_epi16(bg, ra));
+  }
+  for (; x < width; x++) {
+    uint16_t p;
+    std::memcpy(&p, src + (size_t)x * 2, 2);
+    dst[x] = ConvertPixelWithPlan(plan, p);
+  }
+}
+
+void Row32Sse2(const PixelConvertPlan& plan, const uint8_t* src, uint32_t* dst, int width) {
+  ChannelRegs regs[4];
+  for (int i = 0; i < plan.channelCount; i++) {
+    regs[i] = LoadChannel32(plan.channels[i]);
+  }
+  const __m128i opaque = _mm_set1_epi32((int)plan.opaque);
+  int x = 0;
+  for (; x + 4 <= width; x += 4) {
+    const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + (size_t)x * 4));
+    __m128i out = opaque;
+    for (int i = 0; i < plan.channelCount; i++) {
+      out = _mm_or_si128(out, Expand32(px, regs[i]));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), out);
+  }
+  for (; x < width; x++) {
+    uint32_t p;
+    std::memcpy(&p, src + (size_t)x * 4, 4);
+    dst[x] = ConvertPixelWithPlan(plan, p);
+  }
+}
+
+} // namespace
+
+bool GetSse2PixelConvertRow(const PixelConvertPlan& plan, PixelConvertRowFn* out) {
+  if (plan.format.palettized || (plan.format.bytesPerPixel != 2 && plan.format.bytesPerPixel != 4)) {
+    return false;
+  }
+  for (int i = 0; i < plan.channelCount; i++) {
+    if (!plan.channels[i].table || !plan.channels[i].exact) {
+      return false;
+    }
+  }
+  *out = (plan.format.bytesPerPixel == 2) ? Row16Sse2 : Row32Sse2;
+  return true;
+}
+
+#else
+
+bool GetSse2PixelConvertRow(const PixelConvertPlan&, PixelConvertRowFn*) {
+  return false;
+}
+
+#endif
+
+}
@@ -0,0 +1,164 @@
+#include "scale/tiled_scale.h"
+
+#include "scale/filter_weights.h"
+#include "scale/image_scale_kernels.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace twinshim {
+namespace {
+
+// How much each new frame moves the learned cost.
+constexpr double kCostSmoothing = 0.25;
+// A sharper filter has to be predicted under this share of the budget before
+// ScaleWithin moves back up to it.
+constexpr double kUpgradeHeadroom = 0.75;
+
+bool IsValid(const uint8_t* pixels, int width, int height, ptrdiff_t pitch) {
+  return pixels && width > 0 && height > 0 && pitch >= (ptrdiff_t)width * 4;
+}
+
+int FilterRank(ScaleFilter filter) {
+  switch (filter) {
+    case ScaleFilter::kPoint:
+      return 0;
+    case ScaleFilter::kBilinear:
+      return 1;
+    case ScaleFilter::kBicubic:
+    case ScaleFilter::kCatmullRom:
+    case ScaleFilter::kLanczos2:
+      return 2;
+    case ScaleFilter::kLanczos3:
+      return 3;
+  }
+  return 0;
+}
+
+// Filter taps summed over every pixel both passes write.
+double TapWork(const FilterWeightTable& h, const FilterWeightTable& v) {
+  const double width = (double)h.dstSize;
+  return (double)(v.sourceEnd - v.sourceBegin) * width * h.taps + (double)v.dstSize * width * v.taps;
+}
+
+} // namespace
+
+ScaleFilter CheaperScaleFilter(ScaleFilter filter) {
+  switch (filter) {
+    case ScaleFilter::kLanczos3:
+      return ScaleFilter::kLanczos2;
+    case ScaleFilter::kLanczos2:
+    case ScaleFilter::kBicubic:
+    case ScaleFilter::kCatmullRom:
+      return ScaleFilter::kBilinear;
+    case ScaleFilter::kBilinear:
+    case ScaleFilter::kPoint:
+      return ScaleFilter::kPoint;
+  }
+  return ScaleFilter::kPoint;
+}
+
+TiledImageScaler::TiledImageScaler(ImageWorkerPool* pool, ScaleIsa isa) : pool_(pool), isa_(isa) {}
+
+void TiledImageScaler::SetStripeRows(int rows) {
+  stripeRows_ = std::max(rows, 1);
+}
+
+bool TiledImageScaler::Scale(const ImageView& src, const MutableImageView& dst, ScaleFilter filter) {
+  return Run(src, dst, filter);
+}
+
+bool TiledImageScaler::ScaleWithin(const ImageView& src,
+                                   const MutableImageView& dst,
+                                   ScaleFilter filter,
+                                   double budgetMs,
+                                   ScaleFilter* used) {
+  ScaleFilter choice = filter;
+  if (nsPerTap_ > 0.0 && budgetMs > 0.0 && src.width > 0 && src.height > 0 && dst.width > 0 && dst.height > 0) {
+    FilterWeightCache& cache = SharedFilterWeightCache();
+    const double budgetNs = budgetMs * 1e6;
+    while (choice != ScaleFilter::kPoint) {
+      const auto h = cache.Get(src.width, dst.width, choice);
+      const auto v = cache.Get(src.height, dst.height, choice);
+      const bool upgrade = degraded_ && FilterRank(choice) > FilterRank(lastUsed_);
+      if (TapWork(*h, *v) * nsPerTap_ <= (upgrade ? budgetNs * kUpgradeHeadroom : budgetNs)) {
+        break;
+      }
+      choice = CheaperScaleFilter(choice);
+    }
+  }
+  if (!Run(src, dst, choice)) {
+    return false;
+  }
+  degraded_ = choice != filter;
+  lastUsed_ = choice;
+  if (used) {
+    *used = choice;
+  }
+  return true;
+}
+
+bool TiledImageScaler::Run(const ImageView& src, const MutableImageView& dst, ScaleFilter filter) {
+  ScaleKernels kernels{};
+  if (!IsValid(src.pixels, src.width, src.height, src.pitch) || !IsValid(dst.pixels, dst.width, dst.height, dst.pitch) ||
+      !GetScaleKernels(isa_, &kernels)) {
+    return false;
+  }
+  if (!pool_) {
+    pool_ = &SharedImageWorkerPool();
+  }
+  const auto start = std::chrono::steady_clock::now();
+
+  FilterWeightCache& cache = SharedFilterWeightCache();
+  const std::shared_ptr<const FilterWeightTable> h = cache.Get(src.width, dst.width, filter);
+  const std::shared_ptr<const FilterWeightTable> v = cache.Get(src.height, dst.height, filter);
+
+  const int rowBegin = v->sourceBegin;
+  const int rowEnd = v->sourceEnd;
+  const size_t interPitch = (size_t)dst.width * 4;
+  intermediate_.resize(interPitch * (size_t)(rowEnd - rowBegin));
+  const int stripe = stripeRows_;
+
+  // Horizontal pass: stripes of the source rows the vertical pass reads.
+  pool_->ParallelFor((rowEnd - rowBegin + stripe - 1) / stripe, [&](int task, int) {
+    const int begin = rowBegin + task * stripe;
+    const int end = std::min(begin + stripe, rowEnd);
+    for (int y = begin; y < end; y++) {
+      kernels.horizontal(src.pixels + (ptrdiff_t)y * src.pitch,
+                         intermediate_.data() + interPitch * (size_t)(y - rowBegin),
+                         dst.width,
+                         h->first.data(),
+                         h->weights.data(),
+                         h->taps);
+    }
+  });
+
+  // Vertical pass: stripes of destination rows. A stripe reads intermediate
+  // rows written by other stripes above, hence the separate ParallelFor.
+  rows_.resize((size_t)pool_->Concurrency());
+  for (auto& rows : rows_) {
+    rows.resize((size_t)v->taps);
+  }
+  pool_->ParallelFor((dst.height + stripe - 1) / stripe, [&](int task, int participant) {
+    std::vector<const uint8_t*>& rows = rows_[(size_t)participant];
+    const int begin = task * stripe;
+    const int end = std::min(begin + stripe, dst.height);
+    for (int y = begin; y < end; y++) {
+      for (int k = 0; k < v->taps; k++) {
+        rows[(size_t)k] = intermediate_.data() + interPitch * (size_t)(v->first[(size_t)y] + k - rowBegin);
+      }
+      kernels.vertical(rows.data(),
+                       v->weights.data() + (size_t)y * (size_t)v->taps,
+                       v->taps,
+                       dst.pixels + (ptrdiff_t)y * dst.pitch,
+                       (int)interPitch);
+    }
+  });
+
+  const double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  const double perTap = ns / std::max(TapWork(*h, *v), 1.0);
+  nsPerTap_ = (nsPerTap_ > 0.0) ? nsPerTap_ + kCostSmoothing * (perTap - nsPerTap_) : perTap;
+  return true;
+}
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "scale/image_scale.h"
+#include "scale/image_worker_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace twinshim {
+
+// ImageScaler spread over an ImageWorkerPool. The horizontal pass runs over
+// stripes of source rows and the vertical pass over stripes of destination
+// rows, with a barrier between them; the output is byte-for-byte what
+// ImageScaler produces.
+//
+// ScaleWithin adds a frame budget: it learns the cost of one filter tap per
+// pixel from the frames it has scaled and, when the requested filter would
+// not finish in time, steps down CheaperScaleFilter until one does.
+
+// The next filter down in cost: lanczos3 -> lanczos2 -> bilinear -> point.
+// The 4-tap cubics also step to bilinear. Point stays point.
+ScaleFilter CheaperScaleFilter(ScaleFilter filter);
+
+class TiledImageScaler {
+public:
+  static constexpr int kDefaultStripeRows = 16;
+
+  // Null uses SharedImageWorkerPool(), started on the first Scale call
+  // rather than here, so constructing a scaler early is cheap.
+  explicit TiledImageScaler(ImageWorkerPool* pool = nullptr, ScaleIsa isa = BestScaleIsa());
+
+  // Same contract and output as ImageScaler::Scale.
+  bool Scale(const ImageView& src, const MutableImageView& dst, ScaleFilter filter);
+
+  // Scales with `filter`, or the sharpest cheaper filter predicted to take at
+  // most `budgetMs`. `used` (optional) receives the filter that ran. With no
+  // history yet the requested filter runs. After degrading, a sharper filter
+  // comes back only once it is predicted to fit comfortably, so a frame time
+  // near the budget does not flip filters every frame.
+  bool ScaleWithin(const ImageView& src,
+                   const MutableImageView& dst,
+                   ScaleFilter filter,
+                   double budgetMs,
+                   ScaleFilter* used = nullptr);
+
+  // Rows per task in both passes; smaller stripes balance better, larger
+  // ones cost less to hand out.
+  void SetStripeRows(int rows);
+
+  ScaleIsa Isa() const { return isa_; }
+
+  // Learned nanoseconds per filter tap per pixel; 0 until a frame ran.
+  double NsPerTap() const { return nsPerTap_; }
+
+private:
+  bool Run(const ImageView& src, const MutableImageView& dst, ScaleFilter filter);
+
+  ImageWorkerPool* pool_;
+  ScaleIsa isa_;
+  int stripeRows_ = kDefaultStripeRows;
+  std::vector<uint8_t> intermediate_;
+  std::vector<std::vector<const uint8_t*>> rows_; // per participant
+  double nsPerTap_ = 0.0;
+  bool degraded_ = false;
+  ScaleFilter lastUsed_ = ScaleFilter::kPoint;
+};
+
+}
@@ -0,0 +1,189 @@
+#include "scale/image_scale.h"
+#include "scale/pixel_convert.h"
+#include "scale/tiled_scale.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace twinshim;
+
+static void PrintUsage() {
+  std::fprintf(stderr,
+               "twinshim_scale_bench [--src <w>x<h>] [--dst <w>x<h>] [--frames <n>] [--filter <name>] [--isa <name>]\n"
+               "                      [--threads <n>]\n"
+               "\n"
+               "Times the CPU scaler the DirectDraw fallback uses, for every filter and every\n"
+               "kernel set this CPU supports unless narrowed down, on one thread and tiled\n"
+               "across a worker pool, then the conversion of common surface formats to\n"
+               "A8R8G8B8 at the source size.\n"
+               "\n"
+               "  --src <w>x<h>     Source size (default: 640x480)\n"
+               "  --dst <w>x<h>     Destination size (default: 1920x1440)\n"
+               "  --frames <n>      Frames timed per combination (default: 30)\n"
+               "  --filter <name>   point, bilinear, bicubic, catmull-rom, lanczos2 or lanczos3\n"
+               "  --isa <name>      scalar, sse2, avx2 or neon\n"
+               "  --threads <n>     Threads for the tiled rows (default: CPUs the process may use)\n");
+}
+
+static bool ParseSize(const char* text, int* w, int* h) {
+  char* end = nullptr;
+  const long pw = std::strtol(text, &end, 10);
+  if (!end || *end != 'x') {
+    return false;
+  }
+  const long ph = std::strtol(end + 1, &end, 10);
+  if (!end || *end || pw <= 0 || ph <= 0 || pw > 16384 || ph > 16384) {
+    return false;
+  }
+  *w = (int)pw;
+  *h = (int)ph;
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int srcW = 640;
+  int srcH = 480;
+  int dstW = 1920;
+  int dstH = 1440;
+  int frames = 30;
+  std::string filterName;
+  std::string isaName;
+  int threads = ProcessCpuCount();
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (arg == "--src" && hasValue && ParseSize(argv[i + 1], &srcW, &srcH)) {
+      i++;
+    } else if (arg == "--dst" && hasValue && ParseSize(argv[i + 1], &dstW, &dstH)) {
+      i++;
+    } else if (arg == "--frames" && hasValue && std::atoi(argv[i + 1]) > 0) {
+      frames = std::atoi(argv[++i]);
+    } else if (arg == "--filter" && hasValue) {
+      filterName = argv[++i];
+    } else if (arg == "--isa" && hasValue) {
+      isaName = argv[++i];
+    } else if (arg == "--threads" && hasValue && std::atoi(argv[i + 1]) > 0) {
+      threads = std::atoi(argv[++i]);
+    } else {
+      PrintUsage();
+      return 2;
+    }
+  }
+
+  std::vector<uint8_t> src((size_t)srcW * (size_t)srcH * 4);
+  uint32_t state = 1;
+  for (auto& b : src) {
+    state = state * 1664525u + 1013904223u;
+    b = (uint8_t)(state >> 24);
+  }
+  std::vector<uint8_t> dst((size_t)dstW * (size_t)dstH * 4);
+  const ImageView srcView{src.data(), srcW, srcH, (ptrdiff_t)srcW * 4};
+  const MutableImageView dstView{dst.data(), dstW, dstH, (ptrdiff_t)dstW * 4};
+
+  // Runs `scale` once to warm buffers and caches, then returns ms per frame.
+  auto timeFrames = [&](const std::function<void()>& scale) {
+    scale();
+    const auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++) {
+      scale();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+  };
+  auto printRow = [&](ScaleFilter filter, ScaleIsa isa, int rowThreads, double ms) {
+    std::printf("%-12s %-7s %7d %10.2f %10.1f\n",
+                ScaleFilterName(filter),
+                ScaleIsaName(isa),
+                rowThreads,
+                ms,
+                ms > 0 ? (double)dstW * dstH / (ms * 1000.0) : 0.0);
+  };
+
+  threads = threads > 0 ? threads : 1;
+  ImageWorkerPool pool(threads - 1);
+  std::printf("%dx%d -> %dx%d, %d frames each\n", srcW, srcH, dstW, dstH, frames);
+  std::printf("%-12s %-7s %7s %10s %10s\n", "filter", "isa", "threads", "ms/frame", "Mpix/s");
+  bool any = false;
+  for (ScaleFilter filter : {ScaleFilter::kPoint,
+                             ScaleFilter::kBilinear,
+                             ScaleFilter::kBicubic,
+                             ScaleFilter::kCatmullRom,
+                             ScaleFilter::kLanczos2,
+                             ScaleFilter::kLanczos3}) {
+    if (!filterName.empty() && filterName != ScaleFilterName(filter)) {
+      continue;
+    }
+    for (ScaleIsa isa : SupportedScaleIsas()) {
+      if (!isaName.empty() && isaName != ScaleIsaName(isa)) {
+        continue;
+      }
+      ImageScaler scaler(isa);
+      printRow(filter, isa, 1, timeFrames([&] { scaler.Scale(srcView, dstView, filter); }));
+      if (pool.Concurrency() > 1) {
+        TiledImageScaler tiled(&pool, isa);
+        printRow(filter, isa, pool.Concurrency(), timeFrames([&] { tiled.Scale(srcView, dstView, filter); }));
+      }
+      any = true;
+    }
+  }
+  if (!any) {
+    std::fprintf(stderr, "No filter/kernel set matched.\n");
+    return 1;
+  }
+  if (!filterName.empty()) {
+    return 0;
+  }
+
+  struct NamedFormat {
+    const char* name;
+    uint32_t bitCount, r, g, b, a;
+  };
+  const NamedFormat formats[] = {
+      {"r5g6b5", 16, 0xF800, 0x07E0, 0x001F, 0},
+      {"x1r5g5b5", 16, 0x7C00, 0x03E0, 0x001F, 0},
+      {"a4r4g4b4", 16, 0x0F00, 0x00F0, 0x000F, 0xF000},
+      {"a8b8g8r8", 32, 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000},
+      {"p8", 8, 0, 0, 0, 0},
+  };
+  uint32_t palette[256];
+  for (uint32_t i = 0; i < 256; i++) {
+    palette[i] = 0xFF000000u | (i * 0x010101u);
+  }
+  std::vector<uint32_t> argb((size_t)srcW * (size_t)srcH);
+
+  std::printf("\n%-12s %-7s %10s %10s\n", "convert", "isa", "ms/frame", "Mpix/s");
+  for (const auto& nf : formats) {
+    PixelFormatInfo format = Palettized8PixelFormat();
+    if (nf.bitCount != 8 && !DescribeRgbPixelFormat(nf.bitCount, nf.r, nf.g, nf.b, nf.a, &format)) {
+      continue;
+    }
+    for (ScaleIsa isa : SupportedScaleIsas()) {
+      if (!isaName.empty() && isaName != ScaleIsaName(isa)) {
+        continue;
+      }
+      PixelConverter converter(isa);
+      if (!converter.Reset(format, palette)) {
+        continue;
+      }
+      const ptrdiff_t pitch = (ptrdiff_t)srcW * format.bytesPerPixel;
+      converter.ConvertRect(src.data(), pitch, srcW, srcH, argb.data(), srcW);
+      const auto start = std::chrono::steady_clock::now();
+      for (int f = 0; f < frames; f++) {
+        converter.ConvertRect(src.data(), pitch, srcW, srcH, argb.data(), srcW);
+      }
+      const double ms =
+          std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+      std::printf("%-12s %-7s %10.3f %10.1f\n",
+                  nf.name,
+                  ScaleIsaName(isa),
+                  ms,
+                  ms > 0 ? (double)srcW * srcH / (ms * 1000.0) : 0.0);
+    }
+  }
+  return 0;
+}
@@ -1,9 +1,12 @@
 #include "shim/d3d9_surface_scaler.h"
 
 #include "shim/minhook_runtime.h"
+#include "shim/shim_trace.h"
 #include "shim/surface_scale_config.h"
 #include "shim/window_scale_registry.h"
 
+#include "common/launch_timeline.h"
+
 #include <MinHook.h>
 
 #include <windows.h>
@@ -470,7 +470,10 @@ static DWORD WINAPI D3D9InitThreadProc(LPVOID) {
   }
 
   if (!g_stopInitThread.load(std::memory_order_acquire)) {
+    LaunchTimeline& timeline = ShimLaunchTimeline();
+    const uint32_t span = timeline.Begin("shim: d3d9 hooks");
     const bool ok = InstallD3D9ExportsHooksOnce();
+    timeline.End(span);
     D3D9Tracef("init thread finished (ok=%d)", ok ? 1 : 0);
     if (!ok && !g_seenD3D9.load(std::memory_order_acquire)) {
       D3D9Tracef("d3d9.dll not detected; likely not a D3D9 path (check snapshot above)");
@@ -37,47 +37,8 @@ static std::atomic<bool> g_seenD3D11{false};
 static std::atomic<bool> g_seenOpenGL{false};
 static std::atomic<bool> g_seenVulkan{false};
 
-static bool IsTwinShimDebugEnabled() {
-  wchar_t dummy[2] = {};
-  DWORD n = GetEnvironmentVariableW(L"TWINSHIM_DEBUG_PIPE", dummy, (DWORD)(sizeof(dummy) / sizeof(dummy[0])));
-  if (n) {
-    return true;
-  }
-  n = GetEnvironmentVariableW(L"HKLM_WRAPPER_DEBUG_PIPE", dummy, (DWORD)(sizeof(dummy) / sizeof(dummy[0])));
-  return n != 0;
-}
-
-static void D3D9TraceWrite(const char* text) {
-  if (!IsTwinShimDebugEnabled()) {
-    return;
-  }
-  if (!text || !*text) {
-    return;
-  }
-
-  OutputDebugStringA(text);
-
-  wchar_t pipeBuf[512] = {};
-  DWORD pipeLen = GetEnvironmentVariableW(L"TWINSHIM_DEBUG_PIPE", pipeBuf, (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0])));
-  if (!pipeLen || pipeLen >= (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0]))) {
-    pipeLen = GetEnvironmentVariableW(L"HKLM_WRAPPER_DEBUG_PIPE", pipeBuf, (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0])));
-  }
-  if (!pipeLen || pipeLen >= (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0]))) {
-    return;
-  }
-  pipeBuf[pipeLen] = L'\0';
-
-  HANDLE h = CreateFileW(pipeBuf, GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
-  if (h == INVALID_HANDLE_VALUE) {
-    return;
-  }
-  DWORD written = 0;
-  WriteFile(h, text, (DWORD)lstrlenA(text), &written, nullptr);
-  CloseHandle(h);
-}
-
 static void D3D9Tracef(const char* fmt, ...) {
-  if (!IsTwinShimDebugEnabled()) {
+  if (!IsShimTraceEnabled()) {
     return;
   }
   if (!fmt || !*fmt) {
@@ -109,7 +70,7 @@ static void D3D9Tracef(const char* fmt, ...) {
       buf[len + 1] = '\0';
     }
   }
-  D3D9TraceWrite(buf);
+  ShimTraceWrite(buf);
 }
 
 static void ProbeLogModuleIfPresent(const wchar_t* moduleName, std::atomic<bool>& seenFlag) {
@@ -5,6 +5,14 @@
 #include "shim/window_scale_registry.h"
 
 #include "shim/minhook_runtime.h"
+#include "shim/shim_trace.h"
+
+#include "common/launch_timeline.h"
+
+#include "scale/image_scale.h"
+#include "scale/image_worker_pool.h"
+#include "scale/pixel_convert.h"
+#include "scale/tiled_scale.h"
 
 #include <MinHook.h>
 
@@ -32,6 +40,8 @@ namespace {
 
 #include "shim/ddraw_surface_scaler_scaler.inl"
 
+#include "shim/ddraw_surface_scaler_cpu.inl"
+
 #include "shim/ddraw_surface_scaler_hooks.inl"
 
 } // namespace
@@ -0,0 +1,126 @@
+// --- CPU filtered scaling (fallback when D3D9 is unavailable) ---
+//
+// Used when the D3D9 path cannot create a device or upload the frame. The
+// source rect is converted to A8R8G8B8, scaled with the SIMD separable filters
+// in scale/image_scale.h and drawn to the window with SetDIBitsToDevice. This
+// is slower than the GPU path but keeps the configured filter instead of
+// dropping to a point stretch.
+//
+// Scaling is split into row stripes across SharedImageWorkerPool(), whose
+// threads start on the first CPU present rather than at DLL load. Each frame
+// gets kCpuScaleBudgetMs; when the configured filter is predicted to miss it
+// (large --scale factors, slow CPUs) a cheaper one runs for that frame.
+
+// Leaves room for conversion and SetDIBitsToDevice within a 60 Hz frame.
+constexpr double kCpuScaleBudgetMs = 12.0;
+
+// The CPU filter for a configured --scale-method. lanczos is two lobes;
+// pixfast is bilinear.
+static ScaleFilter ScaleFilterForMethod(SurfaceScaleMethod method) {
+  switch (method) {
+    case SurfaceScaleMethod::kPoint:
+      return ScaleFilter::kPoint;
+    case SurfaceScaleMethod::kBicubic:
+      return ScaleFilter::kBicubic;
+    case SurfaceScaleMethod::kCatmullRom:
+      return ScaleFilter::kCatmullRom;
+    case SurfaceScaleMethod::kLanczos:
+      return ScaleFilter::kLanczos2;
+    case SurfaceScaleMethod::kLanczos3:
+      return ScaleFilter::kLanczos3;
+    case SurfaceScaleMethod::kBilinear:
+    case SurfaceScaleMethod::kPixelFast:
+      return ScaleFilter::kBilinear;
+  }
+  return ScaleFilter::kBilinear;
+}
+
+class DDrawCpuScaler {
+ public:
+  bool PresentScaled(LPDIRECTDRAWSURFACE7 srcSurf,
+                     const RECT& srcRect,
+                     HWND hwnd,
+                     UINT dstW,
+                     UINT dstH,
+                     SurfaceScaleMethod method) {
+    if (!srcSurf || !hwnd || dstW == 0 || dstH == 0) {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mu_);
+
+    DDSURFACEDESC2 sd{};
+    sd.dwSize = sizeof(sd);
+    if (FAILED(srcSurf->GetSurfaceDesc(&sd)) || sd.dwWidth == 0 || sd.dwHeight == 0) {
+      return false;
+    }
+
+    RECT rc = srcRect;
+    rc.left = std::max<LONG>(0, rc.left);
+    rc.top = std::max<LONG>(0, rc.top);
+    rc.right = std::min<LONG>((LONG)sd.dwWidth, rc.right);
+    rc.bottom = std::min<LONG>((LONG)sd.dwHeight, rc.bottom);
+
+    const int srcW = (int)(rc.right - rc.left);
+    const int srcH = (int)(rc.bottom - rc.top);
+    if (srcW <= 0 || srcH <= 0) {
+      return false;
+    }
+
+    // No GPU copy to race with here, so waiting for the lock is fine.
+    if (!ReadSurfaceRectToArgb(srcSurf, rc, (UINT)srcW, (UINT)srcH, DDLOCK_WAIT | DDLOCK_READONLY, converter_, src_)) {
+      return false;
+    }
+
+    const size_t dstPixels = (size_t)dstW * (size_t)dstH;
+    if (dst_.size() < dstPixels) {
+      dst_.resize(dstPixels);
+    }
+
+    const ImageView srcView{reinterpret_cast<const uint8_t*>(src_.data()), srcW, srcH, (ptrdiff_t)srcW * 4};
+    const MutableImageView dstView{reinterpret_cast<uint8_t*>(dst_.data()), (int)dstW, (int)dstH, (ptrdiff_t)dstW * 4};
+    const ScaleFilter filter = ScaleFilterForMethod(method);
+    ScaleFilter used = filter;
+    if (!scaler_.ScaleWithin(srcView, dstView, filter, kCpuScaleBudgetMs, &used)) {
+      return false;
+    }
+    if (used != filter && !reportedDegrade_) {
+      reportedDegrade_ = true;
+      Tracef("CPU scale %dx%d -> %ux%u: %s over %.1f ms budget on %d threads, using %s",
+             srcW,
+             srcH,
+             dstW,
+             dstH,
+             ScaleFilterName(filter),
+             kCpuScaleBudgetMs,
+             SharedImageWorkerPool().Concurrency(),
+             ScaleFilterName(used));
+    }
+
+    BITMAPINFO bmi{};
+    bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth = (LONG)dstW;
+    bmi.bmiHeader.biHeight = -(LONG)dstH; // top-down
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    HDC dc = GetDC(hwnd);
+    if (!dc) {
+      return false;
+    }
+    const int lines = SetDIBitsToDevice(dc, 0, 0, dstW, dstH, 0, 0, 0, dstH, dst_.data(), &bmi, DIB_RGB_COLORS);
+    ReleaseDC(hwnd, dc);
+    return lines == (int)dstH;
+  }
+
+ private:
+  std::mutex mu_;
+  TiledImageScaler scaler_;
+  PixelConverter converter_;
+  bool reportedDegrade_ = false;
+  std::vector<uint32_t> src_;
+  std::vector<uint32_t> dst_;
+};
+
+static DDrawCpuScaler g_cpuScaler;
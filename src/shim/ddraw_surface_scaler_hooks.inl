@@ -350,7 +350,7 @@ static bool InstallDDrawSurfaceScalerHooksOnce() {
     Tracef("surface scaling: invalid --scale-method '%ls' -> defaulting to point", cfg.methodRaw.c_str());
   }
   Tracef("surface scaling enabled (scale=%.3f method=%ls)", cfg.factor, SurfaceScaleMethodToString(cfg.method));
-  Tracef("DirectDraw path: filtered scaling uses D3D9 (GPU); fallback on failure is point stretch");
+  Tracef("DirectDraw path: filtered scaling uses D3D9 (GPU), then CPU SIMD; fallback on failure is point stretch");
 
   if (!AcquireMinHook()) {
     Tracef("AcquireMinHook failed");
@@ -397,7 +397,10 @@ static DWORD WINAPI DDrawInitThreadProc(LPVOID) {
   }
 
   if (!g_stopInitThread.load(std::memory_order_acquire)) {
+    LaunchTimeline& timeline = ShimLaunchTimeline();
+    const uint32_t span = timeline.Begin("shim: ddraw hooks");
     const bool ok = InstallDDrawSurfaceScalerHooksOnce();
+    timeline.End(span);
     Tracef("init thread finished (ok=%d)", ok ? 1 : 0);
   }
   return 0;
@@ -598,6 +601,7 @@ static HRESULT STDMETHODCALLTYPE Hook_DDS7_Flip(LPDIRECTDRAWSURFACE7 primary, LP
 
   HRESULT hr = DDERR_GENERIC;
   const bool usePointPath = (cfg.method == SurfaceScaleMethod::kPoint);
+  const char* scaledVia = "DirectDraw::Blt stretch";
   if (usePointPath) {
     // Try to avoid introducing extra latency: don't force DDBLT_WAIT.
     // If the blit can't be scheduled immediately, do a one-time blocking fallback
@@ -616,14 +620,17 @@ static HRESULT STDMETHODCALLTYPE Hook_DDS7_Flip(LPDIRECTDRAWSURFACE7 primary, LP
       }
     }
   } else {
-    // Hardware accelerated path (D3D9). If it fails, fall back to point stretch.
-    const bool okGpu = g_d3d9Scaler.PresentScaled(back, src, hwnd, (UINT)clientW, (UINT)clientH, cfg.method);
-    if (okGpu) {
+    // Hardware accelerated path (D3D9), then the CPU filters. If both fail, fall back to point stretch.
+    if (g_d3d9Scaler.PresentScaled(back, src, hwnd, (UINT)clientW, (UINT)clientH, cfg.method)) {
       hr = DD_OK;
+      scaledVia = "D3D9 GPU present";
+    } else if (g_cpuScaler.PresentScaled(back, src, hwnd, (UINT)clientW, (UINT)clientH, cfg.method)) {
+      hr = DD_OK;
+      scaledVia = "CPU SIMD present";
     } else {
       bool expected = false;
       if (g_loggedFilteredFallback.compare_exchange_strong(expected, true)) {
-        Tracef("Flip: GPU filtered scaling failed (method=%ls); falling back to point stretch", SurfaceScaleMethodToString(cfg.method));
+        Tracef("Flip: filtered scaling failed (method=%ls); falling back to point stretch", SurfaceScaleMethodToString(cfg.method));
       }
       if (g_fpDDS7_Blt) {
         hr = g_fpDDS7_Blt(primary, &dst, back, &src, DDBLT_DONOTWAIT, nullptr);
@@ -645,7 +652,7 @@ static HRESULT STDMETHODCALLTYPE Hook_DDS7_Flip(LPDIRECTDRAWSURFACE7 primary, LP
     bool expected = false;
     if (SUCCEEDED(hr) && g_loggedScaleViaFlip.compare_exchange_strong(expected, true)) {
       Tracef("Flip: scaled via %s (method=%ls)",
-             usePointPath ? "DirectDraw::Blt stretch" : "D3D9 GPU present",
+             scaledVia,
              SurfaceScaleMethodToString(cfg.method));
     }
   }
@@ -746,6 +753,7 @@ static HRESULT STDMETHODCALLTYPE Hook_DDS7_Blt(LPDIRECTDRAWSURFACE7 self,
             }
 
             HRESULT hrScale = DDERR_GENERIC;
+            const char* scaledVia = "DirectDraw::Blt stretch";
             if (cfg.method == SurfaceScaleMethod::kPoint) {
               // Keep original flags if possible, but drop effects.
               const DWORD bltFlags = (flags & (DDBLT_WAIT | DDBLT_DONOTWAIT));
@@ -754,10 +762,13 @@ static HRESULT STDMETHODCALLTYPE Hook_DDS7_Blt(LPDIRECTDRAWSURFACE7 self,
                 hrScale = g_fpDDS7_Blt(self, &localDst, src, &localSrc, DDBLT_WAIT, nullptr);
               }
             } else {
-              // Hardware accelerated path (D3D9). If it fails, fall back to point stretch.
-              const bool okGpu = g_d3d9Scaler.PresentScaled(src, localSrc, hwnd, (UINT)clientW, (UINT)clientH, cfg.method);
-              if (okGpu) {
+              // Hardware accelerated path (D3D9), then the CPU filters. If both fail, fall back to point stretch.
+              if (g_d3d9Scaler.PresentScaled(src, localSrc, hwnd, (UINT)clientW, (UINT)clientH, cfg.method)) {
+                hrScale = DD_OK;
+                scaledVia = "D3D9 GPU present";
+              } else if (g_cpuScaler.PresentScaled(src, localSrc, hwnd, (UINT)clientW, (UINT)clientH, cfg.method)) {
                 hrScale = DD_OK;
+                scaledVia = "CPU SIMD present";
               } else {
                 hrScale = g_fpDDS7_Blt(self, &localDst, src, &localSrc, DDBLT_DONOTWAIT, nullptr);
                 if (FAILED(hrScale)) {
@@ -765,7 +776,7 @@ static HRESULT STDMETHODCALLTYPE Hook_DDS7_Blt(LPDIRECTDRAWSURFACE7 self,
                 }
                 bool expected = false;
                 if (g_loggedFilteredFallback.compare_exchange_strong(expected, true)) {
-                  Tracef("Blt: GPU filtered scaling failed (method=%ls); falling back to point stretch", SurfaceScaleMethodToString(cfg.method));
+                  Tracef("Blt: filtered scaling failed (method=%ls); falling back to point stretch", SurfaceScaleMethodToString(cfg.method));
                 }
               }
             }
@@ -774,7 +785,7 @@ static HRESULT STDMETHODCALLTYPE Hook_DDS7_Blt(LPDIRECTDRAWSURFACE7 self,
               bool expected = false;
               if (g_loggedScaleViaBlt.compare_exchange_strong(expected, true)) {
                 Tracef("Blt: scaled via %s (method=%ls)",
-                       (cfg.method == SurfaceScaleMethod::kPoint) ? "DirectDraw::Blt stretch" : "D3D9 GPU present",
+                       scaledVia,
                        SurfaceScaleMethodToString(cfg.method));
               }
               return DD_OK;
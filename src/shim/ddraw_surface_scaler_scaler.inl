@@ -1,40 +1,3 @@
-struct PixelFormatInfo {
-  uint32_t rMask = 0;
-  uint32_t gMask = 0;
-  uint32_t bMask = 0;
-  uint32_t aMask = 0;
-  int rShift = 0;
-  int gShift = 0;
-  int bShift = 0;
-  int aShift = 0;
-  int rBits = 0;
-  int gBits = 0;
-  int bBits = 0;
-  int aBits = 0;
-  int bytesPerPixel = 0;
-};
-
-static int CountBits(uint32_t v) {
-  int c = 0;
-  while (v) {
-    c += (int)(v & 1u);
-    v >>= 1;
-  }
-  return c;
-}
-
-static int CountTrailingZeros(uint32_t v) {
-  if (v == 0) {
-    return 0;
-  }
-  int c = 0;
-  while ((v & 1u) == 0) {
-    c++;
-    v >>= 1;
-  }
-  return c;
-}
-
 static bool GetPixelFormatInfoFromSurface(LPDIRECTDRAWSURFACE7 surf, PixelFormatInfo* out) {
   if (!surf || !out) {
     return false;
@@ -44,104 +7,84 @@ static bool GetPixelFormatInfoFromSurface(LPDIRECTDRAWSURFACE7 surf, PixelFormat
   if (FAILED(surf->GetSurfaceDesc(&sd))) {
     return false;
   }
+  if (sd.ddpfPixelFormat.dwFlags & DDPF_PALETTEINDEXED8) {
+    *out = Palettized8PixelFormat();
+    return true;
+  }
   if ((sd.ddpfPixelFormat.dwFlags & DDPF_RGB) == 0) {
     return false;
   }
+  const uint32_t aMask = (sd.ddpfPixelFormat.dwFlags & DDPF_ALPHAPIXELS) ? sd.ddpfPixelFormat.dwRGBAlphaBitMask : 0;
+  return DescribeRgbPixelFormat(sd.ddpfPixelFormat.dwRGBBitCount,
+                                sd.ddpfPixelFormat.dwRBitMask,
+                                sd.ddpfPixelFormat.dwGBitMask,
+                                sd.ddpfPixelFormat.dwBBitMask,
+                                aMask,
+                                out);
+}
 
-  PixelFormatInfo info;
-  info.rMask = sd.ddpfPixelFormat.dwRBitMask;
-  info.gMask = sd.ddpfPixelFormat.dwGBitMask;
-  info.bMask = sd.ddpfPixelFormat.dwBBitMask;
-  info.aMask = (sd.ddpfPixelFormat.dwFlags & DDPF_ALPHAPIXELS) ? sd.ddpfPixelFormat.dwRGBAlphaBitMask : 0;
-  info.rShift = CountTrailingZeros(info.rMask);
-  info.gShift = CountTrailingZeros(info.gMask);
-  info.bShift = CountTrailingZeros(info.bMask);
-  info.aShift = CountTrailingZeros(info.aMask);
-  info.rBits = CountBits(info.rMask);
-  info.gBits = CountBits(info.gMask);
-  info.bBits = CountBits(info.bMask);
-  info.aBits = CountBits(info.aMask);
-
-  const uint32_t bpp = sd.ddpfPixelFormat.dwRGBBitCount;
-  if (bpp == 16) {
-    info.bytesPerPixel = 2;
-    // Some wrappers report 16bpp RGB but leave masks zero. Assume 565.
-    if (info.rMask == 0 && info.gMask == 0 && info.bMask == 0) {
-      info.rMask = 0xF800;
-      info.gMask = 0x07E0;
-      info.bMask = 0x001F;
-      info.rShift = 11;
-      info.gShift = 5;
-      info.bShift = 0;
-      info.rBits = 5;
-      info.gBits = 6;
-      info.bBits = 5;
-    }
-  } else if (bpp == 32) {
-    info.bytesPerPixel = 4;
-    // Some wrappers report 32bpp RGB but leave masks zero. Assume XRGB8888.
-    if (info.rMask == 0 && info.gMask == 0 && info.bMask == 0) {
-      info.rMask = 0x00FF0000;
-      info.gMask = 0x0000FF00;
-      info.bMask = 0x000000FF;
-      info.aMask = 0;
-      info.rShift = 16;
-      info.gShift = 8;
-      info.bShift = 0;
-      info.rBits = 8;
-      info.gBits = 8;
-      info.bBits = 8;
-      info.aBits = 0;
-    }
-  } else {
+// The palette of an 8bpp surface as A8R8G8B8. Fails when none is attached.
+static bool GetSurfacePaletteArgb(LPDIRECTDRAWSURFACE7 surf, uint32_t out[256]) {
+  LPDIRECTDRAWPALETTE pal = nullptr;
+  if (FAILED(surf->GetPalette(&pal)) || !pal) {
     return false;
   }
-
-  // If we still don't have masks/bits, bail out.
-  if (info.rMask == 0 || info.gMask == 0 || info.bMask == 0 || info.rBits == 0 || info.gBits == 0 || info.bBits == 0) {
+  PALETTEENTRY entries[256]{};
+  const HRESULT hr = pal->GetEntries(0, 0, 256, entries);
+  pal->Release();
+  if (FAILED(hr)) {
     return false;
   }
-
-  *out = info;
-  return true;
-}
-
-static uint8_t ExpandTo8(uint32_t v, int bits) {
-  if (bits <= 0) {
-    return 0;
+  for (int i = 0; i < 256; i++) {
+    out[i] = 0xFF000000u | ((uint32_t)entries[i].peRed << 16) | ((uint32_t)entries[i].peGreen << 8) |
+             (uint32_t)entries[i].peBlue;
   }
-  if (bits >= 8) {
-    return (uint8_t)std::min<uint32_t>(255u, v);
-  }
-  const uint32_t maxv = (1u << (uint32_t)bits) - 1u;
-  return (uint8_t)((v * 255u + (maxv / 2u)) / maxv);
+  return true;
 }
 
-static void UnpackRGBA(const PixelFormatInfo& fmt, uint32_t px, uint8_t* r, uint8_t* g, uint8_t* b, uint8_t* a) {
-  const uint32_t rv = (fmt.rMask ? ((px & fmt.rMask) >> (uint32_t)fmt.rShift) : 0);
-  const uint32_t gv = (fmt.gMask ? ((px & fmt.gMask) >> (uint32_t)fmt.gShift) : 0);
-  const uint32_t bv = (fmt.bMask ? ((px & fmt.bMask) >> (uint32_t)fmt.bShift) : 0);
-  const uint32_t av = (fmt.aMask ? ((px & fmt.aMask) >> (uint32_t)fmt.aShift) : 255u);
-  if (r) {
-    *r = ExpandTo8(rv, fmt.rBits);
+// Reads `rc` (w x h) of an RGB or 8bpp palettized surface into `out` as
+// A8R8G8B8, w pixels per row.
+static bool ReadSurfaceRectToArgb(LPDIRECTDRAWSURFACE7 srcSurf,
+                                  const RECT& rc,
+                                  UINT w,
+                                  UINT h,
+                                  DWORD lockFlags,
+                                  PixelConverter& converter,
+                                  std::vector<uint32_t>& out) {
+  PixelFormatInfo srcFmt;
+  if (!GetPixelFormatInfoFromSurface(srcSurf, &srcFmt)) {
+    return false;
   }
-  if (g) {
-    *g = ExpandTo8(gv, fmt.gBits);
+  uint32_t palette[256];
+  if (srcFmt.palettized && !GetSurfacePaletteArgb(srcSurf, palette)) {
+    return false;
   }
-  if (b) {
-    *b = ExpandTo8(bv, fmt.bBits);
+  if (!converter.Reset(srcFmt, srcFmt.palettized ? palette : nullptr)) {
+    return false;
   }
-  if (a) {
-    *a = fmt.aMask ? ExpandTo8(av, fmt.aBits) : 255;
+
+  DDSURFACEDESC2 ssd{};
+  ssd.dwSize = sizeof(ssd);
+  HRESULT hr = srcSurf->Lock(nullptr, &ssd, lockFlags, nullptr);
+  if (FAILED(hr) || !ssd.lpSurface || ssd.lPitch <= 0) {
+    if (SUCCEEDED(hr)) {
+      srcSurf->Unlock(nullptr);
+    }
+    return false;
   }
-}
 
-static uint32_t ReadPixel(const uint8_t* base, int pitch, int x, int y, int bpp) {
-  const uint8_t* p = base + (ptrdiff_t)y * pitch + (ptrdiff_t)x * bpp;
-  if (bpp == 4) {
-    return *(const uint32_t*)p;
+  const size_t needed = (size_t)w * (size_t)h;
+  if (out.size() < needed) {
+    out.resize(needed);
   }
-  return (uint32_t)(*(const uint16_t*)p);
+
+  const uint8_t* sBase = (const uint8_t*)ssd.lpSurface;
+  const ptrdiff_t sPitch = (ptrdiff_t)ssd.lPitch;
+  const uint8_t* first = sBase + (ptrdiff_t)rc.top * sPitch + (ptrdiff_t)rc.left * srcFmt.bytesPerPixel;
+  const bool ok = converter.ConvertRect(first, sPitch, (int)w, (int)h, out.data(), (ptrdiff_t)w);
+
+  srcSurf->Unlock(nullptr);
+  return ok;
 }
 
 // --- D3D9-based filtered scaling (hardware accelerated) ---
@@ -149,7 +92,7 @@ static uint32_t ReadPixel(const uint8_t* base, int pitch, int x, int y, int bpp)
 // DirectDraw surfaces from wrappers (e.g. dgVoodoo) can expose GetDC, but using GDI
 // StretchBlt every frame is often very slow. For bilinear/bicubic, we instead:
 //   1) Lock() the source surface (read-only)
-//   2) Convert to A8R8G8B8 in a CPU buffer
+//   2) Convert to A8R8G8B8 in a CPU buffer (SIMD/LUT, see scale/pixel_convert.h)
 //   3) Upload to a dynamic D3D9 texture
 //   4) Render to the game window with:
 //        - bilinear: fixed-function sampling with linear filtering
@@ -596,100 +539,14 @@ class DDrawD3D9Scaler {
   }
 
   bool UploadSurfaceRectToSrcTextureUnlocked(LPDIRECTDRAWSURFACE7 srcSurf, const RECT& rc, UINT w, UINT h) {
-    PixelFormatInfo srcFmt;
-    if (!GetPixelFormatInfoFromSurface(srcSurf, &srcFmt)) {
-      return false;
-    }
-
-    DDSURFACEDESC2 ssd{};
-    ssd.dwSize = sizeof(ssd);
     // Avoid stalling on wrappers that keep surfaces on the GPU (common with dgVoodoo).
-    // If we can't lock immediately, let caller fall back to point stretch.
-    HRESULT hr = srcSurf->Lock(nullptr, &ssd, DDLOCK_DONOTWAIT | DDLOCK_READONLY, nullptr);
-    if (FAILED(hr) || !ssd.lpSurface || ssd.lPitch <= 0) {
-      if (SUCCEEDED(hr)) {
-        srcSurf->Unlock(nullptr);
-      }
-      return false;
-    }
-
-    const uint8_t* sBase = (const uint8_t*)ssd.lpSurface;
-    const int sPitch = (int)ssd.lPitch;
-    const int bpp = srcFmt.bytesPerPixel;
-    if (bpp != 2 && bpp != 4) {
-      srcSurf->Unlock(nullptr);
+    // If we can't lock immediately, let caller fall back.
+    if (!ReadSurfaceRectToArgb(srcSurf, rc, w, h, DDLOCK_DONOTWAIT | DDLOCK_READONLY, converter_, staging_)) {
       return false;
     }
 
-    const size_t needed = (size_t)w * (size_t)h;
-    if (staging_.size() < needed) {
-      staging_.resize(needed);
-    }
-
-    // Fast paths for common formats.
-    const bool isXrgb8888 =
-        (bpp == 4) &&
-        (srcFmt.rMask == 0x00FF0000) &&
-        (srcFmt.gMask == 0x0000FF00) &&
-        (srcFmt.bMask == 0x000000FF) &&
-        (srcFmt.aMask == 0);
-    const bool isArgb8888 =
-        (bpp == 4) &&
-        (srcFmt.rMask == 0x00FF0000) &&
-        (srcFmt.gMask == 0x0000FF00) &&
-        (srcFmt.bMask == 0x000000FF) &&
-        (srcFmt.aMask == 0xFF000000);
-    const bool isRgb565 =
-        (bpp == 2) &&
-        (srcFmt.rMask == 0xF800) &&
-        (srcFmt.gMask == 0x07E0) &&
-        (srcFmt.bMask == 0x001F) &&
-        (srcFmt.aMask == 0);
-
-    if (isArgb8888 || isXrgb8888) {
-      for (UINT y = 0; y < h; y++) {
-        const uint32_t* row = (const uint32_t*)(sBase + (ptrdiff_t)(rc.top + (LONG)y) * sPitch) + rc.left;
-        uint32_t* out = &staging_[y * w];
-        if (isArgb8888) {
-          memcpy(out, row, (size_t)w * sizeof(uint32_t));
-        } else {
-          for (UINT x = 0; x < w; x++) {
-            out[x] = row[x] | 0xFF000000u;
-          }
-        }
-      }
-    } else if (isRgb565) {
-      for (UINT y = 0; y < h; y++) {
-        const uint16_t* row = (const uint16_t*)(sBase + (ptrdiff_t)(rc.top + (LONG)y) * sPitch) + rc.left;
-        uint32_t* out = &staging_[y * w];
-        for (UINT x = 0; x < w; x++) {
-          const uint16_t p16 = row[x];
-          const uint32_t r5 = (uint32_t)((p16 >> 11) & 0x1F);
-          const uint32_t g6 = (uint32_t)((p16 >> 5) & 0x3F);
-          const uint32_t b5 = (uint32_t)(p16 & 0x1F);
-          const uint32_t r8 = (r5 << 3) | (r5 >> 2);
-          const uint32_t g8 = (g6 << 2) | (g6 >> 4);
-          const uint32_t b8 = (b5 << 3) | (b5 >> 2);
-          out[x] = 0xFF000000u | (r8 << 16) | (g8 << 8) | b8;
-        }
-      }
-    } else {
-      for (UINT y = 0; y < h; y++) {
-        for (UINT x = 0; x < w; x++) {
-          const int sx = (int)rc.left + (int)x;
-          const int sy = (int)rc.top + (int)y;
-          const uint32_t p = ReadPixel(sBase, sPitch, sx, sy, bpp);
-          uint8_t r, g, b, a;
-          UnpackRGBA(srcFmt, p, &r, &g, &b, &a);
-          staging_[y * w + x] = ((uint32_t)a << 24) | ((uint32_t)r << 16) | ((uint32_t)g << 8) | (uint32_t)b;
-        }
-      }
-    }
-
-    srcSurf->Unlock(nullptr);
-
     D3DLOCKED_RECT lr{};
-    hr = srcTex_->LockRect(0, &lr, nullptr, D3DLOCK_DISCARD);
+    HRESULT hr = srcTex_->LockRect(0, &lr, nullptr, D3DLOCK_DISCARD);
     if (FAILED(hr) || !lr.pBits || lr.Pitch <= 0) {
       if (SUCCEEDED(hr)) {
         srcTex_->UnlockRect(0);
@@ -834,6 +691,7 @@ class DDrawD3D9Scaler {
   IDirect3DPixelShader9* psCubicH_ = nullptr;
   IDirect3DPixelShader9* psCubicV_ = nullptr;
 
+  PixelConverter converter_;
   std::vector<uint32_t> staging_;
 };
 
@@ -34,16 +34,6 @@ static std::wstring ToLowerCopy(const std::wstring& s) {
   return out;
 }
 
-static bool IsTwinShimDebugEnabled() {
-  wchar_t dummy[2] = {};
-  DWORD n = GetEnvironmentVariableW(L"TWINSHIM_DEBUG_PIPE", dummy, (DWORD)(sizeof(dummy) / sizeof(dummy[0])));
-  if (n) {
-    return true;
-  }
-  n = GetEnvironmentVariableW(L"HKLM_WRAPPER_DEBUG_PIPE", dummy, (DWORD)(sizeof(dummy) / sizeof(dummy[0])));
-  return n != 0;
-}
-
 static bool IsLikelyWrapperDDrawDll() {
   const int cached = g_ddrawModuleKind.load(std::memory_order_acquire);
   if (cached == 1) {
@@ -118,36 +108,8 @@ static void* GetVtableEntry(void* obj, size_t index) {
   return vtbl[index];
 }
 
-static void TraceWrite(const char* text) {
-  if (!IsTwinShimDebugEnabled()) {
-    return;
-  }
-  if (!text || !*text) {
-    return;
-  }
-  OutputDebugStringA(text);
-
-  wchar_t pipeBuf[512] = {};
-  DWORD pipeLen = GetEnvironmentVariableW(L"TWINSHIM_DEBUG_PIPE", pipeBuf, (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0])));
-  if (!pipeLen || pipeLen >= (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0]))) {
-    pipeLen = GetEnvironmentVariableW(L"HKLM_WRAPPER_DEBUG_PIPE", pipeBuf, (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0])));
-  }
-  if (!pipeLen || pipeLen >= (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0]))) {
-    return;
-  }
-  pipeBuf[pipeLen] = L'\0';
-
-  HANDLE h = CreateFileW(pipeBuf, GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
-  if (h == INVALID_HANDLE_VALUE) {
-    return;
-  }
-  DWORD written = 0;
-  WriteFile(h, text, (DWORD)lstrlenA(text), &written, nullptr);
-  CloseHandle(h);
-}
-
 static void Tracef(const char* fmt, ...) {
-  if (!IsTwinShimDebugEnabled()) {
+  if (!IsShimTraceEnabled()) {
     return;
   }
   if (!fmt || !*fmt) {
@@ -177,7 +139,7 @@ static void Tracef(const char* fmt, ...) {
       buf[len + 1] = '\0';
     }
   }
-  TraceWrite(buf);
+  ShimTraceWrite(buf);
 }
 
 static bool IsScalingEnabled() {
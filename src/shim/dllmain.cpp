@@ -3,10 +3,18 @@
 #include "shim/d3d9_surface_scaler.h"
 #include "shim/ddraw_surface_scaler.h"
 #include "shim/mouse_scale_hooks.h"
+#include "shim/shim_trace.h"
 #include "shim/surface_scale_config.h"
 
+#include "common/launch_timeline.h"
+#include "common/trace_record.h"
+#include "common/trace_transport.h"
+
 #include <windows.h>
 
+#include <cstdio>
+#include <cwchar>
+
 namespace {
 
 static DWORD GetEnvVarCompat(const wchar_t* primary, const wchar_t* legacy, wchar_t* buf, DWORD bufCount) {
@@ -49,38 +57,50 @@ void SignalHookReadyEvent() {
 }
 
 void ShimTrace(const char* text) {
-  if (!text || !*text) {
-    return;
-  }
+  twinshim::ShimTraceWrite(text);
+}
 
-  wchar_t pipeBuf[512]{};
-  DWORD pipeLen = GetEnvVarCompat(
-      L"TWINSHIM_DEBUG_PIPE",
-      L"HKLM_WRAPPER_DEBUG_PIPE",
-      pipeBuf,
-      (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0])));
-  if (!pipeLen || pipeLen >= (sizeof(pipeBuf) / sizeof(pipeBuf[0]))) {
-    return;
-  }
-  pipeBuf[pipeLen] = L'\0';
+// TWINSHIM_READY_AFTER=warm holds the hook-ready signal (and so the target's
+// main thread) until the store is open and warm; otherwise the store warms in
+// the background after the signal.
+bool ShouldSignalReadyAfterWarmUp() {
+  wchar_t buf[16]{};
+  DWORD n = GetEnvVarCompat(L"TWINSHIM_READY_AFTER", nullptr, buf, (DWORD)(sizeof(buf) / sizeof(buf[0])));
+  return n && _wcsicmp(buf, L"warm") == 0;
+}
 
-  HANDLE h = CreateFileW(pipeBuf, GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
-  if (h == INVALID_HANDLE_VALUE) {
-    return;
-  }
+double MillisecondsSince(const LARGE_INTEGER& start) {
+  LARGE_INTEGER now{};
+  LARGE_INTEGER freq{};
+  QueryPerformanceCounter(&now);
+  QueryPerformanceFrequency(&freq);
+  return freq.QuadPart ? (double)(now.QuadPart - start.QuadPart) * 1000.0 / (double)freq.QuadPart : 0.0;
+}
 
-  DWORD written = 0;
-  WriteFile(h, text, (DWORD)lstrlenA(text), &written, nullptr);
-  CloseHandle(h);
+void TracePhase(const char* phase, const LARGE_INTEGER& start) {
+  char line[128];
+  std::snprintf(line, sizeof(line), "[shim] %s: %.2f ms\n", phase, MillisecondsSince(start));
+  ShimTrace(line);
 }
 
 volatile LONG g_hooksInstalled = 0;
+uint64_t g_attachTicks = 0;
 HANDLE g_hookInitThread = nullptr;
+// Set on unload so the init thread stops waiting out the profile window.
+HANDLE g_hookInitStop = nullptr;
 
 DWORD WINAPI HookInitThreadProc(LPVOID) {
+  twinshim::LaunchTimeline& timeline = twinshim::ShimLaunchTimeline();
+  timeline.Record("shim: DllMain to init thread", g_attachTicks, twinshim::TraceTicks());
   ShimTrace("[shim] hook init thread started\n");
 
+  const uint32_t readySpan = timeline.Begin("shim: until ready signal");
+  LARGE_INTEGER phaseStart{};
+  QueryPerformanceCounter(&phaseStart);
+  uint32_t span = timeline.Begin("shim: registry hooks");
   const bool installed = twinshim::InstallRegistryHooks();
+  timeline.End(span);
+  TracePhase("registry hooks", phaseStart);
 
   // Only attempt graphics hook installation when a valid --scale was provided.
   // (Avoids any graphics-module probing/threads when scaling isn't requested.)
@@ -88,6 +108,9 @@ DWORD WINAPI HookInitThreadProc(LPVOID) {
     const twinshim::SurfaceScaleConfig& cfg = twinshim::GetSurfaceScaleConfig();
     const bool scalingEnabled = cfg.enabled && cfg.scaleValid && (cfg.factor >= 1.1 && cfg.factor <= 100.0);
     if (scalingEnabled) {
+      QueryPerformanceCounter(&phaseStart);
+      span = timeline.Begin("shim: scaling hooks");
+
       // Install mouse coordinate mapping so cursor movement stays consistent with scaled presentation.
       (void)twinshim::InstallMouseScaleHooks();
 
@@ -96,22 +119,79 @@ DWORD WINAPI HookInitThreadProc(LPVOID) {
 
       // Install optional DirectDraw scaling hooks (system ddraw.dll paths only).
       (void)twinshim::InstallDDrawSurfaceScalerHooks();
+
+      timeline.End(span);
+      TracePhase("scaling hooks", phaseStart);
     }
   }
 
+  // Warming only pays off when registry calls will reach the store.
+  const bool active = installed && twinshim::AreRegistryHooksActive();
+  const bool warmFirst = active && ShouldSignalReadyAfterWarmUp();
   if (!installed) {
     InterlockedExchange(&g_hooksInstalled, -1);
     ShimTrace("[shim] hook install failed\n");
-    SignalHookReadyEvent();
-  } else if (twinshim::AreRegistryHooksActive()) {
+  } else if (active) {
     InterlockedExchange(&g_hooksInstalled, 1);
     ShimTrace("[shim] hook install succeeded\n");
-    SignalHookReadyEvent();
   } else {
     InterlockedExchange(&g_hooksInstalled, 0);
     ShimTrace("[shim] hooks disabled by mode\n");
+  }
+  if (!warmFirst) {
+    timeline.End(readySpan);
     SignalHookReadyEvent();
   }
+
+  if (active) {
+    QueryPerformanceCounter(&phaseStart);
+    span = timeline.Begin("shim: store open");
+    twinshim::OpenRegistryStore();
+    timeline.End(span);
+    TracePhase("store open", phaseStart);
+
+    QueryPerformanceCounter(&phaseStart);
+    span = timeline.Begin("shim: store warm-up");
+    const uint64_t warmBytes = twinshim::WarmRegistryStore();
+    timeline.End(span);
+    char line[128];
+    std::snprintf(line, sizeof(line), "[shim] store warm-up: %.2f ms, %llu bytes\n", MillisecondsSince(phaseStart),
+                  (unsigned long long)warmBytes);
+    ShimTrace(line);
+
+    QueryPerformanceCounter(&phaseStart);
+    span = timeline.Begin("shim: profile prefetch");
+    const size_t prefetched = twinshim::StartRegistryProfile();
+    timeline.End(span);
+    std::snprintf(line, sizeof(line), "[shim] profile prefetch: %.2f ms, %zu entries\n", MillisecondsSince(phaseStart),
+                  prefetched);
+    ShimTrace(line);
+  }
+
+  if (warmFirst) {
+    ShimTrace("[shim] signalling ready after warm-up\n");
+    timeline.End(readySpan);
+    SignalHookReadyEvent();
+  }
+
+  // Save the profile once its window is over. An unload cuts the wait short
+  // and skips the save: a partial profile would replace a complete one.
+  const DWORD windowMs = active ? twinshim::GetRegistryProfileWindowMs() : 0;
+  if (windowMs && g_hookInitStop && WaitForSingleObject(g_hookInitStop, windowMs) == WAIT_TIMEOUT) {
+    const twinshim::RegistryProfileReport report = twinshim::SaveRegistryProfile();
+    const uint64_t lookups = report.hits + report.misses;
+    char line[192];
+    std::snprintf(line,
+                  sizeof(line),
+                  "[shim] access profile: %zu entries %s; prefetched %llu, %llu/%llu lookups hit (%.1f%%)\n",
+                  report.recorded,
+                  report.saved ? "saved" : "not saved",
+                  (unsigned long long)report.prefetched,
+                  (unsigned long long)report.hits,
+                  (unsigned long long)lookups,
+                  lookups ? 100.0 * (double)report.hits / (double)lookups : 0.0);
+    ShimTrace(line);
+  }
   return 0;
 }
 
@@ -121,6 +201,8 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved) {
   (void)hinstDLL;
   if (fdwReason == DLL_PROCESS_ATTACH) {
     DisableThreadLibraryCalls(hinstDLL);
+    g_attachTicks = twinshim::TraceTicks();
+    g_hookInitStop = CreateEventW(nullptr, TRUE, FALSE, nullptr);
     g_hookInitThread = CreateThread(nullptr, 0, &HookInitThreadProc, nullptr, 0, nullptr);
     if (!g_hookInitThread) {
       InterlockedExchange(&g_hooksInstalled, -1);
@@ -140,16 +222,31 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved) {
     // Best-effort cleanup for mouse coordinate mapping hooks.
     twinshim::RemoveMouseScaleHooks();
 
+    if (g_hookInitStop) {
+      SetEvent(g_hookInitStop);
+    }
     HANDLE initThread = g_hookInitThread;
     g_hookInitThread = nullptr;
     if (initThread) {
       WaitForSingleObject(initThread, 2000);
       CloseHandle(initThread);
     }
+    if (g_hookInitStop) {
+      CloseHandle(g_hookInitStop);
+      g_hookInitStop = nullptr;
+    }
 
     if (InterlockedCompareExchange(&g_hooksInstalled, 0, 0) == 1 && twinshim::AreRegistryHooksActive()) {
       twinshim::RemoveRegistryHooks();
     }
+    twinshim::TraceTransportCounters trace{};
+    if (twinshim::GetShimTraceCounters(trace) && trace.droppedRecords) {
+      char line[128];
+      std::snprintf(line, sizeof(line), "[shim] trace: %llu lines dropped (writers outran the debug pipe)\n",
+                    (unsigned long long)trace.droppedRecords);
+      ShimTrace(line);
+    }
+    twinshim::FlushShimTrace();
   }
   return TRUE;
 }
@@ -6,12 +6,20 @@
 
 #include "common/local_registry_store.h"
 #include "common/path_util.h"
+#include "common/real_key_pool.h"
+#include "common/real_registry_backend.h"
+#include "common/registry_api_table.h"
+#include "common/registry_change_notifier.h"
+#include "common/registry_overlay_engine.h"
+#include "common/registry_workload.h"
 
 #include <MinHook.h>
 
 #include <cstring>
 #include <cstdio>
 #include <atomic>
+#include <chrono>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -20,6 +28,7 @@
 #include <algorithm>
 #include <cwctype>
 #include <unordered_map>
+#include <utility>
 
 namespace twinshim {
 
@@ -31,12 +40,21 @@ struct VirtualKey {
   uint32_t magic = kKeyMagic;
   HKEY real = nullptr;
   std::wstring keyPath; // Canonical: HKLM\\... (no trailing slash)
+  std::shared_ptr<ResolvedKey> state; // engine-owned cache, see RegistryOverlayEngine
+  uint32_t viewFlags = 0; // KEY_WOW64_32KEY/64KEY the key was opened with
+  std::mutex realMutex;   // guards `real`, which pooled keys open lazily
+};
+
+// Real HKLM handles opened through the hooks (read-through mode).
+struct RealKey {
+  std::wstring keyPath;
+  std::shared_ptr<ResolvedKey> state;
 };
 
 std::mutex g_virtualKeysMutex;
 std::unordered_set<VirtualKey*> g_virtualKeys;
 std::mutex g_realKeysMutex;
-std::unordered_map<HKEY, std::wstring> g_realKeys;
+std::unordered_map<HKEY, RealKey> g_realKeys;
 
 thread_local bool g_bypass = false;
 std::atomic<bool> g_minHookInitialized{false};
@@ -116,6 +134,41 @@ bool ShouldReadThrough() {
   return enabled;
 }
 
+// How long the access profile records after hooks go live;
+// TWINSHIM_PROFILE_SECONDS=0 turns profiling and prefetch off.
+DWORD ProfileWindowMs() {
+  static const DWORD ms = [] {
+    constexpr DWORD kDefaultSeconds = 30;
+    wchar_t buf[16]{};
+    DWORD n = GetEnvironmentVariableCompat(L"TWINSHIM_PROFILE_SECONDS", nullptr, buf, (DWORD)(sizeof(buf) / sizeof(buf[0])));
+    if (!n) {
+      return kDefaultSeconds * 1000;
+    }
+    const unsigned long seconds = std::wcstoul(buf, nullptr, 10);
+    return (DWORD)std::min<unsigned long>(seconds, 3600) * 1000;
+  }();
+  return ms;
+}
+
+// TWINSHIM_REAL_KEY_POOL=1 makes read-through opens of keys with a local
+// overlay share pooled real handles behind virtual keys (see RealKeyPool).
+// Off by default: a virtual handle passed to a registry API the shim doesn't
+// hook fails there, and keys without local entries always get real handles.
+bool ShouldPoolRealKeys() {
+  static const bool enabled = [] {
+    wchar_t modeBuf[64]{};
+    DWORD modeLen =
+        GetEnvironmentVariableCompat(L"TWINSHIM_REAL_KEY_POOL", nullptr, modeBuf, (DWORD)(sizeof(modeBuf) / sizeof(modeBuf[0])));
+    if (!modeLen || modeLen >= (sizeof(modeBuf) / sizeof(modeBuf[0]))) {
+      return false;
+    }
+    std::wstring mode(modeBuf, modeBuf + modeLen);
+    std::transform(mode.begin(), mode.end(), mode.begin(), [](wchar_t ch) { return (wchar_t)std::towlower(ch); });
+    return mode == L"1" || mode == L"true" || mode == L"yes" || mode == L"on";
+  }();
+  return enabled;
+}
+
 struct BypassGuard {
   bool prev = false;
   BypassGuard() {
@@ -139,124 +192,62 @@ bool IsHKLMRoot(HKEY h) {
   return h == HKEY_LOCAL_MACHINE;
 }
 
-LocalRegistryStore g_store;
-std::once_flag g_openOnce;
-std::mutex g_storeMutex;
-
-void EnsureStoreOpen() {
-  std::call_once(g_openOnce, [] {
-    wchar_t dbPath[4096];
-    DWORD n =
-        GetEnvironmentVariableCompat(L"TWINSHIM_DB_PATH", L"HKLM_WRAPPER_DB_PATH", dbPath, (DWORD)(sizeof(dbPath) / sizeof(dbPath[0])));
-    if (!n || n >= (sizeof(dbPath) / sizeof(dbPath[0]))) {
-      // Fallback: HKLM.sqlite in the current working directory.
-      wchar_t cwdBuf[4096]{};
-      DWORD cwdLen = GetCurrentDirectoryW((DWORD)(sizeof(cwdBuf) / sizeof(cwdBuf[0])), cwdBuf);
-      const std::wstring cwd = (cwdLen && cwdLen < (sizeof(cwdBuf) / sizeof(cwdBuf[0])))
-                                  ? std::wstring(cwdBuf, cwdBuf + cwdLen)
-                                  : std::wstring();
-      g_store.Open(CombinePath(cwd, L"HKLM.sqlite"));
-      return;
-    }
-    g_store.Open(std::wstring(dbPath, dbPath + n));
-  });
-}
-
-// Original function pointers.
-decltype(&RegOpenKeyExW) fpRegOpenKeyExW = nullptr;
-decltype(&RegCreateKeyExW) fpRegCreateKeyExW = nullptr;
-decltype(&RegCloseKey) fpRegCloseKey = nullptr;
-decltype(&RegGetValueW) fpRegGetValueW = nullptr;
-decltype(&RegSetValueExW) fpRegSetValueExW = nullptr;
-decltype(&RegQueryValueExW) fpRegQueryValueExW = nullptr;
-decltype(&RegDeleteValueW) fpRegDeleteValueW = nullptr;
-decltype(&RegDeleteKeyW) fpRegDeleteKeyW = nullptr;
-decltype(&RegDeleteKeyExW) fpRegDeleteKeyExW = nullptr;
-
-decltype(&RegOpenKeyW) fpRegOpenKeyW = nullptr;
-decltype(&RegOpenKeyA) fpRegOpenKeyA = nullptr;
-decltype(&RegCreateKeyW) fpRegCreateKeyW = nullptr;
-decltype(&RegCreateKeyA) fpRegCreateKeyA = nullptr;
-decltype(&RegQueryValueW) fpRegQueryValueW = nullptr;
-decltype(&RegQueryValueA) fpRegQueryValueA = nullptr;
-decltype(&RegSetValueW) fpRegSetValueW = nullptr;
-decltype(&RegSetValueA) fpRegSetValueA = nullptr;
-
-decltype(&RegEnumValueW) fpRegEnumValueW = nullptr;
-decltype(&RegEnumValueA) fpRegEnumValueA = nullptr;
-decltype(&RegEnumKeyExW) fpRegEnumKeyExW = nullptr;
-decltype(&RegEnumKeyExA) fpRegEnumKeyExA = nullptr;
-decltype(&RegEnumKeyW) fpRegEnumKeyW = nullptr;
-decltype(&RegEnumKeyA) fpRegEnumKeyA = nullptr;
-decltype(&RegQueryInfoKeyW) fpRegQueryInfoKeyW = nullptr;
-decltype(&RegQueryInfoKeyA) fpRegQueryInfoKeyA = nullptr;
-
-decltype(&RegSetKeyValueW) fpRegSetKeyValueW = nullptr;
-decltype(&RegSetKeyValueA) fpRegSetKeyValueA = nullptr;
-
-decltype(&RegOpenKeyExA) fpRegOpenKeyExA = nullptr;
-decltype(&RegCreateKeyExA) fpRegCreateKeyExA = nullptr;
-decltype(&RegSetValueExA) fpRegSetValueExA = nullptr;
-decltype(&RegQueryValueExA) fpRegQueryValueExA = nullptr;
-decltype(&RegDeleteValueA) fpRegDeleteValueA = nullptr;
-decltype(&RegDeleteKeyA) fpRegDeleteKeyA = nullptr;
-decltype(&RegGetValueA) fpRegGetValueA = nullptr;
-
-LONG WINAPI Hook_RegOpenKeyExA(HKEY hKey, LPCSTR lpSubKey, DWORD ulOptions, REGSAM samDesired, PHKEY phkResult);
-LONG WINAPI Hook_RegCreateKeyExA(HKEY hKey,
-                                 LPCSTR lpSubKey,
-                                 DWORD Reserved,
-                                 LPSTR lpClass,
-                                 DWORD dwOptions,
-                                 REGSAM samDesired,
-                                 const LPSECURITY_ATTRIBUTES lpSecurityAttributes,
-                                 PHKEY phkResult,
-                                 LPDWORD lpdwDisposition);
-
-LSTATUS WINAPI Hook_RegGetValueW(HKEY hKey,
-                                 LPCWSTR lpSubKey,
-                                 LPCWSTR lpValue,
-                                 DWORD dwFlags,
-                                 LPDWORD pdwType,
-                                 PVOID pvData,
-                                 LPDWORD pcbData);
-
-LSTATUS WINAPI Hook_RegGetValueA(HKEY hKey,
-                                 LPCSTR lpSubKey,
-                                 LPCSTR lpValue,
-                                 DWORD dwFlags,
-                                 LPDWORD pdwType,
-                                 PVOID pvData,
-                                 LPDWORD pcbData);
+// Original function pointers, one per entry in the registry API table.
+#define TWINSHIM_DECLARE_ORIGINAL(name, group) decltype(&name) fp##name = nullptr;
+TWINSHIM_REGISTRY_API_TABLE(TWINSHIM_DECLARE_ORIGINAL)
+#undef TWINSHIM_DECLARE_ORIGINAL
+
+// Path of an HKLM handle plus the key state cached on it (null for the HKLM
+// root itself); an empty path means the handle is not ours to virtualize.
+struct HandleKey {
+  std::wstring path;
+  std::shared_ptr<ResolvedKey> state;
+  uint32_t viewFlags = 0; // virtual keys only; a real handle carries its own view
+};
 
-std::wstring KeyPathFromHandle(HKEY hKey) {
+HandleKey KeyFromHandle(HKEY hKey) {
   if (auto* vk = AsVirtual(hKey)) {
-    return vk->keyPath;
+    return {vk->keyPath, vk->state, vk->viewFlags};
   }
   {
     std::lock_guard<std::mutex> lock(g_realKeysMutex);
     auto it = g_realKeys.find(hKey);
     if (it != g_realKeys.end()) {
-      return it->second;
+      return {it->second.keyPath, it->second.state};
     }
   }
   if (IsHKLMRoot(hKey)) {
-    return L"HKLM";
+    return {L"HKLM", nullptr};
   }
-  return L"";
+  return {};
+}
+
+std::wstring KeyPathFromHandle(HKEY hKey) {
+  return KeyFromHandle(hKey).path;
 }
 
 HKEY RealHandleForFallback(HKEY hKey) {
   if (auto* vk = AsVirtual(hKey)) {
+    std::lock_guard<std::mutex> lock(vk->realMutex);
     return vk->real;
   }
   return hKey;
 }
 
-VirtualKey* NewVirtualKey(const std::wstring& keyPath, HKEY real) {
+// The access bits that pick a registry view.
+uint32_t ViewFlagsOf(REGSAM samDesired) {
+  return (uint32_t)(samDesired & (KEY_WOW64_32KEY | KEY_WOW64_64KEY));
+}
+
+VirtualKey* NewVirtualKey(const std::wstring& keyPath,
+                          HKEY real,
+                          std::shared_ptr<ResolvedKey> state = nullptr,
+                          uint32_t viewFlags = 0) {
   auto* vk = new VirtualKey();
   vk->keyPath = keyPath;
   vk->real = real;
+  vk->viewFlags = viewFlags;
+  vk->state = state ? std::move(state) : std::make_shared<ResolvedKey>();
   {
     std::lock_guard<std::mutex> lock(g_virtualKeysMutex);
     g_virtualKeys.insert(vk);
@@ -264,12 +255,12 @@ VirtualKey* NewVirtualKey(const std::wstring& keyPath, HKEY real) {
   return vk;
 }
 
-void RegisterRealKey(HKEY key, const std::wstring& path) {
+void RegisterRealKey(HKEY key, const std::wstring& path, std::shared_ptr<ResolvedKey> state = nullptr) {
   if (!key || key == HKEY_LOCAL_MACHINE) {
     return;
   }
   std::lock_guard<std::mutex> lock(g_realKeysMutex);
-  g_realKeys[key] = path;
+  g_realKeys[key] = RealKey{path, state ? std::move(state) : std::make_shared<ResolvedKey>()};
 }
 
 void UnregisterRealKey(HKEY key) {
@@ -280,187 +271,263 @@ void UnregisterRealKey(HKEY key) {
   g_realKeys.erase(key);
 }
 
-struct MergedNames {
-  std::vector<std::wstring> names;          // original spelling
-  std::unordered_set<std::wstring> folded;  // case-fold set
-  std::unordered_set<std::wstring> deleted; // case-fold set
-};
-
-MergedNames GetMergedValueNames(const std::wstring& keyPath, HKEY real) {
-  MergedNames merged;
-  std::unordered_map<std::wstring, std::wstring> foldedToName;
-
-  EnsureStoreOpen();
-  bool keyDeleted = false;
-  {
-    std::lock_guard<std::mutex> lock(g_storeMutex);
-    keyDeleted = g_store.IsKeyDeleted(keyPath);
-    if (keyDeleted) {
-      return merged;
+// Real-registry side of the overlay engine. Every call runs under
+// BypassGuard so it reaches the original advapi32 entry points.
+class Win32RealRegistryBackend final : public RealRegistryBackend {
+public:
+  RealKeyHandle OpenKey(const std::wstring& keyPath, uint32_t viewFlags) override {
+    if (keyPath == L"HKLM") {
+      return HKEY_LOCAL_MACHINE;
     }
-    for (const auto& r : g_store.ListValues(keyPath)) {
-      auto f = CaseFold(r.valueName);
-      if (r.isDeleted) {
-        merged.deleted.insert(f);
-        merged.folded.insert(f);
-        foldedToName.emplace(f, r.valueName);
-      } else {
-        merged.folded.insert(f);
-        foldedToName[f] = r.valueName;
-      }
+    if (keyPath.rfind(L"HKLM\\", 0) != 0 || keyPath.size() <= 5) {
+      return nullptr;
+    }
+    HKEY opened = nullptr;
+    BypassGuard guard;
+    const REGSAM sam = KEY_READ | (viewFlags & (KEY_WOW64_32KEY | KEY_WOW64_64KEY));
+    if (fpRegOpenKeyExW(HKEY_LOCAL_MACHINE, keyPath.c_str() + 5, 0, sam, &opened) != ERROR_SUCCESS) {
+      return nullptr;
     }
+    return opened;
   }
 
-  // Include local non-deleted first.
-  {
-    std::lock_guard<std::mutex> lock(g_storeMutex);
-    for (const auto& r : g_store.ListValues(keyPath)) {
-      if (r.isDeleted) {
-        continue;
-      }
-      merged.names.push_back(r.valueName);
+  void CloseKey(RealKeyHandle key) override {
+    HKEY h = static_cast<HKEY>(key);
+    if (!h || h == HKEY_LOCAL_MACHINE) {
+      return;
     }
+    BypassGuard guard;
+    fpRegCloseKey(h);
   }
 
-  // Merge real values.
-  if (ShouldReadThrough() && real && fpRegEnumValueW) {
+  std::vector<std::wstring> EnumValueNames(RealKeyHandle key) override {
+    std::vector<std::wstring> out;
+    if (!key || !fpRegEnumValueW) {
+      return out;
+    }
+    std::vector<wchar_t> buf(256);
     DWORD index = 0;
-    while (true) {
-      std::wstring name;
-      DWORD type = 0;
-      LONG lastRc = ERROR_SUCCESS;
-
-      std::vector<wchar_t> buf(256);
-      while (true) {
-        DWORD nameLen = (DWORD)buf.size();
-        {
-          BypassGuard guard;
-          lastRc = fpRegEnumValueW(real, index, buf.data(), &nameLen, nullptr, &type, nullptr, nullptr);
-        }
-        if (lastRc == ERROR_MORE_DATA) {
-          buf.resize((size_t)nameLen + 1);
-          continue;
-        }
-        if (lastRc == ERROR_NO_MORE_ITEMS) {
-          break;
-        }
-        if (lastRc != ERROR_SUCCESS) {
-          break;
-        }
-        name.assign(buf.data(), buf.data() + nameLen);
-        break;
+    while (index <= 100000) {
+      DWORD nameLen = (DWORD)buf.size();
+      LONG rc;
+      {
+        BypassGuard guard;
+        rc = fpRegEnumValueW(static_cast<HKEY>(key), index, buf.data(), &nameLen, nullptr, nullptr, nullptr, nullptr);
       }
-
-      if (lastRc == ERROR_NO_MORE_ITEMS) {
-        break;
+      if (rc == ERROR_MORE_DATA && buf.size() < 32768) {
+        buf.resize(std::max<size_t>(buf.size() * 2, (size_t)nameLen + 1));
+        continue;
       }
-      if (lastRc != ERROR_SUCCESS) {
+      if (rc != ERROR_SUCCESS) {
         break;
       }
-
-      auto f = CaseFold(name);
-      if (merged.deleted.find(f) == merged.deleted.end() && merged.folded.find(f) == merged.folded.end()) {
-        merged.folded.insert(f);
-        merged.names.push_back(name);
-      }
+      out.emplace_back(buf.data(), buf.data() + nameLen);
       index++;
-      if (index > 100000) {
-        break;
-      }
     }
+    return out;
   }
 
-  std::sort(merged.names.begin(), merged.names.end(), [](const std::wstring& a, const std::wstring& b) {
-    return _wcsicmp(a.c_str(), b.c_str()) < 0;
-  });
-  return merged;
-}
-
-std::vector<std::wstring> GetMergedSubKeyNames(const std::wstring& keyPath, HKEY real) {
-  std::unordered_set<std::wstring> deleted;
-  std::unordered_set<std::wstring> folded;
-  std::vector<std::wstring> out;
-
-  EnsureStoreOpen();
-  bool keyDeleted = false;
-  {
-    std::lock_guard<std::mutex> lock(g_storeMutex);
-    keyDeleted = g_store.IsKeyDeleted(keyPath);
-    if (keyDeleted) {
+  std::vector<std::wstring> EnumSubKeyNames(RealKeyHandle key) override {
+    std::vector<std::wstring> out;
+    if (!key || !fpRegEnumKeyExW) {
       return out;
     }
-    // Deleted children: any immediate child whose full path is deleted.
-    for (const auto& child : g_store.ListImmediateSubKeys(keyPath)) {
-      std::wstring full = keyPath;
-      full.append(L"\\");
-      full.append(child);
-      if (g_store.IsKeyDeleted(full)) {
-        deleted.insert(CaseFold(child));
+    std::vector<wchar_t> buf(256);
+    DWORD index = 0;
+    while (index <= 100000) {
+      DWORD nameLen = (DWORD)buf.size();
+      LONG rc;
+      {
+        BypassGuard guard;
+        rc = fpRegEnumKeyExW(static_cast<HKEY>(key), index, buf.data(), &nameLen, nullptr, nullptr, nullptr, nullptr);
       }
-    }
-    for (const auto& child : g_store.ListImmediateSubKeys(keyPath)) {
-      std::wstring full = keyPath;
-      full.append(L"\\");
-      full.append(child);
-      if (g_store.IsKeyDeleted(full)) {
+      if (rc == ERROR_MORE_DATA && buf.size() < 32768) {
+        buf.resize(std::max<size_t>(buf.size() * 2, (size_t)nameLen + 1));
         continue;
       }
-      auto f = CaseFold(child);
-      folded.insert(f);
-      out.push_back(child);
+      if (rc != ERROR_SUCCESS) {
+        break;
+      }
+      out.emplace_back(buf.data(), buf.data() + nameLen);
+      index++;
     }
+    return out;
   }
 
-  if (ShouldReadThrough() && real && fpRegEnumKeyExW) {
-    DWORD index = 0;
-    while (true) {
-      std::wstring name;
-      std::vector<wchar_t> buf(256);
-      while (true) {
-        DWORD nameLen = (DWORD)buf.size();
-        LONG rc;
-        {
-          BypassGuard guard;
-          rc = fpRegEnumKeyExW(real, index, buf.data(), &nameLen, nullptr, nullptr, nullptr, nullptr);
-        }
-        if (rc == ERROR_MORE_DATA) {
-          buf.resize((size_t)nameLen + 1);
-          continue;
-        }
-        if (rc == ERROR_NO_MORE_ITEMS) {
-          name.clear();
-          break;
+  long QueryValue(RealKeyHandle key, const std::wstring& valueName, uint32_t* type, std::vector<uint8_t>* data) override {
+    if (!key || !fpRegQueryValueExW) {
+      return ERROR_FILE_NOT_FOUND;
+    }
+    BypassGuard guard;
+    DWORD t = 0;
+    DWORD cb = 0;
+    LONG rc = fpRegQueryValueExW(static_cast<HKEY>(key), valueName.c_str(), nullptr, &t, nullptr, &cb);
+    // Values can grow between the size probe and the read; retry a few times.
+    for (int attempt = 0; rc == ERROR_SUCCESS && attempt < 4; attempt++) {
+      std::vector<uint8_t> buf(cb);
+      DWORD got = cb;
+      rc = fpRegQueryValueExW(static_cast<HKEY>(key), valueName.c_str(), nullptr, &t, buf.empty() ? nullptr : buf.data(), &got);
+      if (rc == ERROR_MORE_DATA) {
+        cb = got;
+        rc = ERROR_SUCCESS;
+        continue;
+      }
+      if (rc == ERROR_SUCCESS) {
+        buf.resize(got);
+        if (type) {
+          *type = (uint32_t)t;
         }
-        if (rc != ERROR_SUCCESS) {
-          name.clear();
-          break;
+        if (data) {
+          *data = std::move(buf);
         }
-        name.assign(buf.data(), buf.data() + nameLen);
-        break;
       }
+      return rc;
+    }
+    return rc == ERROR_SUCCESS ? ERROR_MORE_DATA : rc;
+  }
+};
 
-      if (name.empty()) {
-        break;
-      }
+LocalRegistryStore g_store;
+Win32RealRegistryBackend g_realBackend;
+RealKeyPool g_realKeyPool(g_realBackend);
+RegistryOverlayEngine g_engine(g_store, &g_realKeyPool);
+RegistryChangeNotifier g_notifier;
+std::once_flag g_openOnce;
 
-      auto f = CaseFold(name);
-      if (deleted.find(f) == deleted.end() && folded.find(f) == folded.end()) {
-        folded.insert(f);
-        out.push_back(name);
-      }
-      index++;
-      if (index > 100000) {
-        break;
-      }
+// The real key behind a virtual key, opened through the pool on first use in
+// the view the key was opened with; null when the real registry lacks it.
+// Threads sharing the handle open it once between them.
+HKEY PooledRealKeyFor(VirtualKey* vk) {
+  std::lock_guard<std::mutex> lock(vk->realMutex);
+  if (!vk->real && vk->keyPath.rfind(L"HKLM\\", 0) == 0 && vk->keyPath.size() > 5) {
+    vk->real = static_cast<HKEY>(g_realKeyPool.OpenKey(vk->keyPath, vk->viewFlags));
+  }
+  return vk->real;
+}
+
+// Read lock-wait budget when TWINSHIM_STORE_BUDGET_MS is unset: well under a
+// frame, so hklmreg holding the write lock can't stall a render thread. Writes
+// wait in full unless a write budget is given, since a queued write only
+// reaches the store once something flushes it.
+constexpr std::chrono::milliseconds kDefaultStoreReadBudget(20);
+
+// With a write budget, writes that ran out of it are committed by this thread
+// within about kPendingFlushMs, not left until the next write. Process exit
+// skips RemoveRegistryHooks, so waiting for that would lose them.
+constexpr DWORD kPendingFlushMs = 100;
+std::chrono::milliseconds g_pendingFlushBudget(0);
+HANDLE g_pendingFlushStop = nullptr;
+HANDLE g_pendingFlushThread = nullptr;
+
+DWORD WINAPI PendingFlushThreadProc(LPVOID) {
+  while (WaitForSingleObject(g_pendingFlushStop, kPendingFlushMs) == WAIT_TIMEOUT) {
+    if (g_engine.PendingWriteCount()) {
+      g_engine.FlushPendingWrites(g_pendingFlushBudget);
+    }
+  }
+  return 0;
+}
+
+void StartPendingWriteFlusher(std::chrono::milliseconds budget) {
+  g_pendingFlushBudget = budget;
+  g_pendingFlushStop = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+  if (g_pendingFlushStop) {
+    g_pendingFlushThread = CreateThread(nullptr, 0, &PendingFlushThreadProc, nullptr, 0, nullptr);
+  }
+}
+
+void StopPendingWriteFlusher() {
+  if (g_pendingFlushStop) {
+    SetEvent(g_pendingFlushStop);
+  }
+  if (g_pendingFlushThread) {
+    WaitForSingleObject(g_pendingFlushThread, 1000);
+    CloseHandle(g_pendingFlushThread);
+    g_pendingFlushThread = nullptr;
+  }
+}
+
+void ConfigureStoreBudgets() {
+  std::chrono::milliseconds read = kDefaultStoreReadBudget;
+  std::chrono::milliseconds write(0);
+  wchar_t buf[64]{};
+  const DWORD n = GetEnvironmentVariableCompat(L"TWINSHIM_STORE_BUDGET_MS", nullptr, buf, (DWORD)(sizeof(buf) / sizeof(buf[0])));
+  if (n) {
+    ParseStoreBudgets(std::wstring(buf, buf + n), read, write);
+  }
+  g_engine.SetStoreBudgets(read, write);
+  if (write.count() > 0) {
+    StartPendingWriteFlusher(write);
+  }
+}
+
+void EnsureStoreOpen() {
+  std::call_once(g_openOnce, [] {
+    g_engine.SetReadThrough(ShouldReadThrough());
+    g_engine.SetChangeNotifier(&g_notifier);
+    ConfigureStoreBudgets();
+    wchar_t dbPath[4096];
+    DWORD n =
+        GetEnvironmentVariableCompat(L"TWINSHIM_DB_PATH", L"HKLM_WRAPPER_DB_PATH", dbPath, (DWORD)(sizeof(dbPath) / sizeof(dbPath[0])));
+    if (!n || n >= (sizeof(dbPath) / sizeof(dbPath[0]))) {
+      // Fallback: HKLM.sqlite in the current working directory.
+      wchar_t cwdBuf[4096]{};
+      DWORD cwdLen = GetCurrentDirectoryW((DWORD)(sizeof(cwdBuf) / sizeof(cwdBuf[0])), cwdBuf);
+      const std::wstring cwd = (cwdLen && cwdLen < (sizeof(cwdBuf) / sizeof(cwdBuf[0])))
+                                  ? std::wstring(cwdBuf, cwdBuf + cwdLen)
+                                  : std::wstring();
+      g_store.Open(CombinePath(cwd, L"HKLM.sqlite"));
+      return;
     }
+    g_store.Open(std::wstring(dbPath, dbPath + n));
+  });
+}
+
+// Other processes' commits (hklmreg, a second title) only show up when the
+// store is read, so a thread checks for them while anything is watched.
+constexpr DWORD kNotifyPollMs = 100;
+std::once_flag g_notifyPollOnce;
+HANDLE g_notifyPollStop = nullptr;
+HANDLE g_notifyPollThread = nullptr;
+
+DWORD WINAPI NotifyPollThreadProc(LPVOID) {
+  while (WaitForSingleObject(g_notifyPollStop, kNotifyPollMs) == WAIT_TIMEOUT) {
+    g_engine.CheckExternalChanges();
   }
+  return 0;
+}
 
-  std::sort(out.begin(), out.end(), [](const std::wstring& a, const std::wstring& b) {
-    return _wcsicmp(a.c_str(), b.c_str()) < 0;
+void EnsureNotifyPolling() {
+  std::call_once(g_notifyPollOnce, [] {
+    g_notifyPollStop = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (g_notifyPollStop) {
+      g_notifyPollThread = CreateThread(nullptr, 0, &NotifyPollThreadProc, nullptr, 0, nullptr);
+    }
   });
-  return out;
 }
 
+void StopNotifyPolling() {
+  if (g_notifyPollStop) {
+    SetEvent(g_notifyPollStop);
+  }
+  if (g_notifyPollThread) {
+    WaitForSingleObject(g_notifyPollThread, 1000);
+    CloseHandle(g_notifyPollThread);
+    g_notifyPollThread = nullptr;
+  }
+  // Watches still armed are signaled, and their duplicated events closed.
+  g_notifier.FireAll();
+}
+
+std::vector<std::wstring> GetMergedValueNames(const std::wstring& keyPath, HKEY real) {
+  EnsureStoreOpen();
+  return g_engine.MergedValueNames(keyPath, real);
+}
+
+std::vector<std::wstring> GetMergedSubKeyNames(const std::wstring& keyPath, HKEY real) {
+  EnsureStoreOpen();
+  return g_engine.MergedSubKeyNames(keyPath, real);
+}
 
 void DeleteVirtualKey(VirtualKey* vk) {
   if (!vk) {
@@ -487,20 +554,21 @@ void DestroyAllVirtualKeys() {
       continue;
     }
     if (vk->real) {
-      BypassGuard guard;
-      fpRegCloseKey(vk->real);
+      g_realKeyPool.CloseKey(vk->real);
       vk->real = nullptr;
     }
     delete vk;
   }
+  g_realKeyPool.Clear();
 }
 
-#include "shim/registry_hooks_hooks_core.inl"
+#include "shim/registry_hooks_char_traits.inl"
 
+#include "shim/registry_hooks_workload.inl"
 
-#include "shim/registry_hooks_hooks_legacy.inl"
+#include "shim/registry_hooks_hooks_core.inl"
 
-#include "shim/registry_hooks_hooks_ansi.inl"
+#include "shim/registry_hooks_hooks_legacy.inl"
 
 } // namespace
 
@@ -558,57 +626,26 @@ bool InstallRegistryHooks() {
   }
   g_minHookInitialized.store(true, std::memory_order_release);
 
+  InitializeRegistryTrace();
+  InitializeRegistryStats();
+  StartWorkloadRecording();
   const bool extended = ShouldInstallExtendedHooks();
 
-  auto ok = true;
-  // Core W/Unicode hooks (default): include all common handle consumers so
+  // Core W/Unicode hooks (default) include all common handle consumers so
   // virtual HKEY handles never leak into unhooked advapi32 entry points.
-  ok &= CreateHookApiTypedWithFallback("RegOpenKeyExW", &Hook_RegOpenKeyExW, &fpRegOpenKeyExW);
-  ok &= CreateHookApiTypedWithFallback("RegCreateKeyExW", &Hook_RegCreateKeyExW, &fpRegCreateKeyExW);
-  ok &= CreateHookApiTypedWithFallback("RegCloseKey", &Hook_RegCloseKey, &fpRegCloseKey);
-  ok &= CreateHookApiTypedWithFallback("RegGetValueW", &Hook_RegGetValueW, &fpRegGetValueW);
-  ok &= CreateHookApiTypedWithFallback("RegSetValueExW", &Hook_RegSetValueExW, &fpRegSetValueExW);
-  ok &= CreateHookApiTypedWithFallback("RegQueryValueExW", &Hook_RegQueryValueExW, &fpRegQueryValueExW);
-  ok &= CreateHookApiTypedWithFallback("RegDeleteValueW", &Hook_RegDeleteValueW, &fpRegDeleteValueW);
-  ok &= CreateHookApiTypedWithFallback("RegDeleteKeyW", &Hook_RegDeleteKeyW, &fpRegDeleteKeyW);
-  ok &= CreateHookApiTypedWithFallback("RegOpenKeyW", &Hook_RegOpenKeyW, &fpRegOpenKeyW);
-  ok &= CreateHookApiTypedWithFallback("RegCreateKeyW", &Hook_RegCreateKeyW, &fpRegCreateKeyW);
-  ok &= CreateHookApiTypedWithFallback("RegQueryValueW", &Hook_RegQueryValueW, &fpRegQueryValueW);
-  ok &= CreateHookApiTypedWithFallback("RegSetValueW", &Hook_RegSetValueW, &fpRegSetValueW);
-  ok &= CreateHookApiTypedWithFallback("RegEnumValueW", &Hook_RegEnumValueW, &fpRegEnumValueW);
-  ok &= CreateHookApiTypedWithFallback("RegEnumKeyExW", &Hook_RegEnumKeyExW, &fpRegEnumKeyExW);
-  ok &= CreateHookApiTypedWithFallback("RegEnumKeyW", &Hook_RegEnumKeyW, &fpRegEnumKeyW);
-  ok &= CreateHookApiTypedWithFallback("RegQueryInfoKeyW", &Hook_RegQueryInfoKeyW, &fpRegQueryInfoKeyW);
-
-  // Optional on older systems.
-  (void)CreateHookApiTypedWithFallback("RegSetKeyValueW", &Hook_RegSetKeyValueW, &fpRegSetKeyValueW);
-
-  // Optional on older systems.
-  (void)CreateHookApiTypedWithFallback("RegDeleteKeyExW", &Hook_RegDeleteKeyExW, &fpRegDeleteKeyExW);
-
-  if (extended) {
-    ok &= CreateHookApiTypedWithFallback("RegOpenKeyExA", &Hook_RegOpenKeyExA, &fpRegOpenKeyExA);
-    ok &= CreateHookApiTypedWithFallback("RegCreateKeyExA", &Hook_RegCreateKeyExA, &fpRegCreateKeyExA);
-    ok &= CreateHookApiTypedWithFallback("RegSetValueExA", &Hook_RegSetValueExA, &fpRegSetValueExA);
-    ok &= CreateHookApiTypedWithFallback("RegQueryValueExA", &Hook_RegQueryValueExA, &fpRegQueryValueExA);
-    ok &= CreateHookApiTypedWithFallback("RegDeleteValueA", &Hook_RegDeleteValueA, &fpRegDeleteValueA);
-    ok &= CreateHookApiTypedWithFallback("RegDeleteKeyA", &Hook_RegDeleteKeyA, &fpRegDeleteKeyA);
-
-    ok &= CreateHookApiTypedWithFallback("RegGetValueA", &Hook_RegGetValueA, &fpRegGetValueA);
-
-    ok &= CreateHookApiTypedWithFallback("RegOpenKeyA", &Hook_RegOpenKeyA, &fpRegOpenKeyA);
-    ok &= CreateHookApiTypedWithFallback("RegCreateKeyA", &Hook_RegCreateKeyA, &fpRegCreateKeyA);
-    ok &= CreateHookApiTypedWithFallback("RegQueryValueA", &Hook_RegQueryValueA, &fpRegQueryValueA);
-    ok &= CreateHookApiTypedWithFallback("RegSetValueA", &Hook_RegSetValueA, &fpRegSetValueA);
-
-    ok &= CreateHookApiTypedWithFallback("RegEnumValueA", &Hook_RegEnumValueA, &fpRegEnumValueA);
-    ok &= CreateHookApiTypedWithFallback("RegEnumKeyExA", &Hook_RegEnumKeyExA, &fpRegEnumKeyExA);
-    ok &= CreateHookApiTypedWithFallback("RegEnumKeyA", &Hook_RegEnumKeyA, &fpRegEnumKeyA);
-    ok &= CreateHookApiTypedWithFallback("RegQueryInfoKeyA", &Hook_RegQueryInfoKeyA, &fpRegQueryInfoKeyA);
-
-    // Optional on older systems.
-    (void)CreateHookApiTypedWithFallback("RegSetKeyValueA", &Hook_RegSetKeyValueA, &fpRegSetKeyValueA);
-  }
+  // Optional entries are missing on older systems and never fail the install.
+  auto ok = true;
+#define TWINSHIM_INSTALL_HOOK(name, group)                                            \
+  if (extended || (RegistryApiGroup::group != RegistryApiGroup::Extended &&           \
+                   RegistryApiGroup::group != RegistryApiGroup::ExtendedOptional)) {  \
+    const bool hooked = CreateHookApiTypedWithFallback(#name, &Hook_##name, &fp##name); \
+    if (RegistryApiGroup::group == RegistryApiGroup::Core ||                          \
+        RegistryApiGroup::group == RegistryApiGroup::Extended) {                      \
+      ok &= hooked;                                                                   \
+    }                                                                                 \
+  }
+  TWINSHIM_REGISTRY_API_TABLE(TWINSHIM_INSTALL_HOOK)
+#undef TWINSHIM_INSTALL_HOOK
 
   if (!ok) {
     ReleaseMinHook();
@@ -637,7 +674,58 @@ void RemoveRegistryHooks() {
   if (g_minHookInitialized.exchange(false, std::memory_order_acq_rel)) {
     ReleaseMinHook();
   }
+  ReportRegistryTraceFilter();
+  StopWorkloadRecording();
+  StopPendingWriteFlusher();
+  g_engine.FlushPendingWrites();
+  StopNotifyPolling();
   DestroyAllVirtualKeys();
 }
 
+void OpenRegistryStore() {
+  EnsureStoreOpen();
+}
+
+size_t StartRegistryProfile() {
+  const DWORD windowMs = ProfileWindowMs();
+  if (!windowMs) {
+    return 0;
+  }
+  EnsureStoreOpen();
+  // Record first so lookups made while the prefetch runs are noted too.
+  g_engine.StartAccessProfile(std::chrono::steady_clock::now() + std::chrono::milliseconds(windowMs));
+  return g_engine.Prefetch(g_engine.LoadAccessProfile());
+}
+
+DWORD GetRegistryProfileWindowMs() {
+  return ProfileWindowMs();
+}
+
+RegistryProfileReport SaveRegistryProfile() {
+  RegistryProfileReport report;
+  if (!ProfileWindowMs()) {
+    return report;
+  }
+  const std::vector<AccessProfileEntry> profile = g_engine.TakeAccessProfile();
+  report.recorded = profile.size();
+  // An empty profile (hooks live but no HKLM traffic yet) would throw away
+  // a useful one from an earlier run.
+  if (!profile.empty()) {
+    report.saved = g_engine.SaveAccessProfile(profile);
+  }
+  const auto counters = g_engine.GetPrefetchCounters();
+  report.prefetched = counters.entries;
+  report.hits = counters.hits;
+  report.misses = counters.misses;
+  return report;
+}
+
+uint64_t WarmRegistryStore() {
+  // A few MiB covers the page cache and the hot end of the file; past that
+  // warming only evicts what it just read.
+  constexpr uint64_t kWarmStoreBytes = 8ull << 20;
+  EnsureStoreOpen();
+  return g_engine.WarmStore(kWarmStoreBytes).bytes;
+}
+
 }
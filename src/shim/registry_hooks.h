@@ -2,10 +2,34 @@
 
 #include <windows.h>
 
+#include <cstddef>
+#include <cstdint>
+
 namespace twinshim {
 
 bool InstallRegistryHooks();
 bool AreRegistryHooksActive();
 void RemoveRegistryHooks();
 
+// Opens the local store now rather than on the first hooked call.
+void OpenRegistryStore();
+// Opens the store and reads its tables into cache; returns bytes read.
+uint64_t WarmRegistryStore();
+
+// Access profile (TWINSHIM_PROFILE_SECONDS, default 30; 0 turns it off).
+// Start begins recording what this run looks up and prefetches what the last
+// run saved, returning the entries loaded; Save, once the window is over,
+// stores this run's profile for the next launch.
+size_t StartRegistryProfile();
+DWORD GetRegistryProfileWindowMs();
+
+struct RegistryProfileReport {
+  size_t recorded = 0; // entries this run noted
+  bool saved = false;
+  uint64_t prefetched = 0;
+  uint64_t hits = 0;   // lookups served by the prefetch
+  uint64_t misses = 0; // lookups it didn't cover
+};
+RegistryProfileReport SaveRegistryProfile();
+
 }
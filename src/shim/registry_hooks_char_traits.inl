@@ -0,0 +1,114 @@
+// --- Character-set policies for the templated hook core ---
+//
+// Every registry hook is written once as a template over one of these
+// policies. WideApi hands caller data through untouched; AnsiApi converts
+// names on the way in and value data on the way out. The store always holds
+// the wide (W-API) representation.
+
+// Last ANSI value conversion on this thread. Callers nearly always query a
+// value twice (size probe, then data), so the second call reuses the bytes
+// converted by the first instead of running WideCharToMultiByte again.
+struct ConvertedValueSlot {
+  bool valid = false;
+  DWORD type = REG_NONE;
+  std::vector<uint8_t> source;
+  std::vector<uint8_t> converted;
+};
+thread_local ConvertedValueSlot t_convertedValue;
+
+// Caller-supplied value data in the store's wide representation. Wide callers
+// reference their own buffer; ANSI string payloads are converted into `owned`.
+struct StoreValueData {
+  const BYTE* data = nullptr;
+  DWORD size = 0;
+  std::vector<uint8_t> owned;
+};
+
+#define TWINSHIM_REG_API(name, suffix)                                      \
+  static constexpr RegistryApi k##name = RegistryApi::Reg##name##suffix; \
+  static auto Orig##name() { return fpReg##name##suffix; }
+
+struct WideApi {
+  using Char = wchar_t;
+  using ValEnt = VALENTW;
+  static constexpr bool kAnsi = false;
+
+  TWINSHIM_REG_API(OpenKeyEx, W)
+  TWINSHIM_REG_API(CreateKeyEx, W)
+  TWINSHIM_REG_API(SetValueEx, W)
+  TWINSHIM_REG_API(QueryValueEx, W)
+  TWINSHIM_REG_API(GetValue, W)
+  TWINSHIM_REG_API(DeleteValue, W)
+  TWINSHIM_REG_API(DeleteKey, W)
+  TWINSHIM_REG_API(OpenKey, W)
+  TWINSHIM_REG_API(CreateKey, W)
+  TWINSHIM_REG_API(SetKeyValue, W)
+  TWINSHIM_REG_API(EnumValue, W)
+  TWINSHIM_REG_API(EnumKeyEx, W)
+  TWINSHIM_REG_API(EnumKey, W)
+  TWINSHIM_REG_API(QueryInfoKey, W)
+  TWINSHIM_REG_API(SetValue, W)
+  TWINSHIM_REG_API(QueryValue, W)
+  TWINSHIM_REG_API(QueryMultipleValues, W)
+
+  static bool ReadString(const Char* s, std::wstring& out) { return TryReadWideString(s, out); }
+  static std::wstring ToWide(const Char* s, DWORD len) { return std::wstring(s, s + len); }
+  static const std::wstring& FromWide(const std::wstring& s) { return s; }
+
+  static const std::vector<uint8_t>& ClientValueData(DWORD, const std::vector<uint8_t>& wide) { return wide; }
+
+  static void ToStoreData(DWORD, const BYTE* data, DWORD cbData, StoreValueData& out) {
+    out.data = data;
+    out.size = cbData;
+  }
+};
+
+struct AnsiApi {
+  using Char = char;
+  using ValEnt = VALENTA;
+  static constexpr bool kAnsi = true;
+
+  TWINSHIM_REG_API(OpenKeyEx, A)
+  TWINSHIM_REG_API(CreateKeyEx, A)
+  TWINSHIM_REG_API(SetValueEx, A)
+  TWINSHIM_REG_API(QueryValueEx, A)
+  TWINSHIM_REG_API(GetValue, A)
+  TWINSHIM_REG_API(DeleteValue, A)
+  TWINSHIM_REG_API(DeleteKey, A)
+  TWINSHIM_REG_API(OpenKey, A)
+  TWINSHIM_REG_API(CreateKey, A)
+  TWINSHIM_REG_API(SetKeyValue, A)
+  TWINSHIM_REG_API(EnumValue, A)
+  TWINSHIM_REG_API(EnumKeyEx, A)
+  TWINSHIM_REG_API(EnumKey, A)
+  TWINSHIM_REG_API(QueryInfoKey, A)
+  TWINSHIM_REG_API(SetValue, A)
+  TWINSHIM_REG_API(QueryValue, A)
+  TWINSHIM_REG_API(QueryMultipleValues, A)
+
+  static bool ReadString(const Char* s, std::wstring& out) { return TryAnsiToWideString(s, out); }
+  static std::wstring ToWide(const Char* s, DWORD len) { return AnsiToWide(s, (int)len); }
+  static std::string FromWide(const std::wstring& s) { return WideToAnsi(s); }
+
+  static const std::vector<uint8_t>& ClientValueData(DWORD type, const std::vector<uint8_t>& wide) {
+    if (type != REG_SZ && type != REG_EXPAND_SZ && type != REG_MULTI_SZ) {
+      return wide;
+    }
+    ConvertedValueSlot& slot = t_convertedValue;
+    if (!slot.valid || slot.type != type || slot.source != wide) {
+      slot.converted = WideToAnsiBytesForQuery(type, wide);
+      slot.source = wide;
+      slot.type = type;
+      slot.valid = true;
+    }
+    return slot.converted;
+  }
+
+  static void ToStoreData(DWORD type, const BYTE* data, DWORD cbData, StoreValueData& out) {
+    out.owned = EnsureWideStringData(type, data, cbData);
+    out.data = out.owned.empty() ? nullptr : out.owned.data();
+    out.size = (DWORD)out.owned.size();
+  }
+};
+
+#undef TWINSHIM_REG_API
@@ -1,9 +1,15 @@
 // --- Hooks ---
+//
+// Each *T template implements one registry API for both character sets; the
+// Hook_*W / Hook_*A entry points at the bottom instantiate it with WideApi or
+// AnsiApi (see registry_hooks_char_traits.inl).
 
-LONG WINAPI Hook_RegOpenKeyExW(HKEY hKey, LPCWSTR lpSubKey, DWORD ulOptions, REGSAM samDesired, PHKEY phkResult) {
+template <typename Api>
+LONG RegOpenKeyExT(HKEY hKey, const typename Api::Char* lpSubKey, DWORD ulOptions, REGSAM samDesired, PHKEY phkResult) {
   if (g_bypass) {
-    return fpRegOpenKeyExW(hKey, lpSubKey, ulOptions, samDesired, phkResult);
+    return Api::OrigOpenKeyEx()(hKey, lpSubKey, ulOptions, samDesired, phkResult);
   }
+  RegistryApiCallScope apiCall(Api::kOpenKeyEx);
   if (!phkResult) {
     return ERROR_INVALID_PARAMETER;
   }
@@ -11,69 +17,73 @@ LONG WINAPI Hook_RegOpenKeyExW(HKEY hKey, LPCWSTR lpSubKey, DWORD ulOptions, REG
   std::wstring base = KeyPathFromHandle(hKey);
   if (base.empty()) {
     BypassGuard guard;
-    return fpRegOpenKeyExW(hKey, lpSubKey, ulOptions, samDesired, phkResult);
+    return Api::OrigOpenKeyEx()(hKey, lpSubKey, ulOptions, samDesired, phkResult);
   }
   std::wstring rawSub;
-  if (!TryReadWideString(lpSubKey, rawSub)) {
+  if (!Api::ReadString(lpSubKey, rawSub)) {
     *phkResult = nullptr;
     return ERROR_INVALID_PARAMETER;
   }
   std::wstring sub = rawSub.empty() ? L"" : CanonicalizeSubKey(rawSub);
   if (IsHKLMRoot(hKey) && sub.empty()) {
     BypassGuard guard;
-    return fpRegOpenKeyExW(hKey, lpSubKey, ulOptions, samDesired, phkResult);
+    return Api::OrigOpenKeyEx()(hKey, lpSubKey, ulOptions, samDesired, phkResult);
   }
-  std::wstring full = base.empty() ? (sub.empty() ? L"(native)" : sub) : (sub.empty() ? base : JoinKeyPath(base, sub));
-  if (IsRegistryTraceEnabledForApi(L"RegOpenKeyExW")) {
-    TraceApiEvent(L"RegOpenKeyExW", L"open_key", full, L"-", L"-");
+  std::wstring full = sub.empty() ? base : JoinKeyPath(base, sub);
+  if (IsRegistryTraceEnabledForApi(Api::kOpenKeyEx)) {
+    TraceApiEvent(Api::kOpenKeyEx, TraceOp::OpenKey, full);
   }
 
   EnsureStoreOpen();
-  bool localExists = false;
-  {
-    std::lock_guard<std::mutex> lock(g_storeMutex);
-    if (g_store.IsKeyDeleted(full)) {
-      *phkResult = nullptr;
-      return ERROR_FILE_NOT_FOUND;
-    }
-    localExists = g_store.KeyExistsLocally(full);
+  auto state = std::make_shared<ResolvedKey>();
+  const auto keyState = g_engine.ProbeKey(full, state.get());
+  if (keyState.deleted) {
+    *phkResult = nullptr;
+    return ERROR_FILE_NOT_FOUND;
   }
+  const bool localExists = keyState.localExists;
 
   if (!ShouldReadThrough()) {
     if (localExists) {
-      *phkResult = reinterpret_cast<HKEY>(NewVirtualKey(full, nullptr));
+      *phkResult = reinterpret_cast<HKEY>(NewVirtualKey(full, nullptr, std::move(state), ViewFlagsOf(samDesired)));
       return ERROR_SUCCESS;
     }
     *phkResult = nullptr;
     return ERROR_FILE_NOT_FOUND;
   }
 
+  NoteRegistryStatsReadThrough();
+  if (ShouldPoolRealKeys() && localExists) {
+    // Every open of this key shares one pooled real handle; the caller gets
+    // its own virtual key on top of it. Keys with nothing local stay real
+    // handles below, so unhooked APIs can still use them.
+    HKEY pooled = static_cast<HKEY>(g_realKeyPool.OpenKey(full, samDesired));
+    *phkResult = reinterpret_cast<HKEY>(NewVirtualKey(full, pooled, std::move(state), ViewFlagsOf(samDesired)));
+    return ERROR_SUCCESS;
+  }
+
+  // Never pass a virtual handle to the real API: without a real parent, open
+  // the absolute path under HKLM instead.
   HKEY realParent = RealHandleForFallback(hKey);
   HKEY realOut = nullptr;
   LONG realRc = ERROR_FILE_NOT_FOUND;
   {
     BypassGuard guard;
     if (realParent) {
-      realRc = fpRegOpenKeyExW(realParent, lpSubKey, ulOptions, samDesired, &realOut);
-    } else {
-      std::wstring absSub;
-      if (full.rfind(L"HKLM\\", 0) == 0) {
-        absSub = full.substr(5);
-      }
-      if (!absSub.empty()) {
-        realRc = fpRegOpenKeyExW(HKEY_LOCAL_MACHINE, absSub.c_str(), 0, samDesired, &realOut);
-      }
+      realRc = Api::OrigOpenKeyEx()(realParent, lpSubKey, ulOptions, samDesired, &realOut);
+    } else if (full.rfind(L"HKLM\\", 0) == 0 && full.size() > 5) {
+      realRc = fpRegOpenKeyExW(HKEY_LOCAL_MACHINE, full.c_str() + 5, 0, samDesired, &realOut);
     }
   }
 
   if (realRc == ERROR_SUCCESS && realOut) {
-    RegisterRealKey(realOut, full);
+    RegisterRealKey(realOut, full, std::move(state));
     *phkResult = realOut;
     return ERROR_SUCCESS;
   }
 
   if (localExists) {
-    *phkResult = reinterpret_cast<HKEY>(NewVirtualKey(full, nullptr));
+    *phkResult = reinterpret_cast<HKEY>(NewVirtualKey(full, nullptr, std::move(state), ViewFlagsOf(samDesired)));
     return ERROR_SUCCESS;
   }
 
@@ -81,19 +91,21 @@ LONG WINAPI Hook_RegOpenKeyExW(HKEY hKey, LPCWSTR lpSubKey, DWORD ulOptions, REG
   return realRc;
 }
 
-LONG WINAPI Hook_RegCreateKeyExW(HKEY hKey,
-                                LPCWSTR lpSubKey,
-                                DWORD Reserved,
-                                LPWSTR lpClass,
-                                DWORD dwOptions,
-                                REGSAM samDesired,
-                                const LPSECURITY_ATTRIBUTES lpSecurityAttributes,
-                                PHKEY phkResult,
-                                LPDWORD lpdwDisposition) {
+template <typename Api>
+LONG RegCreateKeyExT(HKEY hKey,
+                     const typename Api::Char* lpSubKey,
+                     DWORD Reserved,
+                     typename Api::Char* lpClass,
+                     DWORD dwOptions,
+                     REGSAM samDesired,
+                     const LPSECURITY_ATTRIBUTES lpSecurityAttributes,
+                     PHKEY phkResult,
+                     LPDWORD lpdwDisposition) {
   if (g_bypass) {
-    return fpRegCreateKeyExW(
+    return Api::OrigCreateKeyEx()(
         hKey, lpSubKey, Reserved, lpClass, dwOptions, samDesired, lpSecurityAttributes, phkResult, lpdwDisposition);
   }
+  RegistryApiCallScope apiCall(Api::kCreateKeyEx);
   if (!phkResult) {
     return ERROR_INVALID_PARAMETER;
   }
@@ -101,33 +113,35 @@ LONG WINAPI Hook_RegCreateKeyExW(HKEY hKey,
   std::wstring base = KeyPathFromHandle(hKey);
   if (base.empty()) {
     BypassGuard guard;
-    return fpRegCreateKeyExW(
+    return Api::OrigCreateKeyEx()(
         hKey, lpSubKey, Reserved, lpClass, dwOptions, samDesired, lpSecurityAttributes, phkResult, lpdwDisposition);
   }
   std::wstring rawSub;
-  if (!TryReadWideString(lpSubKey, rawSub)) {
+  if (!Api::ReadString(lpSubKey, rawSub)) {
     *phkResult = nullptr;
     return ERROR_INVALID_PARAMETER;
   }
   std::wstring sub = rawSub.empty() ? L"" : CanonicalizeSubKey(rawSub);
   if (IsHKLMRoot(hKey) && sub.empty()) {
     BypassGuard guard;
-    return fpRegCreateKeyExW(
+    return Api::OrigCreateKeyEx()(
         hKey, lpSubKey, Reserved, lpClass, dwOptions, samDesired, lpSecurityAttributes, phkResult, lpdwDisposition);
   }
-  std::wstring full = base.empty() ? (sub.empty() ? L"(native)" : sub) : (sub.empty() ? base : JoinKeyPath(base, sub));
-  if (IsRegistryTraceEnabledForApi(L"RegCreateKeyExW")) {
-    TraceApiEvent(L"RegCreateKeyExW", L"create_key", full, L"-", L"-");
+  std::wstring full = sub.empty() ? base : JoinKeyPath(base, sub);
+  if (IsRegistryTraceEnabledForApi(Api::kCreateKeyEx)) {
+    TraceApiEvent(Api::kCreateKeyEx, TraceOp::CreateKey, full);
   }
 
   EnsureStoreOpen();
-  {
-    std::lock_guard<std::mutex> lock(g_storeMutex);
-    if (g_store.IsKeyDeleted(full)) {
-      g_store.PutKey(full);
-    } else {
-      g_store.PutKey(full);
+  g_engine.CreateKey(full);
+
+  if (ShouldReadThrough() && ShouldPoolRealKeys()) {
+    HKEY pooled = static_cast<HKEY>(g_realKeyPool.OpenKey(full, samDesired));
+    *phkResult = reinterpret_cast<HKEY>(NewVirtualKey(full, pooled, nullptr, ViewFlagsOf(samDesired)));
+    if (lpdwDisposition) {
+      *lpdwDisposition = REG_OPENED_EXISTING_KEY;
     }
+    return ERROR_SUCCESS;
   }
 
   HKEY realParent = RealHandleForFallback(hKey);
@@ -135,15 +149,9 @@ LONG WINAPI Hook_RegCreateKeyExW(HKEY hKey,
   {
     BypassGuard guard;
     if (realParent) {
-      fpRegOpenKeyExW(realParent, lpSubKey, 0, KEY_READ | (samDesired & (KEY_WOW64_32KEY | KEY_WOW64_64KEY)), &realOut);
-    } else {
-      std::wstring absSub;
-      if (full.rfind(L"HKLM\\", 0) == 0) {
-        absSub = full.substr(5);
-      }
-      if (!absSub.empty()) {
-        fpRegOpenKeyExW(HKEY_LOCAL_MACHINE, absSub.c_str(), 0, KEY_READ, &realOut);
-      }
+      Api::OrigOpenKeyEx()(realParent, lpSubKey, 0, KEY_READ | (samDesired & (KEY_WOW64_32KEY | KEY_WOW64_64KEY)), &realOut);
+    } else if (full.rfind(L"HKLM\\", 0) == 0 && full.size() > 5) {
+      fpRegOpenKeyExW(HKEY_LOCAL_MACHINE, full.c_str() + 5, 0, KEY_READ, &realOut);
     }
   }
 
@@ -151,7 +159,7 @@ LONG WINAPI Hook_RegCreateKeyExW(HKEY hKey,
     RegisterRealKey(realOut, full);
     *phkResult = realOut;
   } else {
-    *phkResult = reinterpret_cast<HKEY>(NewVirtualKey(full, nullptr));
+    *phkResult = reinterpret_cast<HKEY>(NewVirtualKey(full, nullptr, nullptr, ViewFlagsOf(samDesired)));
   }
   if (lpdwDisposition) {
     *lpdwDisposition = REG_OPENED_EXISTING_KEY;
@@ -163,14 +171,20 @@ LONG WINAPI Hook_RegCloseKey(HKEY hKey) {
   if (g_bypass) {
     return fpRegCloseKey(hKey);
   }
-  if (IsRegistryTraceEnabledForApi(L"RegCloseKey")) {
-    TraceApiEvent(L"RegCloseKey", L"close_key", KeyPathFromHandle(hKey), L"-", L"-");
+  RegistryApiCallScope apiCall(RegistryApi::RegCloseKey);
+  if (IsRegistryTraceEnabledForApi(RegistryApi::RegCloseKey)) {
+    TraceApiEvent(RegistryApi::RegCloseKey, TraceOp::CloseKey, KeyPathFromHandle(hKey));
   }
+  // Closing a key signals the notifications armed on it.
+  g_notifier.CloseOwner(hKey);
   if (auto* vk = AsVirtual(hKey)) {
-    if (vk->real) {
-      BypassGuard guard;
-      fpRegCloseKey(vk->real);
-      vk->real = nullptr;
+    HKEY real = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(vk->realMutex);
+      std::swap(real, vk->real);
+    }
+    if (real) {
+      g_realKeyPool.CloseKey(real);
     }
     DeleteVirtualKey(vk);
     return ERROR_SUCCESS;
@@ -180,56 +194,54 @@ LONG WINAPI Hook_RegCloseKey(HKEY hKey) {
   return fpRegCloseKey(hKey);
 }
 
-LONG WINAPI Hook_RegSetValueExW(HKEY hKey,
-                               LPCWSTR lpValueName,
-                               DWORD Reserved,
-                               DWORD dwType,
-                               const BYTE* lpData,
-                               DWORD cbData) {
+template <typename Api>
+LONG RegSetValueExT(HKEY hKey,
+                    const typename Api::Char* lpValueName,
+                    DWORD Reserved,
+                    DWORD dwType,
+                    const BYTE* lpData,
+                    DWORD cbData) {
   if (g_bypass) {
-    return fpRegSetValueExW(hKey, lpValueName, Reserved, dwType, lpData, cbData);
+    return Api::OrigSetValueEx()(hKey, lpValueName, Reserved, dwType, lpData, cbData);
   }
-  std::wstring keyPath = KeyPathFromHandle(hKey);
+  RegistryApiCallScope apiCall(Api::kSetValueEx);
+  const HandleKey key = KeyFromHandle(hKey);
+  const std::wstring& keyPath = key.path;
   if (keyPath.empty()) {
     BypassGuard guard;
-    return fpRegSetValueExW(hKey, lpValueName, Reserved, dwType, lpData, cbData);
+    return Api::OrigSetValueEx()(hKey, lpValueName, Reserved, dwType, lpData, cbData);
   }
   std::wstring valueName;
-  if (!TryReadWideString(lpValueName, valueName)) {
+  if (!Api::ReadString(lpValueName, valueName)) {
     return ERROR_INVALID_PARAMETER;
   }
-  if (IsRegistryTraceEnabledForApi(L"RegSetValueExW")) {
-    TraceApiEvent(L"RegSetValueExW",
-                  L"set_value",
-                  keyPath,
-                  valueName,
-                  FormatRegType(dwType) + L":" + FormatValuePreview(dwType, lpData, cbData));
+  StoreValueData stored;
+  Api::ToStoreData(dwType, lpData, cbData, stored);
+  if (IsRegistryTraceEnabledForApi(Api::kSetValueEx)) {
+    TraceSetValueEvent(Api::kSetValueEx, keyPath, valueName, dwType, stored.data, stored.size);
   }
 
   EnsureStoreOpen();
-  {
-    std::lock_guard<std::mutex> lock(g_storeMutex);
-    if (g_store.IsKeyDeleted(keyPath)) {
-      g_store.PutKey(keyPath);
-    }
-    if (!g_store.PutValue(keyPath, valueName, (uint32_t)dwType, lpData, cbData)) {
-      return ERROR_WRITE_FAULT;
-    }
+  if (!g_engine.SetValue(keyPath, valueName, (uint32_t)dwType, stored.data, (uint32_t)stored.size, key.state.get())) {
+    return ERROR_WRITE_FAULT;
   }
   return ERROR_SUCCESS;
 }
 
-LONG WINAPI Hook_RegQueryValueExW(HKEY hKey,
-                                 LPCWSTR lpValueName,
-                                 LPDWORD lpReserved,
-                                 LPDWORD lpType,
-                                 LPBYTE lpData,
-                                 LPDWORD lpcbData) {
+template <typename Api>
+LONG RegQueryValueExT(HKEY hKey,
+                      const typename Api::Char* lpValueName,
+                      LPDWORD lpReserved,
+                      LPDWORD lpType,
+                      LPBYTE lpData,
+                      LPDWORD lpcbData) {
   if (g_bypass) {
-    return fpRegQueryValueExW(hKey, lpValueName, lpReserved, lpType, lpData, lpcbData);
+    return Api::OrigQueryValueEx()(hKey, lpValueName, lpReserved, lpType, lpData, lpcbData);
   }
+  RegistryApiCallScope apiCall(Api::kQueryValueEx);
 
-  std::wstring keyPath = KeyPathFromHandle(hKey);
+  const HandleKey key = KeyFromHandle(hKey);
+  const std::wstring& keyPath = key.path;
   std::wstring valueName;
   if (keyPath.empty()) {
     DWORD typeLocal = 0;
@@ -237,88 +249,74 @@ LONG WINAPI Hook_RegQueryValueExW(HKEY hKey,
     LONG rc = ERROR_GEN_FAILURE;
     {
       BypassGuard guard;
-      rc = fpRegQueryValueExW(hKey, lpValueName, lpReserved, typeOut, lpData, lpcbData);
+      rc = Api::OrigQueryValueEx()(hKey, lpValueName, lpReserved, typeOut, lpData, lpcbData);
     }
     DWORD cb = lpcbData ? *lpcbData : 0;
     const BYTE* outData = (rc == ERROR_SUCCESS && lpData && lpcbData) ? lpData : nullptr;
     return TraceReadResultAndReturn(
-        L"RegQueryValueExW", keyPath, valueName, rc, true, *typeOut, outData, cb, lpData == nullptr);
+        Api::kQueryValueEx, keyPath, valueName, rc, true, *typeOut, outData, cb, lpData == nullptr);
   }
-  if (!TryReadWideString(lpValueName, valueName)) {
+  if (!Api::ReadString(lpValueName, valueName)) {
     return ERROR_INVALID_PARAMETER;
   }
 
   EnsureStoreOpen();
-  {
-    std::lock_guard<std::mutex> lock(g_storeMutex);
-    auto v = g_store.GetValue(keyPath, valueName);
-    if (v.has_value()) {
-      if (v->isDeleted) {
-        return TraceReadResultAndReturn(
-            L"RegQueryValueExW", keyPath, valueName, ERROR_FILE_NOT_FOUND, false, REG_NONE, nullptr, 0, false);
-      }
-      if (lpType) {
-        *lpType = (DWORD)v->type;
-      }
-      DWORD needed = (DWORD)v->data.size();
-      if (!lpcbData) {
-        return TraceReadResultAndReturn(
-            L"RegQueryValueExW", keyPath, valueName, ERROR_INVALID_PARAMETER, true, (DWORD)v->type, nullptr, 0, false);
-      }
-      if (!lpData) {
-        *lpcbData = needed;
-        return TraceReadResultAndReturn(
-            L"RegQueryValueExW", keyPath, valueName, ERROR_SUCCESS, true, (DWORD)v->type, nullptr, needed, true);
-      }
-      if (*lpcbData < needed) {
-        *lpcbData = needed;
-        return TraceReadResultAndReturn(
-            L"RegQueryValueExW", keyPath, valueName, ERROR_MORE_DATA, true, (DWORD)v->type, nullptr, needed, false);
-      }
-      if (needed) {
-        std::memcpy(lpData, v->data.data(), needed);
-      }
+  auto v = g_engine.LookupLocalValue(keyPath, valueName, key.state.get());
+  if (v.source == RegistryOverlayEngine::Value::Source::Tombstone) {
+    return TraceReadResultAndReturn(
+        Api::kQueryValueEx, keyPath, valueName, ERROR_FILE_NOT_FOUND, false, REG_NONE, nullptr, 0, false);
+  }
+  if (v.source == RegistryOverlayEngine::Value::Source::Local) {
+    const DWORD type = (DWORD)v.type;
+    if (lpType) {
+      *lpType = type;
+    }
+    if (!lpcbData) {
+      return TraceReadResultAndReturn(
+          Api::kQueryValueEx, keyPath, valueName, ERROR_INVALID_PARAMETER, true, type, nullptr, 0, false);
+    }
+    const std::vector<uint8_t>& outBytes = Api::ClientValueData(type, v.data);
+    DWORD needed = (DWORD)outBytes.size();
+    if (!lpData) {
+      *lpcbData = needed;
+      return TraceReadResultAndReturn(
+          Api::kQueryValueEx, keyPath, valueName, ERROR_SUCCESS, true, type, nullptr, needed, true);
+    }
+    if (*lpcbData < needed) {
       *lpcbData = needed;
       return TraceReadResultAndReturn(
-          L"RegQueryValueExW", keyPath, valueName, ERROR_SUCCESS, true, (DWORD)v->type, lpData, needed, false);
+          Api::kQueryValueEx, keyPath, valueName, ERROR_MORE_DATA, true, type, nullptr, needed, false);
+    }
+    if (needed) {
+      std::memcpy(lpData, outBytes.data(), needed);
     }
+    *lpcbData = needed;
+    return TraceReadResultAndReturn(
+        Api::kQueryValueEx, keyPath, valueName, ERROR_SUCCESS, true, type, lpData, needed, false);
   }
 
   if (!ShouldReadThrough()) {
     return TraceReadResultAndReturn(
-        L"RegQueryValueExW", keyPath, valueName, ERROR_FILE_NOT_FOUND, false, REG_NONE, nullptr, 0, false);
+        Api::kQueryValueEx, keyPath, valueName, ERROR_FILE_NOT_FOUND, false, REG_NONE, nullptr, 0, false);
   }
 
-  HKEY real = RealHandleForFallback(hKey);
+  NoteRegistryStatsReadThrough();
+  HKEY real = hKey;
   if (auto* vk = AsVirtual(hKey)) {
-    if (!vk->real) {
-      std::wstring sub;
-      if (vk->keyPath.rfind(L"HKLM\\", 0) == 0) {
-        sub = vk->keyPath.substr(5);
-      }
-      if (!sub.empty()) {
-        HKEY opened = nullptr;
-        BypassGuard guard;
-        if (fpRegOpenKeyExW(HKEY_LOCAL_MACHINE, sub.c_str(), 0, KEY_READ, &opened) == ERROR_SUCCESS) {
-          vk->real = opened;
-          real = opened;
-        }
-      }
-    }
-    real = vk->real ? vk->real : nullptr;
+    real = PooledRealKeyFor(vk);
   }
   if (!real) {
     return TraceReadResultAndReturn(
-        L"RegQueryValueExW", keyPath, valueName, ERROR_FILE_NOT_FOUND, false, REG_NONE, nullptr, 0, false);
+        Api::kQueryValueEx, keyPath, valueName, ERROR_FILE_NOT_FOUND, false, REG_NONE, nullptr, 0, false);
   }
   BypassGuard guard;
   DWORD typeLocal = 0;
   LPDWORD typeOut = lpType ? lpType : &typeLocal;
-  LONG rc = fpRegQueryValueExW(real, lpValueName, lpReserved, typeOut, lpData, lpcbData);
+  LONG rc = Api::OrigQueryValueEx()(real, lpValueName, lpReserved, typeOut, lpData, lpcbData);
   DWORD cb = lpcbData ? *lpcbData : 0;
   const BYTE* outData = (rc == ERROR_SUCCESS && lpData && lpcbData) ? lpData : nullptr;
   return TraceReadResultAndReturn(
-      L"RegQueryValueExW", keyPath, valueName, rc, true, *typeOut, outData, cb, lpData == nullptr);
+      Api::kQueryValueEx, keyPath, valueName, rc, true, *typeOut, outData, cb, lpData == nullptr);
 }
 
 static bool TypeAllowedByRrfMask(DWORD storedType, DWORD mask) {
@@ -345,97 +343,99 @@ static bool TypeAllowedByRrfMask(DWORD storedType, DWORD mask) {
   }
 }
 
-LSTATUS WINAPI Hook_RegGetValueW(HKEY hKey,
-                                 LPCWSTR lpSubKey,
-                                 LPCWSTR lpValue,
-                                 DWORD dwFlags,
-                                 LPDWORD pdwType,
-                                 PVOID pvData,
-                                 LPDWORD pcbData) {
+template <typename Api>
+LSTATUS RegGetValueT(HKEY hKey,
+                     const typename Api::Char* lpSubKey,
+                     const typename Api::Char* lpValue,
+                     DWORD dwFlags,
+                     LPDWORD pdwType,
+                     PVOID pvData,
+                     LPDWORD pcbData) {
   if (g_bypass) {
-    return fpRegGetValueW(hKey, lpSubKey, lpValue, dwFlags, pdwType, pvData, pcbData);
+    return Api::OrigGetValue()(hKey, lpSubKey, lpValue, dwFlags, pdwType, pvData, pcbData);
   }
+  RegistryApiCallScope apiCall(Api::kGetValue);
 
-  std::wstring base = KeyPathFromHandle(hKey);
+  const HandleKey key = KeyFromHandle(hKey);
+  const std::wstring& base = key.path;
   if (base.empty()) {
     DWORD typeLocal = 0;
     LPDWORD typeOut = pdwType ? pdwType : &typeLocal;
     LSTATUS rc = ERROR_GEN_FAILURE;
     {
       BypassGuard guard;
-      rc = fpRegGetValueW(hKey, lpSubKey, lpValue, dwFlags, typeOut, pvData, pcbData);
+      rc = Api::OrigGetValue()(hKey, lpSubKey, lpValue, dwFlags, typeOut, pvData, pcbData);
     }
     DWORD cb = pcbData ? *pcbData : 0;
     const BYTE* outData = (rc == ERROR_SUCCESS && pvData && pcbData) ? reinterpret_cast<const BYTE*>(pvData) : nullptr;
-    return TraceReadResultAndReturn(L"RegGetValueW", base, L"", rc, true, *typeOut, outData, cb, pvData == nullptr);
+    return TraceReadResultAndReturn(Api::kGetValue, base, L"", rc, true, *typeOut, outData, cb, pvData == nullptr);
   }
 
   std::wstring subRaw;
-  if (!TryReadWideString(lpSubKey, subRaw)) {
+  if (!Api::ReadString(lpSubKey, subRaw)) {
     return ERROR_INVALID_PARAMETER;
   }
   std::wstring sub = subRaw.empty() ? L"" : CanonicalizeSubKey(subRaw);
   std::wstring full = sub.empty() ? base : JoinKeyPath(base, sub);
 
   std::wstring valueName;
-  if (!TryReadWideString(lpValue, valueName)) {
+  if (!Api::ReadString(lpValue, valueName)) {
     return ERROR_INVALID_PARAMETER;
   }
-  if (IsRegistryTraceEnabledForApi(L"RegGetValueW")) {
-    TraceApiEvent(L"RegGetValueW", L"query_value", full, valueName.empty() ? L"(Default)" : valueName, L"-");
+  if (IsRegistryTraceEnabledForApi(Api::kGetValue)) {
+    TraceApiEvent(Api::kGetValue, TraceOp::QueryValue, full, valueName.empty() ? L"(Default)" : valueName);
   }
 
   EnsureStoreOpen();
-  {
-    std::lock_guard<std::mutex> lock(g_storeMutex);
-    auto v = g_store.GetValue(full, valueName);
-    if (v.has_value()) {
-      if (v->isDeleted) {
-        return TraceReadResultAndReturn(L"RegGetValueW", full, valueName, ERROR_FILE_NOT_FOUND, false, REG_NONE, nullptr, 0, false);
-      }
-
-      const DWORD storedType = (DWORD)v->type;
-      const DWORD typeMask = (dwFlags & 0x0000FFFF);
-      if (!TypeAllowedByRrfMask(storedType, typeMask)) {
-        return TraceReadResultAndReturn(L"RegGetValueW", full, valueName, ERROR_UNSUPPORTED_TYPE, true, storedType, nullptr, 0, false);
-      }
+  // The handle's cached state only describes the handle's own key.
+  auto v = g_engine.LookupLocalValue(full, valueName, sub.empty() ? key.state.get() : nullptr);
+  if (v.source == RegistryOverlayEngine::Value::Source::Tombstone) {
+    return TraceReadResultAndReturn(Api::kGetValue, full, valueName, ERROR_FILE_NOT_FOUND, false, REG_NONE, nullptr, 0, false);
+  }
+  if (v.source == RegistryOverlayEngine::Value::Source::Local) {
+    const DWORD storedType = (DWORD)v.type;
+    const DWORD typeMask = (dwFlags & 0x0000FFFF);
+    if (!TypeAllowedByRrfMask(storedType, typeMask)) {
+      return TraceReadResultAndReturn(Api::kGetValue, full, valueName, ERROR_UNSUPPORTED_TYPE, true, storedType, nullptr, 0, false);
+    }
 
-      if (pdwType) {
-        *pdwType = storedType;
-      }
-      if (!pcbData) {
-        return TraceReadResultAndReturn(L"RegGetValueW", full, valueName, ERROR_INVALID_PARAMETER, true, storedType, nullptr, 0, false);
-      }
+    if (pdwType) {
+      *pdwType = storedType;
+    }
+    if (!pcbData) {
+      return TraceReadResultAndReturn(Api::kGetValue, full, valueName, ERROR_INVALID_PARAMETER, true, storedType, nullptr, 0, false);
+    }
 
-      DWORD needed = (DWORD)v->data.size();
-      if (!pvData) {
-        *pcbData = needed;
-        return TraceReadResultAndReturn(L"RegGetValueW", full, valueName, ERROR_SUCCESS, true, storedType, nullptr, needed, true);
-      }
-      if (*pcbData < needed) {
-        *pcbData = needed;
-        return TraceReadResultAndReturn(L"RegGetValueW", full, valueName, ERROR_MORE_DATA, true, storedType, nullptr, needed, false);
-      }
-      if (needed) {
-        std::memcpy(pvData, v->data.data(), needed);
-      }
+    const std::vector<uint8_t>& outBytes = Api::ClientValueData(storedType, v.data);
+    DWORD needed = (DWORD)outBytes.size();
+    if (!pvData) {
+      *pcbData = needed;
+      return TraceReadResultAndReturn(Api::kGetValue, full, valueName, ERROR_SUCCESS, true, storedType, nullptr, needed, true);
+    }
+    if (*pcbData < needed) {
       *pcbData = needed;
-      return TraceReadResultAndReturn(L"RegGetValueW",
-                                      full,
-                                      valueName,
-                                      ERROR_SUCCESS,
-                                      true,
-                                      storedType,
-                                      reinterpret_cast<const BYTE*>(pvData),
-                                      needed,
-                                      false);
+      return TraceReadResultAndReturn(Api::kGetValue, full, valueName, ERROR_MORE_DATA, true, storedType, nullptr, needed, false);
+    }
+    if (needed) {
+      std::memcpy(pvData, outBytes.data(), needed);
     }
+    *pcbData = needed;
+    return TraceReadResultAndReturn(Api::kGetValue,
+                                    full,
+                                    valueName,
+                                    ERROR_SUCCESS,
+                                    true,
+                                    storedType,
+                                    reinterpret_cast<const BYTE*>(pvData),
+                                    needed,
+                                    false);
   }
 
   if (!ShouldReadThrough()) {
-    return TraceReadResultAndReturn(L"RegGetValueW", full, valueName, ERROR_FILE_NOT_FOUND, false, REG_NONE, nullptr, 0, false);
+    return TraceReadResultAndReturn(Api::kGetValue, full, valueName, ERROR_FILE_NOT_FOUND, false, REG_NONE, nullptr, 0, false);
   }
 
+  NoteRegistryStatsReadThrough();
   // Fall back to the real registry if possible (never pass virtual handles).
   HKEY realParent = RealHandleForFallback(hKey);
   DWORD typeLocal = 0;
@@ -444,75 +444,141 @@ LSTATUS WINAPI Hook_RegGetValueW(HKEY hKey,
   {
     BypassGuard guard;
     if (realParent) {
-      rc = fpRegGetValueW(realParent, lpSubKey, lpValue, dwFlags, typeOut, pvData, pcbData);
-    } else {
-      std::wstring absSub;
-      if (full.rfind(L"HKLM\\", 0) == 0) {
-        absSub = full.substr(5);
-      }
-      if (!absSub.empty()) {
-        rc = fpRegGetValueW(HKEY_LOCAL_MACHINE, absSub.c_str(), lpValue, dwFlags, typeOut, pvData, pcbData);
-      }
+      rc = Api::OrigGetValue()(realParent, lpSubKey, lpValue, dwFlags, typeOut, pvData, pcbData);
+    } else if (full.rfind(L"HKLM\\", 0) == 0 && full.size() > 5) {
+      const auto& absSub = Api::FromWide(full.substr(5));
+      rc = Api::OrigGetValue()(HKEY_LOCAL_MACHINE, absSub.c_str(), lpValue, dwFlags, typeOut, pvData, pcbData);
     }
   }
   DWORD cb = pcbData ? *pcbData : 0;
   const BYTE* outData = (rc == ERROR_SUCCESS && pvData && pcbData) ? reinterpret_cast<const BYTE*>(pvData) : nullptr;
-  return TraceReadResultAndReturn(L"RegGetValueW", full, valueName, rc, true, *typeOut, outData, cb, pvData == nullptr);
+  return TraceReadResultAndReturn(Api::kGetValue, full, valueName, rc, true, *typeOut, outData, cb, pvData == nullptr);
 }
 
-LONG WINAPI Hook_RegDeleteValueW(HKEY hKey, LPCWSTR lpValueName) {
+template <typename Api>
+LONG RegQueryMultipleValuesT(HKEY hKey,
+                             typename Api::ValEnt* val_list,
+                             DWORD num_vals,
+                             typename Api::Char* lpValueBuf,
+                             LPDWORD ldwTotsize) {
   if (g_bypass) {
-    return fpRegDeleteValueW(hKey, lpValueName);
+    return Api::OrigQueryMultipleValues()(hKey, val_list, num_vals, lpValueBuf, ldwTotsize);
   }
-  std::wstring keyPath = KeyPathFromHandle(hKey);
+  RegistryApiCallScope apiCall(Api::kQueryMultipleValues);
+  const HandleKey key = KeyFromHandle(hKey);
+  const std::wstring& keyPath = key.path;
   if (keyPath.empty()) {
     BypassGuard guard;
-    return fpRegDeleteValueW(hKey, lpValueName);
+    return Api::OrigQueryMultipleValues()(hKey, val_list, num_vals, lpValueBuf, ldwTotsize);
   }
-  std::wstring valueName;
-  if (!TryReadWideString(lpValueName, valueName)) {
+  if (!ldwTotsize || (!val_list && num_vals)) {
     return ERROR_INVALID_PARAMETER;
   }
-  if (IsRegistryTraceEnabledForApi(L"RegDeleteValueW")) {
-    TraceApiEvent(L"RegDeleteValueW", L"delete_value", keyPath, valueName, L"-");
+  std::vector<std::wstring> names(num_vals);
+  for (DWORD i = 0; i < num_vals; i++) {
+    if (!Api::ReadString(val_list[i].ve_valuename, names[i])) {
+      return ERROR_INVALID_PARAMETER;
+    }
   }
 
+  // All names come from one store query; only local misses go to the real key.
   EnsureStoreOpen();
-  {
-    std::lock_guard<std::mutex> lock(g_storeMutex);
-    if (!g_store.DeleteValue(keyPath, valueName)) {
-      return ERROR_WRITE_FAULT;
+  auto values = g_engine.ReadValues(keyPath, names, RealHandleForFallback(hKey), key.state.get(), key.viewFlags);
+  if constexpr (Api::kAnsi) {
+    for (auto& v : values) {
+      const std::vector<uint8_t>& client = Api::ClientValueData((DWORD)v.type, v.data);
+      if (&client != &v.data) {
+        v.data = client;
+      }
+    }
+  }
+
+  uint32_t size = *ldwTotsize;
+  std::vector<uint32_t> offsets;
+  const LONG rc = PackMultipleValues(values, reinterpret_cast<uint8_t*>(lpValueBuf), size, offsets);
+  if (IsRegistryTraceEnabledForApi(Api::kQueryMultipleValues)) {
+    for (DWORD i = 0; i < num_vals; i++) {
+      const auto& v = values[i];
+      const bool found = v.status == ERROR_SUCCESS;
+      TraceReadResultAndReturn(Api::kQueryMultipleValues,
+                               keyPath,
+                               names[i],
+                               found ? rc : v.status,
+                               found,
+                               (DWORD)v.type,
+                               (rc == ERROR_SUCCESS && !v.data.empty()) ? v.data.data() : nullptr,
+                               (DWORD)v.data.size(),
+                               lpValueBuf == nullptr);
     }
   }
+  if (rc != ERROR_SUCCESS && rc != ERROR_MORE_DATA) {
+    return rc;
+  }
+  // Like the real API, lengths and types are reported even when the buffer is
+  // too small; value pointers only once the data is in place.
+  *ldwTotsize = size;
+  for (DWORD i = 0; i < num_vals; i++) {
+    val_list[i].ve_valuelen = (DWORD)values[i].data.size();
+    val_list[i].ve_type = (DWORD)values[i].type;
+    if (rc == ERROR_SUCCESS) {
+      val_list[i].ve_valueptr = (DWORD_PTR)(reinterpret_cast<uint8_t*>(lpValueBuf) + offsets[i]);
+    }
+  }
+  return rc;
+}
+
+template <typename Api>
+LONG RegDeleteValueT(HKEY hKey, const typename Api::Char* lpValueName) {
+  if (g_bypass) {
+    return Api::OrigDeleteValue()(hKey, lpValueName);
+  }
+  RegistryApiCallScope apiCall(Api::kDeleteValue);
+  const HandleKey key = KeyFromHandle(hKey);
+  const std::wstring& keyPath = key.path;
+  if (keyPath.empty()) {
+    BypassGuard guard;
+    return Api::OrigDeleteValue()(hKey, lpValueName);
+  }
+  std::wstring valueName;
+  if (!Api::ReadString(lpValueName, valueName)) {
+    return ERROR_INVALID_PARAMETER;
+  }
+  if (IsRegistryTraceEnabledForApi(Api::kDeleteValue)) {
+    TraceApiEvent(Api::kDeleteValue, TraceOp::DeleteValue, keyPath, valueName);
+  }
+
+  EnsureStoreOpen();
+  if (!g_engine.DeleteValue(keyPath, valueName, key.state.get())) {
+    return ERROR_WRITE_FAULT;
+  }
   return ERROR_SUCCESS;
 }
 
-LONG WINAPI Hook_RegDeleteKeyW(HKEY hKey, LPCWSTR lpSubKey) {
+template <typename Api>
+LONG RegDeleteKeyT(HKEY hKey, const typename Api::Char* lpSubKey) {
   if (g_bypass) {
-    return fpRegDeleteKeyW(hKey, lpSubKey);
+    return Api::OrigDeleteKey()(hKey, lpSubKey);
   }
+  RegistryApiCallScope apiCall(Api::kDeleteKey);
   std::wstring base = KeyPathFromHandle(hKey);
   if (base.empty()) {
     BypassGuard guard;
-    return fpRegDeleteKeyW(hKey, lpSubKey);
+    return Api::OrigDeleteKey()(hKey, lpSubKey);
   }
   std::wstring subRaw;
-  if (!TryReadWideString(lpSubKey, subRaw)) {
+  if (!Api::ReadString(lpSubKey, subRaw)) {
     return ERROR_INVALID_PARAMETER;
   }
   std::wstring sub = subRaw.empty() ? L"" : CanonicalizeSubKey(subRaw);
   std::wstring full = sub.empty() ? base : JoinKeyPath(base, sub);
-  if (IsRegistryTraceEnabledForApi(L"RegDeleteKeyW")) {
-    TraceApiEvent(L"RegDeleteKeyW", L"delete_key", full, L"-", L"-");
+  if (IsRegistryTraceEnabledForApi(Api::kDeleteKey)) {
+    TraceApiEvent(Api::kDeleteKey, TraceOp::DeleteKey, full);
   }
   if (sub.empty()) {
     return ERROR_INVALID_PARAMETER;
   }
   EnsureStoreOpen();
-  {
-    std::lock_guard<std::mutex> lock(g_storeMutex);
-    g_store.DeleteKeyTree(full);
-  }
+  g_engine.DeleteKeyTree(full);
   return ERROR_SUCCESS;
 }
 
@@ -520,6 +586,8 @@ LONG WINAPI Hook_RegDeleteKeyExW(HKEY hKey, LPCWSTR lpSubKey, REGSAM samDesired,
   if (g_bypass) {
     return fpRegDeleteKeyExW ? fpRegDeleteKeyExW(hKey, lpSubKey, samDesired, Reserved) : ERROR_CALL_NOT_IMPLEMENTED;
   }
+  RegistryApiCallScope apiCall(RegistryApi::RegDeleteKeyExW);
+  WorkloadCall<WideApi> capture(RegistryApi::RegDeleteKeyExW, hKey, lpSubKey, nullptr, nullptr, nullptr);
   std::wstring base = KeyPathFromHandle(hKey);
   std::wstring full = base.empty() ? L"(native)" : base;
   if (!base.empty()) {
@@ -530,11 +598,170 @@ LONG WINAPI Hook_RegDeleteKeyExW(HKEY hKey, LPCWSTR lpSubKey, REGSAM samDesired,
     std::wstring sub = subRaw.empty() ? L"" : CanonicalizeSubKey(subRaw);
     full = sub.empty() ? base : JoinKeyPath(base, sub);
   }
-  if (IsRegistryTraceEnabledForApi(L"RegDeleteKeyExW")) {
-    TraceApiEvent(L"RegDeleteKeyExW", L"delete_key", full, L"-", L"-");
+  if (IsRegistryTraceEnabledForApi(RegistryApi::RegDeleteKeyExW)) {
+    TraceApiEvent(RegistryApi::RegDeleteKeyExW, TraceOp::DeleteKey, full);
   }
   (void)samDesired;
   (void)Reserved;
   InternalDispatchGuard internalGuard;
-  return Hook_RegDeleteKeyW(hKey, lpSubKey);
+  return capture.Done(RegDeleteKeyT<WideApi>(hKey, lpSubKey));
+}
+
+// Watches on HKLM keys are armed in the change notifier, which the overlay
+// engine feeds with local writes and the poll thread with other processes'
+// commits. Real handles (read-through opens, the HKLM root) also keep the real
+// registry's notification so changes to real data are still reported; a
+// blocking wait on one can only wait on the real side.
+LSTATUS WINAPI Hook_RegNotifyChangeKeyValue(HKEY hKey, BOOL bWatchSubtree, DWORD dwNotifyFilter, HANDLE hEvent, BOOL fAsynchronous) {
+  if (g_bypass) {
+    return fpRegNotifyChangeKeyValue(hKey, bWatchSubtree, dwNotifyFilter, hEvent, fAsynchronous);
+  }
+  RegistryApiCallScope apiCall(RegistryApi::RegNotifyChangeKeyValue);
+  const HandleKey key = KeyFromHandle(hKey);
+  const bool isVirtual = AsVirtual(hKey) != nullptr;
+  if (key.path.empty() || (!isVirtual && !fAsynchronous)) {
+    BypassGuard guard;
+    return fpRegNotifyChangeKeyValue(hKey, bWatchSubtree, dwNotifyFilter, hEvent, fAsynchronous);
+  }
+  // REG_NOTIFY_THREAD_AGNOSTIC needs no handling: watches here never depend
+  // on the registering thread.
+  const DWORD filter = dwNotifyFilter & kRegNotifyChangeAll;
+  if (!filter || (fAsynchronous && !hEvent)) {
+    return ERROR_INVALID_PARAMETER;
+  }
+  if (IsRegistryTraceEnabledForApi(RegistryApi::RegNotifyChangeKeyValue)) {
+    TraceNotifyEvent(RegistryApi::RegNotifyChangeKeyValue, key.path, bWatchSubtree != FALSE);
+  }
+  if (!isVirtual) {
+    BypassGuard guard;
+    const LONG rc = fpRegNotifyChangeKeyValue(hKey, bWatchSubtree, dwNotifyFilter, hEvent, TRUE);
+    if (rc != ERROR_SUCCESS) {
+      return rc;
+    }
+  }
+
+  EnsureStoreOpen();
+  EnsureNotifyPolling();
+  // Settle commits made before this call so they don't fire the new watch.
+  g_engine.CheckExternalChanges();
+  if (fAsynchronous) {
+    // Our own duplicate: the caller may close its event before the watch fires.
+    HANDLE ev = nullptr;
+    if (!DuplicateHandle(GetCurrentProcess(), hEvent, GetCurrentProcess(), &ev, EVENT_MODIFY_STATE, FALSE, 0)) {
+      return (LONG)GetLastError();
+    }
+    g_notifier.Watch(key.path, bWatchSubtree != FALSE, filter, hKey, [ev] {
+      SetEvent(ev);
+      CloseHandle(ev);
+    });
+    return ERROR_SUCCESS;
+  }
+  HANDLE ev = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+  if (!ev) {
+    return (LONG)GetLastError();
+  }
+  g_notifier.Watch(key.path, bWatchSubtree != FALSE, filter, hKey, [ev] { SetEvent(ev); });
+  WaitForSingleObject(ev, INFINITE);
+  CloseHandle(ev);
+  return ERROR_SUCCESS;
+}
+
+// --- W/A entry points ---
+
+LONG WINAPI Hook_RegOpenKeyExW(HKEY hKey, LPCWSTR lpSubKey, DWORD ulOptions, REGSAM samDesired, PHKEY phkResult) {
+  WorkloadCall<WideApi> capture(RegistryApi::RegOpenKeyExW, hKey, lpSubKey, nullptr, nullptr, nullptr);
+  return capture.Done(RegOpenKeyExT<WideApi>(hKey, lpSubKey, ulOptions, samDesired, phkResult));
+}
+
+LONG WINAPI Hook_RegOpenKeyExA(HKEY hKey, LPCSTR lpSubKey, DWORD ulOptions, REGSAM samDesired, PHKEY phkResult) {
+  WorkloadCall<AnsiApi> capture(RegistryApi::RegOpenKeyExA, hKey, lpSubKey, nullptr, nullptr, nullptr);
+  return capture.Done(RegOpenKeyExT<AnsiApi>(hKey, lpSubKey, ulOptions, samDesired, phkResult));
+}
+
+LONG WINAPI Hook_RegCreateKeyExW(HKEY hKey,
+                                LPCWSTR lpSubKey,
+                                DWORD Reserved,
+                                LPWSTR lpClass,
+                                DWORD dwOptions,
+                                REGSAM samDesired,
+                                const LPSECURITY_ATTRIBUTES lpSecurityAttributes,
+                                PHKEY phkResult,
+                                LPDWORD lpdwDisposition) {
+  WorkloadCall<WideApi> capture(RegistryApi::RegCreateKeyExW, hKey, lpSubKey, nullptr, nullptr, nullptr);
+  return capture.Done(RegCreateKeyExT<WideApi>(
+      hKey, lpSubKey, Reserved, lpClass, dwOptions, samDesired, lpSecurityAttributes, phkResult, lpdwDisposition));
+}
+
+LONG WINAPI Hook_RegCreateKeyExA(HKEY hKey,
+                                LPCSTR lpSubKey,
+                                DWORD Reserved,
+                                LPSTR lpClass,
+                                DWORD dwOptions,
+                                REGSAM samDesired,
+                                const LPSECURITY_ATTRIBUTES lpSecurityAttributes,
+                                PHKEY phkResult,
+                                LPDWORD lpdwDisposition) {
+  WorkloadCall<AnsiApi> capture(RegistryApi::RegCreateKeyExA, hKey, lpSubKey, nullptr, nullptr, nullptr);
+  return capture.Done(RegCreateKeyExT<AnsiApi>(
+      hKey, lpSubKey, Reserved, lpClass, dwOptions, samDesired, lpSecurityAttributes, phkResult, lpdwDisposition));
+}
+
+LONG WINAPI Hook_RegSetValueExW(HKEY hKey, LPCWSTR lpValueName, DWORD Reserved, DWORD dwType, const BYTE* lpData, DWORD cbData) {
+  WorkloadCall<WideApi> capture(RegistryApi::RegSetValueExW, hKey, nullptr, lpValueName, lpData, &cbData);
+  return capture.Done(RegSetValueExT<WideApi>(hKey, lpValueName, Reserved, dwType, lpData, cbData), nullptr, &dwType);
+}
+
+LONG WINAPI Hook_RegSetValueExA(HKEY hKey, LPCSTR lpValueName, DWORD Reserved, DWORD dwType, const BYTE* lpData, DWORD cbData) {
+  WorkloadCall<AnsiApi> capture(RegistryApi::RegSetValueExA, hKey, nullptr, lpValueName, lpData, &cbData);
+  return capture.Done(RegSetValueExT<AnsiApi>(hKey, lpValueName, Reserved, dwType, lpData, cbData), nullptr, &dwType);
+}
+
+LONG WINAPI Hook_RegQueryValueExW(HKEY hKey, LPCWSTR lpValueName, LPDWORD lpReserved, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData) {
+  WorkloadCall<WideApi> capture(RegistryApi::RegQueryValueExW, hKey, nullptr, lpValueName, lpData, lpcbData);
+  return capture.Done(RegQueryValueExT<WideApi>(hKey, lpValueName, lpReserved, lpType, lpData, lpcbData), lpcbData, lpType);
+}
+
+LONG WINAPI Hook_RegQueryValueExA(HKEY hKey, LPCSTR lpValueName, LPDWORD lpReserved, LPDWORD lpType, LPBYTE lpData, LPDWORD lpcbData) {
+  WorkloadCall<AnsiApi> capture(RegistryApi::RegQueryValueExA, hKey, nullptr, lpValueName, lpData, lpcbData);
+  return capture.Done(RegQueryValueExT<AnsiApi>(hKey, lpValueName, lpReserved, lpType, lpData, lpcbData), lpcbData, lpType);
+}
+
+LSTATUS WINAPI Hook_RegGetValueW(HKEY hKey, LPCWSTR lpSubKey, LPCWSTR lpValue, DWORD dwFlags, LPDWORD pdwType, PVOID pvData, LPDWORD pcbData) {
+  WorkloadCall<WideApi> capture(RegistryApi::RegGetValueW, hKey, lpSubKey, lpValue, pvData, pcbData);
+  return capture.Done(RegGetValueT<WideApi>(hKey, lpSubKey, lpValue, dwFlags, pdwType, pvData, pcbData), pcbData, pdwType);
+}
+
+LSTATUS WINAPI Hook_RegGetValueA(HKEY hKey, LPCSTR lpSubKey, LPCSTR lpValue, DWORD dwFlags, LPDWORD pdwType, PVOID pvData, LPDWORD pcbData) {
+  WorkloadCall<AnsiApi> capture(RegistryApi::RegGetValueA, hKey, lpSubKey, lpValue, pvData, pcbData);
+  return capture.Done(RegGetValueT<AnsiApi>(hKey, lpSubKey, lpValue, dwFlags, pdwType, pvData, pcbData), pcbData, pdwType);
+}
+
+LONG WINAPI Hook_RegQueryMultipleValuesW(HKEY hKey, PVALENTW val_list, DWORD num_vals, LPWSTR lpValueBuf, LPDWORD ldwTotsize) {
+  WorkloadCall<WideApi> capture(RegistryApi::RegQueryMultipleValuesW, hKey, val_list, num_vals, lpValueBuf, ldwTotsize);
+  return capture.Done(RegQueryMultipleValuesT<WideApi>(hKey, val_list, num_vals, lpValueBuf, ldwTotsize), ldwTotsize);
+}
+
+LONG WINAPI Hook_RegQueryMultipleValuesA(HKEY hKey, PVALENTA val_list, DWORD num_vals, LPSTR lpValueBuf, LPDWORD ldwTotsize) {
+  WorkloadCall<AnsiApi> capture(RegistryApi::RegQueryMultipleValuesA, hKey, val_list, num_vals, lpValueBuf, ldwTotsize);
+  return capture.Done(RegQueryMultipleValuesT<AnsiApi>(hKey, val_list, num_vals, lpValueBuf, ldwTotsize), ldwTotsize);
+}
+
+LONG WINAPI Hook_RegDeleteValueW(HKEY hKey, LPCWSTR lpValueName) {
+  WorkloadCall<WideApi> capture(RegistryApi::RegDeleteValueW, hKey, nullptr, lpValueName, nullptr, nullptr);
+  return capture.Done(RegDeleteValueT<WideApi>(hKey, lpValueName));
+}
+
+LONG WINAPI Hook_RegDeleteValueA(HKEY hKey, LPCSTR lpValueName) {
+  WorkloadCall<AnsiApi> capture(RegistryApi::RegDeleteValueA, hKey, nullptr, lpValueName, nullptr, nullptr);
+  return capture.Done(RegDeleteValueT<AnsiApi>(hKey, lpValueName));
+}
+
+LONG WINAPI Hook_RegDeleteKeyW(HKEY hKey, LPCWSTR lpSubKey) {
+  WorkloadCall<WideApi> capture(RegistryApi::RegDeleteKeyW, hKey, lpSubKey, nullptr, nullptr, nullptr);
+  return capture.Done(RegDeleteKeyT<WideApi>(hKey, lpSubKey));
+}
+
+LONG WINAPI Hook_RegDeleteKeyA(HKEY hKey, LPCSTR lpSubKey) {
+  WorkloadCall<AnsiApi> capture(RegistryApi::RegDeleteKeyA, hKey, lpSubKey, nullptr, nullptr, nullptr);
+  return capture.Done(RegDeleteKeyT<AnsiApi>(hKey, lpSubKey));
 }
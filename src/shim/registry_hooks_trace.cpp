@@ -1,236 +1,154 @@
 #include "shim/registry_hooks_trace.h"
 
-#include <algorithm>
-#include <cstring>
-#include <cwchar>
-#include <cwctype>
-#include <mutex>
-#include <vector>
+#include "shim/shim_trace.h"
+
+#include "common/trace_filter.h"
+#include "common/utf8.h"
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
 
 namespace twinshim {
 namespace {
 
+// Matches the decoder: larger reads are shown as <data_present>.
 constexpr DWORD kMaxTraceDataBytes = 1024;
-
-std::once_flag g_debugInitOnce;
-bool g_debugAll = false;
-std::vector<std::wstring> g_debugTokens;
-HANDLE g_debugPipe = INVALID_HANDLE_VALUE;
-std::mutex g_debugPipeMutex;
+// Per-thread interning table limit; past it the table starts over.
+constexpr size_t kMaxInternedTraceStrings = 4096;
+// Ids come from one process-wide counter rather than per thread: a thread
+// that reuses an exited thread's id then can't refer to the old thread's
+// definitions, and a table that started over doesn't reuse its own ids.
+std::atomic<uint32_t> g_nextTraceStringId{1};
+
+std::atomic<RegistryApiMask> g_traceMask{0};
+RegistryApiCounters g_apiCalls;
+std::atomic<RegistryStatsBlock*> g_statsBlock{nullptr};
 thread_local int g_internalDispatchDepth = 0;
 
-bool ApiUsesAnsiStrings(const wchar_t* apiName) {
-  if (!apiName) {
-    return false;
-  }
-  size_t len = wcslen(apiName);
-  if (len == 0) {
-    return false;
-  }
-  return apiName[len - 1] == L'A';
-}
-
-std::wstring AnsiBytesToWideBestEffort(const char* bytes, int len) {
-  if (!bytes || len <= 0) {
-    return {};
-  }
-
-  // Prefer strict conversion when supported; fall back to Windows' default substitution behavior.
-  const DWORD flagsToTry[] = {MB_ERR_INVALID_CHARS, 0};
-  for (DWORD flags : flagsToTry) {
-    int needed = MultiByteToWideChar(CP_ACP, flags, bytes, len, nullptr, 0);
-    if (needed <= 0) {
-      continue;
-    }
-    std::wstring out;
-    out.resize((size_t)needed);
-    if (MultiByteToWideChar(CP_ACP, flags, bytes, len, out.data(), needed) <= 0) {
-      continue;
-    }
-    return out;
-  }
-
-  return {};
+// TWINSHIM_DEBUG_FILTER selectors; null when every traced event is written.
+// Never freed: hooks can still run while the process exits.
+std::atomic<TraceFilter*> g_traceFilter{nullptr};
+thread_local uint32_t t_traceSampleCounter = 0;
+
+struct TraceStringTable {
+  std::unordered_map<std::wstring, uint32_t> ids;
+};
+
+thread_local TraceStringTable t_traceStrings;
+
+// Returns the id for `text` on this thread, defining it in the stream the
+// first time. A definition that was dropped is retried on the next use, and
+// the event referring to it decodes as <str:N>.
+uint32_t InternTraceString(const std::wstring& text) {
+  if (text.empty() || text == L"-") {
+    return 0;
+  }
+  auto& table = t_traceStrings;
+  auto it = table.ids.find(text);
+  if (it != table.ids.end()) {
+    return it->second;
+  }
+  if (table.ids.size() >= kMaxInternedTraceStrings) {
+    table.ids.clear();
+  }
+  const uint32_t id = g_nextTraceStringId.fetch_add(1, std::memory_order_relaxed);
+  static_assert(sizeof(wchar_t) == sizeof(uint16_t), "trace strings are UTF-16");
+  char record[16 + kTraceMaxStringUnits * sizeof(uint16_t)];
+  const size_t size = EncodeTraceString(
+      TraceThreadId(), id, reinterpret_cast<const uint16_t*>(text.data()), text.size(), record, sizeof(record));
+  if (size && ShimTraceWriteRecord(record, size)) {
+    table.ids.emplace(text, id);
+  }
+  return id;
 }
 
-std::wstring TrimCopy(const std::wstring& value) {
-  size_t begin = 0;
-  while (begin < value.size() && std::iswspace(value[begin])) {
-    begin++;
-  }
-  size_t end = value.size();
-  while (end > begin && std::iswspace(value[end - 1])) {
-    end--;
+void WriteSuppressedSummary(RegistryApi api, const std::wstring& keyPath, const TraceSuppressedEvents& suppressed) {
+  char line[160];
+  if (suppressed.byApi) {
+    std::snprintf(line, sizeof(line), "[shim] trace: %llu %s events suppressed by rate=\n",
+                  (unsigned long long)suppressed.byApi, GetRegistryApiInfo(api).procName);
+    ShimTraceWrite(line);
   }
-  return value.substr(begin, end - begin);
-}
-
-std::wstring NormalizeApiToken(const std::wstring& in) {
-  std::wstring out;
-  out.reserve(in.size());
-  for (wchar_t ch : in) {
-    if (!std::iswspace(ch)) {
-      out.push_back((wchar_t)std::towlower(ch));
-    }
-  }
-  return out;
-}
-
-std::wstring StripAnsiWideSuffix(const std::wstring& apiNameNorm) {
-  if (apiNameNorm.size() > 1) {
-    wchar_t tail = apiNameNorm.back();
-    if (tail == L'a' || tail == L'w') {
-      return apiNameNorm.substr(0, apiNameNorm.size() - 1);
-    }
+  if (suppressed.byKey) {
+    std::snprintf(line, sizeof(line), "[shim] trace: %llu events suppressed by keyrate= on ",
+                  (unsigned long long)suppressed.byKey);
+    ShimTraceWrite((line + WideToUtf8(keyPath) + "\n").c_str());
   }
-  return apiNameNorm;
 }
 
-void InitializeDebugConfig() {
-  std::call_once(g_debugInitOnce, [] {
-    wchar_t tokenBuf[4096]{};
-    DWORD tokenLen =
-        GetEnvironmentVariableW(L"TWINSHIM_DEBUG_APIS", tokenBuf, (DWORD)(sizeof(tokenBuf) / sizeof(tokenBuf[0])));
-    if (!tokenLen || tokenLen >= (DWORD)(sizeof(tokenBuf) / sizeof(tokenBuf[0]))) {
-      tokenLen =
-          GetEnvironmentVariableW(L"HKLM_WRAPPER_DEBUG_APIS", tokenBuf, (DWORD)(sizeof(tokenBuf) / sizeof(tokenBuf[0])));
-    }
-    if (!tokenLen || tokenLen >= (sizeof(tokenBuf) / sizeof(tokenBuf[0]))) {
-      return;
-    }
-
-    std::wstring csv(tokenBuf, tokenBuf + tokenLen);
-    size_t start = 0;
-    while (start <= csv.size()) {
-      size_t comma = csv.find(L',', start);
-      size_t end = (comma == std::wstring::npos) ? csv.size() : comma;
-      std::wstring token = NormalizeApiToken(TrimCopy(csv.substr(start, end - start)));
-      if (!token.empty()) {
-        if (token == L"all") {
-          g_debugAll = true;
-          g_debugTokens.clear();
-          break;
-        }
-        g_debugTokens.push_back(token);
-      }
-      if (comma == std::wstring::npos) {
-        break;
-      }
-      start = comma + 1;
-    }
-  });
-}
-
-bool ShouldTraceApi(const wchar_t* apiName) {
-  InitializeDebugConfig();
-  if (g_debugAll) {
+// The --debug-filter selectors. Runs after the per-API mask; `status` is null
+// for events that carry no result.
+bool PassesTraceFilter(RegistryApi api, const std::wstring& keyPath, const LONG* status) {
+  TraceFilter* filter = g_traceFilter.load(std::memory_order_acquire);
+  if (!filter) {
     return true;
   }
-  if (g_debugTokens.empty() || !apiName) {
+  const int32_t code = status ? (int32_t)*status : 0;
+  TraceSuppressedEvents suppressed;
+  if (!filter->Admit((uint16_t)api, keyPath.data(), keyPath.size(), status ? &code : nullptr, TraceTicks(),
+                     t_traceSampleCounter, suppressed)) {
     return false;
   }
-
-  const std::wstring apiNorm = NormalizeApiToken(apiName);
-  const std::wstring apiNoAw = StripAnsiWideSuffix(apiNorm);
-
-  for (const auto& token : g_debugTokens) {
-    const std::wstring tokenNoAw = StripAnsiWideSuffix(token);
-    if (tokenNoAw == apiNoAw) {
-      return true;
-    }
-    if (tokenNoAw.size() + 2 == apiNoAw.size() && apiNoAw.rfind(tokenNoAw, 0) == 0 && apiNoAw.substr(tokenNoAw.size()) == L"ex") {
-      return true;
-    }
+  if (suppressed.byApi || suppressed.byKey) {
+    WriteSuppressedSummary(api, keyPath, suppressed);
   }
-  return false;
+  return true;
 }
 
-void EnsureDebugPipeConnected() {
-  if (g_debugPipe != INVALID_HANDLE_VALUE) {
-    return;
-  }
-
-  wchar_t pipeBuf[512]{};
-  DWORD pipeLen =
-      GetEnvironmentVariableW(L"TWINSHIM_DEBUG_PIPE", pipeBuf, (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0])));
-  if (!pipeLen || pipeLen >= (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0]))) {
-    pipeLen =
-        GetEnvironmentVariableW(L"HKLM_WRAPPER_DEBUG_PIPE", pipeBuf, (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0])));
+void WriteTraceEvent(TraceEvent& event,
+                     const std::wstring& keyPath,
+                     const std::wstring& valueName,
+                     const BYTE* data,
+                     size_t dataSize) {
+  event.tid = TraceThreadId();
+  event.ticks = TraceTicks();
+  event.keyId = InternTraceString(keyPath);
+  event.nameId = InternTraceString(valueName);
+  char record[kTraceEventMaxBytes];
+  const size_t size = EncodeTraceEvent(event, data, dataSize, record, sizeof(record));
+  if (size) {
+    ShimTraceWriteRecord(record, size);
   }
-  if (!pipeLen || pipeLen >= (sizeof(pipeBuf) / sizeof(pipeBuf[0]))) {
-    return;
-  }
-
-  HANDLE h = CreateFileW(std::wstring(pipeBuf, pipeBuf + pipeLen).c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
-  if (h == INVALID_HANDLE_VALUE) {
-    return;
-  }
-  g_debugPipe = h;
 }
 
-std::wstring SanitizeForLog(const std::wstring& value, size_t maxChars = 140) {
-  std::wstring out;
-  out.reserve(value.size());
-  for (wchar_t ch : value) {
-    if (ch == L'\r' || ch == L'\n' || ch == L'\t') {
-      out.push_back(L' ');
-    } else {
-      out.push_back(ch);
-    }
-  }
-  if (out.size() > maxChars) {
-    out.resize(maxChars);
-    out += L"...";
-  }
-  return out;
-}
-
-std::wstring HexPreview(const BYTE* data, DWORD cbData, size_t maxBytes = 24) {
-  if (!data || cbData == 0) {
-    return L"<empty>";
-  }
-  static const wchar_t* kHex = L"0123456789ABCDEF";
-  size_t used = std::min<size_t>(cbData, maxBytes);
-  std::wstring out;
-  out.reserve(used * 2 + 8);
-  for (size_t i = 0; i < used; i++) {
-    BYTE b = data[i];
-    out.push_back(kHex[(b >> 4) & 0xF]);
-    out.push_back(kHex[b & 0xF]);
-  }
-  if (used < cbData) {
-    out += L"...";
+void TraceReadResult(RegistryApi api,
+                     TraceOp op,
+                     const std::wstring& keyPath,
+                     const std::wstring& valueName,
+                     LONG status,
+                     bool typeKnown,
+                     DWORD type,
+                     const BYTE* data,
+                     DWORD cbData,
+                     bool sizeOnly,
+                     const DWORD* index) {
+  if (!IsShimTraceEnabled() || !PassesTraceFilter(api, keyPath, &status)) {
+    return;
   }
-  return out;
-}
-
-std::wstring HexEncodeAll(const BYTE* data, DWORD cbData) {
-  if (!data || cbData == 0) {
-    return L"<empty>";
+  TraceEvent event;
+  event.api = (uint16_t)api;
+  event.op = op;
+  event.flags = kTraceEventHasResult;
+  event.status = (int32_t)status;
+  event.type = type;
+  event.cbData = cbData;
+  if (typeKnown) {
+    event.flags |= kTraceEventTypeKnown;
   }
-  static const wchar_t* kHex = L"0123456789ABCDEF";
-  std::wstring out;
-  out.reserve((size_t)cbData * 2);
-  for (DWORD i = 0; i < cbData; i++) {
-    BYTE b = data[i];
-    out.push_back(kHex[(b >> 4) & 0xF]);
-    out.push_back(kHex[b & 0xF]);
+  if (sizeOnly) {
+    event.flags |= kTraceEventSizeOnly;
   }
-  return out;
-}
-
-std::string WideToUtf8(const std::wstring& text) {
-  if (text.empty()) {
-    return {};
+  if (index) {
+    event.flags |= kTraceEventHasIndex;
+    event.index = *index;
   }
-  int needed = WideCharToMultiByte(CP_UTF8, 0, text.c_str(), (int)text.size(), nullptr, 0, nullptr, nullptr);
-  if (needed <= 0) {
-    return {};
+  const bool sendData = status == ERROR_SUCCESS && data && cbData;
+  if (sendData) {
+    event.flags |= kTraceEventHasData;
   }
-  std::string out;
-  out.resize((size_t)needed);
-  WideCharToMultiByte(CP_UTF8, 0, text.c_str(), (int)text.size(), out.data(), needed, nullptr, nullptr);
-  return out;
+  WriteTraceEvent(event, keyPath, valueName, data, sendData && cbData <= kMaxTraceDataBytes ? cbData : 0);
 }
 
 } // namespace
@@ -243,243 +161,136 @@ InternalDispatchGuard::~InternalDispatchGuard() {
   g_internalDispatchDepth--;
 }
 
-std::wstring FormatRegType(DWORD type) {
-  switch (type) {
-    case REG_NONE:
-      return L"REG_NONE";
-    case REG_SZ:
-      return L"REG_SZ";
-    case REG_EXPAND_SZ:
-      return L"REG_EXPAND_SZ";
-    case REG_BINARY:
-      return L"REG_BINARY";
-    case REG_DWORD:
-      return L"REG_DWORD";
-    case REG_MULTI_SZ:
-      return L"REG_MULTI_SZ";
-    case REG_QWORD:
-      return L"REG_QWORD";
-    default:
-      return L"REG_" + std::to_wstring(type);
-  }
-}
-
-std::wstring FormatValuePreview(DWORD type, const BYTE* data, DWORD cbData) {
-  if (!data || cbData == 0) {
-    return L"<empty>";
-  }
-
-  if (type == REG_DWORD && cbData >= sizeof(uint32_t)) {
-    uint32_t value = 0;
-    std::memcpy(&value, data, sizeof(value));
-    return L"dword:" + std::to_wstring(value);
-  }
-  if (type == REG_QWORD && cbData >= sizeof(uint64_t)) {
-    uint64_t value = 0;
-    std::memcpy(&value, data, sizeof(value));
-    return L"qword:" + std::to_wstring(value);
-  }
-
-  if (type == REG_SZ || type == REG_EXPAND_SZ) {
-    const wchar_t* w = reinterpret_cast<const wchar_t*>(data);
-    size_t chars = cbData / sizeof(wchar_t);
-    size_t end = 0;
-    while (end < chars && w[end] != L'\0') {
-      end++;
-    }
-    std::wstring text(w, w + end);
-    return L"str:\"" + SanitizeForLog(text) + L"\"";
-  }
-
-  if (type == REG_MULTI_SZ) {
-    const wchar_t* w = reinterpret_cast<const wchar_t*>(data);
-    size_t chars = cbData / sizeof(wchar_t);
-    size_t i = 0;
-    std::vector<std::wstring> parts;
-    while (i < chars) {
-      size_t start = i;
-      while (i < chars && w[i] != L'\0') {
-        i++;
-      }
-      if (i == start) {
-        break;
-      }
-      parts.emplace_back(w + start, w + i);
-      i++;
-      if (parts.size() >= 2) {
-        break;
+void InitializeRegistryTrace() {
+  wchar_t tokenBuf[4096]{};
+  DWORD tokenLen =
+      GetEnvironmentVariableW(L"TWINSHIM_DEBUG_APIS", tokenBuf, (DWORD)(sizeof(tokenBuf) / sizeof(tokenBuf[0])));
+  if (!tokenLen || tokenLen >= (DWORD)(sizeof(tokenBuf) / sizeof(tokenBuf[0]))) {
+    tokenLen =
+        GetEnvironmentVariableW(L"HKLM_WRAPPER_DEBUG_APIS", tokenBuf, (DWORD)(sizeof(tokenBuf) / sizeof(tokenBuf[0])));
+  }
+  RegistryApiMask mask = 0;
+  if (tokenLen && tokenLen < (sizeof(tokenBuf) / sizeof(tokenBuf[0]))) {
+    mask = ParseRegistryApiList(std::wstring(tokenBuf, tokenBuf + tokenLen));
+  }
+
+  wchar_t filterBuf[4096]{};
+  const DWORD filterLen =
+      GetEnvironmentVariableW(L"TWINSHIM_DEBUG_FILTER", filterBuf, (DWORD)(sizeof(filterBuf) / sizeof(filterBuf[0])));
+  if (mask && filterLen && filterLen < (DWORD)(sizeof(filterBuf) / sizeof(filterBuf[0])) &&
+      !g_traceFilter.load(std::memory_order_acquire)) {
+    TraceFilterSpec spec;
+    std::wstring badClause;
+    if (!ParseTraceFilterSpec(std::wstring(filterBuf, filterLen), spec, &badClause)) {
+      if (IsShimTraceEnabled()) {
+        const std::string line =
+            "[shim] trace: ignoring TWINSHIM_DEBUG_FILTER, bad clause: " + WideToUtf8(badClause) + "\n";
+        ShimTraceWrite(line.c_str());
       }
+    } else if (!spec.Empty()) {
+      auto* filter = new TraceFilter();
+      filter->Configure(spec, kRegistryApiCount, CaptureTraceClock().ticksPerSecond);
+      g_traceFilter.store(filter, std::memory_order_release);
     }
-    std::wstring joined;
-    for (size_t idx = 0; idx < parts.size(); idx++) {
-      if (idx) {
-        joined += L"|";
-      }
-      joined += SanitizeForLog(parts[idx], 40);
-    }
-    if (joined.empty()) {
-      joined = L"<empty>";
-    }
-    if (parts.size() >= 2) {
-      joined += L"|...";
-    }
-    return L"multi:\"" + joined + L"\"";
   }
-
-  return L"hex:" + HexPreview(data, cbData);
+  g_traceMask.store(mask, std::memory_order_release);
 }
 
-bool IsRegistryTraceEnabledForApi(const wchar_t* apiName) {
-  if (g_internalDispatchDepth > 0) {
-    return false;
+void ReportRegistryTraceFilter() {
+  TraceFilter* filter = g_traceFilter.load(std::memory_order_acquire);
+  if (!filter || !IsShimTraceEnabled()) {
+    return;
   }
-  return ShouldTraceApi(apiName);
+  const TraceFilterCounters counters = filter->Counters();
+  char line[192];
+  std::snprintf(line, sizeof(line),
+                "[shim] trace: filter held back %llu events (%llu by key/result, %llu by sample=, %llu by rate limits)\n",
+                (unsigned long long)(counters.filtered + counters.sampledOut + counters.rateLimited),
+                (unsigned long long)counters.filtered, (unsigned long long)counters.sampledOut,
+                (unsigned long long)counters.rateLimited);
+  ShimTraceWrite(line);
 }
 
-std::wstring FormatValueForTrace(bool typeKnown, DWORD type, const BYTE* data, DWORD cbData, bool ansiStrings) {
-  if (!data || cbData == 0) {
-    return L"<empty>";
-  }
+bool IsRegistryTraceEnabledForApi(RegistryApi api) {
+  return (g_traceMask.load(std::memory_order_relaxed) & RegistryApiBit(api)) != 0 && g_internalDispatchDepth == 0;
+}
 
-  if (!typeKnown) {
-    return L"hex:" + HexEncodeAll(data, cbData);
+void NoteRegistryApiCall(RegistryApi api) {
+  if (g_internalDispatchDepth == 0) {
+    g_apiCalls.Add(api);
   }
+}
 
-  if (type == REG_DWORD && cbData >= sizeof(uint32_t)) {
-    uint32_t value = 0;
-    std::memcpy(&value, data, sizeof(value));
-    return L"dword:" + std::to_wstring(value);
-  }
-  if (type == REG_QWORD && cbData >= sizeof(uint64_t)) {
-    uint64_t value = 0;
-    std::memcpy(&value, data, sizeof(value));
-    return L"qword:" + std::to_wstring(value);
-  }
+uint64_t GetRegistryApiCallCount(RegistryApi api) {
+  return g_apiCalls.Get(api);
+}
 
-  if (type == REG_SZ || type == REG_EXPAND_SZ) {
-    if (ansiStrings) {
-      const char* bytes = reinterpret_cast<const char*>(data);
-      size_t end = 0;
-      while (end < cbData && bytes[end] != '\0') {
-        end++;
-      }
-      if (end == 0) {
-        return L"str:\"\"";
-      }
-      std::wstring text = AnsiBytesToWideBestEffort(bytes, (int)end);
-      if (text.empty()) {
-        return L"hex:" + HexPreview(data, cbData);
-      }
-      return L"str:\"" + SanitizeForLog(text, 512) + L"\"";
-    } else {
-      const wchar_t* w = reinterpret_cast<const wchar_t*>(data);
-      size_t chars = cbData / sizeof(wchar_t);
-      size_t end = 0;
-      while (end < chars && w[end] != L'\0') {
-        end++;
-      }
-      std::wstring text(w, w + end);
-      return L"str:\"" + SanitizeForLog(text, 512) + L"\"";
-    }
+void InitializeRegistryStats() {
+  static RegistryStatsMapping mapping;
+  if (g_statsBlock.load(std::memory_order_acquire)) {
+    return;
   }
-
-  if (type == REG_MULTI_SZ) {
-    std::wstring joined;
-    if (ansiStrings) {
-      const char* bytes = reinterpret_cast<const char*>(data);
-      size_t i = 0;
-      while (i < cbData) {
-        size_t start = i;
-        while (i < cbData && bytes[i] != '\0') {
-          i++;
-        }
-        if (i == start) {
-          break;
-        }
-        if (!joined.empty()) {
-          joined += L"|";
-        }
-        std::wstring part = AnsiBytesToWideBestEffort(bytes + start, (int)(i - start));
-        if (part.empty()) {
-          joined += L"<hex:" + HexPreview(reinterpret_cast<const BYTE*>(bytes + start), (DWORD)(i - start)) + L">";
-        } else {
-          joined += SanitizeForLog(part, 256);
-        }
-        // Skip the NUL separator.
-        i++;
-      }
-    } else {
-      const wchar_t* w = reinterpret_cast<const wchar_t*>(data);
-      size_t chars = cbData / sizeof(wchar_t);
-      size_t i = 0;
-      while (i < chars) {
-        size_t start = i;
-        while (i < chars && w[i] != L'\0') {
-          i++;
-        }
-        if (i == start) {
-          break;
-        }
-        if (!joined.empty()) {
-          joined += L"|";
-        }
-        joined += SanitizeForLog(std::wstring(w + start, w + i), 256);
-        i++;
-      }
-    }
-    if (joined.empty()) {
-      joined = L"<empty>";
-    }
-    return L"multi:\"" + joined + L"\"";
+  if (mapping.Create((uint32_t)GetCurrentProcessId())) {
+    g_statsBlock.store(mapping.Block(), std::memory_order_release);
   }
+}
 
-  return L"hex:" + HexEncodeAll(data, cbData);
+RegistryApiCallScope::RegistryApiCallScope(RegistryApi api)
+    : stats_(g_internalDispatchDepth == 0 ? g_statsBlock.load(std::memory_order_relaxed) : nullptr, api) {
+  NoteRegistryApiCall(api);
 }
 
-void TraceApiEvent(const wchar_t* apiName,
-                   const wchar_t* opType,
-                   const std::wstring& keyPath,
-                   const std::wstring& valueName,
-                   const std::wstring& valueData) {
-  if (g_internalDispatchDepth > 0 || !ShouldTraceApi(apiName)) {
+void TraceApiEvent(RegistryApi api, TraceOp op, const std::wstring& keyPath, const std::wstring& valueName) {
+  if (!IsRegistryTraceEnabledForApi(api) || !IsShimTraceEnabled() || !PassesTraceFilter(api, keyPath, nullptr)) {
     return;
   }
+  TraceEvent event;
+  event.api = (uint16_t)api;
+  event.op = op;
+  WriteTraceEvent(event, keyPath, valueName, nullptr, 0);
+}
 
-  SYSTEMTIME localTime{};
-  GetLocalTime(&localTime);
-  const std::wstring ts = L"(" +
-                          std::to_wstring((unsigned long)localTime.wHour / 10) + std::to_wstring((unsigned long)localTime.wHour % 10) + L":" +
-                          std::to_wstring((unsigned long)localTime.wMinute / 10) + std::to_wstring((unsigned long)localTime.wMinute % 10) + L":" +
-                          std::to_wstring((unsigned long)localTime.wSecond / 10) + std::to_wstring((unsigned long)localTime.wSecond % 10) + L"." +
-                          (localTime.wMilliseconds < 100 ? (localTime.wMilliseconds < 10 ? L"00" : L"0") : L"") +
-                          std::to_wstring((unsigned long)localTime.wMilliseconds) + L")";
-
-  std::lock_guard<std::mutex> lock(g_debugPipeMutex);
-  EnsureDebugPipeConnected();
-  if (g_debugPipe == INVALID_HANDLE_VALUE) {
+void TraceSetValueEvent(RegistryApi api,
+                        const std::wstring& keyPath,
+                        const std::wstring& valueName,
+                        DWORD type,
+                        const BYTE* data,
+                        DWORD cbData) {
+  if (!IsRegistryTraceEnabledForApi(api) || !IsShimTraceEnabled() || !PassesTraceFilter(api, keyPath, nullptr)) {
     return;
   }
+  TraceEvent event;
+  event.api = (uint16_t)api;
+  event.op = TraceOp::SetValue;
+  event.type = type;
+  event.cbData = data ? cbData : 0;
+  WriteTraceEvent(event, keyPath, valueName, data, event.cbData);
+}
 
-  const std::wstring lineW = ts + L" [" + std::to_wstring((unsigned long)GetCurrentProcessId()) + L":" +
-                             std::to_wstring((unsigned long)GetCurrentThreadId()) + L"] api=" +
-                             (apiName ? std::wstring(apiName) : L"Reg?") + L" op=" +
-                             (opType ? std::wstring(opType) : L"call") + L" key=\"" +
-                             SanitizeForLog(keyPath.empty() ? L"-" : keyPath) + L"\" name=\"" +
-                             SanitizeForLog(valueName.empty() ? L"-" : valueName) + L"\" value=\"" +
-                             SanitizeForLog(valueData.empty() ? L"-" : valueData) + L"\"\n";
-  std::string line = WideToUtf8(lineW);
-  if (line.empty()) {
+void TraceIndexEvent(RegistryApi api, TraceOp op, const std::wstring& keyPath, DWORD index) {
+  if (!IsRegistryTraceEnabledForApi(api) || !IsShimTraceEnabled() || !PassesTraceFilter(api, keyPath, nullptr)) {
     return;
   }
+  TraceEvent event;
+  event.api = (uint16_t)api;
+  event.op = op;
+  event.flags = kTraceEventHasIndex;
+  event.index = index;
+  WriteTraceEvent(event, keyPath, {}, nullptr, 0);
+}
 
-  DWORD written = 0;
-  if (!WriteFile(g_debugPipe, line.data(), (DWORD)line.size(), &written, nullptr)) {
-    CloseHandle(g_debugPipe);
-    g_debugPipe = INVALID_HANDLE_VALUE;
+void TraceNotifyEvent(RegistryApi api, const std::wstring& keyPath, bool watchSubtree) {
+  if (!IsRegistryTraceEnabledForApi(api) || !IsShimTraceEnabled() || !PassesTraceFilter(api, keyPath, nullptr)) {
+    return;
   }
+  TraceEvent event;
+  event.api = (uint16_t)api;
+  event.op = TraceOp::Notify;
+  event.flags = watchSubtree ? kTraceEventSubtree : 0;
+  WriteTraceEvent(event, keyPath, {}, nullptr, 0);
 }
 
-LONG TraceReadResultAndReturn(const wchar_t* apiName,
+LONG TraceReadResultAndReturn(RegistryApi api,
                               const std::wstring& keyPath,
                               const std::wstring& valueName,
                               LONG status,
@@ -488,34 +299,14 @@ LONG TraceReadResultAndReturn(const wchar_t* apiName,
                               const BYTE* data,
                               DWORD cbData,
                               bool sizeOnly) {
-  if (g_internalDispatchDepth > 0 || !ShouldTraceApi(apiName)) {
-    return status;
-  }
-  std::wstring value = L"rc=" + std::to_wstring((unsigned long)status);
-  if (typeKnown) {
-    value += L" type=" + FormatRegType(type);
+  if (IsRegistryTraceEnabledForApi(api)) {
+    TraceReadResult(api, TraceOp::QueryValue, keyPath, valueName, status, typeKnown, type, data, cbData, sizeOnly,
+                    nullptr);
   }
-  value += L" cb=" + std::to_wstring((unsigned long)cbData);
-
-  if (status == ERROR_SUCCESS) {
-    if (data && cbData) {
-      if (cbData <= kMaxTraceDataBytes) {
-        value += L" data=" + FormatValueForTrace(typeKnown, type, data, cbData, ApiUsesAnsiStrings(apiName));
-      } else {
-        value += L" <data_present>";
-      }
-    } else if (sizeOnly) {
-      value += L" <size_only>";
-    }
-  } else if (status == ERROR_MORE_DATA) {
-    value += L" <more_data>";
-  }
-
-  TraceApiEvent(apiName, L"query_value", keyPath, valueName, value);
   return status;
 }
 
-LONG TraceEnumReadResultAndReturn(const wchar_t* apiName,
+LONG TraceEnumReadResultAndReturn(RegistryApi api,
                                   const std::wstring& keyPath,
                                   DWORD index,
                                   const std::wstring& valueName,
@@ -525,32 +316,10 @@ LONG TraceEnumReadResultAndReturn(const wchar_t* apiName,
                                   const BYTE* data,
                                   DWORD cbData,
                                   bool sizeOnly) {
-  if (g_internalDispatchDepth > 0 || !ShouldTraceApi(apiName)) {
-    return status;
+  if (IsRegistryTraceEnabledForApi(api)) {
+    TraceReadResult(api, TraceOp::EnumValue, keyPath, valueName, status, typeKnown, type, data, cbData, sizeOnly,
+                    &index);
   }
-  std::wstring detail = L"idx=" + std::to_wstring((unsigned long)index) +
-                        L" rc=" + std::to_wstring((unsigned long)status);
-  if (typeKnown) {
-    detail += L" type=" + FormatRegType(type);
-  }
-  detail += L" cb=" + std::to_wstring((unsigned long)cbData);
-
-  if (status == ERROR_SUCCESS) {
-    if (data && cbData) {
-      if (cbData <= kMaxTraceDataBytes) {
-        detail += L" data=" + FormatValueForTrace(typeKnown, type, data, cbData, ApiUsesAnsiStrings(apiName));
-      } else {
-        detail += L" <data_present>";
-      }
-    } else if (sizeOnly) {
-      detail += L" <size_only>";
-    }
-  } else if (status == ERROR_MORE_DATA) {
-    detail += L" <more_data>";
-  }
-
-  std::wstring nameField = valueName.empty() ? (L"index:" + std::to_wstring((unsigned long)index)) : valueName;
-  TraceApiEvent(apiName, L"enum_value", keyPath, nameField, detail);
   return status;
 }
 
@@ -1,7 +1,12 @@
 #pragma once
 
+#include "common/registry_api_table.h"
+#include "common/registry_stats.h"
+#include "common/trace_record.h"
+
 #include <windows.h>
 
+#include <cstdint>
 #include <string>
 
 namespace twinshim {
@@ -12,20 +17,58 @@ class InternalDispatchGuard {
   ~InternalDispatchGuard();
 };
 
-std::wstring FormatRegType(DWORD type);
-std::wstring FormatValuePreview(DWORD type, const BYTE* data, DWORD cbData);
+// Resolves TWINSHIM_DEBUG_APIS into the per-API trace mask and
+// TWINSHIM_DEBUG_FILTER into the event selectors (common/trace_filter.h).
+// Must run before hooks are enabled; until then nothing is traced.
+void InitializeRegistryTrace();
+
+// Writes how many events the TWINSHIM_DEBUG_FILTER selectors held back.
+void ReportRegistryTraceFilter();
+
+// Returns true when registry API tracing is enabled for the given API: one
+// load of the precomputed mask. Intended for guarding expensive debug string
+// construction at call sites.
+bool IsRegistryTraceEnabledForApi(RegistryApi api);
+
+// Counts an application call to `api`. Calls made while an outer hook is
+// dispatching internally (e.g. RegOpenKeyW -> RegOpenKeyExW) are not counted.
+void NoteRegistryApiCall(RegistryApi api);
+uint64_t GetRegistryApiCallCount(RegistryApi api);
+
+// Publishes the per-API stats block for this process (see registry_stats.h).
+// Failure only disables stats; hooks work the same either way.
+void InitializeRegistryStats();
+
+// Placed at the top of every hook once bypass is ruled out: counts the call
+// and times it into the shared stats block for the rest of the hook's scope.
+class RegistryApiCallScope {
+ public:
+  explicit RegistryApiCallScope(RegistryApi api);
+
+ private:
+  RegistryStatsCall stats_;
+};
+
+// Registry trace events. Each one is a fixed-layout binary record (see
+// common/trace_record.h) with the key path and value name interned per
+// thread; the wrapper or `hklmreg trace-decode` renders them as text. Callers
+// guard with IsRegistryTraceEnabledForApi.
+void TraceApiEvent(RegistryApi api, TraceOp op, const std::wstring& keyPath, const std::wstring& valueName = {});
+
+// A write; the record carries a prefix of the stored bytes for the preview.
+void TraceSetValueEvent(RegistryApi api,
+                        const std::wstring& keyPath,
+                        const std::wstring& valueName,
+                        DWORD type,
+                        const BYTE* data,
+                        DWORD cbData);
 
-// Returns true when registry API tracing is enabled for the given API name.
-// This is intended for guarding expensive debug string construction at call sites.
-bool IsRegistryTraceEnabledForApi(const wchar_t* apiName);
+// An enumeration call before it runs (name="index" value=<index>).
+void TraceIndexEvent(RegistryApi api, TraceOp op, const std::wstring& keyPath, DWORD index);
 
-void TraceApiEvent(const wchar_t* apiName,
-                   const wchar_t* opType,
-                   const std::wstring& keyPath,
-                   const std::wstring& valueName,
-                   const std::wstring& valueData);
+void TraceNotifyEvent(RegistryApi api, const std::wstring& keyPath, bool watchSubtree);
 
-LONG TraceReadResultAndReturn(const wchar_t* apiName,
+LONG TraceReadResultAndReturn(RegistryApi api,
                               const std::wstring& keyPath,
                               const std::wstring& valueName,
                               LONG status,
@@ -35,7 +78,7 @@ LONG TraceReadResultAndReturn(const wchar_t* apiName,
                               DWORD cbData,
                               bool sizeOnly);
 
-LONG TraceEnumReadResultAndReturn(const wchar_t* apiName,
+LONG TraceEnumReadResultAndReturn(RegistryApi api,
                                   const std::wstring& keyPath,
                                   DWORD index,
                                   const std::wstring& valueName,
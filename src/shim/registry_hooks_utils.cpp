@@ -4,35 +4,6 @@
 
 namespace twinshim {
 
-std::wstring CanonicalizeSubKey(const std::wstring& s) {
-  std::wstring out = s;
-  while (!out.empty() && (out.front() == L'\\' || out.front() == L'/')) {
-    out.erase(out.begin());
-  }
-  while (!out.empty() && (out.back() == L'\\' || out.back() == L'/')) {
-    out.pop_back();
-  }
-  for (auto& ch : out) {
-    if (ch == L'/') {
-      ch = L'\\';
-    }
-  }
-  return out;
-}
-
-std::wstring JoinKeyPath(const std::wstring& base, const std::wstring& sub) {
-  if (sub.empty()) {
-    return base;
-  }
-  if (base.empty()) {
-    return sub;
-  }
-  if (base.back() == L'\\') {
-    return base + sub;
-  }
-  return base + L"\\" + sub;
-}
-
 std::wstring AnsiToWide(const char* s, int len) {
   if (!s) {
     return {};
@@ -54,6 +25,20 @@ std::wstring AnsiToWide(const char* s, int len) {
   return out;
 }
 
+std::string WideToAnsi(const std::wstring& s) {
+  if (s.empty()) {
+    return {};
+  }
+  int needed = WideCharToMultiByte(CP_ACP, 0, s.c_str(), (int)s.size(), nullptr, 0, nullptr, nullptr);
+  if (needed <= 0) {
+    return {};
+  }
+  std::string out;
+  out.resize((size_t)needed);
+  WideCharToMultiByte(CP_ACP, 0, s.c_str(), (int)s.size(), out.data(), needed, nullptr, nullptr);
+  return out;
+}
+
 bool TryReadWideString(const wchar_t* s, std::wstring& out) {
   out.clear();
   if (!s) {
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "common/registry_path.h"
+
 #include <windows.h>
 
 #include <cstdint>
@@ -8,9 +10,8 @@
 
 namespace twinshim {
 
-std::wstring CanonicalizeSubKey(const std::wstring& s);
-std::wstring JoinKeyPath(const std::wstring& base, const std::wstring& sub);
 std::wstring AnsiToWide(const char* s, int len);
+std::string WideToAnsi(const std::wstring& s);
 bool TryReadWideString(const wchar_t* s, std::wstring& out);
 bool TryAnsiToWideString(const char* s, std::wstring& out);
 std::wstring CaseFold(const std::wstring& s);
@@ -0,0 +1,100 @@
+// --- Workload capture (TWINSHIM_RECORD) ---
+//
+// When TWINSHIM_RECORD names a file, every HKLM call an application makes is
+// appended to a RegistryWorkloadWriter log for offline replay with
+// twinshim_replay. Capture happens at the Hook_* entry points so it sees the
+// caller's own arguments and final status, and costs one relaxed load per call
+// when recording is off.
+
+RegistryWorkloadWriter g_workload;
+std::atomic<bool> g_workloadActive{false};
+
+void StartWorkloadRecording() {
+  wchar_t pathBuf[1024]{};
+  const DWORD n = GetEnvironmentVariableCompat(
+      L"TWINSHIM_RECORD", nullptr, pathBuf, (DWORD)(sizeof(pathBuf) / sizeof(pathBuf[0])));
+  if (!n) {
+    return;
+  }
+  if (g_workload.Open(std::wstring(pathBuf, pathBuf + n))) {
+    g_workloadActive.store(true, std::memory_order_release);
+  }
+}
+
+void StopWorkloadRecording() {
+  g_workloadActive.store(false, std::memory_order_release);
+  g_workload.Close();
+}
+
+template <typename Api>
+class WorkloadCall {
+ public:
+  WorkloadCall(RegistryApi api,
+               HKEY hKey,
+               const typename Api::Char* subKey,
+               const typename Api::Char* valueName,
+               const void* data,
+               const DWORD* cbData) {
+    if (!g_workloadActive.load(std::memory_order_relaxed) || g_bypass) {
+      return;
+    }
+    if (Api::ReadString(subKey, subKey_) && Api::ReadString(valueName, valueName_)) {
+      Begin(api, hKey, data, cbData);
+    }
+  }
+
+  // RegQueryMultipleValues: the requested names are recorded NUL-separated.
+  WorkloadCall(RegistryApi api,
+               HKEY hKey,
+               const typename Api::ValEnt* valList,
+               DWORD numVals,
+               const void* data,
+               const DWORD* cbData) {
+    if (!g_workloadActive.load(std::memory_order_relaxed) || g_bypass || (!valList && numVals)) {
+      return;
+    }
+    std::wstring name;
+    for (DWORD i = 0; i < numVals; i++) {
+      if (!Api::ReadString(valList[i].ve_valuename, name)) {
+        return;
+      }
+      if (i) {
+        valueName_.push_back(L'\0');
+      }
+      valueName_ += name;
+    }
+    Begin(api, hKey, data, cbData);
+  }
+
+  // Appends the call with its result and returns `status` unchanged.
+  LONG Done(LONG status, const DWORD* cbData = nullptr, const DWORD* type = nullptr) {
+    if (!active_) {
+      return status;
+    }
+    op_.durationNs = (uint32_t)std::min<uint64_t>(g_workload.ElapsedNs() - op_.startNs, UINT32_MAX);
+    op_.status = (int32_t)status;
+    op_.dataSize = cbData ? *cbData : 0;
+    op_.type = type ? *type : 0;
+    g_workload.Append(op_, keyPath_, subKey_, valueName_);
+    return status;
+  }
+
+ private:
+  void Begin(RegistryApi api, HKEY hKey, const void* data, const DWORD* cbData) {
+    keyPath_ = KeyPathFromHandle(hKey);
+    if (keyPath_.empty()) {
+      return;
+    }
+    active_ = true;
+    op_.api = api;
+    op_.flags = data ? kWorkloadHasBuffer : 0;
+    op_.bufferSize = cbData ? *cbData : 0;
+    op_.startNs = g_workload.ElapsedNs();
+  }
+
+  bool active_ = false;
+  RegistryWorkloadOp op_;
+  std::wstring keyPath_;
+  std::wstring subKey_;
+  std::wstring valueName_;
+};
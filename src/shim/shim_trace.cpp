@@ -0,0 +1,154 @@
+#include "shim/shim_trace.h"
+
+#include "common/launch_timeline.h"
+#include "common/trace_record.h"
+#include "common/trace_transport.h"
+
+#include <windows.h>
+
+#include <atomic>
+#include <cstring>
+#include <cwchar>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace twinshim {
+namespace {
+
+std::once_flag g_traceInit;
+// Never destroyed: the drain thread may outlive static destruction at unload.
+// It can't be joined from DllMain either (its exit waits on the loader lock),
+// so starting it pins the shim in memory instead; see Trace().
+std::atomic<TraceTransport*> g_trace{nullptr};
+
+// Forwards batches to the debug pipe and, while a debugger is attached, to
+// OutputDebugStringA (which the subsystems used to call per line). Only
+// batches seen while attached are decoded, so names interned before the
+// debugger arrived show up as <str:N> there; the pipe gets everything.
+class DebugPipeSink : public TraceSink {
+public:
+  DebugPipeSink(std::unique_ptr<TraceSink> pipe, const std::string& clock) : pipe_(std::move(pipe)) {
+    decoder_.Feed(clock.data(), clock.size(), echo_);
+  }
+
+  bool Write(const char* data, size_t size) override {
+    if (IsDebuggerPresent()) {
+      echo_.clear();
+      decoder_.Feed(data, size, echo_);
+      if (!echo_.empty()) {
+        OutputDebugStringA(echo_.c_str());
+      }
+    }
+    return pipe_->Write(data, size);
+  }
+
+private:
+  std::unique_ptr<TraceSink> pipe_;
+  TraceDecoder decoder_;
+  std::string echo_;
+};
+
+std::wstring DebugPipeName() {
+  wchar_t pipeBuf[512]{};
+  DWORD pipeLen =
+      GetEnvironmentVariableW(L"TWINSHIM_DEBUG_PIPE", pipeBuf, (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0])));
+  if (!pipeLen || pipeLen >= (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0]))) {
+    pipeLen =
+        GetEnvironmentVariableW(L"HKLM_WRAPPER_DEBUG_PIPE", pipeBuf, (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0])));
+  }
+  if (!pipeLen || pipeLen >= (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0]))) {
+    return {};
+  }
+  return std::wstring(pipeBuf, pipeBuf + pipeLen);
+}
+
+TraceTransport* Trace() {
+  std::call_once(g_traceInit, [] {
+    char clockRecord[64];
+    const std::string clock(clockRecord, EncodeTraceClock(CaptureTraceClock(), clockRecord, sizeof(clockRecord)));
+    auto pipe = MakePipeTraceSink(DebugPipeName(), clock);
+    if (!pipe) {
+      return;
+    }
+    auto* trace = new TraceTransport();
+    if (trace->Start(std::make_unique<DebugPipeSink>(std::move(pipe), clock))) {
+      // FreeLibrary would otherwise unmap the code the drain thread runs.
+      HMODULE self = nullptr;
+      GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN,
+                         reinterpret_cast<LPCWSTR>(&Trace),
+                         &self);
+      g_trace.store(trace, std::memory_order_release);
+    } else {
+      delete trace;
+    }
+  });
+  return g_trace.load(std::memory_order_acquire);
+}
+
+} // namespace
+
+bool IsShimTraceEnabled() {
+  return Trace() != nullptr;
+}
+
+void ShimTraceWrite(const char* text) {
+  if (text && *text) {
+    ShimTraceWrite(text, std::strlen(text));
+  }
+}
+
+void ShimTraceWrite(const char* text, size_t size) {
+  auto* trace = Trace();
+  if (!trace) {
+    return;
+  }
+  thread_local std::string record;
+  if (EncodeTraceText(TraceThreadId(), TraceTicks(), text, size, record)) {
+    trace->Write(record);
+  }
+}
+
+bool ShimTraceWriteRecord(const void* record, size_t size) {
+  auto* trace = Trace();
+  return trace && trace->Write(record, size);
+}
+
+void FlushShimTrace() {
+  // Doesn't start the transport: this runs at unload.
+  if (auto* trace = g_trace.load(std::memory_order_acquire)) {
+    trace->Flush();
+  }
+}
+
+bool GetShimTraceCounters(TraceTransportCounters& out) {
+  auto* trace = g_trace.load(std::memory_order_acquire);
+  if (!trace) {
+    return false;
+  }
+  out = trace->Counters();
+  return true;
+}
+
+LaunchTimeline& ShimLaunchTimeline() {
+  // Never destroyed, like the transport: init threads may still record spans
+  // during unload.
+  static LaunchTimeline* timeline = [] {
+    auto* recorder = new LaunchTimeline();
+    wchar_t buf[16]{};
+    const DWORD n = GetEnvironmentVariableW(L"TWINSHIM_TIMELINE", buf, (DWORD)(sizeof(buf) / sizeof(buf[0])));
+    const unsigned long pid = n && n < (DWORD)(sizeof(buf) / sizeof(buf[0])) ? wcstoul(buf, nullptr, 10) : 0;
+    if (pid) {
+      auto* mapping = new LaunchTimelineMapping();
+      if (mapping->Open((uint32_t)pid)) {
+        recorder->Attach(mapping->Block());
+      } else {
+        delete mapping;
+      }
+    }
+    return recorder;
+  }();
+  return *timeline;
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+
+namespace twinshim {
+
+struct TraceTransportCounters;
+class LaunchTimeline;
+
+// One trace facility for every shim subsystem. Records go into the calling
+// thread's ring and a single drain thread forwards them in batches over one
+// persistent connection to the wrapper's debug pipe (TWINSHIM_DEBUG_PIPE, set
+// by --debug); with a debugger attached each batch is decoded and echoed to it
+// as well. The stream is binary (common/trace_record.h): registry events are
+// encoded by registry_hooks_trace.cpp, text lines travel as Text records.
+// Writers never block on the pipe: when a ring is full the record is dropped
+// and counted.
+
+// True when the wrapper asked for debug output. Reads the environment once.
+bool IsShimTraceEnabled();
+
+// Queues `text` (one or more complete lines) for the debug pipe.
+void ShimTraceWrite(const char* text);
+void ShimTraceWrite(const char* text, size_t size);
+
+// Queues one already encoded record; false if it was dropped.
+bool ShimTraceWriteRecord(const void* record, size_t size);
+
+// Pushes everything queued so far to the pipe from the calling thread. Used at
+// unload; the drain thread itself lives until the process exits.
+void FlushShimTrace();
+
+// Transport counters (drops, batches, bytes); false until something was traced.
+bool GetShimTraceCounters(TraceTransportCounters& out);
+
+// The launch timeline shared with `twinshim_cli --timings`
+// (common/launch_timeline.h). TWINSHIM_TIMELINE carries the wrapper's pid; the
+// mapping is opened on first use and stays mapped. Without it the recorder is
+// disabled and spans cost nothing.
+LaunchTimeline& ShimLaunchTimeline();
+
+}
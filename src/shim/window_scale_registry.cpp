@@ -1,5 +1,7 @@
 #include "shim/window_scale_registry.h"
 
+#include "shim/shim_trace.h"
+
 #include <mutex>
 #include <unordered_map>
 #include <atomic>
@@ -36,46 +38,8 @@ static bool IsMouseDebugEnabled() {
   return on;
 }
 
-static bool IsTwinShimDebugEnabled() {
-  // Only set by the wrapper when launched with --debug.
-  wchar_t dummy[2] = {};
-  DWORD n = GetEnvironmentVariableW(L"TWINSHIM_DEBUG_PIPE", dummy, (DWORD)(sizeof(dummy) / sizeof(dummy[0])));
-  if (n) {
-    return true;
-  }
-  n = GetEnvironmentVariableW(L"HKLM_WRAPPER_DEBUG_PIPE", dummy, (DWORD)(sizeof(dummy) / sizeof(dummy[0])));
-  return n != 0;
-}
-
-static void TraceWrite(const char* text) {
-  if (!IsTwinShimDebugEnabled()) {
-    return;
-  }
-  if (!text || !*text) {
-    return;
-  }
-  OutputDebugStringA(text);
-
-  wchar_t pipeBuf[512] = {};
-  DWORD pipeLen = GetEnvironmentVariableW(L"TWINSHIM_DEBUG_PIPE", pipeBuf, (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0])));
-  if (!pipeLen || pipeLen >= (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0]))) {
-    pipeLen = GetEnvironmentVariableW(L"HKLM_WRAPPER_DEBUG_PIPE", pipeBuf, (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0])));
-  }
-  if (!pipeLen || pipeLen >= (DWORD)(sizeof(pipeBuf) / sizeof(pipeBuf[0]))) {
-    return;
-  }
-  pipeBuf[pipeLen] = L'\0';
-  HANDLE h = CreateFileW(pipeBuf, GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
-  if (h == INVALID_HANDLE_VALUE) {
-    return;
-  }
-  DWORD written = 0;
-  WriteFile(h, text, (DWORD)lstrlenA(text), &written, nullptr);
-  CloseHandle(h);
-}
-
 static void Tracef(const char* fmt, ...) {
-  if (!IsTwinShimDebugEnabled()) {
+  if (!IsShimTraceEnabled()) {
     return;
   }
   if (!fmt || !*fmt) {
@@ -103,7 +67,7 @@ static void Tracef(const char* fmt, ...) {
       buf[len + 1] = '\0';
     }
   }
-  TraceWrite(buf);
+  ShimTraceWrite(buf);
 }
 
 static bool IsValidDims(int w, int h) {
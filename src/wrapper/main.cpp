@@ -1,6 +1,13 @@
 #include "common/arg_quote.h"
+#include "common/launch_timeline.h"
 #include "common/local_registry_store.h"
 #include "common/path_util.h"
+#include "common/registry_overlay_engine.h"
+#include "common/registry_stats.h"
+#include "common/trace_collector.h"
+#include "common/trace_filter.h"
+#include "common/trace_record.h"
+#include "common/wait_set.h"
 #include "common/win32_error.h"
 
 #include "wrapper/ddraw_devices.h"
@@ -11,6 +18,7 @@
 #include <windows.h>
 #include <shellapi.h>
 
+#include <iostream>
 #include <string>
 #include <vector>
 #include <cwctype>
@@ -19,6 +27,7 @@
 #include <thread>
 #include <sstream>
 #include <atomic>
+#include <chrono>
 
 using namespace twinshim;
 
@@ -147,16 +156,52 @@ static const wchar_t* GetWrapperExeNameForUsage() {
 static std::wstring BuildUsageMessage() {
   const std::wstring exe = GetWrapperExeNameForUsage();
   return L"Usage:\n"
-         L"  " + exe + L" [--db <path>] [--debug <api1,api2,...|all>] [--readthrough] [--scale <1.1-100>] [--scale-method <point|bilinear|bicubic|cr|catmull-rom|lanczos|lanczos3|pixfast>] <target_exe> [target arguments...]\n"
+         L"  " + exe + L" [--db <path>] [--debug <api1,api2,...|all>] [--debug-filter <spec>] [--debug-out <file> [--debug-out-max <MB>]] [--readthrough] [--store-budget <ms>[,<ms>]] [--ready <hooks|warm>] [--record <file>] [--timings] [--timings-json <file>] [--scale <1.1-100>] [--scale-method <point|bilinear|bicubic|cr|catmull-rom|lanczos|lanczos3|pixfast>] <target_exe> [target arguments...]\n"
          L"  " + exe + L" [--db <path>] --list-devices\n"
          L"  " + exe + L" [--db <path>] --json-devices\n"
-         L"  " + exe + L" [--db <path>] --device\n\n"
+         L"  " + exe + L" [--db <path>] --device\n"
+         L"  " + exe + L" --stats <pid> [--interval <ms>]\n\n"
          L"Device options:\n"
          L"  --list-devices  Enumerate all D3D devices via ddraw.dll and print their GUIDs.\n"
          L"  --json-devices  Same as --list-devices but output as a JSON array for\n"
          L"                  programmatic consumption.\n"
          L"  --device        Select the best hardware device and save its GUID to the\n"
          L"                  HKLM registry store under Software\\RuneBreakers\\Ragnarok.\n\n"
+         L"Store options:\n"
+         L"  --store-budget <read>[,<write>]\n"
+         L"                  Longest a registry call waits (ms) for another process\n"
+         L"                  holding the store; past it reads fall back to cached\n"
+         L"                  values (never past a local deletion) and writes are\n"
+         L"                  queued, then committed in the background. 0 waits up\n"
+         L"                  to 5 s. One number sets both. Default: 20 for reads,\n"
+         L"                  0 for writes.\n"
+         L"  --ready <hooks|warm>\n"
+         L"                  Resume the target once registry hooks are installed\n"
+         L"                  (hooks; the store then warms in the background) or once\n"
+         L"                  the store is also open and read into cache (warm).\n\n"
+         L"Diagnostics:\n"
+         L"  --debug-filter <spec>\n"
+         L"                  Narrow --debug to some registry events. ';'-separated:\n"
+         L"                  key=<prefix>|!<prefix>  result=miss|error|ok  sample=<N>\n"
+         L"                  rate=<per second per API>  keyrate=<per second per key>\n"
+         L"  --debug-out <file>\n"
+         L"                  With --debug, save the shim's binary trace stream to a\n"
+         L"                  file instead of printing it; decode it later with\n"
+         L"                  hklmreg trace-decode <file> [--json].\n"
+         L"  --debug-out-max <MB>\n"
+         L"                  Start a new --debug-out file past this size; the last\n"
+         L"                  four are kept as <file>.1 (newest) to <file>.4. Each\n"
+         L"                  file decodes on its own.\n"
+         L"  --record <file> Capture a binary log of the target's registry calls for\n"
+         L"                  offline replay with twinshim_replay.\n"
+         L"  --timings       After the target exits, print how long each launch phase\n"
+         L"                  took in the wrapper and in the shim (create, inject,\n"
+         L"                  hook install, store open, ...).\n"
+         L"  --timings-json <file>\n"
+         L"                  Save the same spans as Chrome trace JSON (chrome://tracing,\n"
+         L"                  ui.perfetto.dev).\n"
+         L"  --stats <pid>   Live per-API registry call counts and latency percentiles of\n"
+         L"                  a running shimmed process (console build only).\n\n"
          L"Examples:\n"
          L"  " + exe + L" C:\\Apps\\TargetApp.exe\n"
          L"  " + exe + L" --db .\\HKLM.sqlite C:\\Apps\\TargetApp.exe\n"
@@ -165,14 +210,23 @@ static std::wstring BuildUsageMessage() {
          L"  " + exe + L" C:\\Apps\\TargetApp.exe --mode test --config \"C:\\path with spaces\\cfg.json\"\n"
          L"  " + exe + L" --list-devices\n"
          L"  " + exe + L" --json-devices\n"
-         L"  " + exe + L" --db .\\HKLM.sqlite --device";
+         L"  " + exe + L" --db .\\HKLM.sqlite --device\n"
+         L"  " + exe + L" --stats 4242";
 }
 
 static int ParseLaunchArguments(std::wstring& targetExe,
                                 std::vector<std::wstring>& forwardedArgs,
                                 std::wstring& debugApisCsv,
+                                std::wstring& debugFilterArg,
+                                std::wstring& debugOutArg,
+                                uint64_t& debugOutMaxBytes,
                                 std::wstring& dbPathArg,
                                 bool& readThrough,
+                                std::wstring& storeBudgetArg,
+                                std::wstring& readyArg,
+                                std::wstring& recordPathArg,
+                                bool& timings,
+                                std::wstring& timingsJsonArg,
                                 std::wstring& scaleArg,
                                 std::wstring& scaleMethodArg) {
   const std::vector<std::wstring> rawArgs = GetRawArgs();
@@ -197,6 +251,56 @@ static int ParseLaunchArguments(std::wstring& targetExe,
       i += 2;
       continue;
     }
+    if (rawArgs[i] == L"--debug-filter") {
+      if (i + 1 >= rawArgs.size()) {
+        ShowError(L"Missing value for --debug-filter.");
+        return 1;
+      }
+      TraceFilterSpec spec;
+      std::wstring badClause;
+      if (!ParseTraceFilterSpec(rawArgs[i + 1], spec, &badClause)) {
+        ShowError(L"Invalid --debug-filter clause: " + badClause +
+                  L"\nExpected key=<prefix>|!<prefix>, result=miss|error|ok, sample=<N>, rate=<N> or keyrate=<N>.");
+        return 1;
+      }
+      debugFilterArg = rawArgs[i + 1];
+      i += 2;
+      continue;
+    }
+    if (rawArgs[i] == L"--debug-out") {
+      if (i + 1 >= rawArgs.size()) {
+        ShowError(L"Missing value for --debug-out.");
+        return 1;
+      }
+      debugOutArg = rawArgs[i + 1];
+      i += 2;
+      continue;
+    }
+    if (rawArgs[i] == L"--debug-out-max") {
+      wchar_t* end = nullptr;
+      const unsigned long long mb = i + 1 < rawArgs.size() ? wcstoull(rawArgs[i + 1].c_str(), &end, 10) : 0;
+      if (mb == 0 || mb > 1024 * 1024 || !end || *end != L'\0') {
+        ShowError(L"Invalid --debug-out-max. Expected a size in MB.");
+        return 1;
+      }
+      debugOutMaxBytes = (uint64_t)mb * 1024 * 1024;
+      i += 2;
+      continue;
+    }
+    if (rawArgs[i] == L"--timings") {
+      timings = true;
+      i += 1;
+      continue;
+    }
+    if (rawArgs[i] == L"--timings-json") {
+      if (i + 1 >= rawArgs.size()) {
+        ShowError(L"Missing value for --timings-json.");
+        return 1;
+      }
+      timingsJsonArg = rawArgs[i + 1];
+      i += 2;
+      continue;
+    }
     if (rawArgs[i] == L"--db") {
       if (i + 1 >= rawArgs.size()) {
         ShowError(L"Missing value for --db.");
@@ -211,6 +315,35 @@ static int ParseLaunchArguments(std::wstring& targetExe,
       i += 1;
       continue;
     }
+    if (rawArgs[i] == L"--store-budget") {
+      std::chrono::milliseconds read{0};
+      std::chrono::milliseconds write{0};
+      if (i + 1 >= rawArgs.size() || !ParseStoreBudgets(rawArgs[i + 1], read, write)) {
+        ShowError(L"Invalid --store-budget. Expected <read ms>[,<write ms>].");
+        return 1;
+      }
+      storeBudgetArg = rawArgs[i + 1];
+      i += 2;
+      continue;
+    }
+    if (rawArgs[i] == L"--ready") {
+      if (i + 1 >= rawArgs.size() || (rawArgs[i + 1] != L"hooks" && rawArgs[i + 1] != L"warm")) {
+        ShowError(L"Invalid --ready. Expected hooks or warm.");
+        return 1;
+      }
+      readyArg = rawArgs[i + 1];
+      i += 2;
+      continue;
+    }
+    if (rawArgs[i] == L"--record") {
+      if (i + 1 >= rawArgs.size()) {
+        ShowError(L"Missing value for --record.");
+        return 1;
+      }
+      recordPathArg = rawArgs[i + 1];
+      i += 2;
+      continue;
+    }
 
     auto startsWith = [](const std::wstring& s, const std::wstring& prefix) {
       return s.rfind(prefix, 0) == 0;
@@ -381,7 +514,10 @@ static bool EnsureStdoutBoundToConsole() {
   return true;
 }
 
-static HANDLE CreateProcessTrackingJob() {
+// The job posts its JOB_OBJECT_MSG_* notifications to `port`. The port is
+// associated before any process joins, so no exit can go unreported.
+static HANDLE CreateProcessTrackingJob(HANDLE& port) {
+  port = nullptr;
   HANDLE job = CreateJobObjectW(nullptr, nullptr);
   if (!job) {
     return nullptr;
@@ -394,90 +530,100 @@ static HANDLE CreateProcessTrackingJob() {
     return nullptr;
   }
 
+  HANDLE completionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+  JOBOBJECT_ASSOCIATE_COMPLETION_PORT association{};
+  association.CompletionKey = job;
+  association.CompletionPort = completionPort;
+  if (!completionPort ||
+      !SetInformationJobObject(job, JobObjectAssociateCompletionPortInformation, &association, sizeof(association))) {
+    if (completionPort) {
+      CloseHandle(completionPort);
+    }
+    CloseHandle(job);
+    return nullptr;
+  }
+
+  port = completionPort;
   return job;
 }
 
-static bool WaitForJobToDrain(HANDLE job) {
-  if (!job) {
+// Sleeps in GetQueuedCompletionStatus until the job reports that its last
+// process exited; nothing wakes the wrapper before then. The port is
+// associated before any process joins the job, so ACTIVE_PROCESS_ZERO can't
+// be missed once one has; the process count is checked up front for a job
+// that never got one (a failed or raced assignment).
+static bool WaitForJobToDrain(HANDLE job, HANDLE port) {
+  if (!job || !port) {
     return false;
   }
 
+  JOBOBJECT_BASIC_ACCOUNTING_INFORMATION accounting{};
+  if (QueryInformationJobObject(job, JobObjectBasicAccountingInformation, &accounting, sizeof(accounting), nullptr) &&
+      accounting.ActiveProcesses == 0) {
+    return true;
+  }
+
   while (true) {
-    JOBOBJECT_BASIC_ACCOUNTING_INFORMATION info{};
-    if (!QueryInformationJobObject(job, JobObjectBasicAccountingInformation, &info, sizeof(info), nullptr)) {
+    DWORD message = 0;
+    ULONG_PTR key = 0;
+    LPOVERLAPPED overlapped = nullptr;
+    if (!GetQueuedCompletionStatus(port, &message, &key, &overlapped, INFINITE)) {
       return false;
     }
-    if (info.ActiveProcesses == 0) {
+    if (key == reinterpret_cast<ULONG_PTR>(job) && message == JOB_OBJECT_MSG_ACTIVE_PROCESS_ZERO) {
       return true;
     }
-    Sleep(50);
   }
 }
 
+// Receives the binary trace streams (common/trace_record.h) of the target and
+// every child it starts, and prints them decoded or, with --debug-out, writes
+// them undecoded to a file. Each shim process gets its own pipe instance, so a
+// busy child never waits behind another process's connection.
 struct DebugPipeBridge {
-  HANDLE pipe = INVALID_HANDLE_VALUE;
-  std::thread reader;
+  TraceCollector collector;
+  TraceCollectorServer server;
   std::wstring pipeName;
-  std::atomic<bool> stopping{false};
 
-  bool Start() {
-    wchar_t pipePath[256]{};
-    swprintf_s(pipePath, L"\\\\.\\pipe\\twinshim_debug_%lu", GetCurrentProcessId());
-    pipeName = pipePath;
-
-    pipe = CreateNamedPipeW(pipeName.c_str(),
-                            PIPE_ACCESS_INBOUND,
-                            PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT,
-                            1,
-                            4096,
-                            4096,
-                            0,
-                            nullptr);
-    if (pipe == INVALID_HANDLE_VALUE) {
+  bool Start(const std::wstring& rawOutPath, uint64_t rotateBytes) {
+    TraceCollectorOptions options;
+    options.console = stdout;
+    options.rawPath = rawOutPath;
+    options.rotateBytes = rotateBytes;
+    if (!collector.Start(options)) {
       return false;
     }
 
-    reader = std::thread([this] {
-      while (!stopping.load()) {
-        BOOL connected = ConnectNamedPipe(pipe, nullptr);
-        if (!connected && GetLastError() != ERROR_PIPE_CONNECTED) {
-          if (stopping.load()) {
-            break;
-          }
-          Sleep(10);
-          continue;
-        }
-
-        char buffer[1024];
-        while (!stopping.load()) {
-          DWORD bytesRead = 0;
-          if (!ReadFile(pipe, buffer, (DWORD)sizeof(buffer), &bytesRead, nullptr) || bytesRead == 0) {
-            break;
-          }
-          fwrite(buffer, 1, bytesRead, stdout);
-          fflush(stdout);
-        }
-        DisconnectNamedPipe(pipe);
-      }
-    });
-    return true;
+    wchar_t pipePath[256]{};
+    swprintf_s(pipePath, L"\\\\.\\pipe\\twinshim_debug_%lu", GetCurrentProcessId());
+    pipeName = pipePath;
+    return server.Start(pipeName, collector);
   }
 
   void Stop() {
-    stopping.store(true);
-    if (pipe != INVALID_HANDLE_VALUE && !pipeName.empty()) {
-      HANDLE unblockClient = CreateFileW(pipeName.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
-      if (unblockClient != INVALID_HANDLE_VALUE) {
-        CloseHandle(unblockClient);
-      }
+    server.Stop();
+    collector.Stop();
+  }
+
+  std::wstring Summary() const {
+    const TraceCollectorStats stats = collector.Stats();
+    std::wstringstream out;
+    out << L"debug collector: " << stats.clients << L" connection(s) (peak " << stats.peakClients << L"), "
+        << stats.records << L" records, " << stats.bytesIn << L" bytes in, " << stats.batches << L" writes, "
+        << stats.bytesOut << L" bytes out";
+    if (stats.rotations) {
+      out << L", " << stats.rotations << L" rotation(s)";
     }
-    if (reader.joinable()) {
-      reader.join();
+    if (stats.malformed) {
+      out << L", " << stats.malformed << L" malformed";
     }
-    if (pipe != INVALID_HANDLE_VALUE) {
-      CloseHandle(pipe);
-      pipe = INVALID_HANDLE_VALUE;
+    if (stats.bytesLost) {
+      out << L", " << stats.bytesLost << L" bytes lost";
     }
+    if (stats.stalls) {
+      out << L", output stalled " << stats.stalls << L" time(s) for " << stats.stallMicros / 1000 << L" ms";
+    }
+    return out.str();
   }
 
   ~DebugPipeBridge() {
@@ -485,6 +631,33 @@ struct DebugPipeBridge {
   }
 };
 
+// --timings / --timings-json: the spans the wrapper and the shim recorded.
+static void ReportLaunchTimeline(const LaunchTimeline& timeline,
+                                 DWORD targetPid,
+                                 bool printTable,
+                                 const std::wstring& jsonPath) {
+  const std::vector<LaunchSpan> spans = timeline.Spans();
+  if (printTable && EnsureStdoutBoundToConsole()) {
+    std::wstring table = FormatLaunchTimeline(
+        spans, timeline.TicksPerSecond(), {{GetCurrentProcessId(), L"wrapper"}, {targetPid, L"target"}});
+    if (timeline.Dropped()) {
+      table += std::to_wstring(timeline.Dropped()) + L" span(s) did not fit in the timeline.\n";
+    }
+    fwprintf(stdout, L"[TwinShim] launch timeline:\n%ls", table.c_str());
+    fflush(stdout);
+  }
+  if (!jsonPath.empty()) {
+    const std::string json = FormatLaunchTimelineChromeTrace(spans, timeline.TicksPerSecond());
+    FILE* out = _wfopen(jsonPath.c_str(), L"wb");
+    if (!out || fwrite(json.data(), 1, json.size(), out) != json.size()) {
+      ShowError(L"Failed to write --timings-json file: " + jsonPath);
+    }
+    if (out) {
+      fclose(out);
+    }
+  }
+}
+
 // --------------------------------------------------------------------------
 // --list-devices / --device  (D3D device enumeration via ddraw.dll)
 // --------------------------------------------------------------------------
@@ -656,6 +829,46 @@ static int HandleDeviceCommands() {
   return 0;
 }
 
+// Handle --stats <pid> [--interval <ms>]: sample the shim's shared-memory
+// stats block until the target exits. Returns -1 when --stats is absent.
+static int HandleStatsCommand() {
+  const std::vector<std::wstring> rawArgs = GetRawArgs();
+
+  std::wstring pidArg;
+  RegistryStatsViewerOptions options;
+  bool statsRequested = false;
+  for (size_t i = 0; i < rawArgs.size(); i++) {
+    if (rawArgs[i] == L"--stats") {
+      statsRequested = true;
+      if (i + 1 < rawArgs.size()) {
+        pidArg = rawArgs[++i];
+      }
+    } else if (rawArgs[i] == L"--interval" && i + 1 < rawArgs.size()) {
+      options.intervalMs = (uint32_t)std::wcstoul(rawArgs[++i].c_str(), nullptr, 10);
+    }
+  }
+  if (!statsRequested) {
+    return -1;
+  }
+
+#if defined(HKLM_WRAPPER_CONSOLE_APP)
+  wchar_t* end = nullptr;
+  const unsigned long pid = pidArg.empty() ? 0 : std::wcstoul(pidArg.c_str(), &end, 10);
+  if (pid == 0 || (end && *end != L'\0')) {
+    ShowError(L"Missing or invalid value for --stats. Expected a process id.");
+    return 2;
+  }
+  if (options.intervalMs == 0) {
+    options.intervalMs = 1000;
+  }
+  EnsureStdoutBoundToConsole();
+  return RunRegistryStatsViewer((uint32_t)pid, options, std::wcout);
+#else
+  ShowError(L"--stats is only supported in the console (CLI) build.");
+  return 1;
+#endif
+}
+
 // --------------------------------------------------------------------------
 
 static std::wstring DefaultWorkingDirForTarget(const std::wstring& targetExe) {
@@ -746,28 +959,42 @@ int wmain() {
 #else
 int WINAPI wWinMain(HINSTANCE, HINSTANCE, PWSTR, int) {
 #endif
-  // Handle --list-devices / --device early (these exit without launching a
-  // target process).
+  // Handle --list-devices / --device / --stats early (these exit without
+  // launching a target process).
   {
     int deviceResult = HandleDeviceCommands();
     if (deviceResult >= 0) {
       return deviceResult;
     }
+    int statsResult = HandleStatsCommand();
+    if (statsResult >= 0) {
+      return statsResult;
+    }
   }
 
   std::wstring targetExe;
   std::vector<std::wstring> args;
   std::wstring debugApisCsv;
+  std::wstring debugFilterArg;
+  std::wstring debugOutArg;
+  uint64_t debugOutMaxBytes = 0;
   std::wstring dbPathArg;
   bool readThrough = false;
+  std::wstring storeBudgetArg;
+  std::wstring readyArg;
+  std::wstring recordPathArg;
+  bool timings = false;
+  std::wstring timingsJsonArg;
   std::wstring scaleArg;
   std::wstring scaleMethodArg;
-  int parseResult = ParseLaunchArguments(targetExe, args, debugApisCsv, dbPathArg, readThrough, scaleArg, scaleMethodArg);
+  int parseResult = ParseLaunchArguments(
+      targetExe, args, debugApisCsv, debugFilterArg, debugOutArg, debugOutMaxBytes, dbPathArg, readThrough, storeBudgetArg, readyArg, recordPathArg, timings, timingsJsonArg, scaleArg, scaleMethodArg);
   if (parseResult >= 0) {
     return parseResult;
   }
 
   const bool traceEnabled = !debugApisCsv.empty();
+  const uint64_t launchStart = TraceTicks();
 
   const std::wstring wrapperDir = GetDirectoryName(GetModulePath());
   const std::wstring cwd = GetCurrentDirectoryPath();
@@ -783,6 +1010,24 @@ int WINAPI wWinMain(HINSTANCE, HINSTANCE, PWSTR, int) {
 
   SetEnvVarCompat(L"TWINSHIM_DB_PATH", L"HKLM_WRAPPER_DB_PATH", dbPath.c_str());
   SetEnvVarCompat(L"TWINSHIM_READTHROUGH", L"HKLM_WRAPPER_READTHROUGH", readThrough ? L"1" : nullptr);
+  SetEnvVarCompat(L"TWINSHIM_STORE_BUDGET_MS", nullptr, storeBudgetArg.empty() ? nullptr : storeBudgetArg.c_str());
+  SetEnvVarCompat(L"TWINSHIM_READY_AFTER", nullptr, readyArg.empty() ? nullptr : readyArg.c_str());
+  if (!recordPathArg.empty()) {
+    const std::wstring recordPath =
+        IsAbsolutePath(recordPathArg) ? NormalizeSlashes(recordPathArg) : CombinePath(cwd, recordPathArg);
+    SetEnvVarCompat(L"TWINSHIM_RECORD", nullptr, recordPath.c_str());
+  }
+
+  // The shim adds its spans to the same block (TWINSHIM_TIMELINE).
+  LaunchTimelineMapping timelineMapping;
+  if ((timings || !timingsJsonArg.empty()) && !timelineMapping.Create(GetCurrentProcessId())) {
+    ShowError(L"Failed to create the launch timeline for --timings: " + FormatWin32Error(GetLastError()));
+    return 7;
+  }
+  LaunchTimeline timeline(timelineMapping.Block());
+  SetEnvVarCompat(L"TWINSHIM_TIMELINE",
+                  nullptr,
+                  timeline.Enabled() ? std::to_wstring(GetCurrentProcessId()).c_str() : nullptr);
 
   // Also export surface scaling config via environment variables so any injected
   // components (shim, dgVoodoo add-on, etc) can read it reliably.
@@ -795,29 +1040,37 @@ int WINAPI wWinMain(HINSTANCE, HINSTANCE, PWSTR, int) {
 
   DebugPipeBridge debugBridge;
   HANDLE hookReadyEvent = nullptr;
-  if (!debugApisCsv.empty()) {
-    if (!EnsureStdoutBoundToConsole()) {
-      ShowError(L"Failed to bind stdout to console for --debug mode.");
-      return 4;
-    }
-    TraceLine(L"debug mode enabled", traceEnabled);
-
+  if (!debugApisCsv.empty() || !readyArg.empty()) {
     // Create a named event that the injected shim will signal when hook
-    // installation finishes. This avoids races where the target runs/exits
-    // before hooks are active (especially in fast workflow tests).
+    // installation (or, with --ready warm, store warm-up) finishes. This
+    // avoids races where the target runs/exits before hooks are active
+    // (especially in fast workflow tests).
     const std::wstring hookReadyEventName = MakeHookReadyEventName();
     hookReadyEvent = CreateEventW(nullptr, TRUE, FALSE, hookReadyEventName.c_str());
     if (hookReadyEvent) {
       SetEnvVarCompat(L"TWINSHIM_HOOK_READY_EVENT", L"HKLM_WRAPPER_HOOK_READY_EVENT", hookReadyEventName.c_str());
     }
+  }
+  if (!debugApisCsv.empty()) {
+    if (!EnsureStdoutBoundToConsole()) {
+      ShowError(L"Failed to bind stdout to console for --debug mode.");
+      return 4;
+    }
+    TraceLine(L"debug mode enabled", traceEnabled);
 
-    if (!debugBridge.Start()) {
-      std::wstring msg = L"Failed to create debug pipe: " + FormatWin32Error(GetLastError());
+    const std::wstring debugOutPath = debugOutArg.empty() || IsAbsolutePath(debugOutArg)
+                                          ? NormalizeSlashes(debugOutArg)
+                                          : CombinePath(cwd, debugOutArg);
+    if (!debugBridge.Start(debugOutPath, debugOutMaxBytes)) {
+      std::wstring msg = (debugBridge.pipeName.empty() ? L"Failed to open --debug-out file: "
+                                                       : L"Failed to create debug pipe: ") +
+                         FormatWin32Error(GetLastError());
       ShowError(msg);
       return 5;
     }
     TraceLineLazy(traceEnabled, [&] { return L"debug pipe created: " + debugBridge.pipeName; });
     SetEnvVarCompat(L"TWINSHIM_DEBUG_APIS", L"HKLM_WRAPPER_DEBUG_APIS", debugApisCsv.c_str());
+    SetEnvVarCompat(L"TWINSHIM_DEBUG_FILTER", nullptr, debugFilterArg.empty() ? nullptr : debugFilterArg.c_str());
     SetEnvVarCompat(L"TWINSHIM_DEBUG_PIPE", L"HKLM_WRAPPER_DEBUG_PIPE", debugBridge.pipeName.c_str());
   }
 
@@ -845,6 +1098,7 @@ int WINAPI wWinMain(HINSTANCE, HINSTANCE, PWSTR, int) {
 #endif
 
   DWORD flags = CREATE_SUSPENDED | CREATE_UNICODE_ENVIRONMENT;
+  uint32_t span = timeline.Begin("wrapper: CreateProcessW");
   BOOL ok = CreateProcessW(
       targetExe.c_str(),
       mutableCmd.data(),
@@ -856,6 +1110,7 @@ int WINAPI wWinMain(HINSTANCE, HINSTANCE, PWSTR, int) {
       workDir.empty() ? nullptr : workDir.c_str(),
       &si,
       &pi);
+  timeline.End(span);
 
   if (!ok) {
     auto err = GetLastError();
@@ -876,7 +1131,10 @@ int WINAPI wWinMain(HINSTANCE, HINSTANCE, PWSTR, int) {
 
   TraceLineLazy(traceEnabled, [&] { return L"injecting shim: " + shimPath; });
 
-  if (!InjectDllIntoProcess(pi.hProcess, shimPath)) {
+  span = timeline.Begin("wrapper: inject shim");
+  const bool injected = InjectDllIntoProcess(pi.hProcess, shimPath);
+  timeline.End(span);
+  if (!injected) {
     DWORD injectErr = GetLastError();
     TerminateProcess(pi.hProcess, 1);
     CloseHandle(pi.hThread);
@@ -890,10 +1148,23 @@ int WINAPI wWinMain(HINSTANCE, HINSTANCE, PWSTR, int) {
 
   if (hookReadyEvent) {
     TraceLine(L"waiting for shim hook-ready signal", traceEnabled);
-    DWORD waitRc = WaitForSingleObject(hookReadyEvent, 2000);
-    if (waitRc == WAIT_OBJECT_0) {
-      TraceLine(L"shim hook-ready signaled", traceEnabled);
-    } else if (waitRc == WAIT_TIMEOUT) {
+    // Warm-up reads the store from disk; give it longer than hook install.
+    const ULONGLONG waitStart = GetTickCount64();
+    span = timeline.Begin("wrapper: wait for hook-ready");
+    // Also wake if the target dies first (e.g. the shim crashed it), rather
+    // than sitting out the timeout.
+    WaitSet readyWait;
+    readyWait.Add(hookReadyEvent);
+    readyWait.Add(pi.hProcess);
+    const size_t waitRc = readyWait.Wait(readyArg == L"warm" ? 10000 : 2000);
+    timeline.End(span);
+    if (waitRc == 0) {
+      TraceLineLazy(traceEnabled, [&] {
+        return L"shim hook-ready signaled after " + std::to_wstring(GetTickCount64() - waitStart) + L" ms";
+      });
+    } else if (waitRc == 1) {
+      TraceLine(L"target exited before the shim signaled hook-ready", traceEnabled);
+    } else if (waitRc == WaitSet::kTimeout) {
       TraceLine(L"timed out waiting for shim hook-ready signal", traceEnabled);
     } else {
       TraceLineLazy(traceEnabled, [&] { return L"failed waiting for shim hook-ready signal: " + FormatWin32Error(GetLastError()); });
@@ -901,28 +1172,33 @@ int WINAPI wWinMain(HINSTANCE, HINSTANCE, PWSTR, int) {
   }
 
   HANDLE debugJob = nullptr;
+  HANDLE debugJobPort = nullptr;
   bool trackWithDebugJob = false;
   bool waitedForJob = false;
   if (!debugApisCsv.empty()) {
-    debugJob = CreateProcessTrackingJob();
+    debugJob = CreateProcessTrackingJob(debugJobPort);
     if (debugJob && AssignProcessToJobObject(debugJob, pi.hProcess)) {
       trackWithDebugJob = true;
     }
   }
 
   ResumeThread(pi.hThread);
+  const uint64_t resumedAt = TraceTicks();
+  timeline.Record("wrapper: launch", launchStart, resumedAt);
   TraceLine(L"target resumed", traceEnabled);
   CloseHandle(pi.hThread);
 
   if (trackWithDebugJob) {
     TraceLine(L"waiting for job-tracked process tree to exit", traceEnabled);
     if (debugJob) {
-      waitedForJob = WaitForJobToDrain(debugJob);
+      waitedForJob = WaitForJobToDrain(debugJob, debugJobPort);
     }
   }
   if (debugJob) {
     CloseHandle(debugJob);
+    CloseHandle(debugJobPort);
     debugJob = nullptr;
+    debugJobPort = nullptr;
   }
 
   if (!waitedForJob) {
@@ -930,7 +1206,15 @@ int WINAPI wWinMain(HINSTANCE, HINSTANCE, PWSTR, int) {
     WaitForSingleObject(pi.hProcess, INFINITE);
   }
   TraceLine(L"wait complete; stopping debug pipe bridge", traceEnabled);
+  timeline.Record("target: run", resumedAt, TraceTicks());
   debugBridge.Stop();
+  TraceLineLazy(traceEnabled, [&] { return debugBridge.Summary(); });
+  if (timeline.Enabled()) {
+    const std::wstring timingsJsonPath = timingsJsonArg.empty() || IsAbsolutePath(timingsJsonArg)
+                                             ? NormalizeSlashes(timingsJsonArg)
+                                             : CombinePath(cwd, timingsJsonArg);
+    ReportLaunchTimeline(timeline, pi.dwProcessId, timings, timingsJsonPath);
+  }
   DWORD exitCode = 0;
   GetExitCodeProcess(pi.hProcess, &exitCode);
 
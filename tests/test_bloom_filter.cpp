@@ -0,0 +1,63 @@
+#include "common/bloom_filter.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdint>
+
+using namespace twinshim;
+
+namespace {
+
+uint64_t Item(uint64_t i) {
+  // Sequential inputs, as a weak caller hash might produce.
+  return i * 0x9E3779B97F4A7C15ull;
+}
+
+} // namespace
+
+TEST_CASE("BloomFilter never loses an added hash", "[bloom]") {
+  BloomFilter filter;
+  // An unsized filter vouches for nothing.
+  CHECK(filter.Empty());
+  CHECK(filter.MayContain(Item(1)));
+  CHECK_FALSE(filter.Add(Item(1)));
+
+  filter.Reset(1000);
+  CHECK_FALSE(filter.Empty());
+  CHECK(filter.Capacity() >= 1000);
+  for (uint64_t i = 0; i < 1000; i++) {
+    filter.Add(Item(i));
+  }
+  for (uint64_t i = 0; i < 1000; i++) {
+    CHECK(filter.MayContain(Item(i)));
+  }
+  // Re-adding a present hash doesn't count against the capacity.
+  const size_t count = filter.Count();
+  CHECK_FALSE(filter.Add(Item(7)));
+  CHECK(filter.Count() == count);
+}
+
+TEST_CASE("BloomFilter false positives stay rare up to capacity", "[bloom]") {
+  BloomFilter filter;
+  filter.Reset(10000);
+  for (uint64_t i = 0; i < filter.Capacity(); i++) {
+    filter.Add(Item(i));
+  }
+  CHECK_FALSE(filter.Saturated());
+
+  size_t falsePositives = 0;
+  for (uint64_t i = 0; i < 100000; i++) {
+    falsePositives += filter.MayContain(Item(1000000 + i)) ? 1 : 0;
+  }
+  // ~1% expected; allow generous slack.
+  CHECK(falsePositives < 3000);
+
+  for (uint64_t i = 0; !filter.Saturated(); i++) {
+    filter.Add(Item(2000000 + i));
+  }
+  CHECK(filter.Count() > filter.Capacity());
+
+  filter.Clear();
+  CHECK(filter.Empty());
+  CHECK(filter.Count() == 0);
+}
@@ -0,0 +1,178 @@
+#include "scale/filter_weights.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+using namespace twinshim;
+
+namespace {
+
+constexpr ScaleFilter kAllFilters[] = {
+    ScaleFilter::kPoint,
+    ScaleFilter::kBilinear,
+    ScaleFilter::kBicubic,
+    ScaleFilter::kCatmullRom,
+    ScaleFilter::kLanczos2,
+    ScaleFilter::kLanczos3,
+};
+
+// Upscales, downscales, identity, coprime sizes and sizes smaller than the
+// filter support.
+const std::pair<int, int> kSizes[] = {
+    {320, 640}, {640, 1920}, {640, 480}, {1024, 333}, {37, 37}, {7, 101}, {101, 7}, {1, 5}, {3, 2}, {2, 3}, {640, 1919},
+};
+
+const int16_t* Row(const FilterWeightTable& t, int i) {
+  return t.weights.data() + (size_t)i * (size_t)t.taps;
+}
+
+// Output i's weight for source sample s; rows may pad on either side, so
+// compare by position rather than by tap index.
+int WeightAt(const FilterWeightTable& t, int i, int s) {
+  const int k = s - t.first[(size_t)i];
+  return (k >= 0 && k < t.taps) ? Row(t, i)[k] : 0;
+}
+
+} // namespace
+
+TEST_CASE("Every output's weights sum to exactly one and stay inside the source", "[filter_weights]") {
+  for (const auto& size : kSizes) {
+    for (ScaleFilter filter : kAllFilters) {
+      const FilterWeightTable t = BuildFilterWeightTable(size.first, size.second, filter);
+      INFO(ScaleFilterName(filter) << " " << size.first << " -> " << size.second);
+      REQUIRE(t.taps > 0);
+      REQUIRE(t.first.size() == (size_t)size.second);
+      REQUIRE(t.weights.size() == (size_t)size.second * (size_t)t.taps);
+      CHECK(t.taps <= size.first);
+      bool normalized = true;
+      bool inside = true;
+      for (int i = 0; i < t.dstSize; i++) {
+        const int16_t* w = Row(t, i);
+        normalized = normalized && std::accumulate(w, w + t.taps, 0) == kFilterWeightOne;
+        inside = inside && t.first[(size_t)i] >= t.sourceBegin && t.first[(size_t)i] + t.taps <= t.sourceEnd;
+      }
+      CHECK(normalized);
+      CHECK(inside);
+      CHECK(t.sourceBegin >= 0);
+      CHECK(t.sourceEnd <= size.first);
+    }
+  }
+}
+
+TEST_CASE("Weight tables are mirror symmetric", "[filter_weights]") {
+  for (const auto& size : kSizes) {
+    for (ScaleFilter filter : kAllFilters) {
+      const FilterWeightTable t = BuildFilterWeightTable(size.first, size.second, filter);
+      INFO(ScaleFilterName(filter) << " " << size.first << " -> " << size.second);
+      bool mirrored = true;
+      for (int i = 0; i < t.dstSize; i++) {
+        const int j = t.dstSize - 1 - i;
+        if (i == j && filter == ScaleFilter::kPoint) {
+          continue; // may sit exactly between two samples and has to pick one
+        }
+        for (int s = t.first[(size_t)i]; s < t.first[(size_t)i] + t.taps; s++) {
+          const int diff = std::abs(WeightAt(t, i, s) - WeightAt(t, j, t.srcSize - 1 - s));
+          // Only the self-mirrored middle output may split a tie unevenly.
+          mirrored = mirrored && (diff == 0 || (i == j && diff <= 1));
+        }
+      }
+      CHECK(mirrored);
+    }
+  }
+}
+
+TEST_CASE("Unclipped outputs of the same phase share their weights", "[filter_weights]") {
+  for (ScaleFilter filter : kAllFilters) {
+    for (const auto& size : {std::pair<int, int>{320, 960}, std::pair<int, int>{640, 1024}, std::pair<int, int>{900, 600}}) {
+      const FilterWeightTable t = BuildFilterWeightTable(size.first, size.second, filter);
+      const int g = std::gcd(size.first, size.second);
+      INFO(ScaleFilterName(filter) << " " << size.first << " -> " << size.second);
+      CHECK(t.phases == size.second / g);
+      const int step = size.first / g;
+      bool shared = true;
+      for (int i = 0; i + t.phases < t.dstSize; i++) {
+        const int j = i + t.phases;
+        // Keep well away from the clipped edges.
+        if (t.first[(size_t)i] < t.taps || t.first[(size_t)j] + 2 * t.taps > t.srcSize) {
+          continue;
+        }
+        for (int s = t.first[(size_t)i] - t.taps; s < t.first[(size_t)i] + 2 * t.taps; s++) {
+          shared = shared && WeightAt(t, i, s) == WeightAt(t, j, s + step);
+        }
+      }
+      CHECK(shared);
+    }
+  }
+}
+
+TEST_CASE("Known weights for point and bilinear", "[filter_weights]") {
+  const FilterWeightTable point = BuildFilterWeightTable(4, 8, ScaleFilter::kPoint);
+  REQUIRE(point.taps == 1);
+  for (int i = 0; i < 8; i++) {
+    CHECK(point.first[(size_t)i] == i / 2);
+    CHECK(point.weights[(size_t)i] == kFilterWeightOne);
+  }
+
+  // 2x bilinear: interior outputs sit a quarter pixel from a source centre.
+  const FilterWeightTable bilinear = BuildFilterWeightTable(8, 16, ScaleFilter::kBilinear);
+  CHECK(bilinear.phases == 2);
+  bool quarters = true;
+  for (int i = 1; i < 15; i++) {
+    const int16_t* w = Row(bilinear, i);
+    int16_t big = 0;
+    int16_t small = kFilterWeightOne;
+    for (int k = 0; k < bilinear.taps; k++) {
+      if (w[k] != 0) {
+        big = std::max(big, w[k]);
+        small = std::min(small, w[k]);
+      }
+    }
+    quarters = quarters && big == 3 * kFilterWeightOne / 4 && small == kFilterWeightOne / 4;
+  }
+  CHECK(quarters);
+
+  // Scale 1 with an interpolating filter is the identity.
+  const FilterWeightTable same = BuildFilterWeightTable(9, 9, ScaleFilter::kLanczos3);
+  bool identity = true;
+  for (int i = 0; i < 9; i++) {
+    for (int k = 0; k < same.taps; k++) {
+      identity = identity && Row(same, i)[k] == ((same.first[(size_t)i] + k == i) ? kFilterWeightOne : 0);
+    }
+  }
+  CHECK(identity);
+
+  CHECK(BuildFilterWeightTable(0, 4, ScaleFilter::kBilinear).taps == 0);
+  CHECK(BuildFilterWeightTable(4, -1, ScaleFilter::kBilinear).taps == 0);
+}
+
+TEST_CASE("FilterWeightCache reuses tables and evicts the least recently used", "[filter_weights]") {
+  FilterWeightCache cache(2);
+  const auto a = cache.Get(640, 1280, ScaleFilter::kLanczos3);
+  REQUIRE(a);
+  CHECK(a->srcSize == 640);
+  CHECK(a->dstSize == 1280);
+  CHECK(cache.Get(640, 1280, ScaleFilter::kLanczos3) == a);
+  CHECK(cache.Hits() == 1);
+  CHECK(cache.Misses() == 1);
+
+  const auto b = cache.Get(480, 960, ScaleFilter::kLanczos2);
+  REQUIRE(b);
+  CHECK(b->filter == ScaleFilter::kLanczos2);
+  CHECK(cache.Get(640, 1280, ScaleFilter::kLanczos3) == a); // a is now the most recent
+  cache.Get(640, 1280, ScaleFilter::kBilinear);             // evicts b
+  CHECK(cache.Size() == 2);
+  const uint64_t misses = cache.Misses();
+  CHECK(cache.Get(640, 1280, ScaleFilter::kLanczos3) == a);
+  CHECK(cache.Misses() == misses);
+  CHECK(cache.Get(480, 960, ScaleFilter::kLanczos2) != b);
+  CHECK(cache.Misses() == misses + 1);
+
+  CHECK_FALSE(cache.Get(0, 10, ScaleFilter::kBilinear));
+  cache.Clear();
+  CHECK(cache.Size() == 0);
+}
@@ -0,0 +1,177 @@
+#include "scale/image_scale.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdint>
+#include <vector>
+
+using namespace twinshim;
+
+namespace {
+
+constexpr ScaleFilter kAllFilters[] = {
+    ScaleFilter::kPoint,
+    ScaleFilter::kBilinear,
+    ScaleFilter::kBicubic,
+    ScaleFilter::kCatmullRom,
+    ScaleFilter::kLanczos2,
+    ScaleFilter::kLanczos3,
+};
+
+struct Image {
+  int width = 0;
+  int height = 0;
+  ptrdiff_t pitch = 0;
+  std::vector<uint8_t> pixels;
+
+  Image(int w, int h, int padBytes = 0) : width(w), height(h), pitch((ptrdiff_t)w * 4 + padBytes) {
+    pixels.assign((size_t)pitch * (size_t)h, 0xCD);
+  }
+
+  uint8_t* At(int x, int y) { return pixels.data() + (ptrdiff_t)y * pitch + x * 4; }
+  ImageView View() const { return {pixels.data(), width, height, pitch}; }
+  MutableImageView Mutable() { return {pixels.data(), width, height, pitch}; }
+
+  // Only the visible part of each row; padding is not compared.
+  std::vector<uint8_t> Packed() const {
+    std::vector<uint8_t> out;
+    for (int y = 0; y < height; y++) {
+      const uint8_t* row = pixels.data() + (ptrdiff_t)y * pitch;
+      out.insert(out.end(), row, row + width * 4);
+    }
+    return out;
+  }
+};
+
+Image Noise(int w, int h, uint32_t seed, int padBytes = 0) {
+  Image img(w, h, padBytes);
+  uint32_t state = seed;
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w * 4; x++) {
+      state = state * 1664525u + 1013904223u;
+      img.At(0, y)[x] = (uint8_t)(state >> 24);
+    }
+  }
+  return img;
+}
+
+} // namespace
+
+TEST_CASE("Every SIMD kernel set matches the scalar one bit for bit", "[scale]") {
+  const std::vector<ScaleIsa> isas = SupportedScaleIsas();
+  REQUIRE(!isas.empty());
+  CHECK(isas.front() == ScaleIsa::kScalar);
+  CHECK(BestScaleIsa() == isas.back());
+
+  struct Case {
+    int srcW, srcH, dstW, dstH;
+  };
+  // Odd widths exercise every tail; shrinking widens the filters.
+  const Case cases[] = {
+      {17, 13, 61, 47},
+      {64, 48, 160, 120},
+      {33, 9, 7, 30},
+      {1, 1, 5, 3},
+      {50, 40, 11, 8},
+      {8, 8, 8, 8},
+  };
+  for (const auto& c : cases) {
+    const Image src = Noise(c.srcW, c.srcH, (uint32_t)(c.srcW * 31 + c.dstW), 12);
+    for (ScaleFilter filter : kAllFilters) {
+      Image expected(c.dstW, c.dstH, 4);
+      ImageScaler scalar(ScaleIsa::kScalar);
+      REQUIRE(scalar.Scale(src.View(), expected.Mutable(), filter));
+      for (ScaleIsa isa : isas) {
+        Image actual(c.dstW, c.dstH, 4);
+        ImageScaler scaler(isa);
+        INFO(ScaleIsaName(isa) << " " << ScaleFilterName(filter) << " " << c.srcW << "x" << c.srcH << " -> " << c.dstW
+                               << "x" << c.dstH);
+        REQUIRE(scaler.Scale(src.View(), actual.Mutable(), filter));
+        CHECK(actual.Packed() == expected.Packed());
+      }
+    }
+  }
+}
+
+TEST_CASE("Scaling keeps flat colour flat and leaves row padding alone", "[scale]") {
+  Image src(23, 19);
+  for (int y = 0; y < src.height; y++) {
+    for (int x = 0; x < src.width; x++) {
+      uint8_t* p = src.At(x, y);
+      p[0] = 10;
+      p[1] = 128;
+      p[2] = 250;
+      p[3] = 255;
+    }
+  }
+  for (ScaleFilter filter : kAllFilters) {
+    for (ScaleIsa isa : SupportedScaleIsas()) {
+      for (const auto& size : {std::pair<int, int>{97, 71}, std::pair<int, int>{5, 4}}) {
+        Image dst(size.first, size.second, 8);
+        ImageScaler scaler(isa);
+        REQUIRE(scaler.Scale(src.View(), dst.Mutable(), filter));
+        INFO(ScaleIsaName(isa) << " " << ScaleFilterName(filter));
+        bool flat = true;
+        for (int y = 0; y < dst.height; y++) {
+          for (int x = 0; x < dst.width; x++) {
+            const uint8_t* p = dst.At(x, y);
+            flat = flat && p[0] == 10 && p[1] == 128 && p[2] == 250 && p[3] == 255;
+          }
+          const uint8_t* pad = dst.At(dst.width, y);
+          flat = flat && pad[0] == 0xCD && pad[7] == 0xCD;
+        }
+        CHECK(flat);
+      }
+    }
+  }
+}
+
+TEST_CASE("Interpolating filters reproduce the source at scale 1 and point replicates", "[scale]") {
+  const Image src = Noise(29, 21, 7);
+  for (ScaleFilter filter :
+       {ScaleFilter::kPoint, ScaleFilter::kBilinear, ScaleFilter::kCatmullRom, ScaleFilter::kLanczos2, ScaleFilter::kLanczos3}) {
+    Image same(29, 21);
+    REQUIRE(ScaleImage(src.View(), same.Mutable(), filter));
+    INFO(ScaleFilterName(filter));
+    CHECK(same.Packed() == src.Packed());
+  }
+
+  // Mitchell-Netravali is a smoothing filter: not the identity.
+  Image smoothed(29, 21);
+  REQUIRE(ScaleImage(src.View(), smoothed.Mutable(), ScaleFilter::kBicubic));
+  CHECK(smoothed.Packed() != src.Packed());
+
+  Image doubled(58, 42);
+  REQUIRE(ScaleImage(src.View(), doubled.Mutable(), ScaleFilter::kPoint));
+  bool replicated = true;
+  for (int y = 0; y < doubled.height; y++) {
+    for (int x = 0; x < doubled.width; x++) {
+      for (int c = 0; c < 4; c++) {
+        replicated = replicated && doubled.At(x, y)[c] == src.pixels[(size_t)(y / 2) * (size_t)src.pitch + (size_t)(x / 2) * 4 + c];
+      }
+    }
+  }
+  CHECK(replicated);
+}
+
+TEST_CASE("ImageScaler rejects empty or inconsistent views", "[scale]") {
+  Image src(4, 4);
+  Image dst(8, 8);
+  ImageScaler scaler(ScaleIsa::kScalar);
+  CHECK_FALSE(scaler.Scale(ImageView{}, dst.Mutable(), ScaleFilter::kBilinear));
+  CHECK_FALSE(scaler.Scale(src.View(), MutableImageView{}, ScaleFilter::kBilinear));
+  ImageView shortPitch = src.View();
+  shortPitch.pitch = 8;
+  CHECK_FALSE(scaler.Scale(shortPitch, dst.Mutable(), ScaleFilter::kBilinear));
+  CHECK(scaler.Scale(src.View(), dst.Mutable(), ScaleFilter::kBilinear));
+
+  // A kernel set this build or CPU lacks is refused rather than run.
+  for (ScaleIsa isa : {ScaleIsa::kSse2, ScaleIsa::kAvx2, ScaleIsa::kNeon}) {
+    bool supported = false;
+    for (ScaleIsa s : SupportedScaleIsas()) {
+      supported = supported || s == isa;
+    }
+    ImageScaler other(isa);
+    CHECK(other.Scale(src.View(), dst.Mutable(), ScaleFilter::kBilinear) == supported);
+  }
+}
@@ -0,0 +1,88 @@
+#include "scale/image_worker_pool.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+using namespace twinshim;
+
+TEST_CASE("ParallelFor runs every task exactly once", "[worker_pool]") {
+  for (int workers : {0, 1, 3, 7}) {
+    ImageWorkerPool pool(workers, false);
+    REQUIRE(pool.Concurrency() == workers + 1);
+    for (int count : {0, 1, 2, 7, 1000}) {
+      INFO("workers=" << workers << " count=" << count);
+      std::vector<std::atomic<int>> runs((size_t)count);
+      std::atomic<bool> participantsInRange{true};
+      pool.ParallelFor(count, [&](int task, int participant) {
+        runs[(size_t)task].fetch_add(1);
+        if (participant < 0 || participant >= pool.Concurrency()) {
+          participantsInRange = false;
+        }
+      });
+      bool once = true;
+      for (const auto& r : runs) {
+        once = once && r.load() == 1;
+      }
+      CHECK(once);
+      CHECK(participantsInRange);
+    }
+  }
+}
+
+TEST_CASE("ParallelFor can be called repeatedly and from several threads", "[worker_pool]") {
+  ImageWorkerPool pool(3, false);
+  std::atomic<int> total{0};
+  auto caller = [&] {
+    for (int i = 0; i < 50; i++) {
+      pool.ParallelFor(17, [&](int, int) { total.fetch_add(1); });
+    }
+  };
+  std::thread a(caller);
+  std::thread b(caller);
+  caller();
+  a.join();
+  b.join();
+  CHECK(total.load() == 3 * 50 * 17);
+}
+
+TEST_CASE("Idle participants steal from a slow one", "[worker_pool]") {
+  ImageWorkerPool pool(1, false);
+  // The caller starts with [0, 32), all slow; the worker's [32, 64) is
+  // instant, so it runs out and has to take work from the caller.
+  std::vector<std::atomic<int>> ranBy(64);
+  pool.ParallelFor(64, [&](int task, int participant) {
+    if (task < 32) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ranBy[(size_t)task] = participant;
+  });
+  CHECK(pool.Steals() > 0);
+  int slowOnWorker = 0;
+  for (int t = 0; t < 32; t++) {
+    slowOnWorker += ranBy[(size_t)t].load() == 1 ? 1 : 0;
+  }
+  CHECK(slowOnWorker > 0);
+}
+
+TEST_CASE("The shared pool uses every CPU the process may run on", "[worker_pool]") {
+  const int cpus = ProcessCpuCount();
+  CHECK(cpus >= 1);
+  CHECK(cpus <= std::max(1, (int)std::thread::hardware_concurrency()));
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  REQUIRE(sched_getaffinity(0, sizeof(set), &set) == 0);
+  CHECK(cpus == CPU_COUNT(&set));
+#endif
+  CHECK(SharedImageWorkerPool().Concurrency() == cpus);
+  CHECK(&SharedImageWorkerPool() == &SharedImageWorkerPool());
+}
@@ -0,0 +1,155 @@
+#include "common/launch_timeline.h"
+#include "common/trace_record.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace twinshim;
+
+namespace {
+
+uint32_t CurrentPid() {
+#if defined(_WIN32)
+  return (uint32_t)GetCurrentProcessId();
+#else
+  return (uint32_t)getpid();
+#endif
+}
+
+struct LocalTimeline {
+  std::unique_ptr<LaunchTimelineBlock> block{new LaunchTimelineBlock()};
+  LaunchTimeline timeline;
+
+  explicit LocalTimeline(uint64_t ticksPerSecond = 1000) {
+    InitializeLaunchTimelineBlock(block.get(), 1, ticksPerSecond);
+    timeline.Attach(block.get());
+  }
+};
+
+LaunchSpan Span(const char* name, uint32_t pid, uint64_t start, uint64_t end) {
+  LaunchSpan span;
+  span.name = name;
+  span.pid = pid;
+  span.start = start;
+  span.end = end;
+  return span;
+}
+
+} // namespace
+
+TEST_CASE("LaunchTimeline records nested spans in start order", "[timeline]") {
+  LaunchTimeline disabled;
+  CHECK_FALSE(disabled.Enabled());
+  CHECK(disabled.Begin("ignored") == LaunchTimeline::kNoSpan);
+  disabled.End(LaunchTimeline::kNoSpan);
+  CHECK(disabled.Spans().empty());
+
+  LocalTimeline local;
+  REQUIRE(IsLaunchTimelineBlockValid(local.block.get()));
+  {
+    LaunchTimelineScope outer(local.timeline, "launch");
+    { LaunchTimelineScope inner(local.timeline, "CreateProcessW"); }
+    local.timeline.Record("a name much longer than the forty-seven bytes a slot can hold", TraceTicks(), TraceTicks());
+    // Still open when read: not reported.
+    local.timeline.Begin("wait for exit");
+  }
+  local.timeline.Record("earlier", 5, 10);
+
+  const auto spans = local.timeline.Spans();
+  REQUIRE(spans.size() == 4);
+  CHECK(spans[0].name == "earlier");
+  CHECK(spans[1].name == "launch");
+  CHECK(spans[2].name == "CreateProcessW");
+  CHECK(spans[3].name.size() == kLaunchTimelineNameBytes - 1);
+  CHECK(spans[1].start <= spans[2].start);
+  CHECK(spans[2].end <= spans[1].end);
+  CHECK(spans[1].pid == CurrentPid());
+  CHECK(spans[1].tid == TraceThreadId());
+}
+
+TEST_CASE("LaunchTimeline takes spans from many threads and counts overflow", "[timeline]") {
+  LocalTimeline local;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 40; i++) {
+        LaunchTimelineScope scope(local.timeline, "step");
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  CHECK(local.timeline.Spans().size() == kLaunchTimelineCapacity);
+  CHECK(local.timeline.Dropped() == 8 * 40 - kLaunchTimelineCapacity);
+}
+
+TEST_CASE("FormatLaunchTimeline indents phases per process", "[timeline]") {
+  const std::vector<LaunchSpan> spans = {
+      Span("launch", 10, 1000, 5000),
+      Span("CreateProcessW", 10, 1000, 1500),
+      Span("inject shim", 10, 1500, 3000),
+      Span("shim: registry hooks", 20, 2000, 2500),
+      Span("wait for hook-ready", 10, 3000, 4000),
+  };
+  const std::wstring table = FormatLaunchTimeline(spans, 1000, {{10, L"wrapper"}});
+  CHECK(table.find(L"      0.00   4000.00  wrapper   launch\n") != std::wstring::npos);
+  CHECK(table.find(L"      0.00    500.00  wrapper     CreateProcessW\n") != std::wstring::npos);
+  CHECK(table.find(L"    500.00   1500.00  wrapper     inject shim\n") != std::wstring::npos);
+  // Another process's span is not nested under the wrapper's.
+  CHECK(table.find(L"   1000.00    500.00  20        shim: registry hooks\n") != std::wstring::npos);
+  CHECK(table.find(L"   2000.00   1000.00  wrapper     wait for hook-ready\n") != std::wstring::npos);
+
+  CHECK(FormatLaunchTimeline({}, 1000).find(L"No launch timeline") != std::wstring::npos);
+}
+
+TEST_CASE("FormatLaunchTimelineChromeTrace emits complete events in microseconds", "[timeline]") {
+  const std::vector<LaunchSpan> spans = {
+      Span("launch", 10, 1000, 5000),
+      Span("say \"hi\"", 20, 2000, 2500),
+  };
+  const std::string json = FormatLaunchTimelineChromeTrace(spans, 1000);
+  CHECK(json.find("\"traceEvents\":[") != std::string::npos);
+  CHECK(json.find("{\"name\":\"launch\",\"cat\":\"launch\",\"ph\":\"X\",\"ts\":0.000,\"dur\":4000000.000,"
+                  "\"pid\":10,\"tid\":0}") != std::string::npos);
+  CHECK(json.find("{\"name\":\"say \\\"hi\\\"\",\"cat\":\"launch\",\"ph\":\"X\",\"ts\":1000000.000,"
+                  "\"dur\":500000.000,\"pid\":20,\"tid\":0}") != std::string::npos);
+  CHECK(FormatLaunchTimelineChromeTrace({}, 1000) == "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n]}\n");
+}
+
+TEST_CASE("LaunchTimelineMapping shares spans between wrapper and shim", "[timeline]") {
+  const uint32_t pid = CurrentPid();
+  LaunchTimelineMapping wrapper;
+  REQUIRE(wrapper.Create(pid));
+  LaunchTimeline wrapperTimeline(wrapper.Block());
+  const uint32_t launch = wrapperTimeline.Begin("launch");
+
+  {
+    LaunchTimelineMapping shim;
+    REQUIRE(shim.Open(pid));
+    CHECK(shim.Block() != wrapper.Block());
+    LaunchTimeline shimTimeline(shim.Block());
+    LaunchTimelineScope scope(shimTimeline, "shim: registry hooks");
+  }
+  wrapperTimeline.End(launch);
+
+  const auto spans = wrapperTimeline.Spans();
+  REQUIRE(spans.size() == 2);
+  CHECK(spans[0].name == "launch");
+  CHECK(spans[1].name == "shim: registry hooks");
+  CHECK(wrapperTimeline.TicksPerSecond() == CaptureTraceClock().ticksPerSecond);
+
+  wrapper.Close();
+  LaunchTimelineMapping late;
+  CHECK_FALSE(late.Open(pid));
+}
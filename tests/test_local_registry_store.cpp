@@ -533,3 +533,358 @@ TEST_CASE("LocalRegistryStore waits through writer contention (busy_timeout)", "
   CHECK_FALSE(v->isDeleted);
   CHECK(v->data == std::vector<uint8_t>{payload});
 }
+
+TEST_CASE("LocalRegistryStore resolved keys track the store generation", "[store]") {
+  const std::wstring dbPath = MakeTempDbPath();
+  LocalRegistryStore store;
+  REQUIRE(store.Open(dbPath));
+
+  const uint8_t one = 1;
+  const uint8_t two = 2;
+  REQUIRE(store.PutKey(L"HKLM\\Software\\Vendor\\App"));
+
+  ResolvedKey key;
+  REQUIRE(store.ResolveKey(L"hklm\\software\\vendor\\APP", key));
+  CHECK(key.keyPath == L"HKLM\\Software\\Vendor\\App");
+  CHECK(key.rowId != 0);
+  CHECK_FALSE(key.deleted);
+  CHECK(key.localExists);
+  CHECK(key.generation == store.Generation());
+
+  // Writes through a current key keep it current.
+  REQUIRE(store.PutValue(key, L"Level", REG_BINARY, &one, 1));
+  CHECK(key.generation == store.Generation());
+  auto v = store.GetValue(key, L"level");
+  REQUIRE(v.has_value());
+  CHECK(v->data == std::vector<uint8_t>{one});
+
+  // Any other write moves the generation on.
+  const uint64_t before = store.Generation();
+  REQUIRE(store.DeleteKeyTree(L"HKLM\\Software\\Vendor"));
+  CHECK(store.Generation() != before);
+  CHECK(key.generation != store.Generation());
+
+  // A stale key falls back to the path-based lookups, so it sees the tombstone.
+  v = store.GetValue(key, L"Level");
+  REQUIRE(v.has_value());
+  CHECK(v->isDeleted);
+
+  REQUIRE(store.ResolveKey(key.keyPath, key));
+  CHECK(key.deleted);
+  CHECK(key.rowId == 0);
+  CHECK_FALSE(key.localExists);
+
+  // Writing under a tombstoned key recreates it; the key must be resolved again.
+  REQUIRE(store.PutValue(key, L"Level", REG_BINARY, &two, 1));
+  CHECK(key.generation == 0);
+  REQUIRE(store.ResolveKey(key.keyPath, key));
+  CHECK_FALSE(key.deleted);
+  CHECK(key.rowId != 0);
+  v = store.GetValue(key, L"Level");
+  REQUIRE(v.has_value());
+  CHECK(v->data == std::vector<uint8_t>{two});
+
+  REQUIRE(store.DeleteValue(key, L"Level"));
+  CHECK(key.generation == store.Generation());
+  v = store.GetValue(key, L"Level");
+  REQUIRE(v.has_value());
+  CHECK(v->isDeleted);
+}
+
+TEST_CASE("LocalRegistryStore generation notices commits from other connections", "[store][wal]") {
+  const std::wstring dbPath = MakeTempDbPath();
+  LocalRegistryStore shim;
+  REQUIRE(shim.Open(dbPath));
+  LocalRegistryStore tool;
+  REQUIRE(tool.Open(dbPath));
+
+  const uint8_t payload = 0x5A;
+  REQUIRE(shim.PutValue(L"HKLM\\Software\\Ext", L"V", REG_BINARY, &payload, 1));
+
+  ResolvedKey key;
+  REQUIRE(shim.ResolveKey(L"HKLM\\Software\\Ext", key));
+  REQUIRE(key.generation == shim.Generation());
+
+  REQUIRE(tool.DeleteKeyTree(L"HKLM\\Software\\Ext"));
+
+  // The other connection's commit is observed no later than the next read.
+  auto v = shim.GetValue(key, L"V");
+  if (v.has_value() && !v->isDeleted) {
+    v = shim.GetValue(key, L"V");
+  }
+  REQUIRE(v.has_value());
+  CHECK(v->isDeleted);
+  CHECK(key.generation != shim.Generation());
+}
+
+TEST_CASE("LocalRegistryStore GetValues answers many names in one statement", "[store]") {
+  const std::wstring dbPath = MakeTempDbPath();
+  LocalRegistryStore store;
+  REQUIRE(store.Open(dbPath));
+
+  const uint8_t one = 1;
+  const uint8_t two = 2;
+  REQUIRE(store.PutValue(L"HKLM\\Software\\Vendor", L"Alpha", REG_BINARY, &one, 1));
+  REQUIRE(store.PutValue(L"HKLM\\Software\\Vendor", L"Beta", REG_BINARY, &two, 1));
+  REQUIRE(store.PutValue(L"HKLM\\Software\\Vendor", L"Gone", REG_BINARY, &one, 1));
+  REQUIRE(store.DeleteValue(L"HKLM\\Software\\Vendor", L"Gone"));
+
+  ResolvedKey key;
+  REQUIRE(store.ResolveKey(L"HKLM\\Software\\Vendor", key));
+  const std::vector<std::wstring> names{L"alpha", L"Missing", L"BETA", L"Gone", L"Alpha"};
+  const uint64_t before = store.StatementCount();
+  auto values = store.GetValues(key, names);
+  CHECK(store.StatementCount() - before == 1);
+
+  REQUIRE(values.size() == names.size());
+  REQUIRE(values[0].has_value());
+  CHECK(values[0]->data == std::vector<uint8_t>{one});
+  CHECK_FALSE(values[1].has_value());
+  REQUIRE(values[2].has_value());
+  CHECK(values[2]->data == std::vector<uint8_t>{two});
+  REQUIRE(values[3].has_value());
+  CHECK(values[3]->isDeleted);
+  REQUIRE(values[4].has_value());
+  CHECK(values[4]->data == std::vector<uint8_t>{one});
+
+  // More names than fit in one statement still answer every slot.
+  std::vector<std::wstring> many;
+  for (int i = 0; i < 1200; i++) {
+    many.push_back(L"Name" + std::to_wstring(i));
+  }
+  many.push_back(L"beta");
+  values = store.GetValues(L"HKLM\\Software\\Vendor", many);
+  REQUIRE(values.size() == many.size());
+  CHECK_FALSE(values[0].has_value());
+  REQUIRE(values.back().has_value());
+  CHECK(values.back()->data == std::vector<uint8_t>{two});
+
+  // A deleted key hides all of its values.
+  REQUIRE(store.DeleteKeyTree(L"HKLM\\Software\\Vendor"));
+  values = store.GetValues(key, names);
+  for (const auto& v : values) {
+    REQUIRE(v.has_value());
+    CHECK(v->isDeleted);
+  }
+}
+
+TEST_CASE("LocalRegistryStore gives up on writer contention past a BusyBudget", "[store][wal]") {
+  const std::wstring dbPath = MakeTempDbPath();
+  LocalRegistryStore store;
+  REQUIRE(store.Open(dbPath));
+
+  sqlite3* lockDb = nullptr;
+  const std::string dbPathUtf8 = WideToUtf8(dbPath);
+  REQUIRE(sqlite3_open_v2(dbPathUtf8.c_str(), &lockDb, SQLITE_OPEN_READWRITE, nullptr) == SQLITE_OK);
+  REQUIRE(sqlite3_exec(lockDb, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr) == SQLITE_OK);
+
+  const uint8_t payload = 0x7F;
+  const auto start = std::chrono::steady_clock::now();
+  {
+    LocalRegistryStore::BusyBudget budget(store, std::chrono::milliseconds(40));
+    CHECK_FALSE(store.PutValue(L"HKLM\\Software\\BudgetTest", L"X", REG_BINARY, &payload, 1));
+    CHECK(store.TimedOut());
+  }
+  const auto elapsedMs =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+  CHECK(elapsedMs >= 30);
+  CHECK(elapsedMs < 1000);
+  CHECK(store.BusyOverrunCount() == 1);
+
+  // Readers aren't blocked by a WAL writer.
+  {
+    LocalRegistryStore::BusyBudget budget(store, std::chrono::milliseconds(40));
+    CHECK_FALSE(store.GetValue(L"HKLM\\Software\\BudgetTest", L"X").has_value());
+    CHECK_FALSE(store.TimedOut());
+  }
+
+  REQUIRE(sqlite3_exec(lockDb, "COMMIT;", nullptr, nullptr, nullptr) == SQLITE_OK);
+  sqlite3_close(lockDb);
+  CHECK(store.PutValue(L"HKLM\\Software\\BudgetTest", L"X", REG_BINARY, &payload, 1));
+  CHECK(store.BusyOverrunCount() == 1);
+}
+
+TEST_CASE("LocalRegistryStore Warm reads both tables up to its byte cap", "[store]") {
+  LocalRegistryStore store;
+  REQUIRE(store.Open(MakeTempDbPath()));
+  CHECK(store.Warm(1 << 20).rows == 0);
+
+  const std::vector<uint8_t> payload(1000, 0x5A);
+  for (int i = 0; i < 20; i++) {
+    REQUIRE(store.PutValue(L"HKLM\\Software\\Warm", L"V" + std::to_wstring(i), REG_BINARY, payload.data(),
+                           (uint32_t)payload.size()));
+  }
+
+  const auto all = store.Warm(1 << 20);
+  CHECK(all.rows == 21); // one key row, twenty values
+  CHECK(all.bytes >= 20 * payload.size());
+
+  const auto capped = store.Warm(5000);
+  CHECK(capped.rows < all.rows);
+  CHECK(capped.bytes >= 5000);
+}
+
+TEST_CASE("LocalRegistryStore access profile round-trips without touching the generation", "[store]") {
+  LocalRegistryStore store;
+  REQUIRE(store.Open(MakeTempDbPath()));
+  CHECK(store.LoadAccessProfile().empty());
+
+  std::vector<AccessProfileEntry> profile(3);
+  profile[0].keyPath = L"HKLM\\Software\\Vendor";
+  profile[0].isKey = true;
+  profile[1].keyPath = L"HKLM\\Software\\Vendor";
+  profile[1].valueName = L"";
+  profile[2].keyPath = L"HKLM\\Software\\Vendor\\App";
+  profile[2].valueName = L"Path";
+
+  const uint64_t generation = store.Generation();
+  const uint64_t external = store.ExternalGeneration();
+  REQUIRE(store.SaveAccessProfile(profile));
+  CHECK(store.Generation() == generation);
+  CHECK(store.ExternalGeneration() == external);
+
+  auto loaded = store.LoadAccessProfile();
+  REQUIRE(loaded.size() == 3);
+  CHECK(loaded[0].isKey);
+  CHECK(loaded[0].keyPath == L"HKLM\\Software\\Vendor");
+  CHECK_FALSE(loaded[1].isKey); // the default value is not a key probe
+  CHECK(loaded[1].valueName.empty());
+  CHECK(loaded[2].valueName == L"Path");
+
+  // Saving replaces the previous profile.
+  profile.resize(1);
+  REQUIRE(store.SaveAccessProfile(profile));
+  CHECK(store.LoadAccessProfile().size() == 1);
+
+  // Own writes move only the generation.
+  const uint8_t b = 1;
+  REQUIRE(store.PutValue(L"HKLM\\Software\\Vendor", L"X", REG_BINARY, &b, 1));
+  CHECK(store.Generation() != generation);
+  CHECK(store.ExternalGeneration() == external);
+}
+
+TEST_CASE("LocalRegistryStore answers absent keys and values from its lookup filter", "[store]") {
+  LocalRegistryStore store;
+  REQUIRE(store.Open(MakeTempDbPath()));
+  const uint8_t b = 1;
+  REQUIRE(store.PutValue(L"HKLM\\Software\\Vendor\\App", L"Path", REG_BINARY, &b, 1));
+  REQUIRE(store.PutKey(L"HKLM\\Software\\Vendor\\Gone\\Child"));
+  REQUIRE(store.DeleteKeyTree(L"HKLM\\Software\\Vendor\\Gone"));
+  store.Warm(1 << 20);
+
+  const uint64_t before = store.StatementCount();
+  for (int i = 0; i < 100; i++) {
+    const std::wstring missing = L"HKLM\\Software\\Other" + std::to_wstring(i);
+    CHECK_FALSE(store.KeyExistsLocally(missing));
+    CHECK_FALSE(store.GetValue(missing, L"Path").has_value());
+    CHECK_FALSE(store.GetValue(L"HKLM\\Software\\Vendor\\App", L"Missing" + std::to_wstring(i)).has_value());
+    CHECK(store.ListValues(missing).empty());
+  }
+  // Only the occasional poll for other connections' commits.
+  CHECK(store.StatementCount() - before < 10);
+  CHECK(store.FilteredMissCount() >= 400);
+
+  // Present and tombstoned entries still come from the tables, any casing.
+  CHECK(store.KeyExistsLocally(L"hklm\\SOFTWARE\\vendor"));
+  auto v = store.GetValue(L"HKLM\\software\\Vendor\\APP", L"path");
+  REQUIRE(v.has_value());
+  CHECK_FALSE(v->isDeleted);
+  CHECK(store.IsKeyDeleted(L"HKLM\\Software\\Vendor\\Gone\\Child\\Deeper"));
+  CHECK_FALSE(store.KeyExistsLocally(L"HKLM\\Software\\Vendor\\Gone\\Child"));
+  ResolvedKey key;
+  REQUIRE(store.ResolveKey(L"HKLM\\Software\\Vendor\\Absent", key));
+  CHECK_FALSE(key.deleted);
+  CHECK_FALSE(key.localExists);
+  CHECK(key.rowId == 0);
+
+  // Writes after the build are visible straight away.
+  REQUIRE(store.PutValue(L"HKLM\\Software\\Other7", L"Path", REG_BINARY, &b, 1));
+  CHECK(store.KeyExistsLocally(L"HKLM\\Software\\Other7"));
+  CHECK(store.GetValue(L"HKLM\\Software\\Other7", L"PATH").has_value());
+  REQUIRE(store.DeleteKeyTree(L"HKLM\\Software\\Vendor\\App"));
+  CHECK(store.IsKeyDeleted(L"HKLM\\Software\\Vendor\\App"));
+}
+
+TEST_CASE("LocalRegistryStore grows a saturated lookup filter instead of rebuilding it per lookup", "[store]") {
+  LocalRegistryStore store;
+  REQUIRE(store.Open(MakeTempDbPath()));
+  // Every row brings several ancestors of its own, more than the row count
+  // sizes the filter for.
+  const uint8_t b = 1;
+  for (int i = 0; i < 2000; i++) {
+    const std::wstring path = L"HKLM\\Software\\Deep" + std::to_wstring(i) + L"\\a\\b\\c\\d\\e\\f\\g\\h";
+    REQUIRE(store.PutValue(path, L"V", REG_BINARY, &b, 1));
+  }
+  CHECK_FALSE(store.KeyExistsLocally(L"HKLM\\Software\\Missing"));
+
+  const uint64_t before = store.StatementCount();
+  for (int i = 0; i < 100; i++) {
+    CHECK_FALSE(store.KeyExistsLocally(L"HKLM\\Software\\Missing" + std::to_wstring(i)));
+  }
+  CHECK(store.StatementCount() - before < 10);
+}
+
+TEST_CASE("LocalRegistryStore lookup filter picks up other connections' writes", "[store][wal]") {
+  const std::wstring dbPath = MakeTempDbPath();
+  LocalRegistryStore shim;
+  REQUIRE(shim.Open(dbPath));
+  LocalRegistryStore tool;
+  REQUIRE(tool.Open(dbPath));
+
+  CHECK_FALSE(shim.KeyExistsLocally(L"HKLM\\Software\\Ext"));
+  const uint64_t misses = shim.FilteredMissCount();
+  CHECK(misses > 0);
+
+  const uint8_t b = 1;
+  REQUIRE(tool.PutValue(L"HKLM\\Software\\Ext", L"V", REG_BINARY, &b, 1));
+
+  // A negative answer may lag another connection's commit by one poll interval.
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  CHECK(shim.KeyExistsLocally(L"HKLM\\Software\\Ext"));
+  CHECK(shim.GetValue(L"HKLM\\Software\\Ext", L"V").has_value());
+}
+
+TEST_CASE("LocalRegistryStore skips writes that match the live value", "[store]") {
+  const std::wstring dbPath = MakeTempDbPath();
+  LocalRegistryStore store;
+  REQUIRE(store.Open(dbPath));
+
+  const uint8_t config[3] = {1, 2, 3};
+  const uint8_t changed[3] = {1, 2, 4};
+  REQUIRE(store.PutValue(L"HKLM\\Software\\Vendor", L"Config", REG_BINARY, config, 3));
+  CHECK(store.ElidedWriteCount() == 0);
+
+  // Same type and bytes, any spelling: no write and no new generation.
+  uint64_t generation = store.Generation();
+  REQUIRE(store.PutValue(L"hklm\\software\\VENDOR", L"config", REG_BINARY, config, 3));
+  CHECK(store.ElidedWriteCount() == 1);
+  CHECK(store.Generation() == generation);
+
+  ResolvedKey key;
+  REQUIRE(store.ResolveKey(L"HKLM\\Software\\Vendor", key));
+  REQUIRE(store.PutValue(key, L"Config", REG_BINARY, config, 3));
+  CHECK(store.ElidedWriteCount() == 2);
+  CHECK(key.generation == store.Generation());
+
+  // A different type, different bytes or an empty value are real writes.
+  REQUIRE(store.PutValue(key, L"Config", REG_BINARY + 1, config, 3));
+  REQUIRE(store.PutValue(key, L"Config", REG_BINARY + 1, changed, 3));
+  REQUIRE(store.PutValue(key, L"Config", REG_BINARY + 1, nullptr, 0));
+  CHECK(store.ElidedWriteCount() == 2);
+  REQUIRE(store.PutValue(key, L"Config", REG_BINARY + 1, nullptr, 0));
+  CHECK(store.ElidedWriteCount() == 3);
+
+  // Rewriting a deleted value, or one under a deleted key, brings it back.
+  REQUIRE(store.PutValue(key, L"Config", REG_BINARY, config, 3));
+  REQUIRE(store.DeleteValue(key, L"Config"));
+  REQUIRE(store.PutValue(key, L"Config", REG_BINARY, config, 3));
+  REQUIRE(store.DeleteKeyTree(L"HKLM\\Software\\Vendor"));
+  generation = store.Generation();
+  REQUIRE(store.PutValue(L"HKLM\\Software\\Vendor", L"Config", REG_BINARY, config, 3));
+  CHECK(store.ElidedWriteCount() == 3);
+  CHECK(store.Generation() != generation);
+  CHECK(store.KeyExistsLocally(L"HKLM\\Software\\Vendor"));
+  auto v = store.GetValue(L"HKLM\\Software\\Vendor", L"Config");
+  REQUIRE(v.has_value());
+  CHECK_FALSE(v->isDeleted);
+}
@@ -0,0 +1,206 @@
+#include "scale/pixel_convert.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace twinshim;
+
+namespace {
+
+bool HasIsa(ScaleIsa isa) {
+  for (ScaleIsa s : SupportedScaleIsas()) {
+    if (s == isa) {
+      return true;
+    }
+  }
+  return false;
+}
+
+PixelFormatInfo Rgb(uint32_t bitCount, uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+  PixelFormatInfo f;
+  REQUIRE(DescribeRgbPixelFormat(bitCount, r, g, b, a, &f));
+  return f;
+}
+
+// Converts `pixels` (packed, little endian) in rows of `width` and checks
+// every result against ConvertPixelToArgb.
+void CheckAgainstReference(const PixelFormatInfo& format, const std::vector<uint8_t>& pixels, int width, ScaleIsa isa) {
+  const int bpp = format.bytesPerPixel;
+  const int count = (int)(pixels.size() / (size_t)bpp);
+  const int height = count / width;
+  PixelConverter converter(isa);
+  REQUIRE(converter.Reset(format));
+  std::vector<uint32_t> out((size_t)count, 0xDEADBEEFu);
+  REQUIRE(converter.ConvertRect(pixels.data(), (ptrdiff_t)width * bpp, width, height, out.data(), width));
+  int mismatches = 0;
+  for (int i = 0; i < width * height; i++) {
+    uint32_t p = 0;
+    std::memcpy(&p, pixels.data() + (size_t)i * (size_t)bpp, (size_t)bpp);
+    mismatches += (out[(size_t)i] != ConvertPixelToArgb(format, p)) ? 1 : 0;
+  }
+  INFO(ScaleIsaName(isa) << " " << bpp * 8 << "bpp r=" << format.rMask << " g=" << format.gMask << " b=" << format.bMask
+                         << " a=" << format.aMask);
+  CHECK(mismatches == 0);
+}
+
+std::vector<uint8_t> Every16BitValue() {
+  std::vector<uint8_t> bytes(65536 * 2);
+  for (uint32_t v = 0; v < 65536; v++) {
+    bytes[v * 2] = (uint8_t)v;
+    bytes[v * 2 + 1] = (uint8_t)(v >> 8);
+  }
+  return bytes;
+}
+
+std::vector<uint8_t> Random32BitValues(int count, uint32_t seed) {
+  std::vector<uint8_t> bytes((size_t)count * 4);
+  uint32_t state = seed;
+  for (auto& b : bytes) {
+    state = state * 1664525u + 1013904223u;
+    b = (uint8_t)(state >> 24);
+  }
+  return bytes;
+}
+
+} // namespace
+
+TEST_CASE("DescribeRgbPixelFormat derives shifts and fills in missing masks", "[pixel_convert]") {
+  PixelFormatInfo f = Rgb(16, 0x7C00, 0x03E0, 0x001F, 0x8000);
+  CHECK(f.bytesPerPixel == 2);
+  CHECK(f.rShift == 10);
+  CHECK(f.rBits == 5);
+  CHECK(f.aShift == 15);
+  CHECK(f.aBits == 1);
+
+  f = Rgb(16, 0, 0, 0, 0);
+  CHECK(f.rMask == 0xF800);
+  CHECK(f.gMask == 0x07E0);
+  CHECK(f.gBits == 6);
+
+  f = Rgb(32, 0, 0, 0, 0);
+  CHECK(f.rMask == 0x00FF0000);
+  CHECK(f.bytesPerPixel == 4);
+
+  PixelFormatInfo rejected;
+  CHECK_FALSE(DescribeRgbPixelFormat(24, 0xFF0000, 0xFF00, 0xFF, 0, &rejected));
+  CHECK_FALSE(DescribeRgbPixelFormat(16, 0xF800, 0, 0x1F, 0, &rejected));
+}
+
+TEST_CASE("16bpp conversion matches the scalar reference for every pixel value", "[pixel_convert]") {
+  const std::vector<uint8_t> all = Every16BitValue();
+  const PixelFormatInfo formats[] = {
+      Rgb(16, 0xF800, 0x07E0, 0x001F, 0),      // 565
+      Rgb(16, 0x001F, 0x07E0, 0xF800, 0),      // BGR 565
+      Rgb(16, 0x7C00, 0x03E0, 0x001F, 0),      // 555
+      Rgb(16, 0x7C00, 0x03E0, 0x001F, 0x8000), // 1555
+      Rgb(16, 0x0F00, 0x00F0, 0x000F, 0xF000), // 4444
+      Rgb(16, 0x0F00, 0x00F0, 0x000F, 0),      // X444
+      Rgb(16, 0x00E0, 0x001C, 0x0003, 0xFF00), // 8332
+  };
+  for (const auto& format : formats) {
+    for (ScaleIsa isa : SupportedScaleIsas()) {
+      // 65536 / 256: every value, with rows long enough for the SIMD loops.
+      CheckAgainstReference(format, all, 256, isa);
+      // Odd widths leave tails for the scalar remainder.
+      CheckAgainstReference(format, std::vector<uint8_t>(all.begin(), all.begin() + 13 * 7 * 2), 13, isa);
+    }
+  }
+}
+
+TEST_CASE("32bpp conversion matches the scalar reference for arbitrary masks", "[pixel_convert]") {
+  const std::vector<uint8_t> noise = Random32BitValues(64 * 37, 99);
+  const PixelFormatInfo formats[] = {
+      Rgb(32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0),          // X8R8G8B8
+      Rgb(32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000), // A8R8G8B8
+      Rgb(32, 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000), // A8B8G8R8
+      Rgb(32, 0xFF000000, 0x00FF0000, 0x0000FF00, 0x000000FF), // R8G8B8A8
+      Rgb(32, 0x3FF00000, 0x000FFC00, 0x000003FF, 0xC0000000), // A2R10G10B10: wide fields
+      Rgb(32, 0x0000F800, 0x000007E0, 0x0000001F, 0),          // 565 in the low word
+      Rgb(32, 0x00F00000, 0x0000F000, 0x000000F0, 0x0F000000), // holes between channels
+  };
+  for (const auto& format : formats) {
+    for (ScaleIsa isa : SupportedScaleIsas()) {
+      CheckAgainstReference(format, noise, 64, isa);
+      CheckAgainstReference(format, noise, 37, isa);
+    }
+  }
+}
+
+TEST_CASE("Every field width up to 8 bits has an exact SIMD form", "[pixel_convert]") {
+  const std::vector<uint8_t> noise = Random32BitValues(4096, 5);
+  for (uint32_t bits = 1; bits <= 8; bits++) {
+    const uint32_t field = (1u << bits) - 1u;
+    const PixelFormatInfo format = Rgb(32, field, field << 8, field << 16, field << 24); // not the memcpy layout
+    for (ScaleIsa isa : SupportedScaleIsas()) {
+      CheckAgainstReference(format, noise, 64, isa);
+    }
+    if (HasIsa(ScaleIsa::kSse2)) {
+      PixelConverter converter(ScaleIsa::kSse2);
+      REQUIRE(converter.Reset(format));
+      INFO("bits=" << bits);
+      CHECK(converter.Vectorized());
+    }
+  }
+
+  if (HasIsa(ScaleIsa::kSse2)) {
+    PixelConverter converter(ScaleIsa::kSse2);
+    for (const auto& format : {Rgb(16, 0xF800, 0x07E0, 0x001F, 0), Rgb(16, 0x0F00, 0x00F0, 0x000F, 0xF000)}) {
+      REQUIRE(converter.Reset(format));
+      CHECK(converter.Vectorized());
+    }
+  }
+  PixelConverter scalar(ScaleIsa::kScalar);
+  REQUIRE(scalar.Reset(Rgb(16, 0xF800, 0x07E0, 0x001F, 0)));
+  CHECK_FALSE(scalar.Vectorized());
+}
+
+TEST_CASE("Palettized surfaces convert through the palette", "[pixel_convert]") {
+  uint32_t palette[256];
+  for (uint32_t i = 0; i < 256; i++) {
+    palette[i] = 0xFF000000u | (i << 16) | ((255 - i) << 8) | (i * 7 & 0xFF);
+  }
+  const PixelFormatInfo format = Palettized8PixelFormat();
+  CHECK(format.bytesPerPixel == 1);
+
+  PixelConverter converter;
+  CHECK_FALSE(converter.Reset(format));
+  REQUIRE(converter.Reset(format, palette));
+
+  // 3 rows of 5 indices in a 8-byte pitch; the padding must not be read as pixels.
+  const uint8_t src[] = {0, 1, 2, 254, 255, 9, 9, 9, 10, 20, 30, 40, 50, 9, 9, 9, 200, 100, 0, 255, 128};
+  std::vector<uint32_t> out(3 * 6, 0);
+  REQUIRE(converter.ConvertRect(src, 8, 5, 3, out.data(), 6));
+  for (int y = 0; y < 3; y++) {
+    for (int x = 0; x < 5; x++) {
+      CHECK(out[(size_t)y * 6 + (size_t)x] == palette[src[y * 8 + x]]);
+    }
+    CHECK(out[(size_t)y * 6 + 5] == 0);
+  }
+
+  // A changed palette is picked up even though the format is the same.
+  palette[0] = 0x12345678u;
+  REQUIRE(converter.Reset(format, palette));
+  uint32_t first = 0;
+  converter.ConvertRow(src, &first, 1);
+  CHECK(first == 0x12345678u);
+}
+
+TEST_CASE("PixelConverter rejects what it cannot convert", "[pixel_convert]") {
+  PixelConverter converter;
+  uint32_t out[4] = {};
+  const uint8_t src[16] = {};
+  CHECK_FALSE(converter.ConvertRect(src, 16, 4, 1, out, 4)); // no Reset yet
+
+  PixelFormatInfo threeBytes = Rgb(32, 0xFF0000, 0xFF00, 0xFF, 0);
+  threeBytes.bytesPerPixel = 3;
+  CHECK_FALSE(converter.Reset(threeBytes));
+
+  REQUIRE(converter.Reset(Rgb(32, 0xFF0000, 0xFF00, 0xFF, 0)));
+  CHECK_FALSE(converter.ConvertRect(src, 8, 4, 1, out, 4)); // pitch shorter than a row
+  CHECK_FALSE(converter.ConvertRect(src, 16, 4, 1, out, 3));
+  CHECK(converter.ConvertRect(src, 16, 4, 1, out, 4));
+  CHECK(out[0] == 0xFF000000u);
+}
@@ -0,0 +1,104 @@
+#include "common/in_memory_real_registry.h"
+#include "common/real_key_pool.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace twinshim;
+
+namespace {
+
+constexpr uint32_t kRegDword = 4;
+constexpr uint32_t kWow6432 = 0x0200; // KEY_WOW64_32KEY
+
+struct Fixture {
+  InMemoryRealRegistry real;
+  RealKeyPool pool{real, std::chrono::hours(1)};
+
+  Fixture() {
+    real.PutValue(L"HKLM\\Software\\Vendor", L"Size", kRegDword, {7, 0, 0, 0});
+    real.PutKey(L"HKLM\\Software\\Other");
+  }
+};
+
+} // namespace
+
+TEST_CASE("RealKeyPool shares one real handle per key and view", "[pool]") {
+  Fixture f;
+
+  RealKeyHandle a = f.pool.OpenKey(L"HKLM\\Software\\Vendor", 0);
+  RealKeyHandle b = f.pool.OpenKey(L"hklm\\software\\VENDOR", 0);
+  REQUIRE(a);
+  CHECK(a == b);
+  CHECK(f.real.GetCounters().opens == 1);
+
+  // Another view of the same path is a different key.
+  RealKeyHandle wow = f.pool.OpenKey(L"HKLM\\Software\\Vendor", kWow6432);
+  REQUIRE(wow);
+  CHECK(wow != a);
+  CHECK(f.real.GetCounters().opens == 2);
+
+  uint32_t type = 0;
+  std::vector<uint8_t> data;
+  CHECK(f.pool.QueryValue(a, L"Size", &type, &data) == regstatus::kSuccess);
+  CHECK(type == kRegDword);
+
+  // Open/close loops stay on the pooled handle.
+  f.pool.CloseKey(a);
+  f.pool.CloseKey(b);
+  for (int i = 0; i < 10; i++) {
+    RealKeyHandle h = f.pool.OpenKey(L"HKLM\\Software\\Vendor", 0);
+    CHECK(h == a);
+    f.pool.CloseKey(h);
+  }
+  CHECK(f.real.GetCounters().opens == 2);
+  CHECK(f.real.GetCounters().closes == 0);
+  CHECK(f.pool.GetCounters().hits == 11);
+
+  // Missing keys are not pooled.
+  CHECK(f.pool.OpenKey(L"HKLM\\Software\\Missing", 0) == nullptr);
+  CHECK(f.pool.PooledHandleCount() == 2);
+}
+
+TEST_CASE("RealKeyPool closes handles only after the idle timeout", "[pool]") {
+  Fixture f;
+  const auto now = RealKeyPool::Clock::now();
+
+  RealKeyHandle held = f.pool.OpenKey(L"HKLM\\Software\\Vendor", 0);
+  RealKeyHandle idle = f.pool.OpenKey(L"HKLM\\Software\\Other", 0);
+  REQUIRE(held);
+  REQUIRE(idle);
+  f.pool.CloseKey(idle);
+
+  CHECK(f.pool.Trim(now) == 0);
+  CHECK(f.real.OpenHandleCount() == 2);
+
+  // Referenced handles survive any timeout; idle ones are closed.
+  CHECK(f.pool.Trim(now + std::chrono::hours(2)) == 1);
+  CHECK(f.real.OpenHandleCount() == 1);
+  CHECK(f.pool.PooledHandleCount() == 1);
+  CHECK(f.pool.GetCounters().closes == 1);
+
+  // Reopening after a trim reaches the real registry again.
+  RealKeyHandle again = f.pool.OpenKey(L"HKLM\\Software\\Other", 0);
+  REQUIRE(again);
+  CHECK(f.real.GetCounters().opens == 3);
+
+  f.pool.CloseKey(again);
+  f.pool.CloseKey(held);
+  f.pool.Clear();
+  CHECK(f.real.OpenHandleCount() == 0);
+  CHECK(f.pool.PooledHandleCount() == 0);
+}
+
+TEST_CASE("RealKeyPool passes foreign handles through to the inner backend", "[pool]") {
+  Fixture f;
+  RealKeyHandle direct = f.real.OpenKey(L"HKLM\\Software\\Vendor", 0);
+  REQUIRE(direct);
+  CHECK(f.pool.EnumValueNames(direct) == std::vector<std::wstring>{L"Size"});
+  f.pool.CloseKey(direct);
+  CHECK(f.real.OpenHandleCount() == 0);
+}
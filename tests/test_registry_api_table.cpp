@@ -0,0 +1,67 @@
+#include "common/registry_api_table.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+
+using namespace twinshim;
+
+TEST_CASE("Registry API table names and string widths match the enum", "[api_table]") {
+  CHECK(std::wcscmp(GetRegistryApiInfo(RegistryApi::RegOpenKeyExW).name, L"RegOpenKeyExW") == 0);
+  CHECK(std::strcmp(GetRegistryApiInfo(RegistryApi::RegQueryValueExA).procName, "RegQueryValueExA") == 0);
+
+  CHECK(GetRegistryApiInfo(RegistryApi::RegSetValueA).ansi);
+  CHECK_FALSE(GetRegistryApiInfo(RegistryApi::RegSetValueW).ansi);
+  CHECK_FALSE(GetRegistryApiInfo(RegistryApi::RegCloseKey).ansi);
+
+  CHECK(GetRegistryApiInfo(RegistryApi::RegOpenKeyExW).group == RegistryApiGroup::Core);
+  CHECK(GetRegistryApiInfo(RegistryApi::RegDeleteKeyExW).group == RegistryApiGroup::CoreOptional);
+  CHECK(GetRegistryApiInfo(RegistryApi::RegOpenKeyExA).group == RegistryApiGroup::Extended);
+  CHECK(GetRegistryApiInfo(RegistryApi::RegSetKeyValueA).group == RegistryApiGroup::ExtendedOptional);
+
+  for (size_t i = 0; i < kRegistryApiCount; i++) {
+    const auto& info = kRegistryApiInfo[i];
+    CHECK(std::wcslen(info.name) == std::strlen(info.procName));
+    CHECK(info.ansi == (info.group == RegistryApiGroup::Extended || info.group == RegistryApiGroup::ExtendedOptional));
+  }
+}
+
+TEST_CASE("ParseRegistryApiList selects both widths and the Ex variant", "[api_table]") {
+  const RegistryApiMask mask = ParseRegistryApiList(L"RegOpenKey");
+  const RegistryApiMask expected = RegistryApiBit(RegistryApi::RegOpenKeyW) | RegistryApiBit(RegistryApi::RegOpenKeyA) |
+                                   RegistryApiBit(RegistryApi::RegOpenKeyExW) |
+                                   RegistryApiBit(RegistryApi::RegOpenKeyExA);
+  CHECK(mask == expected);
+
+  CHECK(ParseRegistryApiList(L"RegQueryValueExA") ==
+        (RegistryApiBit(RegistryApi::RegQueryValueExW) | RegistryApiBit(RegistryApi::RegQueryValueExA)));
+  CHECK(ParseRegistryApiList(L"RegCloseKey") == RegistryApiBit(RegistryApi::RegCloseKey));
+}
+
+TEST_CASE("ParseRegistryApiList ignores case, whitespace and empty tokens", "[api_table]") {
+  CHECK(ParseRegistryApiList(L"") == 0);
+  CHECK(ParseRegistryApiList(L" , ,") == 0);
+  CHECK(ParseRegistryApiList(L"RegNoSuchApi") == 0);
+
+  CHECK(ParseRegistryApiList(L" regclosekey , REGDELETEVALUEW") ==
+        (RegistryApiBit(RegistryApi::RegCloseKey) | RegistryApiBit(RegistryApi::RegDeleteValueW) |
+         RegistryApiBit(RegistryApi::RegDeleteValueA)));
+
+  CHECK(ParseRegistryApiList(L"all") == kAllRegistryApis);
+  CHECK(ParseRegistryApiList(L"RegCloseKey, ALL") == kAllRegistryApis);
+}
+
+TEST_CASE("RegistryApiCounters count per API and reset", "[api_table]") {
+  RegistryApiCounters counters;
+  counters.Add(RegistryApi::RegOpenKeyExW);
+  counters.Add(RegistryApi::RegOpenKeyExW);
+  counters.Add(RegistryApi::RegCloseKey);
+
+  CHECK(counters.Get(RegistryApi::RegOpenKeyExW) == 2);
+  CHECK(counters.Get(RegistryApi::RegCloseKey) == 1);
+  CHECK(counters.Get(RegistryApi::RegOpenKeyExA) == 0);
+
+  counters.Reset();
+  CHECK(counters.Get(RegistryApi::RegOpenKeyExW) == 0);
+  CHECK(counters.Get(RegistryApi::RegCloseKey) == 0);
+}
@@ -0,0 +1,147 @@
+#include "common/local_registry_store.h"
+#include "common/registry_change_notifier.h"
+#include "common/registry_overlay_engine.h"
+#include "test_tmp.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <filesystem>
+#include <string>
+
+using namespace twinshim;
+
+namespace {
+
+constexpr uint32_t kRegDword = 4;
+
+std::wstring MakeTempDbPath() {
+  auto base = testutil::GetTestTempDir("notify");
+  REQUIRE_FALSE(base.empty());
+
+  static size_t counter = 0;
+  counter++;
+
+  auto path = base / ("notify-" + std::to_string(counter) + ".sqlite");
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+  return path.wstring();
+}
+
+// Counts how often each of a set of watches fired.
+struct Watches {
+  RegistryChangeNotifier notifier;
+  int fired[8] = {};
+
+  void Arm(int slot, const std::wstring& keyPath, bool subtree, uint32_t filter, const void* owner = nullptr) {
+    notifier.Watch(keyPath, subtree, filter, owner, [this, slot] { fired[slot]++; });
+  }
+};
+
+} // namespace
+
+TEST_CASE("RegistryChangeNotifier matches changes to watched keys and subtrees", "[notify]") {
+  Watches w;
+  w.Arm(0, L"HKLM\\Software\\Vendor", false, kRegNotifyChangeLastSet);
+  w.Arm(1, L"HKLM\\Software\\Vendor", false, kRegNotifyChangeName);
+  w.Arm(2, L"HKLM\\Software", true, kRegNotifyChangeLastSet);
+  w.Arm(3, L"HKLM\\Software\\Vendor\\App", false, kRegNotifyChangeSecurity);
+  REQUIRE(w.notifier.WatchCount() == 4);
+
+  // A value below the non-subtree watch is not its business.
+  w.notifier.ValueChanged(L"HKLM\\software\\VENDOR\\App");
+  CHECK(w.fired[0] == 0);
+  CHECK(w.fired[2] == 1);
+
+  // Watches fire once; the subtree one is gone now.
+  w.notifier.ValueChanged(L"HKLM\\Software\\Vendor");
+  CHECK(w.fired[0] == 1);
+  CHECK(w.fired[1] == 0);
+  CHECK(w.fired[2] == 1);
+
+  // A new subkey is a name change of its parent.
+  w.notifier.KeyCreated(L"HKLM\\Software\\Vendor\\Other");
+  CHECK(w.fired[1] == 1);
+
+  // Deleting a key fires watches on it and below, whatever their filter.
+  CHECK(w.fired[3] == 0);
+  w.notifier.KeyDeleted(L"HKLM\\Software\\Vendor");
+  CHECK(w.fired[3] == 1);
+  CHECK_FALSE(w.notifier.HasWatches());
+}
+
+TEST_CASE("RegistryChangeNotifier fires watches when their owner closes", "[notify]") {
+  Watches w;
+  int handleA = 0;
+  int handleB = 0;
+  w.Arm(0, L"HKLM\\Software\\A", false, kRegNotifyChangeAll, &handleA);
+  w.Arm(1, L"HKLM\\Software\\A", true, kRegNotifyChangeAll, &handleA);
+  w.Arm(2, L"HKLM\\Software\\B", false, kRegNotifyChangeAll, &handleB);
+
+  CHECK(w.notifier.CloseOwner(&handleA) == 2);
+  CHECK(w.fired[0] == 1);
+  CHECK(w.fired[1] == 1);
+  CHECK(w.fired[2] == 0);
+  CHECK(w.notifier.WatchCount() == 1);
+
+  CHECK(w.notifier.FireAll() == 1);
+  CHECK(w.fired[2] == 1);
+  CHECK(w.notifier.FireAll() == 0);
+}
+
+TEST_CASE("RegistryOverlayEngine reports its writes to watchers", "[notify][engine]") {
+  LocalRegistryStore store;
+  REQUIRE(store.Open(MakeTempDbPath()));
+  RegistryOverlayEngine engine(store, nullptr);
+  Watches w;
+  engine.SetChangeNotifier(&w.notifier);
+
+  const uint8_t one[4] = {1, 0, 0, 0};
+  REQUIRE(engine.CreateKey(L"HKLM\\Software\\Vendor"));
+  w.Arm(0, L"HKLM\\Software\\Vendor", false, kRegNotifyChangeLastSet);
+  w.Arm(1, L"HKLM\\Software\\Vendor", false, kRegNotifyChangeName);
+
+  // Re-creating an existing key changes nothing.
+  REQUIRE(engine.CreateKey(L"HKLM\\Software\\Vendor"));
+  CHECK(w.fired[1] == 0);
+  REQUIRE(engine.CreateKey(L"HKLM\\Software\\Vendor\\App"));
+  CHECK(w.fired[1] == 1);
+
+  REQUIRE(engine.SetValue(L"HKLM\\Software\\Vendor", L"Size", kRegDword, one, 4));
+  CHECK(w.fired[0] == 1);
+
+  w.Arm(2, L"HKLM\\Software\\Vendor", false, kRegNotifyChangeLastSet);
+  REQUIRE(engine.DeleteValue(L"HKLM\\Software\\Vendor", L"Size"));
+  CHECK(w.fired[2] == 1);
+
+  w.Arm(3, L"HKLM\\Software\\Vendor\\App", false, kRegNotifyChangeLastSet);
+  REQUIRE(engine.DeleteKeyTree(L"HKLM\\Software\\Vendor"));
+  CHECK(w.fired[3] == 1);
+  CHECK_FALSE(w.notifier.HasWatches());
+}
+
+TEST_CASE("RegistryOverlayEngine fires watchers on other connections' commits", "[notify][engine][wal]") {
+  const std::wstring dbPath = MakeTempDbPath();
+  LocalRegistryStore store;
+  REQUIRE(store.Open(dbPath));
+  RegistryOverlayEngine engine(store, nullptr);
+  Watches w;
+  engine.SetChangeNotifier(&w.notifier);
+  LocalRegistryStore tool;
+  REQUIRE(tool.Open(dbPath));
+
+  const uint8_t one[4] = {1, 0, 0, 0};
+  // The first check only takes the baseline.
+  CHECK_FALSE(engine.CheckExternalChanges());
+  REQUIRE(tool.PutValue(L"HKLM\\Software\\Unwatched", L"V", kRegDword, one, 4));
+  CHECK_FALSE(engine.CheckExternalChanges());
+
+  w.Arm(0, L"HKLM\\Software\\Vendor", true, kRegNotifyChangeLastSet);
+  // Nothing new, and this engine's own writes never look external.
+  REQUIRE(engine.SetValue(L"HKLM\\Software\\Other", L"V", kRegDword, one, 4));
+  CHECK_FALSE(engine.CheckExternalChanges());
+  CHECK(w.fired[0] == 0);
+
+  REQUIRE(tool.PutValue(L"HKLM\\Software\\Vendor", L"V", kRegDword, one, 4));
+  CHECK(engine.CheckExternalChanges());
+  CHECK(w.fired[0] == 1);
+}
@@ -0,0 +1,505 @@
+#include "common/in_memory_real_registry.h"
+#include "common/local_registry_store.h"
+#include "common/registry_overlay_engine.h"
+#include "common/registry_stats.h"
+#include "common/utf8.h"
+#include "test_tmp.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <sqlite3.h>
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace twinshim;
+
+namespace {
+
+constexpr uint32_t kRegSz = 1;
+constexpr uint32_t kRegDword = 4;
+
+std::wstring MakeTempDbPath() {
+  auto base = testutil::GetTestTempDir("engine");
+  REQUIRE_FALSE(base.empty());
+
+  static size_t counter = 0;
+  counter++;
+
+  auto path = base / ("engine-" + std::to_string(counter) + ".sqlite");
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+  return path.wstring();
+}
+
+std::vector<uint8_t> Dword(uint32_t v) {
+  return {uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16), uint8_t(v >> 24)};
+}
+
+std::vector<uint8_t> WideSz(const std::wstring& s) {
+  std::vector<uint8_t> out;
+  for (wchar_t ch : s) {
+    out.push_back(uint8_t(ch & 0xFF));
+    out.push_back(uint8_t((ch >> 8) & 0xFF));
+  }
+  out.push_back(0);
+  out.push_back(0);
+  return out;
+}
+
+struct Fixture {
+  LocalRegistryStore store;
+  InMemoryRealRegistry real;
+  RegistryOverlayEngine engine{store, &real};
+
+  Fixture() {
+    REQUIRE(store.Open(MakeTempDbPath()));
+    real.PutValue(L"HKLM\\Software\\Vendor", L"RealOnly", kRegDword, Dword(7));
+    real.PutValue(L"HKLM\\Software\\Vendor", L"Shared", kRegSz, WideSz(L"real"));
+    real.PutKey(L"HKLM\\Software\\Vendor\\RealChild");
+    real.PutKey(L"HKLM\\Software\\Vendor\\Hidden");
+  }
+};
+
+} // namespace
+
+TEST_CASE("RegistryOverlayEngine prefers local values and honors read-through", "[engine]") {
+  Fixture f;
+  const std::wstring key = L"HKLM\\Software\\Vendor";
+  const auto local = WideSz(L"local");
+  REQUIRE(f.engine.SetValue(key, L"Shared", kRegSz, local.data(), (uint32_t)local.size()));
+
+  SECTION("local-only mode never touches the backend") {
+    auto v = f.engine.ReadValue(key, L"RealOnly", nullptr);
+    CHECK(v.status == regstatus::kFileNotFound);
+    CHECK(v.source == RegistryOverlayEngine::Value::Source::None);
+    CHECK(f.real.GetCounters().opens == 0);
+  }
+
+  SECTION("read-through falls back for misses and closes temporary handles") {
+    f.engine.SetReadThrough(true);
+    auto shared = f.engine.ReadValue(key, L"shared", nullptr);
+    REQUIRE(shared.status == regstatus::kSuccess);
+    CHECK(shared.source == RegistryOverlayEngine::Value::Source::Local);
+    CHECK(shared.data == local);
+    CHECK(f.real.GetCounters().queries == 0);
+
+    auto realOnly = f.engine.ReadValue(key, L"RealOnly", nullptr);
+    REQUIRE(realOnly.status == regstatus::kSuccess);
+    CHECK(realOnly.source == RegistryOverlayEngine::Value::Source::Real);
+    CHECK(realOnly.type == kRegDword);
+    CHECK(realOnly.data == Dword(7));
+    CHECK(f.real.OpenHandleCount() == 0);
+  }
+
+  SECTION("read-through opens the key in the caller's registry view") {
+    f.engine.SetReadThrough(true);
+    const uint32_t kWow64_32Key = 0x0200;
+    REQUIRE(f.engine.ReadValue(key, L"RealOnly", nullptr, nullptr, kWow64_32Key).source ==
+            RegistryOverlayEngine::Value::Source::Real);
+    CHECK(f.real.GetCounters().lastViewFlags == kWow64_32Key);
+    REQUIRE(f.engine.ReadValues(key, {L"RealOnly"}, nullptr, nullptr, kWow64_32Key)[0].source ==
+            RegistryOverlayEngine::Value::Source::Real);
+    CHECK(f.real.GetCounters().lastViewFlags == kWow64_32Key);
+    f.engine.ReadValue(key, L"RealOnly", nullptr);
+    CHECK(f.real.GetCounters().lastViewFlags == 0);
+  }
+
+  SECTION("a local tombstone hides the real value") {
+    f.engine.SetReadThrough(true);
+    REQUIRE(f.engine.DeleteValue(key, L"RealOnly"));
+    auto v = f.engine.ReadValue(key, L"RealOnly", nullptr);
+    CHECK(v.status == regstatus::kFileNotFound);
+    CHECK(v.source == RegistryOverlayEngine::Value::Source::Tombstone);
+    CHECK(f.real.GetCounters().queries == 0);
+  }
+}
+
+TEST_CASE("RegistryOverlayEngine merges and sorts names case-insensitively", "[engine]") {
+  Fixture f;
+  f.engine.SetReadThrough(true);
+  const std::wstring key = L"HKLM\\Software\\Vendor";
+  const auto one = Dword(1);
+  REQUIRE(f.engine.SetValue(key, L"alpha", kRegDword, one.data(), 4));
+  REQUIRE(f.engine.SetValue(key, L"SHARED", kRegDword, one.data(), 4));
+  REQUIRE(f.engine.CreateKey(key + L"\\LocalChild"));
+  REQUIRE(f.engine.DeleteKeyTree(key + L"\\hidden"));
+
+  RealKeyHandle real = f.engine.OpenRealKey(key, 0);
+  REQUIRE(real != nullptr);
+
+  const auto values = f.engine.MergedValueNames(key, real);
+  CHECK(values == std::vector<std::wstring>{L"alpha", L"RealOnly", L"SHARED"});
+
+  const auto subkeys = f.engine.MergedSubKeyNames(key, real);
+  CHECK(subkeys == std::vector<std::wstring>{L"LocalChild", L"RealChild"});
+
+  const auto info = f.engine.QueryInfo(key, real);
+  CHECK(info.subKeyCount == 2);
+  CHECK(info.maxSubKeyLen == 10);
+  CHECK(info.valueCount == 3);
+  CHECK(info.maxValueNameLen == 8);
+  CHECK(info.maxValueLen == 4);
+
+  f.engine.CloseRealKey(real);
+  CHECK(f.real.OpenHandleCount() == 0);
+}
+
+TEST_CASE("RegistryOverlayEngine key probes reflect tombstones and rewrites", "[engine]") {
+  Fixture f;
+  const std::wstring key = L"HKLM\\Software\\Local\\Deep";
+  const auto one = Dword(1);
+
+  CHECK_FALSE(f.engine.ProbeKey(key).localExists);
+  REQUIRE(f.engine.SetValue(key, L"V", kRegDword, one.data(), 4));
+  CHECK(f.engine.ProbeKey(key).localExists);
+  CHECK(f.engine.ProbeKey(L"HKLM\\Software\\Local").localExists);
+
+  REQUIRE(f.engine.DeleteKeyTree(L"HKLM\\Software\\Local"));
+  CHECK(f.engine.ProbeKey(key).deleted);
+  CHECK(f.engine.MergedValueNames(key, nullptr).empty());
+
+  REQUIRE(f.engine.SetValue(key, L"V", kRegDword, one.data(), 4));
+  const auto state = f.engine.ProbeKey(key);
+  CHECK_FALSE(state.deleted);
+  CHECK(state.localExists);
+  CHECK(f.engine.MergedValueNames(key, nullptr) == std::vector<std::wstring>{L"V"});
+}
+
+TEST_CASE("RegistryOverlayEngine attributes lookups to the active stats call", "[engine]") {
+  Fixture f;
+  const std::wstring key = L"HKLM\\Software\\Vendor";
+  const auto local = WideSz(L"local");
+  REQUIRE(f.engine.SetValue(key, L"Shared", kRegSz, local.data(), (uint32_t)local.size()));
+  f.engine.SetReadThrough(true);
+
+  auto block = std::make_unique<RegistryStatsBlock>();
+  InitializeRegistryStatsBlock(block.get(), 1);
+  {
+    RegistryStatsCall call(block.get(), RegistryApi::RegQueryValueExW);
+    CHECK(f.engine.ReadValue(key, L"Shared", nullptr).source ==
+          RegistryOverlayEngine::Value::Source::Local);
+    CHECK(f.engine.ReadValue(key, L"RealOnly", nullptr).source ==
+          RegistryOverlayEngine::Value::Source::Real);
+  }
+  // Untracked work outside a call is not attributed anywhere.
+  f.engine.ReadValue(key, L"Shared", nullptr);
+
+  const auto snap = SnapshotRegistryStats(*block);
+  const auto& q = snap.apis[static_cast<size_t>(RegistryApi::RegQueryValueExW)];
+  CHECK(q.calls == 1);
+  CHECK(q.localHits == 1);
+  CHECK(q.localMisses == 1);
+  CHECK(q.readThroughs == 1);
+  CHECK(q.sqlite.Count() == 2);
+  CHECK(q.lockWait.Count() == 2);
+}
+
+TEST_CASE("RegistryOverlayEngine reuses and refreshes handle key state", "[engine]") {
+  Fixture f;
+  const std::wstring key = L"HKLM\\Software\\Cached";
+  const auto one = Dword(1);
+  const auto two = Dword(2);
+  REQUIRE(f.engine.CreateKey(key));
+
+  ResolvedKey handle;
+  const auto state = f.engine.ProbeKey(key, &handle);
+  CHECK(state.localExists);
+  CHECK(handle.generation != 0);
+  CHECK(handle.rowId != 0);
+
+  REQUIRE(f.engine.SetValue(key, L"V", kRegDword, one.data(), 4, &handle));
+  auto v = f.engine.LookupLocalValue(key, L"V", &handle);
+  CHECK(v.source == RegistryOverlayEngine::Value::Source::Local);
+  CHECK(v.data == one);
+
+  // Changes made through other paths are picked up on the next call.
+  REQUIRE(f.engine.SetValue(key, L"V", kRegDword, two.data(), 4));
+  CHECK(f.engine.LookupLocalValue(key, L"V", &handle).data == two);
+
+  REQUIRE(f.engine.DeleteKeyTree(key));
+  CHECK(f.engine.ReadValue(key, L"V", nullptr, &handle).source == RegistryOverlayEngine::Value::Source::Tombstone);
+  CHECK(f.engine.ProbeKey(key, &handle).deleted);
+
+  REQUIRE(f.engine.SetValue(key, L"V", kRegDword, one.data(), 4, &handle));
+  CHECK_FALSE(f.engine.ProbeKey(key, &handle).deleted);
+  REQUIRE(f.engine.DeleteValue(key, L"V", &handle));
+  CHECK(f.engine.LookupLocalValue(key, L"V", &handle).source == RegistryOverlayEngine::Value::Source::Tombstone);
+}
+
+TEST_CASE("RegistryOverlayEngine serves repeated handle reads from the last result", "[engine]") {
+  Fixture f;
+  const std::wstring key = L"HKLM\\Software\\Probe";
+  const auto one = Dword(1);
+  const auto two = Dword(2);
+  REQUIRE(f.engine.SetValue(key, L"V", kRegDword, one.data(), 4));
+
+  ResolvedKey handle;
+  REQUIRE(f.engine.ProbeKey(key, &handle).localExists);
+
+  // Size probe, then the data call: the second one runs no SQL.
+  CHECK(f.engine.LookupLocalValue(key, L"V", &handle).data == one);
+  const uint64_t afterProbe = f.store.StatementCount();
+  CHECK(f.engine.LookupLocalValue(key, L"V", &handle).data == one);
+  CHECK(f.store.StatementCount() == afterProbe);
+
+  // Other names, paths and handles miss; this one is absent, so the store's
+  // lookup filter answers it.
+  const uint64_t filtered = f.store.FilteredMissCount();
+  CHECK(f.engine.LookupLocalValue(key, L"Other", &handle).source == RegistryOverlayEngine::Value::Source::None);
+  CHECK(f.store.FilteredMissCount() == filtered + 1);
+
+  // A write anywhere invalidates it.
+  CHECK(f.engine.LookupLocalValue(key, L"V", &handle).data == one);
+  REQUIRE(f.engine.SetValue(key, L"V", kRegDword, two.data(), 4));
+  CHECK(f.engine.LookupLocalValue(key, L"V", &handle).data == two);
+
+  // Reuse is bounded so a polling loop still reaches the store.
+  const uint64_t before = f.store.StatementCount();
+  for (int i = 0; i < 8; i++) {
+    CHECK(f.engine.LookupLocalValue(key, L"V", &handle).data == two);
+  }
+  CHECK(f.store.StatementCount() > before);
+}
+
+TEST_CASE("RegistryOverlayEngine reads several values with read-through for local misses", "[engine]") {
+  Fixture f;
+  f.engine.SetReadThrough(true);
+  REQUIRE(f.engine.SetValue(L"HKLM\\Software\\Vendor", L"Shared", kRegSz, WideSz(L"local").data(), 12));
+  REQUIRE(f.engine.SetValue(L"HKLM\\Software\\Vendor", L"LocalOnly", kRegDword, Dword(3).data(), 4));
+
+  ResolvedKey state;
+  const std::vector<std::wstring> names{L"shared", L"RealOnly", L"LocalOnly", L"Missing"};
+  auto values = f.engine.ReadValues(L"HKLM\\Software\\Vendor", names, nullptr, &state);
+  REQUIRE(values.size() == 4);
+  CHECK(values[0].source == RegistryOverlayEngine::Value::Source::Local);
+  CHECK(values[0].data == WideSz(L"local"));
+  CHECK(values[1].source == RegistryOverlayEngine::Value::Source::Real);
+  CHECK(values[1].data == Dword(7));
+  CHECK(values[2].source == RegistryOverlayEngine::Value::Source::Local);
+  CHECK(values[2].status == regstatus::kSuccess);
+  CHECK(values[3].source == RegistryOverlayEngine::Value::Source::None);
+  CHECK(values[3].status == regstatus::kFileNotFound);
+
+  REQUIRE(f.engine.DeleteValue(L"HKLM\\Software\\Vendor", L"RealOnly"));
+  values = f.engine.ReadValues(L"HKLM\\Software\\Vendor", names, nullptr, &state);
+  CHECK(values[1].source == RegistryOverlayEngine::Value::Source::Tombstone);
+  CHECK(values[1].status == regstatus::kFileNotFound);
+
+  f.engine.SetReadThrough(false);
+  values = f.engine.ReadValues(L"HKLM\\Software\\Vendor", {L"Shared", L"RealOnly"}, nullptr);
+  CHECK(values[0].source == RegistryOverlayEngine::Value::Source::Local);
+  CHECK(values[1].source == RegistryOverlayEngine::Value::Source::Tombstone);
+}
+
+TEST_CASE("PackMultipleValues follows RegQueryMultipleValues buffer sizing", "[engine]") {
+  std::vector<RegistryOverlayEngine::Value> values(3);
+  for (auto& v : values) {
+    v.status = regstatus::kSuccess;
+    v.source = RegistryOverlayEngine::Value::Source::Local;
+  }
+  values[0].type = kRegDword;
+  values[0].data = Dword(0x11223344);
+  values[1].type = kRegSz;
+  values[1].data = WideSz(L"ab");
+  values[2].type = kRegSz; // empty value: no bytes, but still a slot
+
+  std::vector<uint32_t> offsets;
+
+  SECTION("null buffer reports the total") {
+    uint32_t size = 1000;
+    CHECK(PackMultipleValues(values, nullptr, size, offsets) == regstatus::kMoreData);
+    CHECK(size == 10);
+    CHECK(offsets.empty());
+  }
+
+  SECTION("short buffer reports the total and writes nothing") {
+    std::vector<uint8_t> buf(9, 0xCC);
+    uint32_t size = (uint32_t)buf.size();
+    CHECK(PackMultipleValues(values, buf.data(), size, offsets) == regstatus::kMoreData);
+    CHECK(size == 10);
+    CHECK(buf == std::vector<uint8_t>(9, 0xCC));
+  }
+
+  SECTION("exact buffer is filled contiguously") {
+    std::vector<uint8_t> buf(10, 0xCC);
+    uint32_t size = (uint32_t)buf.size();
+    REQUIRE(PackMultipleValues(values, buf.data(), size, offsets) == regstatus::kSuccess);
+    CHECK(size == 10);
+    CHECK(offsets == std::vector<uint32_t>{0, 4, 10});
+    CHECK(std::vector<uint8_t>(buf.begin(), buf.begin() + 4) == Dword(0x11223344));
+    CHECK(std::vector<uint8_t>(buf.begin() + 4, buf.end()) == WideSz(L"ab"));
+  }
+
+  SECTION("a missing value fails the whole call") {
+    values[1] = RegistryOverlayEngine::Value{};
+    uint32_t size = 64;
+    CHECK(PackMultipleValues(values, nullptr, size, offsets) == regstatus::kFileNotFound);
+    CHECK(size == 64);
+  }
+}
+
+TEST_CASE("RegistryOverlayEngine queues writes that overrun the store budget", "[engine][wal]") {
+  const std::wstring dbPath = MakeTempDbPath();
+  LocalRegistryStore store;
+  REQUIRE(store.Open(dbPath));
+  RegistryOverlayEngine engine(store, nullptr);
+  engine.SetStoreBudgets(std::chrono::milliseconds(20), std::chrono::milliseconds(20));
+  const std::wstring key = L"HKLM\\Software\\Vendor";
+  const auto one = Dword(1);
+  const auto two = Dword(2);
+  REQUIRE(engine.SetValue(key, L"Size", kRegDword, one.data(), 4));
+
+  sqlite3* lockDb = nullptr;
+  const std::string dbPathUtf8 = WideToUtf8(dbPath);
+  REQUIRE(sqlite3_open_v2(dbPathUtf8.c_str(), &lockDb, SQLITE_OPEN_READWRITE, nullptr) == SQLITE_OK);
+  REQUIRE(sqlite3_exec(lockDb, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr) == SQLITE_OK);
+
+  auto block = std::make_unique<RegistryStatsBlock>();
+  InitializeRegistryStatsBlock(block.get(), 1);
+  {
+    RegistryStatsCall call(block.get(), RegistryApi::RegSetValueExW);
+    CHECK(engine.SetValue(key, L"Size", kRegDword, two.data(), 4));
+  }
+  CHECK(SnapshotRegistryStats(*block).apis[static_cast<size_t>(RegistryApi::RegSetValueExW)].budgetOverruns == 1);
+  CHECK(engine.DeleteValue(key, L"Size2"));
+  CHECK(engine.PendingWriteCount() == 2);
+  CHECK_FALSE(engine.FlushPendingWrites(std::chrono::milliseconds(10)));
+
+  // Lookups see the queued write before it reaches the store.
+  auto v = engine.LookupLocalValue(key, L"Size");
+  CHECK(v.status == regstatus::kSuccess);
+  CHECK(v.data == two);
+  CHECK(store.GetValue(key, L"Size")->data == one);
+
+  REQUIRE(sqlite3_exec(lockDb, "COMMIT;", nullptr, nullptr, nullptr) == SQLITE_OK);
+  sqlite3_close(lockDb);
+
+  CHECK(engine.FlushPendingWrites());
+  CHECK(engine.PendingWriteCount() == 0);
+  CHECK(store.GetValue(key, L"Size")->data == two);
+  CHECK(store.GetValue(key, L"Size2")->isDeleted);
+}
+
+TEST_CASE("RegistryOverlayEngine counts rewrites of unchanged values as elided", "[engine]") {
+  Fixture f;
+  const std::wstring key = L"HKLM\\Software\\Vendor";
+  const auto one = Dword(1);
+  const auto two = Dword(2);
+
+  auto block = std::make_unique<RegistryStatsBlock>();
+  InitializeRegistryStatsBlock(block.get(), 1);
+  for (const auto* data : {&one, &one, &one, &two}) {
+    RegistryStatsCall call(block.get(), RegistryApi::RegSetValueExW);
+    REQUIRE(f.engine.SetValue(key, L"Size", kRegDword, data->data(), 4));
+  }
+  const auto& set = SnapshotRegistryStats(*block).apis[static_cast<size_t>(RegistryApi::RegSetValueExW)];
+  CHECK(set.calls == 4);
+  CHECK(set.elidedWrites == 2);
+  CHECK(f.store.ElidedWriteCount() == 2);
+
+  auto v = f.engine.LookupLocalValue(key, L"Size");
+  CHECK(v.status == regstatus::kSuccess);
+  CHECK(v.data == two);
+}
+
+TEST_CASE("ParseStoreBudgets accepts one or two millisecond counts", "[engine]") {
+  std::chrono::milliseconds read{-1};
+  std::chrono::milliseconds write{-1};
+  CHECK(ParseStoreBudgets(L"25", read, write));
+  CHECK(read.count() == 25);
+  CHECK(write.count() == 25);
+  CHECK(ParseStoreBudgets(L"5,100", read, write));
+  CHECK(read.count() == 5);
+  CHECK(write.count() == 100);
+  CHECK(ParseStoreBudgets(L"0", read, write));
+  CHECK(read.count() == 0);
+
+  for (const wchar_t* bad : {L"", L",", L"5,", L"-1", L"1,2,3", L"12345678", L"ten"}) {
+    CHECK_FALSE(ParseStoreBudgets(bad, read, write));
+  }
+  CHECK(read.count() == 0);
+}
+
+TEST_CASE("RegistryOverlayEngine records an access profile once per name", "[engine][profile]") {
+  Fixture f;
+  const std::wstring key = L"HKLM\\Software\\Vendor";
+  f.engine.ProbeKey(key); // before recording starts: not noted
+
+  f.engine.StartAccessProfile(std::chrono::steady_clock::now() + std::chrono::hours(1));
+  f.engine.ProbeKey(key);
+  f.engine.ReadValue(key, L"Shared", nullptr);
+  f.engine.ReadValue(L"HKLM\\SOFTWARE\\VENDOR", L"shared", nullptr);
+  f.engine.ReadValues(key, {L"Shared", L"RealOnly"}, nullptr);
+  f.engine.ProbeKey(L"hklm\\software\\vendor");
+
+  auto profile = f.engine.TakeAccessProfile();
+  REQUIRE(profile.size() == 3);
+  CHECK(profile[0].isKey);
+  CHECK(profile[0].keyPath == key);
+  CHECK(profile[1].valueName == L"Shared");
+  CHECK(profile[2].valueName == L"RealOnly");
+
+  // Stopped: nothing more is noted, and an expired window notes nothing.
+  f.engine.ReadValue(key, L"Other", nullptr);
+  CHECK(f.engine.TakeAccessProfile().empty());
+  f.engine.StartAccessProfile(std::chrono::steady_clock::now() - std::chrono::seconds(1));
+  f.engine.ReadValue(key, L"Other", nullptr);
+  CHECK(f.engine.TakeAccessProfile().empty());
+}
+
+TEST_CASE("RegistryOverlayEngine answers prefetched lookups without SQL", "[engine][profile]") {
+  const std::wstring dbPath = MakeTempDbPath();
+  LocalRegistryStore store;
+  REQUIRE(store.Open(dbPath));
+  RegistryOverlayEngine engine(store, nullptr);
+  const std::wstring key = L"HKLM\\Software\\Vendor";
+  const std::wstring other = L"HKLM\\Software\\Other";
+  REQUIRE(engine.SetValue(key, L"Size", kRegDword, Dword(1).data(), 4));
+  REQUIRE(engine.SetValue(other, L"Size", kRegDword, Dword(5).data(), 4));
+
+  std::vector<AccessProfileEntry> profile(4);
+  profile[0] = {key, true, L""};
+  profile[1] = {key, false, L"Size"};
+  profile[2] = {key, false, L"Missing"};
+  profile[3] = {other, false, L"Size"};
+  CHECK(engine.Prefetch(profile) == 5); // two keys, three values
+
+  const uint64_t statements = store.StatementCount();
+  ResolvedKey handle;
+  auto state = engine.ProbeKey(key, &handle);
+  CHECK(state.localExists);
+  CHECK(handle.generation == store.Generation());
+  CHECK(engine.LookupLocalValue(key, L"size", &handle).data == Dword(1));
+  CHECK(engine.LookupLocalValue(key, L"Missing").source == RegistryOverlayEngine::Value::Source::None);
+  auto both = engine.ReadValues(key, {L"Size", L"Missing"}, nullptr);
+  CHECK(both[0].data == Dword(1));
+  CHECK(store.StatementCount() == statements);
+  CHECK(engine.GetPrefetchCounters().hits == 5);
+  CHECK(engine.GetPrefetchCounters().misses == 0);
+
+  // Not in the profile: a miss that goes to the store.
+  CHECK(engine.LookupLocalValue(key, L"Unlisted").source == RegistryOverlayEngine::Value::Source::None);
+  CHECK(engine.GetPrefetchCounters().misses == 1);
+
+  // An own write drops what it affects and keeps the rest.
+  REQUIRE(engine.SetValue(key, L"Size", kRegDword, Dword(2).data(), 4));
+  CHECK(engine.LookupLocalValue(key, L"Size").data == Dword(2));
+  const uint64_t hits = engine.GetPrefetchCounters().hits;
+  CHECK(engine.LookupLocalValue(other, L"Size").data == Dword(5));
+  CHECK(engine.GetPrefetchCounters().hits == hits + 1);
+
+  // Another connection's commit drops everything.
+  {
+    LocalRegistryStore second;
+    REQUIRE(second.Open(dbPath));
+    REQUIRE(second.PutValue(other, L"Size", kRegDword, Dword(6).data(), 4));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  CHECK(engine.LookupLocalValue(other, L"Size").data == Dword(6));
+  CHECK(engine.GetPrefetchCounters().hits == hits + 1);
+}
@@ -0,0 +1,153 @@
+#include "common/registry_stats.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace twinshim;
+
+namespace {
+
+std::unique_ptr<RegistryStatsBlock> MakeBlock() {
+  auto block = std::make_unique<RegistryStatsBlock>();
+  InitializeRegistryStatsBlock(block.get(), 1234);
+  return block;
+}
+
+uint32_t CurrentPid() {
+#if defined(_WIN32)
+  return (uint32_t)GetCurrentProcessId();
+#else
+  return (uint32_t)getpid();
+#endif
+}
+
+} // namespace
+
+TEST_CASE("Latency buckets are log2 in nanoseconds", "[stats]") {
+  CHECK(LatencyBucketIndex(0) == 0);
+  CHECK(LatencyBucketIndex(1) == 0);
+  CHECK(LatencyBucketIndex(2) == 1);
+  CHECK(LatencyBucketIndex(3) == 1);
+  CHECK(LatencyBucketIndex(1024) == 10);
+  CHECK(LatencyBucketIndex(2047) == 10);
+  CHECK(LatencyBucketIndex(~uint64_t(0)) == kLatencyBucketCount - 1);
+  CHECK(LatencyBucketUpperNs(10) == 2048);
+}
+
+TEST_CASE("LatencySnapshot percentiles report bucket upper bounds", "[stats]") {
+  LatencySnapshot h;
+  CHECK(h.PercentileNs(50) == 0);
+
+  h.buckets[LatencyBucketIndex(100)] = 90; // [64, 128)
+  h.buckets[LatencyBucketIndex(5000)] = 10; // [4096, 8192)
+  CHECK(h.Count() == 100);
+  CHECK(h.PercentileNs(50) == 128);
+  CHECK(h.PercentileNs(90) == 128);
+  CHECK(h.PercentileNs(91) == 8192);
+  CHECK(h.PercentileNs(100) == 8192);
+}
+
+TEST_CASE("RegistryStatsCall charges only the outermost call on a thread", "[stats]") {
+  auto block = MakeBlock();
+  REQUIRE(IsRegistryStatsBlockValid(block.get()));
+
+  // Outside any call the attribution helpers are no-ops.
+  CHECK_FALSE(RegistryStatsActive());
+  NoteRegistryStatsLocalLookup(true);
+  NoteRegistryStatsReadThrough();
+
+  {
+    RegistryStatsCall outer(block.get(), RegistryApi::RegOpenKeyW);
+    CHECK(RegistryStatsActive());
+    {
+      RegistryStatsCall inner(block.get(), RegistryApi::RegOpenKeyExW);
+      NoteRegistryStatsLocalLookup(false);
+      NoteRegistryStatsReadThrough();
+      NoteRegistryStatsBudgetOverrun();
+      NoteRegistryStatsElidedWrite();
+      RecordRegistryStatsSqliteNs(300);
+      RecordRegistryStatsLockWaitNs(0);
+    }
+    CHECK(RegistryStatsActive());
+  }
+  CHECK_FALSE(RegistryStatsActive());
+  {
+    RegistryStatsCall disabled(nullptr, RegistryApi::RegCloseKey);
+    CHECK_FALSE(RegistryStatsActive());
+  }
+
+  const auto snap = SnapshotRegistryStats(*block);
+  const auto& open = snap.apis[static_cast<size_t>(RegistryApi::RegOpenKeyW)];
+  CHECK(open.calls == 1);
+  CHECK(open.localHits == 0);
+  CHECK(open.localMisses == 1);
+  CHECK(open.readThroughs == 1);
+  CHECK(open.budgetOverruns == 1);
+  CHECK(open.elidedWrites == 1);
+  CHECK(open.latency.Count() == 1);
+  CHECK(open.sqlite.Count() == 1);
+  CHECK(open.sqlite.totalNs == 300);
+  CHECK(open.lockWait.buckets[0] == 1);
+  CHECK(snap.apis[static_cast<size_t>(RegistryApi::RegOpenKeyExW)].calls == 0);
+  CHECK(snap.apis[static_cast<size_t>(RegistryApi::RegCloseKey)].calls == 0);
+}
+
+TEST_CASE("Snapshots sum per-thread shards and diff over an interval", "[stats]") {
+  auto block = MakeBlock();
+  const auto before = SnapshotRegistryStats(*block);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&block] {
+      for (int i = 0; i < 1000; i++) {
+        RegistryStatsCall call(block.get(), RegistryApi::RegQueryValueExW);
+        NoteRegistryStatsLocalLookup(i % 4 != 0);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  const auto after = SnapshotRegistryStats(*block);
+  const auto delta = DiffRegistryStats(after, before);
+  const auto& q = delta.apis[static_cast<size_t>(RegistryApi::RegQueryValueExW)];
+  CHECK(q.calls == 8000);
+  CHECK(q.localHits == 6000);
+  CHECK(q.localMisses == 2000);
+  CHECK(q.latency.Count() == 8000);
+
+  const std::wstring table = FormatRegistryStatsTable(after, &delta, 1.0);
+  CHECK(table.find(L"RegQueryValueExW") != std::wstring::npos);
+  CHECK(table.find(L"8000") != std::wstring::npos);
+  CHECK(table.find(L"RegOpenKeyExW") == std::wstring::npos);
+}
+
+TEST_CASE("RegistryStatsMapping publishes a block another mapping can read", "[stats]") {
+  const uint32_t pid = CurrentPid();
+  RegistryStatsMapping writer;
+  REQUIRE(writer.Create(pid));
+  {
+    RegistryStatsCall call(writer.Block(), RegistryApi::RegEnumKeyExW);
+  }
+
+  RegistryStatsMapping reader;
+  REQUIRE(reader.Open(pid));
+  CHECK(reader.Block() != writer.Block());
+  CHECK(reader.Block()->pid == pid);
+  const auto snap = SnapshotRegistryStats(*reader.Block());
+  CHECK(snap.apis[static_cast<size_t>(RegistryApi::RegEnumKeyExW)].calls == 1);
+
+  reader.Close();
+  writer.Close();
+  CHECK_FALSE(reader.Open(pid));
+}
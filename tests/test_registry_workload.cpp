@@ -0,0 +1,255 @@
+#include "common/local_registry_store.h"
+#include "common/registry_overlay_engine.h"
+#include "common/registry_workload.h"
+#include "test_tmp.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace twinshim;
+
+namespace {
+
+constexpr uint32_t kRegDword = 4;
+
+std::filesystem::path MakeTempPath(const char* prefix, const char* ext) {
+  auto base = testutil::GetTestTempDir("workload");
+  REQUIRE_FALSE(base.empty());
+
+  static size_t counter = 0;
+  counter++;
+
+  auto path = base / (std::string(prefix) + "-" + std::to_string(counter) + ext);
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+  return path;
+}
+
+RegistryWorkloadRecord MakeRecord(RegistryApi api,
+                                  const std::wstring& keyPath,
+                                  const std::wstring& subKey,
+                                  const std::wstring& valueName) {
+  RegistryWorkloadRecord rec;
+  rec.op.api = api;
+  rec.keyPath = keyPath;
+  rec.subKey = subKey;
+  rec.valueName = valueName;
+  return rec;
+}
+
+} // namespace
+
+TEST_CASE("workload capture round-trips through the binary format", "[workload]") {
+  const auto path = MakeTempPath("capture", ".twwl").wstring();
+
+  RegistryWorkloadOp set;
+  set.api = RegistryApi::RegSetValueExW;
+  set.flags = kWorkloadHasBuffer;
+  set.type = kRegDword;
+  set.bufferSize = 4;
+  set.status = 0;
+  set.startNs = 1000;
+  set.durationNs = 250;
+
+  RegistryWorkloadOp probe;
+  probe.api = RegistryApi::RegQueryValueExA;
+  probe.dataSize = 4;
+  probe.status = 234; // ERROR_MORE_DATA
+  probe.startNs = 2000;
+
+  const std::wstring nonBmp = std::wstring(L"Café ") + (sizeof(wchar_t) == 2 ? std::wstring(L"\xD83D\xDE00")
+                                                                                    : std::wstring(1, wchar_t(0x1F600)));
+
+  {
+    RegistryWorkloadWriter writer;
+    REQUIRE(writer.Open(path));
+    REQUIRE(writer.IsOpen());
+    writer.Append(set, L"HKLM\\Software\\Vendor", L"App", nonBmp);
+    writer.Append(probe, L"HKLM\\Software\\Vendor", L"App", nonBmp);
+    writer.Close();
+    REQUIRE_FALSE(writer.IsOpen());
+  }
+
+  std::vector<RegistryWorkloadRecord> records;
+  REQUIRE(ReadRegistryWorkload(path, records));
+  REQUIRE(records.size() == 2);
+
+  CHECK(records[0].op.api == RegistryApi::RegSetValueExW);
+  CHECK(records[0].op.flags == kWorkloadHasBuffer);
+  CHECK(records[0].op.type == kRegDword);
+  CHECK(records[0].op.bufferSize == 4);
+  CHECK(records[0].op.startNs == 1000);
+  CHECK(records[0].op.durationNs == 250);
+  CHECK(records[0].keyPath == L"HKLM\\Software\\Vendor");
+  CHECK(records[0].subKey == L"App");
+  CHECK(records[0].valueName == nonBmp);
+
+  CHECK(records[1].op.api == RegistryApi::RegQueryValueExA);
+  CHECK(records[1].op.flags == 0);
+  CHECK(records[1].op.dataSize == 4);
+  CHECK(records[1].op.status == 234);
+  CHECK(records[1].valueName == nonBmp);
+
+  // Strings are interned: a repeated call costs exactly one op record.
+  const auto onePath = MakeTempPath("capture", ".twwl");
+  {
+    RegistryWorkloadWriter writer;
+    REQUIRE(writer.Open(onePath.wstring()));
+    writer.Append(set, L"HKLM\\Software\\Vendor", L"App", nonBmp);
+  }
+  std::error_code ec;
+  const auto twoSize = std::filesystem::file_size(std::filesystem::path(path), ec);
+  REQUIRE_FALSE(ec);
+  const auto oneSize = std::filesystem::file_size(onePath, ec);
+  REQUIRE_FALSE(ec);
+  const uintmax_t opRecordSize = 4 + 7 * 4 + 8 + 4;
+  CHECK(twoSize - oneSize == opRecordSize);
+}
+
+TEST_CASE("workload reader rejects bad headers and truncated records", "[workload]") {
+  const auto path = MakeTempPath("bad", ".twwl");
+
+  SECTION("missing file") {
+    std::vector<RegistryWorkloadRecord> records;
+    CHECK_FALSE(ReadRegistryWorkload(path.wstring(), records));
+  }
+
+  SECTION("wrong magic") {
+    {
+      std::ofstream f(path, std::ios::binary);
+      f << "not a workload capture";
+    }
+    std::vector<RegistryWorkloadRecord> records;
+    CHECK_FALSE(ReadRegistryWorkload(path.wstring(), records));
+  }
+
+  SECTION("truncated op") {
+    {
+      RegistryWorkloadWriter writer;
+      REQUIRE(writer.Open(path.wstring()));
+      RegistryWorkloadOp op;
+      op.api = RegistryApi::RegOpenKeyExW;
+      writer.Append(op, L"HKLM", L"Software", L"");
+    }
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(path, ec);
+    REQUIRE_FALSE(ec);
+    std::filesystem::resize_file(path, size - 3, ec);
+    REQUIRE_FALSE(ec);
+
+    std::vector<RegistryWorkloadRecord> records;
+    CHECK_FALSE(ReadRegistryWorkload(path.wstring(), records));
+  }
+}
+
+TEST_CASE("workload target key resolves HKLM handles only", "[workload]") {
+  CHECK(RegistryWorkloadTargetKey(MakeRecord(RegistryApi::RegOpenKeyExW, L"HKLM", L"\\Software/Vendor\\", L"")) ==
+        L"HKLM\\Software\\Vendor");
+  CHECK(RegistryWorkloadTargetKey(MakeRecord(RegistryApi::RegQueryValueExW, L"HKLM\\Software", L"", L"x")) ==
+        L"HKLM\\Software");
+  CHECK(RegistryWorkloadTargetKey(MakeRecord(RegistryApi::RegOpenKeyExW, L"HKCU", L"Software", L"")).empty());
+  CHECK(RegistryWorkloadTargetKey(MakeRecord(RegistryApi::RegOpenKeyExW, L"HKLMX", L"Software", L"")).empty());
+}
+
+TEST_CASE("workload replay drives the overlay engine", "[workload]") {
+  LocalRegistryStore store;
+  REQUIRE(store.Open(MakeTempPath("replay", ".sqlite").wstring()));
+  RegistryOverlayEngine engine(store, nullptr);
+
+  std::vector<RegistryWorkloadRecord> records;
+  records.push_back(MakeRecord(RegistryApi::RegCreateKeyExW, L"HKLM", L"Software\\Vendor", L""));
+  auto set = MakeRecord(RegistryApi::RegSetValueExW, L"HKLM\\Software\\Vendor", L"", L"Size");
+  set.op.type = kRegDword;
+  set.op.bufferSize = 4;
+  records.push_back(set);
+  records.push_back(MakeRecord(RegistryApi::RegQueryValueExW, L"HKLM\\Software\\Vendor", L"", L"Size"));
+  records.push_back(MakeRecord(RegistryApi::RegEnumValueW, L"HKLM\\Software\\Vendor", L"", L""));
+  records.push_back(MakeRecord(RegistryApi::RegCloseKey, L"HKLM\\Software\\Vendor", L"", L""));
+  records.push_back(MakeRecord(RegistryApi::RegQueryValueExW, L"HKCU\\Software", L"", L"Other"));
+
+  RegistryWorkloadReplayOptions options;
+  options.iterations = 2;
+  const auto report = ReplayRegistryWorkload(engine, records, options);
+
+  CHECK(report.ops == 8);
+  CHECK(report.skipped == 4);
+  CHECK(report.perApiOps[static_cast<size_t>(RegistryApi::RegSetValueExW)] == 2);
+  CHECK(report.perApiOps[static_cast<size_t>(RegistryApi::RegQueryValueExW)] == 2);
+  CHECK(report.perApiOps[static_cast<size_t>(RegistryApi::RegCloseKey)] == 0);
+  CHECK(report.p50Ns <= report.p90Ns);
+  CHECK(report.p90Ns <= report.p99Ns);
+  CHECK(report.p99Ns <= report.maxNs);
+  CHECK(report.seconds > 0);
+
+  auto stored = store.GetValue(L"HKLM\\Software\\Vendor", L"Size");
+  REQUIRE(stored.has_value());
+  CHECK(stored->type == kRegDword);
+  CHECK(stored->data.size() == 4);
+  // The second pass rewrites Size with different bytes: a real write, not
+  // an elided one.
+  CHECK(store.ElidedWriteCount() == 0);
+}
+
+TEST_CASE("workload replay counts statements per logical read", "[workload]") {
+  std::vector<RegistryWorkloadRecord> records;
+  auto set = MakeRecord(RegistryApi::RegSetValueExW, L"HKLM\\Software\\Vendor\\App\\Settings", L"", L"Size");
+  set.op.type = kRegDword;
+  set.op.bufferSize = 4;
+  records.push_back(set);
+  records.push_back(MakeRecord(RegistryApi::RegOpenKeyExW, L"HKLM", L"Software\\Vendor\\App\\Settings", L""));
+  for (const wchar_t* name : {L"Size", L"Missing"}) {
+    // Size probe, then the data call.
+    auto probe = MakeRecord(RegistryApi::RegQueryValueExW, L"HKLM\\Software\\Vendor\\App\\Settings", L"", name);
+    records.push_back(probe);
+    auto data = probe;
+    data.op.flags = kWorkloadHasBuffer;
+    records.push_back(data);
+  }
+
+  auto run = [&](bool handleState) {
+    LocalRegistryStore store;
+    REQUIRE(store.Open(MakeTempPath("stmts", ".sqlite").wstring()));
+    RegistryOverlayEngine engine(store, nullptr);
+    RegistryWorkloadReplayOptions options;
+    options.handleState = handleState;
+    return ReplayRegistryWorkload(engine, records, options);
+  };
+
+  const auto cached = run(true);
+  const auto uncached = run(false);
+  CHECK(cached.readOps == 4);
+  CHECK(cached.logicalReads == 2);
+  CHECK(uncached.logicalReads == 2);
+  CHECK(cached.statements > 0);
+  CHECK(cached.StatementsPerLogicalRead() > 0);
+  CHECK(cached.StatementsPerLogicalRead() < uncached.StatementsPerLogicalRead());
+}
+
+TEST_CASE("workload replay batches RegQueryMultipleValues names", "[workload]") {
+  LocalRegistryStore store;
+  REQUIRE(store.Open(MakeTempPath("multi", ".sqlite").wstring()));
+  RegistryOverlayEngine engine(store, nullptr);
+  const uint8_t one = 1;
+  REQUIRE(store.PutValue(L"HKLM\\Software\\Vendor", L"A", kRegDword, &one, 1));
+  // Build the lookup filter up front so neither run pays for it.
+  store.Warm(0);
+
+  auto replay = [&](const std::wstring& names) {
+    std::vector<RegistryWorkloadRecord> records;
+    records.push_back(MakeRecord(RegistryApi::RegQueryMultipleValuesW, L"HKLM\\Software\\Vendor", L"", names));
+    return ReplayRegistryWorkload(engine, records, RegistryWorkloadReplayOptions{});
+  };
+
+  const auto single = replay(L"A");
+  const auto triple = replay(std::wstring(L"A\0B\0C", 5));
+  CHECK(triple.ops == 1);
+  CHECK(triple.readOps == 1);
+  CHECK(triple.logicalReads == 1);
+  // Extra names ride along in the same query (give or take one poll for
+  // other connections' commits).
+  CHECK(triple.statements <= single.statements + 1);
+}
@@ -0,0 +1,173 @@
+#include "scale/tiled_scale.h"
+
+#include "scale/filter_weights.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+using namespace twinshim;
+
+namespace {
+
+constexpr ScaleFilter kAllFilters[] = {
+    ScaleFilter::kPoint,
+    ScaleFilter::kBilinear,
+    ScaleFilter::kBicubic,
+    ScaleFilter::kCatmullRom,
+    ScaleFilter::kLanczos2,
+    ScaleFilter::kLanczos3,
+};
+
+struct Image {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> pixels;
+
+  Image(int w, int h) : width(w), height(h), pixels((size_t)w * (size_t)h * 4, 0xCD) {}
+
+  ImageView View() const { return {pixels.data(), width, height, (ptrdiff_t)width * 4}; }
+  MutableImageView Mutable() { return {pixels.data(), width, height, (ptrdiff_t)width * 4}; }
+};
+
+Image Noise(int w, int h, uint32_t seed) {
+  Image img(w, h);
+  uint32_t state = seed;
+  for (auto& b : img.pixels) {
+    state = state * 1664525u + 1013904223u;
+    b = (uint8_t)(state >> 24);
+  }
+  return img;
+}
+
+} // namespace
+
+TEST_CASE("Tiled scaling matches ImageScaler byte for byte", "[tiled_scale]") {
+  struct Case {
+    int srcW, srcH, dstW, dstH;
+  };
+  const Case cases[] = {
+      {64, 48, 160, 120},
+      {17, 13, 61, 47},
+      {160, 100, 21, 9},
+      {1, 1, 5, 3},
+      {40, 30, 40, 30},
+  };
+  for (int workers : {0, 2, 7}) {
+    ImageWorkerPool pool(workers, false);
+    for (int stripeRows : {1, 5, TiledImageScaler::kDefaultStripeRows}) {
+      for (ScaleIsa isa : SupportedScaleIsas()) {
+        TiledImageScaler tiled(&pool, isa);
+        tiled.SetStripeRows(stripeRows);
+        ImageScaler reference(isa);
+        for (const auto& c : cases) {
+          const Image src = Noise(c.srcW, c.srcH, (uint32_t)(c.srcH * 7 + c.dstW));
+          for (ScaleFilter filter : kAllFilters) {
+            Image expected(c.dstW, c.dstH);
+            Image actual(c.dstW, c.dstH);
+            REQUIRE(reference.Scale(src.View(), expected.Mutable(), filter));
+            INFO("workers=" << workers << " stripe=" << stripeRows << " " << ScaleIsaName(isa) << " "
+                            << ScaleFilterName(filter) << " " << c.srcW << "x" << c.srcH << " -> " << c.dstW << "x"
+                            << c.dstH);
+            REQUIRE(tiled.Scale(src.View(), actual.Mutable(), filter));
+            CHECK(actual.pixels == expected.pixels);
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("TiledImageScaler rejects what ImageScaler rejects", "[tiled_scale]") {
+  ImageWorkerPool pool(1, false);
+  TiledImageScaler tiled(&pool);
+  Image src(4, 4);
+  Image dst(8, 8);
+  CHECK_FALSE(tiled.Scale(ImageView{}, dst.Mutable(), ScaleFilter::kBilinear));
+  CHECK_FALSE(tiled.Scale(src.View(), MutableImageView{}, ScaleFilter::kBilinear));
+  CHECK(tiled.NsPerTap() == 0.0);
+  CHECK(tiled.Scale(src.View(), dst.Mutable(), ScaleFilter::kBilinear));
+  CHECK(tiled.NsPerTap() > 0.0);
+}
+
+TEST_CASE("CheaperScaleFilter walks down to point", "[tiled_scale]") {
+  CHECK(CheaperScaleFilter(ScaleFilter::kLanczos3) == ScaleFilter::kLanczos2);
+  CHECK(CheaperScaleFilter(ScaleFilter::kLanczos2) == ScaleFilter::kBilinear);
+  CHECK(CheaperScaleFilter(ScaleFilter::kCatmullRom) == ScaleFilter::kBilinear);
+  CHECK(CheaperScaleFilter(ScaleFilter::kBicubic) == ScaleFilter::kBilinear);
+  CHECK(CheaperScaleFilter(ScaleFilter::kBilinear) == ScaleFilter::kPoint);
+  CHECK(CheaperScaleFilter(ScaleFilter::kPoint) == ScaleFilter::kPoint);
+}
+
+TEST_CASE("ScaleWithin degrades to meet the budget and recovers", "[tiled_scale]") {
+  ImageWorkerPool pool(1, false);
+  TiledImageScaler tiled(&pool);
+  const Image src = Noise(96, 64, 3);
+  Image dst(288, 192);
+
+  // No history: the requested filter runs whatever the budget.
+  ScaleFilter used = ScaleFilter::kPoint;
+  REQUIRE(tiled.ScaleWithin(src.View(), dst.Mutable(), ScaleFilter::kLanczos3, 1e-9, &used));
+  CHECK(used == ScaleFilter::kLanczos3);
+
+  // Nothing fits a nanosecond budget, so it goes all the way down.
+  REQUIRE(tiled.ScaleWithin(src.View(), dst.Mutable(), ScaleFilter::kLanczos3, 1e-6, &used));
+  CHECK(used == ScaleFilter::kPoint);
+  Image point(288, 192);
+  REQUIRE(ScaleImage(src.View(), point.Mutable(), ScaleFilter::kPoint));
+  CHECK(dst.pixels == point.pixels);
+
+  // A generous budget brings the requested filter back.
+  REQUIRE(tiled.ScaleWithin(src.View(), dst.Mutable(), ScaleFilter::kLanczos3, 1e6, &used));
+  CHECK(used == ScaleFilter::kLanczos3);
+  REQUIRE(tiled.ScaleWithin(src.View(), dst.Mutable(), ScaleFilter::kCatmullRom, 1e6, &used));
+  CHECK(used == ScaleFilter::kCatmullRom);
+}
+
+TEST_CASE("ScaleWithin needs headroom before moving back up", "[tiled_scale]") {
+  ImageWorkerPool pool(0, false);
+  TiledImageScaler tiled(&pool);
+  const Image src = Noise(200, 150, 11);
+  Image dst(600, 450);
+
+  ScaleFilter used = ScaleFilter::kPoint;
+  REQUIRE(tiled.ScaleWithin(src.View(), dst.Mutable(), ScaleFilter::kLanczos3, 0.0, &used));
+  REQUIRE(tiled.ScaleWithin(src.View(), dst.Mutable(), ScaleFilter::kLanczos3, 1e-6, &used));
+  REQUIRE(used == ScaleFilter::kPoint);
+
+  // Just above the predicted lanczos3 cost: enough to keep it, not enough to
+  // return to it.
+  const auto h = SharedFilterWeightCache().Get(200, 600, ScaleFilter::kLanczos3);
+  const auto v = SharedFilterWeightCache().Get(150, 450, ScaleFilter::kLanczos3);
+  const double taps = (double)(v->sourceEnd - v->sourceBegin) * 600 * h->taps + 450.0 * 600 * v->taps;
+  const double lanczos3Ms = tiled.NsPerTap() * taps * 1e-6;
+  REQUIRE(tiled.ScaleWithin(src.View(), dst.Mutable(), ScaleFilter::kLanczos3, lanczos3Ms * 1.05, &used));
+  CHECK(used == ScaleFilter::kLanczos2);
+}
+
+TEST_CASE("Tiled scaling throughput", "[.][throughput]") {
+  const Image src = Noise(640, 480, 1);
+  Image dst(3840, 2160);
+  const int frames = 5;
+  auto framesPerSecond = [&](ImageWorkerPool& pool) {
+    TiledImageScaler tiled(&pool);
+    REQUIRE(tiled.Scale(src.View(), dst.Mutable(), ScaleFilter::kLanczos3));
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) {
+      REQUIRE(tiled.Scale(src.View(), dst.Mutable(), ScaleFilter::kLanczos3));
+    }
+    const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return frames / s;
+  };
+  ImageWorkerPool single(0);
+  const double one = framesPerSecond(single);
+  const double all = framesPerSecond(SharedImageWorkerPool());
+  std::printf("lanczos3 640x480 -> 3840x2160: %.1f fps on 1 thread, %.1f fps on %d\n",
+              one,
+              all,
+              SharedImageWorkerPool().Concurrency());
+  CHECK(all > 0.0);
+}
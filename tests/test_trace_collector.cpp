@@ -0,0 +1,270 @@
+#include "common/registry_api_table.h"
+#include "common/trace_collector.h"
+#include "common/trace_record.h"
+#include "common/trace_transport.h"
+#include "test_tmp.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+using namespace twinshim;
+
+namespace {
+
+std::filesystem::path MakeTempPath(const char* name) {
+  auto base = testutil::GetTestTempDir("trace_collector");
+  REQUIRE_FALSE(base.empty());
+  auto path = base / name;
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+  for (int n = 1; n <= 8; n++) {
+    std::filesystem::remove(path.string() + "." + std::to_string(n), ec);
+  }
+  return path;
+}
+
+std::string ReadAll(const std::filesystem::path& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::ostringstream out;
+  out << in.rdbuf();
+  return out.str();
+}
+
+std::string ClockRecord(uint32_t pid) {
+  TraceClock clock;
+  clock.pid = pid;
+  clock.ticksPerSecond = 1000;
+  clock.baseTicks = 0;
+  clock.baseUnixMicros = 0;
+  char buf[64];
+  return std::string(buf, EncodeTraceClock(clock, buf, sizeof(buf)));
+}
+
+std::string TextRecord(uint32_t tid, const std::string& line) {
+  std::string record;
+  REQUIRE(EncodeTraceText(tid, 0, line.data(), line.size(), record));
+  return record;
+}
+
+std::string StringRecord(uint32_t tid, uint32_t id, const std::string& text) {
+  const std::vector<uint16_t> units(text.begin(), text.end());
+  char buf[1024];
+  return std::string(buf, EncodeTraceString(tid, id, units.data(), units.size(), buf, sizeof(buf)));
+}
+
+std::string OpenKeyRecord(uint32_t tid, uint32_t keyId) {
+  TraceEvent e;
+  e.tid = tid;
+  e.api = (uint16_t)RegistryApi::RegOpenKeyExW;
+  e.op = TraceOp::OpenKey;
+  e.keyId = keyId;
+  char buf[kTraceEventMaxBytes];
+  return std::string(buf, EncodeTraceEvent(e, nullptr, 0, buf, sizeof(buf)));
+}
+
+// Each line must be "<tag> <n>" with n counting up from 0 per tag.
+size_t CheckPerSourceOrder(const std::string& text) {
+  std::istringstream lines(text);
+  std::map<std::string, int> next;
+  std::string line;
+  size_t count = 0;
+  while (std::getline(lines, line)) {
+    const auto space = line.rfind(' ');
+    REQUIRE(space != std::string::npos);
+    const std::string tag = line.substr(0, space);
+    CHECK(line == tag + " " + std::to_string(next[tag]));
+    next[tag]++;
+    count++;
+  }
+  return count;
+}
+
+} // namespace
+
+TEST_CASE("TraceCollector decodes interleaved clients in large batches", "[trace]") {
+  const auto path = MakeTempPath("console.log");
+  FILE* console = std::fopen(path.string().c_str(), "wb");
+  REQUIRE(console);
+  {
+    TraceCollector collector;
+    TraceCollectorOptions options;
+    options.console = console;
+    REQUIRE(collector.Start(options));
+
+    const uint64_t a = collector.OpenClient();
+    const uint64_t b = collector.OpenClient();
+    const std::string clockA = ClockRecord(100);
+    const std::string clockB = ClockRecord(200);
+    collector.Receive(a, clockA.data(), clockA.size());
+    collector.Receive(b, clockB.data(), clockB.size());
+    for (int i = 0; i < 100; i++) {
+      const std::string ra = TextRecord(1, "a " + std::to_string(i) + "\n");
+      collector.Receive(a, ra.data(), ra.size());
+      // Client b's records arrive split at every byte.
+      const std::string rb = TextRecord(2, "b " + std::to_string(i) + "\n");
+      for (char ch : rb) {
+        collector.Receive(b, &ch, 1);
+      }
+    }
+    collector.CloseClient(a);
+    collector.CloseClient(b);
+    collector.Stop();
+
+    const auto stats = collector.Stats();
+    CHECK(stats.clients == 2);
+    CHECK(stats.peakClients == 2);
+    CHECK(stats.records == 202);
+    CHECK(stats.malformed == 0);
+    CHECK(stats.batches < 10);
+    CHECK(stats.bytesLost == 0);
+  }
+  std::fclose(console);
+  CHECK(CheckPerSourceOrder(ReadAll(path)) == 200);
+}
+
+TEST_CASE("TraceCollector raw output rotates into files that decode on their own", "[trace]") {
+  const auto path = MakeTempPath("raw.bin");
+  TraceCollector collector;
+  TraceCollectorOptions options;
+  options.rawPath = path.wstring();
+  options.rotateBytes = 2048;
+  options.keepFiles = 8;
+  options.batchBytes = 512;
+  REQUIRE(collector.Start(options));
+
+  const uint64_t a = collector.OpenClient();
+  const uint64_t b = collector.OpenClient();
+  std::string streamA = ClockRecord(100) + StringRecord(1, 1, "HKLM\\Software\\A");
+  std::string streamB = ClockRecord(200) + StringRecord(1, 1, "HKLM\\Software\\B");
+  collector.Receive(a, streamA.data(), streamA.size());
+  collector.Receive(b, streamB.data(), streamB.size());
+  for (int i = 0; i < 60; i++) {
+    // Same tid and string id in both processes; the repeated clock record
+    // keeps them apart.
+    const std::string ra = OpenKeyRecord(1, 1);
+    const std::string rb = OpenKeyRecord(1, 1);
+    collector.Receive(a, ra.data(), ra.size());
+    collector.Receive(b, rb.data(), rb.size());
+    // Give the writer a chance to cut batches between them.
+    if (i % 10 == 9) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    }
+  }
+  collector.Stop();
+  CHECK(collector.Stats().rotations >= 1);
+
+  size_t events = 0;
+  for (int n = 0; n <= 8; n++) {
+    const auto file = n == 0 ? path : std::filesystem::path(path.string() + "." + std::to_string(n));
+    if (!std::filesystem::exists(file)) {
+      continue;
+    }
+    const std::string bytes = ReadAll(file);
+    TraceDecoder decoder;
+    std::string text;
+    decoder.Feed(bytes.data(), bytes.size(), text);
+    CHECK(decoder.Finish(text));
+    events += decoder.Events();
+    CHECK(text.find("<str:") == std::string::npos);
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+      const bool fromA = line.find("[100:1]") != std::string::npos;
+      const bool fromB = line.find("[200:1]") != std::string::npos;
+      REQUIRE(fromA != fromB);
+      CHECK(line.find(fromA ? "Software\\A" : "Software\\B") != std::string::npos);
+    }
+  }
+  CHECK(events == 120);
+}
+
+TEST_CASE("TraceCollector holds readers back when output falls behind", "[trace]") {
+  const auto path = MakeTempPath("slow.log");
+  FILE* console = std::fopen(path.string().c_str(), "wb");
+  REQUIRE(console);
+  TraceCollector collector;
+  TraceCollectorOptions options;
+  options.console = console;
+  options.batchBytes = 1 << 20;
+  options.flushInterval = std::chrono::milliseconds(10000);
+  options.maxQueuedBytes = 64;
+  REQUIRE(collector.Start(options));
+
+  const uint64_t c = collector.OpenClient();
+  for (int i = 0; i < 20; i++) {
+    const std::string r = TextRecord(1, "line " + std::to_string(i) + "\n");
+    collector.Receive(c, r.data(), r.size());
+  }
+  collector.Stop();
+  std::fclose(console);
+
+  const auto stats = collector.Stats();
+  CHECK(stats.stalls >= 1);
+  CHECK(stats.peakQueuedBytes < 64 + 16);
+  CHECK(CheckPerSourceOrder(ReadAll(path)) == 20);
+}
+
+#if !defined(_WIN32)
+TEST_CASE("TraceCollectorServer serves many shim connections at once", "[trace]") {
+  const auto path = MakeTempPath("console-server.log");
+  FILE* console = std::fopen(path.string().c_str(), "wb");
+  REQUIRE(console);
+  const std::string endpoint =
+      (std::filesystem::temp_directory_path() / ("twinshim-collector-" + std::to_string(getpid()))).string();
+
+  TraceCollector collector;
+  TraceCollectorOptions options;
+  options.console = console;
+  REQUIRE(collector.Start(options));
+  TraceCollectorServer server;
+  REQUIRE(server.Start(std::wstring(endpoint.begin(), endpoint.end()), collector));
+
+  // Every client holds its connection open while the others write.
+  constexpr int kClients = 6;
+  std::vector<std::unique_ptr<TraceTransport>> transports;
+  for (int c = 0; c < kClients; c++) {
+    transports.push_back(std::make_unique<TraceTransport>());
+    REQUIRE(transports.back()->Start(
+        MakePipeTraceSink(std::wstring(endpoint.begin(), endpoint.end()), ClockRecord(1000 + c))));
+  }
+  std::vector<std::thread> writers;
+  for (int c = 0; c < kClients; c++) {
+    writers.emplace_back([&, c] {
+      for (int i = 0; i < 300; i++) {
+        transports[c]->Write(TextRecord((uint32_t)c, "client " + std::to_string(c) + " " + std::to_string(i) + "\n"));
+      }
+      transports[c]->Flush();
+    });
+  }
+  for (auto& w : writers) {
+    w.join();
+  }
+  uint64_t dropped = 0;
+  for (auto& t : transports) {
+    t->Stop();
+    dropped += t->Counters().droppedRecords + (t->Counters().bytesLost ? 1 : 0);
+  }
+  transports.clear(); // disconnects
+
+  server.Stop();
+  collector.Stop();
+  std::fclose(console);
+
+  REQUIRE(dropped == 0);
+  const auto stats = collector.Stats();
+  CHECK(stats.clients == kClients);
+  CHECK(stats.malformed == 0);
+  CHECK(CheckPerSourceOrder(ReadAll(path)) == kClients * 300);
+}
+#endif
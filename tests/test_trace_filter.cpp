@@ -0,0 +1,216 @@
+#include "common/trace_filter.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace twinshim;
+
+namespace {
+
+constexpr uint64_t kTicksPerSecond = 1000000;
+
+int Match(const KeyPrefixTrie& trie, const std::wstring& path) {
+  return trie.Match(path.data(), path.size());
+}
+
+bool Admit(TraceFilter& filter,
+           const std::wstring& key,
+           uint64_t now,
+           const int32_t* status = nullptr,
+           uint16_t api = 0) {
+  uint32_t counter = 0;
+  TraceSuppressedEvents suppressed;
+  return filter.Admit(api, key.data(), key.size(), status, now, counter, suppressed);
+}
+
+} // namespace
+
+TEST_CASE("ParseTraceFilterSpec reads every clause", "[trace_filter]") {
+  TraceFilterSpec spec;
+  REQUIRE(ParseTraceFilterSpec(
+      L" key = HKEY_LOCAL_MACHINE/Software/Game/ | !HKLM\\Software\\Game\\Cache ; result=miss|Error; sample=10;"
+      L"rate=200;keyrate=5;",
+      spec));
+  REQUIRE(spec.includeKeys.size() == 1);
+  CHECK(spec.includeKeys[0] == L"hklm\\software\\game");
+  REQUIRE(spec.excludeKeys.size() == 1);
+  CHECK(spec.excludeKeys[0] == L"hklm\\software\\game\\cache");
+  CHECK(spec.results == (kTraceResultMiss | kTraceResultError));
+  CHECK(spec.sampleEvery == 10);
+  CHECK(spec.apiRate == 200);
+  CHECK(spec.keyRate == 5);
+  CHECK_FALSE(spec.Empty());
+
+  TraceFilterSpec empty;
+  CHECK(ParseTraceFilterSpec(L"", empty));
+  CHECK(empty.Empty());
+
+  std::wstring error;
+  CHECK_FALSE(ParseTraceFilterSpec(L"rate=100;sample=0", spec, &error));
+  CHECK(error == L"sample=0");
+  CHECK_FALSE(ParseTraceFilterSpec(L"result=hit", spec, &error));
+  CHECK_FALSE(ParseTraceFilterSpec(L"key=", spec, &error));
+  CHECK_FALSE(ParseTraceFilterSpec(L"key=HKLM|!\\", spec, &error));
+  CHECK_FALSE(ParseTraceFilterSpec(L"rate=fast", spec, &error));
+  CHECK_FALSE(ParseTraceFilterSpec(L"color=blue", spec, &error));
+  // A failed parse leaves the output alone.
+  CHECK(spec.apiRate == 200);
+}
+
+TEST_CASE("KeyPrefixTrie matches whole components, longest prefix first", "[trace_filter]") {
+  KeyPrefixTrie trie;
+  CHECK(trie.Empty());
+  CHECK(Match(trie, L"HKLM\\Software") == 0);
+
+  trie.Add(L"HKLM\\Software\\Game", true);
+  trie.Add(L"HKLM\\Software\\Game\\Cache", false);
+  trie.Add(L"hklm\\software\\game\\cache\\keep", true);
+  trie.Add(L"HKLM\\System", true);
+  CHECK(trie.HasIncludes());
+
+  CHECK(Match(trie, L"HKLM\\Software\\Game") == 1);
+  CHECK(Match(trie, L"hklm\\SOFTWARE\\game\\Video") == 1);
+  CHECK(Match(trie, L"HKLM\\Software\\Games") == 0);
+  CHECK(Match(trie, L"HKLM\\Software") == 0);
+  CHECK(Match(trie, L"HKLM\\Software\\Game\\Cache") == -1);
+  CHECK(Match(trie, L"HKLM\\Software\\Game\\Cache\\Shaders") == -1);
+  CHECK(Match(trie, L"HKLM\\Software\\Game\\Cache\\Keep\\A") == 1);
+  CHECK(Match(trie, L"HKLM\\Software\\Game\\CacheX") == 1);
+  CHECK(Match(trie, L"HKLM\\System\\CurrentControlSet") == 1);
+  CHECK(Match(trie, L"") == 0);
+}
+
+TEST_CASE("TraceFilter applies key and result selectors", "[trace_filter]") {
+  TraceFilterSpec spec;
+  REQUIRE(ParseTraceFilterSpec(L"key=HKLM\\Software\\Game|!HKLM\\Software\\Game\\Cache;result=miss", spec));
+  TraceFilter filter;
+  filter.Configure(spec, 8, kTicksPerSecond);
+  REQUIRE(filter.Active());
+
+  const int32_t miss = 2;
+  const int32_t ok = 0;
+  const int32_t denied = 5;
+  CHECK(Admit(filter, L"HKLM\\Software\\Game", 0, &miss));
+  CHECK_FALSE(Admit(filter, L"HKLM\\Software\\Game", 0, &ok));
+  CHECK_FALSE(Admit(filter, L"HKLM\\Software\\Game", 0, &denied));
+  // No result to judge.
+  CHECK_FALSE(Admit(filter, L"HKLM\\Software\\Game", 0));
+  CHECK_FALSE(Admit(filter, L"HKLM\\Software\\Game\\Cache", 0, &miss));
+  CHECK_FALSE(Admit(filter, L"HKLM\\Software\\Other", 0, &miss));
+  CHECK(filter.Counters().filtered == 5);
+
+  CHECK(ClassifyTraceResult(0) == kTraceResultOk);
+  CHECK(ClassifyTraceResult(234) == kTraceResultOk);
+  CHECK(ClassifyTraceResult(259) == kTraceResultOk);
+  CHECK(ClassifyTraceResult(3) == kTraceResultMiss);
+  CHECK(ClassifyTraceResult(5) == kTraceResultError);
+
+  // Exclusions alone let everything else through.
+  REQUIRE(ParseTraceFilterSpec(L"key=!HKLM\\Software\\Noisy", spec));
+  filter.Configure(spec, 8, kTicksPerSecond);
+  CHECK(Admit(filter, L"HKLM\\Software\\Game", 0));
+  CHECK_FALSE(Admit(filter, L"HKLM\\Software\\Noisy\\Sub", 0));
+
+  filter.Configure(TraceFilterSpec{}, 8, kTicksPerSecond);
+  CHECK_FALSE(filter.Active());
+  CHECK(Admit(filter, L"HKLM\\Anything", 0));
+}
+
+TEST_CASE("TraceFilter samples one in N per counter", "[trace_filter]") {
+  TraceFilterSpec spec;
+  REQUIRE(ParseTraceFilterSpec(L"sample=4", spec));
+  TraceFilter filter;
+  filter.Configure(spec, 8, kTicksPerSecond);
+
+  uint32_t counter = 0;
+  TraceSuppressedEvents suppressed;
+  const std::wstring key = L"HKLM\\Software";
+  int admitted = 0;
+  for (int i = 0; i < 100; i++) {
+    admitted += filter.Admit(0, key.data(), key.size(), nullptr, 0, counter, suppressed) ? 1 : 0;
+  }
+  CHECK(admitted == 25);
+  CHECK(filter.Counters().sampledOut == 75);
+}
+
+TEST_CASE("TraceFilter rate limits per API and per key and reports suppressed counts", "[trace_filter]") {
+  TraceFilterSpec spec;
+  REQUIRE(ParseTraceFilterSpec(L"rate=10", spec));
+  TraceFilter filter;
+  filter.Configure(spec, 4, kTicksPerSecond);
+
+  uint32_t counter = 0;
+  TraceSuppressedEvents suppressed;
+  const std::wstring key = L"HKLM\\Software";
+  auto admit = [&](uint16_t api, uint64_t now) {
+    return filter.Admit(api, key.data(), key.size(), nullptr, now, counter, suppressed);
+  };
+
+  // A full bucket lets a second's worth through at once, then nothing.
+  int admitted = 0;
+  for (int i = 0; i < 50; i++) {
+    admitted += admit(1, 1000) ? 1 : 0;
+  }
+  CHECK(admitted == 10);
+  // Other APIs have their own bucket.
+  CHECK(admit(2, 1000));
+  CHECK(suppressed.byApi == 0);
+
+  // One interval later one token is back, and the event that takes it
+  // carries the count refused meanwhile.
+  CHECK(admit(1, 1000 + kTicksPerSecond / 10));
+  CHECK(suppressed.byApi == 40);
+  CHECK_FALSE(admit(1, 1000 + kTicksPerSecond / 10));
+  CHECK(filter.Counters().rateLimited == 41);
+
+  // Steady arrivals at the limit are never refused.
+  for (uint64_t t = 10 * kTicksPerSecond; t < 12 * kTicksPerSecond; t += kTicksPerSecond / 10) {
+    CHECK(admit(3, t));
+  }
+
+  REQUIRE(ParseTraceFilterSpec(L"rate=100;keyrate=2", spec));
+  filter.Configure(spec, 4, kTicksPerSecond);
+  const std::wstring a = L"HKLM\\Software\\A";
+  const std::wstring b = L"HKLM\\Software\\B";
+  auto admitKey = [&](const std::wstring& path, uint64_t now) {
+    return filter.Admit(1, path.data(), path.size(), nullptr, now, counter, suppressed);
+  };
+  CHECK(admitKey(a, 0));
+  CHECK(admitKey(L"hklm\\software\\a", 0)); // same key, other case
+  CHECK_FALSE(admitKey(a, 0));
+  CHECK_FALSE(admitKey(a, 0));
+  CHECK(admitKey(b, 0));
+  CHECK(admitKey(a, kTicksPerSecond));
+  CHECK(suppressed.byKey == 2);
+  // The API bucket gave back the tokens of events the key limit refused.
+  CHECK(suppressed.byApi == 0);
+}
+
+TEST_CASE("TraceRateLimiter admits exactly one burst across threads", "[trace_filter]") {
+  TraceRateLimiter limiter;
+  limiter.Reset(100, 8, kTicksPerSecond);
+  std::atomic<uint64_t> admitted{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 1000; i++) {
+        for (size_t slot = 0; slot < limiter.Slots(); slot++) {
+          uint64_t suppressed = 0;
+          if (limiter.Admit(slot, slot, 0, suppressed)) {
+            admitted.fetch_add(1);
+          }
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  // A full bucket holds one second, 100 events, per slot; time stands still.
+  CHECK(admitted.load() == 8 * 100);
+  CHECK(limiter.Refused() == 4 * 1000 * 8 - 8 * 100);
+}
@@ -0,0 +1,209 @@
+#include "common/registry_api_table.h"
+#include "common/trace_record.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace twinshim;
+
+namespace {
+
+constexpr uint32_t kTid = 7;
+// 12:34:56.789 UTC on 2024-01-01.
+constexpr int64_t kBaseMicros = 1704112496789000ll;
+
+std::vector<uint16_t> Units(const std::string& ascii) {
+  return std::vector<uint16_t>(ascii.begin(), ascii.end());
+}
+
+// REG_SZ bytes as the registry stores them: UTF-16LE with a terminator.
+std::vector<uint8_t> Utf16Data(const std::string& ascii) {
+  std::vector<uint8_t> out;
+  for (char ch : ascii) {
+    out.push_back((uint8_t)ch);
+    out.push_back(0);
+  }
+  out.push_back(0);
+  out.push_back(0);
+  return out;
+}
+
+struct StreamBuilder {
+  std::string bytes;
+
+  void Clock() {
+    TraceClock clock;
+    clock.pid = 42;
+    clock.ticksPerSecond = 1000;
+    clock.baseTicks = 5000;
+    clock.baseUnixMicros = kBaseMicros;
+    clock.utcOffsetMinutes = 0;
+    char buf[64];
+    bytes.append(buf, EncodeTraceClock(clock, buf, sizeof(buf)));
+  }
+
+  void String(uint32_t id, const std::string& text) {
+    const auto units = Units(text);
+    char buf[4096];
+    const size_t size = EncodeTraceString(kTid, id, units.data(), units.size(), buf, sizeof(buf));
+    REQUIRE(size != 0);
+    bytes.append(buf, size);
+  }
+
+  void Event(TraceEvent e, const void* data = nullptr, size_t size = 0) {
+    e.tid = kTid;
+    char buf[kTraceEventMaxBytes];
+    const size_t n = EncodeTraceEvent(e, data, size, buf, sizeof(buf));
+    REQUIRE(n != 0);
+    bytes.append(buf, n);
+  }
+};
+
+TraceEvent MakeEvent(RegistryApi api, TraceOp op, uint64_t ticks, uint32_t keyId, uint32_t nameId = 0) {
+  TraceEvent e;
+  e.api = (uint16_t)api;
+  e.op = op;
+  e.ticks = ticks;
+  e.keyId = keyId;
+  e.nameId = nameId;
+  return e;
+}
+
+std::string Decode(const std::string& bytes, TraceDecoder::Format format = TraceDecoder::Format::Text) {
+  TraceDecoder decoder(format);
+  std::string out;
+  decoder.Feed(bytes.data(), bytes.size(), out);
+  CHECK(decoder.Finish(out));
+  return out;
+}
+
+} // namespace
+
+TEST_CASE("TraceDecoder renders events in the live --debug text format", "[trace]") {
+  StreamBuilder s;
+  s.Clock();
+  s.String(1, "HKLM\\Software\\App");
+  s.String(2, "Width");
+  s.Event(MakeEvent(RegistryApi::RegOpenKeyExW, TraceOp::OpenKey, 5000, 1));
+
+  TraceEvent set = MakeEvent(RegistryApi::RegSetValueExW, TraceOp::SetValue, 5001, 1, 2);
+  set.type = 4; // REG_DWORD
+  set.cbData = 4;
+  const uint32_t dword = 640;
+  s.Event(set, &dword, sizeof(dword));
+
+  const auto text = Utf16Data("hello");
+  TraceEvent query = MakeEvent(RegistryApi::RegQueryValueExW, TraceOp::QueryValue, 6250, 1, 2);
+  query.flags = kTraceEventHasResult | kTraceEventTypeKnown | kTraceEventHasData;
+  query.type = 1; // REG_SZ
+  query.cbData = (uint32_t)text.size();
+  s.Event(query, text.data(), text.size());
+
+  TraceEvent enumKey = MakeEvent(RegistryApi::RegEnumKeyExW, TraceOp::EnumKey, 6251, 1);
+  enumKey.flags = kTraceEventHasIndex;
+  enumKey.index = 3;
+  s.Event(enumKey);
+
+  TraceEvent enumValue = MakeEvent(RegistryApi::RegEnumValueA, TraceOp::EnumValue, 6251, 1);
+  enumValue.flags = kTraceEventHasResult | kTraceEventHasIndex;
+  enumValue.index = 2;
+  enumValue.status = 259; // ERROR_NO_MORE_ITEMS
+  s.Event(enumValue);
+
+  TraceEvent notify = MakeEvent(RegistryApi::RegNotifyChangeKeyValue, TraceOp::Notify, 6252, 1);
+  notify.flags = kTraceEventSubtree;
+  s.Event(notify);
+
+  CHECK(Decode(s.bytes) ==
+        "(12:34:56.789) [42:7] api=RegOpenKeyExW op=open_key key=\"HKLM\\Software\\App\" name=\"-\" value=\"-\"\n"
+        "(12:34:56.790) [42:7] api=RegSetValueExW op=set_value key=\"HKLM\\Software\\App\" name=\"Width\" "
+        "value=\"REG_DWORD:dword:640\"\n"
+        "(12:34:58.039) [42:7] api=RegQueryValueExW op=query_value key=\"HKLM\\Software\\App\" name=\"Width\" "
+        "value=\"rc=0 type=REG_SZ cb=12 data=str:\"hello\"\"\n"
+        "(12:34:58.040) [42:7] api=RegEnumKeyExW op=enum_key key=\"HKLM\\Software\\App\" name=\"index\" value=\"3\"\n"
+        "(12:34:58.040) [42:7] api=RegEnumValueA op=enum_value key=\"HKLM\\Software\\App\" name=\"index:2\" "
+        "value=\"idx=2 rc=259 cb=0\"\n"
+        "(12:34:58.041) [42:7] api=RegNotifyChangeKeyValue op=notify key=\"HKLM\\Software\\App\" name=\"-\" "
+        "value=\"subtree\"\n");
+
+  // The same stream fed a byte at a time decodes identically.
+  TraceDecoder decoder;
+  std::string chunked;
+  for (char ch : s.bytes) {
+    decoder.Feed(&ch, 1, chunked);
+  }
+  CHECK(decoder.Finish(chunked));
+  CHECK(chunked == Decode(s.bytes));
+  CHECK(decoder.Events() == 6);
+}
+
+TEST_CASE("TraceDecoder keeps records small and marks what was cut", "[trace]") {
+  StreamBuilder s;
+  s.Clock();
+  s.String(1, "HKLM\\Software\\App");
+
+  // Values past the prefix travel truncated and decode with a trailing "...".
+  const auto longText = Utf16Data(std::string(300, 'a'));
+  TraceEvent query = MakeEvent(RegistryApi::RegQueryValueExW, TraceOp::QueryValue, 5000, 1);
+  query.flags = kTraceEventHasResult | kTraceEventTypeKnown | kTraceEventHasData;
+  query.type = 1;
+  query.cbData = (uint32_t)longText.size();
+  const size_t before = s.bytes.size();
+  s.Event(query, longText.data(), longText.size());
+  CHECK(s.bytes.size() - before == kTraceEventMaxBytes);
+
+  // Reads over 1 KB were never rendered.
+  TraceEvent big = query;
+  big.cbData = 4096;
+  s.Event(big);
+
+  TraceEvent more = MakeEvent(RegistryApi::RegQueryValueExW, TraceOp::QueryValue, 5000, 1);
+  more.flags = kTraceEventHasResult;
+  more.status = 234;
+  more.cbData = 16;
+  s.Event(more);
+
+  // An id whose definition was dropped still decodes.
+  s.Event(MakeEvent(RegistryApi::RegCloseKey, TraceOp::CloseKey, 5000, 9));
+
+  // Other subsystems' lines pass through verbatim.
+  std::string textRecord;
+  REQUIRE(EncodeTraceText(kTid, 5000, "[shim] hook install succeeded\n", 30, textRecord));
+  s.bytes += textRecord;
+
+  // Text lines cap the value at 140 characters; JSON keeps the whole prefix.
+  const std::string json = Decode(s.bytes, TraceDecoder::Format::Json);
+  CHECK(json.find("data=str:\\\"" + std::string(128, 'a') + "...\\\"") != std::string::npos);
+
+  const std::string out = Decode(s.bytes);
+  CHECK(out.find("cb=4096 <data_present>") != std::string::npos);
+  CHECK(out.find("value=\"rc=234 cb=16 <more_data>\"") != std::string::npos);
+  CHECK(out.find("api=RegCloseKey op=close_key key=\"<str:9>\"") != std::string::npos);
+  CHECK(out.find("\n[shim] hook install succeeded\n") != std::string::npos);
+}
+
+TEST_CASE("TraceDecoder writes JSON lines and reports damaged streams", "[trace]") {
+  StreamBuilder s;
+  s.Clock();
+  s.String(1, "HKLM\\Software\\\"Quoted\"");
+  TraceEvent query = MakeEvent(RegistryApi::RegGetValueW, TraceOp::QueryValue, 5000, 1);
+  query.flags = kTraceEventHasResult | kTraceEventTypeKnown;
+  query.type = 4;
+  query.cbData = 4;
+  s.Event(query);
+
+  CHECK(Decode(s.bytes, TraceDecoder::Format::Json) ==
+        "{\"ts_us\":1704112496789000,\"pid\":42,\"tid\":7,\"api\":\"RegGetValueW\",\"op\":\"query_value\","
+        "\"key\":\"HKLM\\\\Software\\\\\\\"Quoted\\\"\",\"name\":\"-\",\"rc\":0,\"type\":\"REG_DWORD\",\"cb\":4,"
+        "\"value\":\"rc=0 type=REG_DWORD cb=4\"}\n");
+
+  // A stream cut mid-record decodes what is whole and flags the rest.
+  TraceDecoder decoder;
+  std::string out;
+  decoder.Feed(s.bytes.data(), s.bytes.size() - 3, out);
+  CHECK_FALSE(decoder.Finish(out));
+  CHECK(decoder.Events() == 0);
+  CHECK(decoder.Malformed() == 1);
+}
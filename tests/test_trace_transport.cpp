@@ -0,0 +1,207 @@
+#include "common/trace_transport.h"
+#include "test_tmp.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
+using namespace twinshim;
+
+namespace {
+
+std::filesystem::path MakeTempPath(const char* name) {
+  auto base = testutil::GetTestTempDir("trace");
+  REQUIRE_FALSE(base.empty());
+  auto path = base / name;
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+  return path;
+}
+
+std::string ReadAll(const std::filesystem::path& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::ostringstream out;
+  out << in.rdbuf();
+  return out.str();
+}
+
+// Keeps every batch it is handed, or refuses them all.
+class RecordingSink : public TraceSink {
+public:
+  explicit RecordingSink(std::vector<std::string>& batches, bool fail = false) : batches_(batches), fail_(fail) {}
+
+  bool Write(const char* data, size_t size) override {
+    if (fail_) {
+      return false;
+    }
+    batches_.emplace_back(data, size);
+    return true;
+  }
+
+private:
+  std::vector<std::string>& batches_;
+  bool fail_;
+};
+
+} // namespace
+
+TEST_CASE("TraceRing hands records back in order and drops what doesn't fit", "[trace]") {
+  TraceRing ring(64);
+  CHECK(ring.Push("abc", 3));
+  CHECK(ring.Push("defgh", 5));
+  CHECK(ring.Used() == 2 * sizeof(uint32_t) + 8);
+
+  std::string out;
+  CHECK(ring.DrainTo(out, 1024) == 2 * sizeof(uint32_t) + 8);
+  CHECK(out == "abcdefgh");
+  CHECK(ring.Used() == 0);
+
+  // Records wrap around the end of the buffer intact.
+  out.clear();
+  for (int i = 0; i < 20; i++) {
+    const std::string record = "record-" + std::to_string(i) + ";";
+    REQUIRE(ring.Push(record.data(), record.size()));
+    ring.DrainTo(out, 1024);
+  }
+  CHECK(out.rfind("record-19;") == out.size() - 10);
+  CHECK(out.find("record-7;record-8;") != std::string::npos);
+
+  const std::string big(61, 'x');
+  CHECK_FALSE(ring.Push(big.data(), big.size()));
+  CHECK(ring.Dropped() == 1);
+}
+
+TEST_CASE("TraceTransport batches every thread's records into the sink", "[trace]") {
+  const auto path = MakeTempPath("batches.log");
+  {
+    TraceTransport trace;
+    CHECK_FALSE(trace.Write("before start\n", 13));
+    REQUIRE(trace.Start(MakeFileTraceSink(path.wstring())));
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; t++) {
+      writers.emplace_back([&trace, t] {
+        for (int i = 0; i < 200; i++) {
+          trace.Write("t" + std::to_string(t) + " line " + std::to_string(i) + "\n");
+        }
+      });
+    }
+    for (auto& w : writers) {
+      w.join();
+    }
+    trace.Stop();
+
+    const auto counters = trace.Counters();
+    CHECK(counters.records == 800);
+    CHECK(counters.droppedRecords == 0);
+    CHECK(counters.rings == 4);
+    CHECK(counters.batches < counters.records);
+    CHECK(counters.bytesLost == 0);
+  }
+
+  // Each thread's lines arrive complete and in order.
+  std::istringstream lines(ReadAll(path));
+  std::map<std::string, int> next;
+  std::string line;
+  size_t count = 0;
+  while (std::getline(lines, line)) {
+    const auto space = line.find(' ');
+    REQUIRE(space != std::string::npos);
+    const std::string thread = line.substr(0, space);
+    CHECK(line == thread + " line " + std::to_string(next[thread]));
+    next[thread]++;
+    count++;
+  }
+  CHECK(count == 800);
+}
+
+TEST_CASE("TraceTransport drops instead of waiting and counts lost batches", "[trace]") {
+  std::vector<std::string> batches;
+  TraceTransport trace;
+  TraceTransportOptions options;
+  options.ringBytes = 256;
+  options.drainInterval = std::chrono::milliseconds(10000);
+  REQUIRE(trace.Start(std::make_unique<RecordingSink>(batches), options));
+
+  // A small ring fills faster than the drain empties it; writers move on.
+  const std::string record(60, 'r');
+  size_t accepted = 0;
+  for (int i = 0; i < 10; i++) {
+    accepted += trace.Write(record) ? 1 : 0;
+  }
+  CHECK(accepted >= 4);
+  CHECK(accepted + trace.Counters().droppedRecords == 10);
+
+  trace.Flush();
+  size_t bytes = 0;
+  for (const auto& batch : batches) {
+    bytes += batch.size();
+  }
+  CHECK(bytes == accepted * record.size());
+  trace.Stop();
+  CHECK_FALSE(trace.Write(record));
+
+  std::vector<std::string> none;
+  TraceTransport failing;
+  REQUIRE(failing.Start(std::make_unique<RecordingSink>(none, true)));
+  CHECK(failing.Write(record));
+  failing.Stop();
+  CHECK(failing.Counters().bytesLost == record.size());
+  CHECK(failing.Counters().bytesWritten == 0);
+}
+
+#if !defined(_WIN32)
+TEST_CASE("TraceTransport pipe sink streams over a UNIX socket", "[trace]") {
+  const std::string path = (std::filesystem::temp_directory_path() / ("twinshim-trace-" + std::to_string(getpid()))).string();
+  unlink(path.c_str());
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  REQUIRE(path.size() < sizeof(addr.sun_path));
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  REQUIRE(listener >= 0);
+  REQUIRE(bind(listener, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0);
+  REQUIRE(listen(listener, 4) == 0);
+
+  std::string received;
+  std::thread reader([&] {
+    const int client = accept(listener, nullptr, nullptr);
+    char buf[256];
+    ssize_t n = 0;
+    while (client >= 0 && (n = read(client, buf, sizeof(buf))) > 0) {
+      received.append(buf, (size_t)n);
+    }
+    if (client >= 0) {
+      close(client);
+    }
+  });
+
+  {
+    TraceTransport trace;
+    REQUIRE(trace.Start(MakePipeTraceSink(std::wstring(path.begin(), path.end()))));
+    trace.Write("first\n");
+    trace.Write("second\n");
+    trace.Stop();
+    CHECK(trace.Counters().bytesWritten == 13);
+  } // closes the connection
+
+  reader.join();
+  close(listener);
+  unlink(path.c_str());
+  CHECK(received == "first\nsecond\n");
+}
+#endif
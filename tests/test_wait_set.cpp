@@ -0,0 +1,96 @@
+#include "common/wait_set.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+using namespace twinshim;
+
+TEST_CASE("WaitEvent is manual-reset and survives repeated Set", "[wait_set]") {
+  WaitEvent event;
+  REQUIRE(event.Create());
+  CHECK_FALSE(event.IsSet());
+
+  WaitSet set;
+  CHECK(set.Add(event.Handle()) == 0);
+  CHECK(set.Wait(0) == WaitSet::kTimeout);
+
+  event.Set();
+  event.Set();
+  CHECK(event.IsSet());
+  // Stays signaled until reset, however often it is waited on.
+  CHECK(set.Wait(0) == 0);
+  CHECK(set.Wait(0) == 0);
+
+  event.Reset();
+  CHECK_FALSE(event.IsSet());
+  CHECK(set.Wait(0) == WaitSet::kTimeout);
+  event.Set();
+  CHECK(set.Wait(0) == 0);
+}
+
+TEST_CASE("WaitSet reports the first signaled source", "[wait_set]") {
+  WaitEvent a;
+  WaitEvent b;
+  WaitEvent c;
+  REQUIRE(a.Create());
+  REQUIRE(b.Create());
+  REQUIRE(c.Create());
+  WaitSet set;
+  set.Add(a.Handle());
+  set.Add(b.Handle());
+  set.Add(c.Handle());
+  REQUIRE(set.Size() == 3);
+
+  c.Set();
+  CHECK(set.Wait(0) == 2);
+  b.Set();
+  CHECK(set.Wait(0) == 1);
+  b.Reset();
+  c.Reset();
+  CHECK(set.Wait(10) == WaitSet::kTimeout);
+
+  set.Clear();
+  CHECK(set.Wait(0) == WaitSet::kFailed);
+}
+
+TEST_CASE("WaitSet wakes as soon as another thread signals", "[wait_set]") {
+  WaitEvent stop;
+  WaitEvent done;
+  REQUIRE(stop.Create());
+  REQUIRE(done.Create());
+  WaitSet set;
+  set.Add(stop.Handle());
+  set.Add(done.Handle());
+
+  const auto start = std::chrono::steady_clock::now();
+  std::thread worker([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    done.Set();
+  });
+  CHECK(set.Wait() == 1);
+  const auto waited = std::chrono::steady_clock::now() - start;
+  worker.join();
+  CHECK(waited >= std::chrono::milliseconds(15));
+  CHECK(waited < std::chrono::seconds(5));
+}
+
+#if !defined(_WIN32)
+TEST_CASE("WaitSet treats a readable or closed descriptor as signaled", "[wait_set]") {
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  WaitSet set;
+  set.Add(fds[0]);
+  CHECK(set.Wait(0) == WaitSet::kTimeout);
+
+  // A writer going away, like a child process exiting, wakes the waiter.
+  close(fds[1]);
+  CHECK(set.Wait(1000) == 0);
+  close(fds[0]);
+}
+#endif